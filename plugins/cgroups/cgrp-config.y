@@ -97,6 +97,7 @@ static char rule_group[256];
 %type <string>   path
 %type <uint32>   partition_cpu_share
 %type <uint32>   partition_mem_limit
+%type <uint32>   partition_mem_threshold
 %type <part>     partition_rt_limit
 %type <uint32>   optional_unit
 %type <group>    group
@@ -163,6 +164,8 @@ static char rule_group[256];
 %token KEYWORD_PATH
 %token KEYWORD_CPU_SHARES
 %token KEYWORD_MEM_LIMIT
+%token KEYWORD_MEM_THRESHOLD
+%token KEYWORD_MEM_NOTIFY
 %token KEYWORD_REALTIME_LIMIT
 %token KEYWORD_RULE
 %token KEYWORD_BINARY
@@ -273,6 +276,7 @@ global_option: KEYWORD_EXPORT_GROUPS "\n" {
     | iowait_notify "\n"
     | ioqlen_notify "\n"
     | swap_pressure "\n"
+    | memory_notify "\n"
     | cgroupfs_options "\n"
     | addon_rules "\n"
     | cgroup_control "\n"
@@ -406,6 +410,16 @@ swap_pressure_option: TOKEN_IDENT TOKEN_UINT TOKEN_UINT {
     }
     ;
 
+memory_notify: KEYWORD_MEM_NOTIFY TOKEN_IDENT string {
+          if (!strcmp($2.value, "hook"))
+              ctx->mem.hook = STRDUP($3.value);
+          else {
+              OHM_ERROR("cgrp: invalid memory-notify parameter %s", $2.value);
+	      YYABORT;
+          }
+    }
+    ;
+
 cgroupfs_options: KEYWORD_CGROUPFS_OPTIONS mount_options
     ;
 
@@ -612,17 +626,25 @@ partition: "[" KEYWORD_PARTITION TOKEN_IDENT "]" "\n" partition_properties
     ;
 
 partition_properties: partition_path "\n" {
+          memset(&$$, 0, sizeof($$));
           $$.path = $1.value;
     }
     | partition_export_fact "\n" {
+          memset(&$$, 0, sizeof($$));
           CGRP_SET_FLAG($$.flags, CGRP_PARTITION_FACT);
     }
     | partition_cpu_share "\n" {
+          memset(&$$, 0, sizeof($$));
           $$.limit.cpu = $1.value;
     }
     | partition_mem_limit "\n" {
+          memset(&$$, 0, sizeof($$));
           $$.limit.mem = $1.value;
     }
+    | partition_mem_threshold "\n" {
+          memset(&$$, 0, sizeof($$));
+          $$.mem_notify = $1.value;
+    }
     | partition_properties partition_path "\n" {
           $$ = $1;
           $$.path = $2.value;
@@ -639,6 +661,10 @@ partition_properties: partition_path "\n" {
           $$           = $1;
           $$.limit.mem = $2.value;
     }
+    | partition_properties partition_mem_threshold "\n" {
+          $$            = $1;
+          $$.mem_notify = $2.value;
+    }
     | partition_properties partition_rt_limit "\n" {
           $$                  = $1;
           $$.limit.rt_period  = $2.limit.rt_period;
@@ -666,6 +692,12 @@ partition_mem_limit: KEYWORD_MEM_LIMIT TOKEN_UINT optional_unit {
     }
     ;
 
+partition_mem_threshold: KEYWORD_MEM_THRESHOLD TOKEN_UINT optional_unit {
+          $$        = $2;
+	  $$.value *= $3.value;
+    }
+    ;
+
 partition_rt_limit: KEYWORD_REALTIME_LIMIT 
                       TOKEN_IDENT time_usec TOKEN_IDENT time_usec {
           if (!strcmp($2.value, "period") &&
@@ -80,6 +80,26 @@ static void           rspcrv_destroy(cgrp_rspcrv_t *);
 static int check_curve(cgrp_rspcrv_t *);
 
 
+/*
+ * shared curve lookup tables
+ *
+ * Response curves are fully precalculated into lookup tables. Curves with
+ * identical definitions (function, curve, input and output ranges) map to
+ * the same table which is reference counted and freed with the last user.
+ */
+
+typedef struct {
+    list_hook_t    hook;                      /* to more tables */
+    int            refcnt;                    /* reference count */
+    cgrp_rspcrv_t *rsp;                       /* curve definition */
+    cgrp_curve_t   curve;                     /* calculated lookup table */
+} curve_table_t;
+
+static list_hook_t tables;                    /* shared lookup tables */
+
+static curve_table_t *curve_table_find(cgrp_rspcrv_t *);
+
+
 /*
  * symbolically interpreted curve functions
  *
@@ -92,14 +112,32 @@ static int check_curve(cgrp_rspcrv_t *);
  * in symbolic form. The code below uses a straightforward implementation
  * of the Shunting-yard algorithm to convert a function from infix to
  * reverse-polish notation. This is used as the internal representation
- * of the curve and can be used to evaluate its value for a given input.
+ * of the curve. It is compiled further for evaluation (see below), the
+ * token list interpreter rpn_calc is kept as a reference implementation.
  */
 
 #define RPN_MAX_TOKENS 256
 
 static void   *rpn_parse(const char *);
 static void    rpn_free (void *);
-static double  rpn_calc (double, void *);
+static double  rpn_calc (double, void *) __attribute__((unused));
+
+
+/*
+ * compiled curve functions
+ *
+ * The RPN token list produced by the parser is further compiled into a
+ * compact program for a simple stack machine. While compiling, constant
+ * subexpressions are folded, the stack usage of the program is verified
+ * and domain errors (division by zero, logarithm of a non-positive number)
+ * in constant arguments are rejected. The resulting program can then be
+ * evaluated without any further checks.
+ */
+
+static void   *rpn_compile(const char *, void *);
+static void    rpn_release(void *);
+static double  rpn_eval   (double, void *);
+static int     rpn_equal  (void *, void *);
 
 
 
@@ -112,6 +150,7 @@ curve_init(cgrp_context_t *ctx)
     (void)ctx;
     
     list_init(&curves);
+    list_init(&tables);
 
     return TRUE;
 }
@@ -146,48 +185,62 @@ cgrp_curve_t *
 curve_create(const char *fn, double cmin, double cmax,
              int imin, int imax, int omin, int omax)
 {
+    curve_table_t *tbl;
     cgrp_curve_t  *crv;
     cgrp_rspcrv_t *rsp;
     int            n, i;
     
-    n   = imax - imin + 1;
-    crv = NULL;
+    n = imax - imin + 1;
 
     if ((rsp = rspcrv_create(fn, cmin, cmax, 1.0 * imin, 1.0 * imax,
                              1.0 * omin, 1.0 * omax)) == NULL) {
         OHM_ERROR("cgrp: could not create response curve '%s'", fn);
         return NULL;
     }
-    
-    if (ALLOC_OBJ(crv) != NULL && (crv->out = ALLOC_ARR(int, n)) != NULL) {
-        crv->min = imin;
-        crv->max = imax;
-
-        crv->out[0] = omin;
 
-        errno = 0;
-        for (i = imin + 1; i < imax; i++) {
-            crv->out[i-imin] = (int)(rspcrv_calc(rsp, 1.0 * i) + 0.5);
-
-            if (errno != 0) {
-                OHM_ERROR("cgrp: evaluation error for '%s'", rsp->f);
-                curve_destroy(crv);
-                crv = NULL;
-                goto out;
-            }
-        }
+    if ((tbl = curve_table_find(rsp)) != NULL) {
+        OHM_DEBUG(DBG_CURVE, "sharing lookup table of curve '%s'", rsp->f);
         
-        crv->out[n-1] = omax;
+        tbl->refcnt++;
+        rspcrv_destroy(rsp);
+        
+        return &tbl->curve;
     }
-    else {
+    
+    if (ALLOC_OBJ(tbl) == NULL || (tbl->curve.out = ALLOC_ARR(int, n)) == NULL) {
         OHM_ERROR("cgrp: failed to allocate curve '%s'", fn);
-        FREE(crv);
-        crv = NULL;
+        FREE(tbl);
+        rspcrv_destroy(rsp);
+        return NULL;
     }
+
+    list_init(&tbl->hook);
+    tbl->refcnt = 1;
+    tbl->rsp    = rsp;
     
- out:
-    rspcrv_destroy(rsp);
+    crv      = &tbl->curve;
+    crv->min = imin;
+    crv->max = imax;
 
+    crv->out[0] = omin;
+    
+    errno = 0;
+    for (i = imin + 1; i < imax; i++) {
+        crv->out[i-imin] = (int)(rspcrv_calc(rsp, 1.0 * i) + 0.5);
+        
+        if (errno != 0) {
+            OHM_ERROR("cgrp: evaluation error for '%s'", rsp->f);
+            FREE(crv->out);
+            FREE(tbl);
+            rspcrv_destroy(rsp);
+            return NULL;
+        }
+    }
+    
+    crv->out[n-1] = omax;
+
+    list_append(&tables, &tbl->hook);
+    
     return crv;
 }
 
@@ -198,13 +251,56 @@ curve_create(const char *fn, double cmin, double cmax,
 void
 curve_destroy(cgrp_curve_t *crv)
 {
+    curve_table_t *tbl;
+
     if (crv != NULL) {
+        tbl = list_entry(crv, curve_table_t, curve);
+        
+        if (--tbl->refcnt > 0)
+            return;
+        
+        list_delete(&tbl->hook);
+        rspcrv_destroy(tbl->rsp);
         FREE(crv->out);
-        FREE(crv);
+        FREE(tbl);
     }
 }
 
 
+/********************
+ * curve_table_find
+ ********************/
+static curve_table_t *
+curve_table_find(cgrp_rspcrv_t *rsp)
+{
+    curve_table_t *tbl;
+    cgrp_rspcrv_t *r;
+    list_hook_t   *p, *n;
+
+    list_foreach(&tables, p, n) {
+        tbl = list_entry(p, curve_table_t, hook);
+        r   = tbl->rsp;
+
+        if (r->fn   != rsp->fn   ||
+            r->cmin != rsp->cmin || r->cmax != rsp->cmax ||
+            r->imin != rsp->imin || r->imax != rsp->imax ||
+            r->omin != rsp->omin || r->omax != rsp->omax)
+            continue;
+
+        if (r->fn == rpn_eval) {
+            if (rpn_equal(r->data, rsp->data))
+                return tbl;
+        }
+        else {
+            if (r->data == rsp->data)
+                return tbl;
+        }
+    }
+    
+    return NULL;
+}
+
+
 /********************
  * curve_map
  ********************/
@@ -314,6 +410,7 @@ rspcrv_create(const char *fn,
 {
     cgrp_rspcrv_t *crv;
     curve_func_t  *cfn;
+    void          *rpn;
 
     if (ALLOC_OBJ(crv) != NULL) {
         crv->f    = STRDUP(fn);
@@ -326,8 +423,13 @@ rspcrv_create(const char *fn,
             crv->data = cfn->data;
         }
         else {
-            crv->fn   = rpn_calc;
-            crv->data = rpn_parse(crv->f);
+            crv->fn   = rpn_eval;
+            crv->data = NULL;
+
+            if ((rpn = rpn_parse(crv->f)) != NULL) {
+                crv->data = rpn_compile(crv->f, rpn);
+                rpn_free(rpn);
+            }
             
             if (crv->data == NULL) {
                 rspcrv_destroy(crv);
@@ -366,8 +468,8 @@ rspcrv_destroy(cgrp_rspcrv_t *crv)
 {
     if (crv != NULL) {
         FREE(crv->f);
-        if (crv->data != NULL && crv->fn == rpn_calc)
-            rpn_free(crv->data);
+        if (crv->data != NULL && crv->fn == rpn_eval)
+            rpn_release(crv->data);
         FREE(crv);
     }
 }
@@ -962,6 +1064,279 @@ rpn_calc(double x, void *data)
 
 
 
+/*****************************************************************************
+ *                   *** compiled function evaluation ***                    *
+ *****************************************************************************/
+
+/*
+ * instructions of the RPN stack machine
+ */
+
+typedef enum {
+    RPN_CONST = 0,                             /* push a constant */
+    RPN_VAR,                                   /* push the variable */
+    RPN_ADD,                                   /* binary operators, */
+    RPN_SUB,                                   /*   in the same order */
+    RPN_MUL,                                   /*   as OPER_* */
+    RPN_DIV,
+    RPN_POW,
+    RPN_LN,                                    /* functions, in the */
+    RPN_LOG2,                                  /*   same order as FUNC_* */
+    RPN_LOG10,
+    RPN_SIN,
+    RPN_COS,
+    RPN_ABS,
+} rpn_opcode_t;
+
+typedef struct {
+    rpn_opcode_t op;                           /* RPN_* */
+    double       val;                          /* constant for RPN_CONST */
+} rpn_insn_t;
+
+typedef struct {
+    int        ninsn;                          /* number of instructions */
+    int        depth;                          /* maximum stack depth */
+    rpn_insn_t insn[0];                        /* instructions */
+} rpn_prog_t;
+
+
+/********************
+ * rpn_apply
+ ********************/
+static inline double
+rpn_apply(rpn_opcode_t op, double a, double b)
+{
+    switch (op) {
+    case RPN_ADD:   return a + b;
+    case RPN_SUB:   return a - b;
+    case RPN_MUL:   return a * b;
+    case RPN_DIV:   return a / b;
+    case RPN_POW:   return pow(a, b);
+    case RPN_LN:    return log(a);
+    case RPN_LOG2:  return log2(a);
+    case RPN_LOG10: return log10(a);
+    case RPN_SIN:   return sin(a);
+    case RPN_COS:   return cos(a);
+    case RPN_ABS:   return a >= 0 ? a : -a;
+    default:        return 0.0;
+    }
+}
+
+
+/********************
+ * rpn_compile
+ ********************/
+static void *
+rpn_compile(const char *expr, void *tokens)
+{
+    rpn_prog_t   *prog;
+    token_t      *rpn, *t;
+    rpn_insn_t   *insn;
+    rpn_opcode_t  op;
+    char          konst[RPN_MAX_TOKENS];
+    int           n, ni, depth;
+    double        v;
+
+    rpn = (token_t *)tokens;
+    for (n = 0; rpn[n].type != TOKEN_END; n++)
+        ;
+
+    prog = (rpn_prog_t *)ALLOC_ARR(char, sizeof(*prog) + n * sizeof(*insn));
+    
+    if (prog == NULL) {
+        OHM_ERROR("cgrp: failed to allocate RPN program");
+        return NULL;
+    }
+
+    insn  = prog->insn;
+    ni    = 0;
+    depth = 0;
+    
+    for (t = rpn; t->type != TOKEN_END; t++) {
+        switch (t->type) {
+        case TOKEN_CONSTANT:
+        case TOKEN_VARIABLE:
+            if (t->type == TOKEN_CONSTANT) {
+                insn[ni].op  = RPN_CONST;
+                insn[ni].val = t->val;
+            }
+            else
+                insn[ni].op  = RPN_VAR;
+            konst[depth++] = (t->type == TOKEN_CONSTANT);
+            ni++;
+            break;
+
+        case TOKEN_OPERATOR:
+            if (depth < 2)
+                goto invalid;
+            
+            op = RPN_ADD + (t->op - OPER_PLUS);
+            
+            if (op == RPN_DIV && konst[depth-1] && insn[ni-1].val == 0.0) {
+                OHM_ERROR("cgrp: division by zero in '%s'", expr);
+                goto error;
+            }
+            
+            if (konst[depth-1] && konst[depth-2]) {
+                errno = 0;
+                v = rpn_apply(op, insn[ni-2].val, insn[ni-1].val);
+                
+                if (errno != 0 || !isfinite(v)) {
+                    OHM_ERROR("cgrp: evaluation error in '%s'", expr);
+                    goto error;
+                }
+                
+                ni -= 1;
+                insn[ni-1].op  = RPN_CONST;
+                insn[ni-1].val = v;
+            }
+            else {
+                insn[ni].op  = op;
+                insn[ni].val = 0.0;
+                ni++;
+                konst[depth-2] = FALSE;
+            }
+            depth--;
+            break;
+
+        case TOKEN_FUNCTION:
+            if (depth < 1)
+                goto invalid;
+
+            op = RPN_LN + (t->fn - FUNC_LN);
+            
+            if (konst[depth-1]) {
+                if ((op == RPN_LN || op == RPN_LOG2 || op == RPN_LOG10) &&
+                    insn[ni-1].val <= 0.0) {
+                    OHM_ERROR("cgrp: logarithm of non-positive number in '%s'",
+                              expr);
+                    goto error;
+                }
+                
+                errno = 0;
+                v = rpn_apply(op, insn[ni-1].val, 0.0);
+                
+                if (errno != 0 || !isfinite(v)) {
+                    OHM_ERROR("cgrp: evaluation error in '%s'", expr);
+                    goto error;
+                }
+                
+                insn[ni-1].val = v;
+            }
+            else {
+                insn[ni].op  = op;
+                insn[ni].val = 0.0;
+                ni++;
+            }
+            break;
+            
+        default:
+            goto invalid;
+        }
+        
+        if (depth > prog->depth)
+            prog->depth = depth;
+    }
+
+    if (depth != 1)
+        goto invalid;
+
+    prog->ninsn = ni;
+
+    OHM_DEBUG(DBG_CURVE, "compiled '%s' into %d instructions (stack %d)",
+              expr, prog->ninsn, prog->depth);
+    
+    return prog;
+    
+ invalid:
+    OHM_ERROR("cgrp: invalid RPN expression '%s'", expr);
+ error:
+    FREE(prog);
+    return NULL;
+}
+
+
+/********************
+ * rpn_release
+ ********************/
+static void
+rpn_release(void *prog)
+{
+    FREE(prog);
+}
+
+
+/********************
+ * rpn_equal
+ ********************/
+static int
+rpn_equal(void *data1, void *data2)
+{
+    rpn_prog_t *p1 = (rpn_prog_t *)data1;
+    rpn_prog_t *p2 = (rpn_prog_t *)data2;
+    int         i;
+
+    if (p1->ninsn != p2->ninsn)
+        return FALSE;
+
+    for (i = 0; i < p1->ninsn; i++) {
+        if (p1->insn[i].op != p2->insn[i].op)
+            return FALSE;
+        if (p1->insn[i].op == RPN_CONST && p1->insn[i].val != p2->insn[i].val)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * rpn_eval
+ ********************/
+static double
+rpn_eval(double x, void *data)
+{
+    rpn_prog_t *prog = (rpn_prog_t *)data;
+    rpn_insn_t *insn, *end;
+    double      stack[RPN_MAX_TOKENS], *sp;
+
+    /*
+     * Notes:
+     *   The program has been verified by rpn_compile so we do not need
+     *   to check for stack under- or overflows here. Domain errors are
+     *   flagged in errno the same way the math library does it.
+     */
+
+    sp = stack - 1;
+    
+    for (insn = prog->insn, end = insn + prog->ninsn; insn < end; insn++) {
+        switch (insn->op) {
+        case RPN_CONST: *++sp = insn->val;                     break;
+        case RPN_VAR:   *++sp = x;                             break;
+        case RPN_ADD:   sp--; sp[0] = sp[0] + sp[1];           break;
+        case RPN_SUB:   sp--; sp[0] = sp[0] - sp[1];           break;
+        case RPN_MUL:   sp--; sp[0] = sp[0] * sp[1];           break;
+        case RPN_DIV:
+            sp--;
+            if (sp[1] == 0.0)
+                errno = EDOM;
+            sp[0] = sp[0] / sp[1];
+            break;
+        case RPN_POW:   sp--; sp[0] = pow(sp[0], sp[1]);       break;
+        case RPN_LN:    sp[0] = log(sp[0]);                    break;
+        case RPN_LOG2:  sp[0] = log2(sp[0]);                   break;
+        case RPN_LOG10: sp[0] = log10(sp[0]);                  break;
+        case RPN_SIN:   sp[0] = sin(sp[0]);                    break;
+        case RPN_COS:   sp[0] = cos(sp[0]);                    break;
+        case RPN_ABS:   sp[0] = sp[0] >= 0 ? sp[0] : -sp[0];   break;
+        }
+    }
+    
+    return *sp;
+}
+
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
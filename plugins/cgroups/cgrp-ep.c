@@ -18,6 +18,8 @@ USA.
 *************************************************************************/
 
 
+#include <time.h>
+
 #include "cgrp-plugin.h"
 
 
@@ -81,18 +83,23 @@ typedef struct {                        /* custom control setting */
     char *value;                        /* new value */
 } setting_t;
 
-typedef void (*ep_cb_t) (GObject *, GObject *, gboolean);
+static int      policy_decision (GObject *, guint, const gchar *, GSList *,
+                                 gpointer);
+static void     policy_keychange(GObject *, const gchar *, GSList *, gpointer);
+static gboolean txparser        (cgrp_context_t *, guint, const gchar *,
+                                 GSList *);
 
-static void     policy_decision (GObject *, GObject *, ep_cb_t, gpointer);
-static void     policy_keychange(GObject *, GObject *, gpointer);
-static gboolean txparser        (GObject *, GObject *, gpointer);
+static const internal_ep_ops_t ep_ops = {
+    .decision   = policy_decision,
+    .key_change = policy_keychange,
+};
 
 
 /********************
  * ep_init
  ********************/
 int
-ep_init(cgrp_context_t *ctx, GObject *(*signaling_register)(gchar *, gchar **))
+ep_init(cgrp_context_t *ctx, cgrp_ep_register_t signaling_register)
 {
     char *signals[] = {
         "cgroup_actions",
@@ -109,16 +116,13 @@ ep_init(cgrp_context_t *ctx, GObject *(*signaling_register)(gchar *, gchar **))
         return FALSE;
     }
 
-    if ((ctx->sigconn = signaling_register("cgroups", signals)) == NULL) {
+    ctx->sigconn = signaling_register("cgroups", signals, &ep_ops, ctx);
+
+    if (ctx->sigconn == NULL) {
         OHM_ERROR("cgrp: failed to register for policy decisions");
         return FALSE;
     }
 
-    ctx->sigdcn = g_signal_connect(ctx->sigconn, "on-decision",
-                                   G_CALLBACK(policy_decision),  (gpointer)ctx);
-    ctx->sigkey = g_signal_connect(ctx->sigconn, "on-key-change",
-                                   G_CALLBACK(policy_keychange), (gpointer)ctx);
-
     return TRUE;
 }
 
@@ -134,9 +138,6 @@ ep_exit(cgrp_context_t *ctx, gboolean (*signaling_unregister)(GObject *ep))
     if (signaling_unregister == NULL || ctx->sigconn == NULL)
         return;
 
-    g_signal_handler_disconnect(ctx->sigconn, ctx->sigdcn);
-    g_signal_handler_disconnect(ctx->sigconn, ctx->sigkey);
-    
 #if 0 /* Hmm... this seems to crash in the signaling plugin. Is it possible
        * that this triggers a bug that causes crashes if there are more than
        * 1 enforcement points ? */
@@ -149,13 +150,13 @@ ep_exit(cgrp_context_t *ctx, gboolean (*signaling_unregister)(GObject *ep))
 /********************
  * policy_decision
  ********************/
-static void
-policy_decision(GObject *ep, GObject *tx, ep_cb_t callback, gpointer data)
+static int
+policy_decision(GObject *ep, guint txid, const gchar *signal, GSList *facts,
+                gpointer data)
 {
-    gboolean success;
-    
-    success = txparser(ep, tx, data);
-    callback(ep, tx, success);
+    (void)ep;
+
+    return txparser((cgrp_context_t *)data, txid, signal, facts);
 }
 
 
@@ -163,9 +164,12 @@ policy_decision(GObject *ep, GObject *tx, ep_cb_t callback, gpointer data)
  * policy_keychange
  ********************/
 static void
-policy_keychange(GObject *ep, GObject *tx, gpointer data)
+policy_keychange(GObject *ep, const gchar *signal, GSList *facts,
+                 gpointer data)
 {
-    txparser(ep, tx, data);
+    (void)ep;
+
+    txparser((cgrp_context_t *)data, 0, signal, facts);
 }
 
 
@@ -558,6 +562,47 @@ group_oom_action(cgrp_context_t *ctx, void *data)
 
 #define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
 
+typedef enum {                  /* execution stages of an action plan */
+    STAGE_THAW = 0,                     /* thaw partitions */
+    STAGE_MOVE,                         /* reparent groups */
+    STAGE_SCHEDULE,                     /* set CPU shares */
+    STAGE_LIMIT,                        /* set memory limits and settings */
+    STAGE_FREEZE,                       /* freeze partitions */
+    STAGE_PRIO,                         /* adjust priorities, OOM-scores */
+} stage_t;
+
+typedef union {                 /* arguments of any action */
+    reparent_t   reparent;
+    freeze_t     freeze;
+    schedule_t   schedule;
+    limit_t      limit;
+    renice_t     renice;
+    proc_prio_t  proc_prio;
+    proc_oom_t   proc_oom;
+    group_prio_t group_prio;
+    group_oom_t  group_oom;
+    setting_t    setting;
+} actargs_t;
+
+typedef struct {                /* saved state for undoing a step */
+    cgrp_partition_t *partition;        /* previous partition of a group */
+    int               frozen;           /* previous freezer state */
+    unsigned int      cpu;              /* previous CPU share */
+    u64_t             mem;              /* previous memory limit */
+} undo_t;
+
+typedef struct actdsc_s actdsc_t;
+
+typedef struct {                /* a single step of an action plan */
+    actdsc_t  *action;                  /* action descriptor */
+    stage_t    stage;                   /* execution stage */
+    int        seq;                     /* original position in decision */
+    int        merged;                  /* superseded by a later step */
+    int        saved;                   /* has undo state */
+    undo_t     undo;                    /* undo state */
+    actargs_t  args;                    /* action arguments */
+} step_t;
+
 typedef int (*action_t)(cgrp_context_t *, void *);
 
 typedef enum {
@@ -573,12 +618,29 @@ typedef struct {		/* argument descriptor for actions */
     int         offs;
 } argdsc_t; 
 
-typedef struct {		/* action descriptor */
+struct actdsc_s {		/* action descriptor */
     const char *name;
     action_t    handler;
     argdsc_t   *argdsc;
     int         datalen;
-} actdsc_t;
+    stage_t     stage;                          /* execution stage */
+    int       (*same)(void *, void *);          /* same target ? */
+    int       (*save)(cgrp_context_t *, void *, undo_t *);
+    int       (*undo)(cgrp_context_t *, void *, undo_t *);
+    int         fatal;                          /* failure rolls back plan */
+};
+
+static int reparent_same(void *, void *);
+static int reparent_save(cgrp_context_t *, void *, undo_t *);
+static int reparent_undo(cgrp_context_t *, void *, undo_t *);
+static int freeze_save  (cgrp_context_t *, void *, undo_t *);
+static int freeze_undo  (cgrp_context_t *, void *, undo_t *);
+static int schedule_save(cgrp_context_t *, void *, undo_t *);
+static int schedule_undo(cgrp_context_t *, void *, undo_t *);
+static int limit_save   (cgrp_context_t *, void *, undo_t *);
+static int limit_undo   (cgrp_context_t *, void *, undo_t *);
+static int setting_same (void *, void *);
+static int same_partition(void *, void *);
 
 static argdsc_t reparent_args[] = {
     { argtype_string , "group"    , STRUCT_OFFSET(reparent_t, group)      },
@@ -647,70 +709,99 @@ static argdsc_t group_oom_args[] = {
 };
 
 static actdsc_t actions[] = {
-    { REPARENT , reparent_action  , reparent_args  , sizeof(reparent_t)   },
-    { FREEZE   , freeze_action    , freeze_args    , sizeof(freeze_t)     },
-    { SCHEDULE , schedule_action  , schedule_args  , sizeof(schedule_t)   },
-    { LIMIT    , limit_action     , limit_args     , sizeof(limit_t)      },
-    { SETTING  , setting_action   , setting_args   , sizeof(setting_t)    },
-    { RENICE   , renice_action    , renice_args    , sizeof(renice_t)     },
-    { PROC_PRIO, proc_prio_action , proc_prio_args , sizeof(proc_prio_t)  },
-    { PROC_OOM , proc_oom_action  , proc_oom_args  , sizeof(proc_oom_t)   },
-    { GRP_PRIO , group_prio_action, group_prio_args, sizeof(group_prio_t) },
-    { GRP_OOM  , group_oom_action , group_oom_args , sizeof(group_oom_t)  },
-    { NULL     , NULL             , NULL           , 0                    }
+#define REVERSIBLE(type) type##_save, type##_undo
+#define IRREVERSIBLE     NULL, NULL
+    /*
+     * Only failing writes to partition control files roll back the plan.
+     * A failed reparenting is retried later anyway (the group is flagged
+     * for reassignment) and irreversible steps have nothing to restore,
+     * so their failures are only reported.
+     */
+    { REPARENT , reparent_action  , reparent_args  , sizeof(reparent_t)  ,
+      STAGE_MOVE    , reparent_same , REVERSIBLE(reparent), FALSE },
+    { FREEZE   , freeze_action    , freeze_args    , sizeof(freeze_t)    ,
+      STAGE_FREEZE  , same_partition, REVERSIBLE(freeze)  , TRUE  },
+    { SCHEDULE , schedule_action  , schedule_args  , sizeof(schedule_t)  ,
+      STAGE_SCHEDULE, same_partition, REVERSIBLE(schedule), TRUE  },
+    { LIMIT    , limit_action     , limit_args     , sizeof(limit_t)     ,
+      STAGE_LIMIT   , same_partition, REVERSIBLE(limit)   , TRUE  },
+    { SETTING  , setting_action   , setting_args   , sizeof(setting_t)   ,
+      STAGE_LIMIT   , setting_same  , IRREVERSIBLE        , FALSE },
+    { RENICE   , renice_action    , renice_args    , sizeof(renice_t)    ,
+      STAGE_PRIO    , NULL          , IRREVERSIBLE        , FALSE },
+    { PROC_PRIO, proc_prio_action , proc_prio_args , sizeof(proc_prio_t) ,
+      STAGE_PRIO    , NULL          , IRREVERSIBLE        , FALSE },
+    { PROC_OOM , proc_oom_action  , proc_oom_args  , sizeof(proc_oom_t)  ,
+      STAGE_PRIO    , NULL          , IRREVERSIBLE        , FALSE },
+    { GRP_PRIO , group_prio_action, group_prio_args, sizeof(group_prio_t),
+      STAGE_PRIO    , NULL          , IRREVERSIBLE        , FALSE },
+    { GRP_OOM  , group_oom_action , group_oom_args , sizeof(group_oom_t) ,
+      STAGE_PRIO    , NULL          , IRREVERSIBLE        , FALSE },
+    { NULL     , NULL             , NULL           , 0                   ,
+      0             , NULL          , IRREVERSIBLE        , FALSE }
+#undef REVERSIBLE
+#undef IRREVERSIBLE
 };
 
-static int action_parser  (actdsc_t *, cgrp_context_t *);
-static int get_args       (OhmFact *, argdsc_t *, void *);
+static int  plan_collect(cgrp_context_t *, actdsc_t *, step_t **, int *);
+static void plan_merge  (step_t *, int);
+static int  plan_compare(const void *, const void *);
+static int  plan_apply  (cgrp_context_t *, step_t *, int);
+static void plan_revert (cgrp_context_t *, step_t *, int);
+static int  get_args    (OhmFact *, argdsc_t *, void *);
 
 
 static gboolean
-txparser(GObject *conn, GObject *transaction, gpointer data)
+txparser(cgrp_context_t *ctx, guint txid, const gchar *signal, GSList *list)
 {
-    cgrp_context_t *ctx = (cgrp_context_t *)data;
-    guint      txid;
-    GSList    *entry, *list;
+    GSList    *entry;
     char      *name;
     actdsc_t  *action;
     gboolean   success;
-    gchar     *signal;
-
-    (void)conn;
+    step_t    *plan;
+    int        nstep;
 
-    g_object_get(transaction, "txid" , &txid, NULL);
-    g_object_get(transaction, "facts", &list, NULL);
-    g_object_get(transaction, "signal", &signal, NULL);
-    
     success = TRUE;
 
     if (!strcmp(signal, "cgroup_actions")) {
+        plan  = NULL;
+        nstep = 0;
+
         for (entry = list; entry != NULL; entry = g_slist_next(entry)) {
             name = (char *)entry->data;
             for (action = actions; action->name != NULL; action++) {
                 if (!strcmp(name, action->name))
-                    success &= action_parser(action, ctx);
+                    success &= plan_collect(ctx, action, &plan, &nstep);
             }
         }
+
+        /* steps that failed to parse are left out, the rest is applied */
+        if (!success)
+            OHM_ERROR("cgrp: failed to parse some cgroup actions of "
+                      "transaction %u", txid);
+
+        plan_merge(plan, nstep);
+        qsort(plan, nstep, sizeof(plan[0]), plan_compare);
+        success &= plan_apply(ctx, plan, nstep);
+
+        FREE(plan);
     }
 
-    g_free(signal);
-    
     return success;
 }
 
-static int action_parser(actdsc_t *action, cgrp_context_t *ctx)
+
+/********************
+ * plan_collect
+ ********************/
+static int
+plan_collect(cgrp_context_t *ctx, actdsc_t *action, step_t **plan, int *nstep)
 {
     OhmFact *fact;
     GSList  *list;
-    char    *data;
+    step_t  *step;
     int      success;
 
-    if ((data = malloc(action->datalen)) == NULL) {
-        OHM_ERROR("Can't allocate %d byte memory", action->datalen);
-
-        return FALSE;
-    }
-
     success = TRUE;
 
     for (list  = ohm_fact_store_get_facts_by_name(ctx->store, action->name);
@@ -719,22 +810,343 @@ static int action_parser(actdsc_t *action, cgrp_context_t *ctx)
     {
         fact = (OhmFact *)list->data;
 
-        memset(data, 0, action->datalen);
+        if (REALLOC_ARR(*plan, *nstep, *nstep + 1) == NULL) {
+            OHM_ERROR("cgrp: failed to allocate action plan");
+            return FALSE;
+        }
+
+        step = *plan + *nstep;
+        memset(step, 0, sizeof(*step));
 
-        if (get_args(fact, action->argdsc, data))
-            success &= action->handler(ctx, data);
-        else {
+        if (!get_args(fact, action->argdsc, &step->args)) {
             OHM_DEBUG(DBG_ACTION, "argument parsing error for action '%s'",
                       action->name);
-            success &= FALSE;
+            success = FALSE;
+            continue;
         }
+
+        step->action = action;
+        step->stage  = action->stage;
+        step->seq    = *nstep;
+
+        if (action->handler == freeze_action &&
+            strcmp(step->args.freeze.state, "frozen"))
+            step->stage = STAGE_THAW;
+
+        (*nstep)++;
     }
 
-    free(data);
-    
     return success;
 }
 
+
+/********************
+ * plan_merge
+ ********************/
+static void
+plan_merge(step_t *plan, int nstep)
+{
+    step_t *s, *later;
+    int     i, j;
+
+    /*
+     * Only the last one of several steps with the same target is executed.
+     */
+
+    for (i = 0; i < nstep; i++) {
+        s = plan + i;
+
+        if (s->action->same == NULL)
+            continue;
+
+        for (j = i + 1; j < nstep; j++) {
+            later = plan + j;
+
+            if (later->action == s->action &&
+                s->action->same(&s->args, &later->args)) {
+                OHM_DEBUG(DBG_ACTION, "merged duplicate '%s' step #%d to #%d",
+                          s->action->name, s->seq, later->seq);
+                s->merged = TRUE;
+                break;
+            }
+        }
+    }
+}
+
+
+/********************
+ * plan_compare
+ ********************/
+static int
+plan_compare(const void *p1, const void *p2)
+{
+    const step_t *s1 = (const step_t *)p1;
+    const step_t *s2 = (const step_t *)p2;
+
+    if (s1->stage != s2->stage)
+        return s1->stage - s2->stage;
+    else
+        return s1->seq - s2->seq;
+}
+
+
+/********************
+ * plan_apply
+ ********************/
+static int
+plan_apply(cgrp_context_t *ctx, step_t *plan, int nstep)
+{
+    struct timespec  start, end;
+    step_t          *step;
+    actdsc_t        *action;
+    int              i, success, status;
+    long             usecs;
+
+    status = TRUE;
+
+    for (i = 0; i < nstep; i++) {
+        step   = plan + i;
+        action = step->action;
+
+        if (step->merged)
+            continue;
+
+        if (action->save != NULL)
+            step->saved = action->save(ctx, &step->args, &step->undo);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        success = action->handler(ctx, &step->args);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        usecs = (end.tv_sec - start.tv_sec) * 1000000 +
+            (end.tv_nsec - start.tv_nsec) / 1000;
+
+        OHM_DEBUG(DBG_ACTION, "step #%d (stage %d) '%s': %s, %ld usecs",
+                  step->seq, step->stage, action->name,
+                  success ? "OK" : "FAILED", usecs);
+
+        if (!success) {
+            if (!action->fatal) {
+                OHM_WARNING("cgrp: action '%s' failed", action->name);
+                status = FALSE;
+                continue;
+            }
+
+            /* the failed step may have been partially applied, undo it too */
+            OHM_ERROR("cgrp: action '%s' failed, rolling back", action->name);
+            plan_revert(ctx, plan, i + 1);
+            return FALSE;
+        }
+    }
+
+    return status;
+}
+
+
+/********************
+ * plan_revert
+ ********************/
+static void
+plan_revert(cgrp_context_t *ctx, step_t *plan, int nstep)
+{
+    step_t   *step;
+    actdsc_t *action;
+    int       i, success;
+
+    for (i = nstep - 1; i >= 0; i--) {
+        step   = plan + i;
+        action = step->action;
+
+        if (step->merged)
+            continue;
+
+        if (action->undo == NULL || !step->saved) {
+            OHM_WARNING("cgrp: cannot roll back action '%s'", action->name);
+            continue;
+        }
+
+        success = action->undo(ctx, &step->args, &step->undo);
+
+        OHM_DEBUG(DBG_ACTION, "rolling back step #%d '%s': %s",
+                  step->seq, action->name, success ? "OK" : "FAILED");
+    }
+}
+
+
+/********************
+ * same_partition
+ ********************/
+static int
+same_partition(void *a1, void *a2)
+{
+    /* freeze_t, schedule_t and limit_t all start with the partition name */
+    char *p1 = *(char **)a1;
+    char *p2 = *(char **)a2;
+
+    return p1 != NULL && p2 != NULL && !strcmp(p1, p2);
+}
+
+
+/********************
+ * reparent_same
+ ********************/
+static int
+reparent_same(void *a1, void *a2)
+{
+    reparent_t *r1 = (reparent_t *)a1;
+    reparent_t *r2 = (reparent_t *)a2;
+
+    return r1->pid == r2->pid &&
+        r1->group != NULL && r2->group != NULL && !strcmp(r1->group, r2->group);
+}
+
+
+/********************
+ * reparent_save
+ ********************/
+static int
+reparent_save(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    reparent_t   *action = (reparent_t *)data;
+    cgrp_group_t *group;
+
+    if ((group = group_lookup(ctx, action->group)) == NULL)
+        return FALSE;
+
+    undo->partition = group->partition;
+
+    return undo->partition != NULL;
+}
+
+
+/********************
+ * reparent_undo
+ ********************/
+static int
+reparent_undo(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    reparent_t   *action = (reparent_t *)data;
+    cgrp_group_t *group;
+
+    if ((group = group_lookup(ctx, action->group)) == NULL)
+        return FALSE;
+
+    if (group->partition == undo->partition)
+        return TRUE;
+
+    return partition_add_group(undo->partition, group, action->pid);
+}
+
+
+/********************
+ * freeze_save
+ ********************/
+static int
+freeze_save(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    freeze_t         *action = (freeze_t *)data;
+    cgrp_partition_t *partition;
+
+    if ((partition = partition_lookup(ctx, action->partition)) == NULL)
+        return FALSE;
+
+    undo->partition = partition;
+    undo->frozen    = partition->frozen;
+
+    return TRUE;
+}
+
+
+/********************
+ * freeze_undo
+ ********************/
+static int
+freeze_undo(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    (void)data;
+
+    return partition_freeze(ctx, undo->partition, undo->frozen);
+}
+
+
+/********************
+ * schedule_save
+ ********************/
+static int
+schedule_save(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    schedule_t       *action = (schedule_t *)data;
+    cgrp_partition_t *partition;
+
+    if ((partition = partition_lookup(ctx, action->partition)) == NULL)
+        return FALSE;
+
+    undo->partition = partition;
+    undo->cpu       = partition->limit.cpu;
+
+    return TRUE;
+}
+
+
+/********************
+ * schedule_undo
+ ********************/
+static int
+schedule_undo(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    (void)ctx;
+    (void)data;
+
+    return partition_limit_cpu(undo->partition, undo->cpu);
+}
+
+
+/********************
+ * limit_save
+ ********************/
+static int
+limit_save(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    limit_t          *action = (limit_t *)data;
+    cgrp_partition_t *partition;
+
+    if ((partition = partition_lookup(ctx, action->partition)) == NULL)
+        return FALSE;
+
+    undo->partition = partition;
+    undo->mem       = partition->limit.mem;
+
+    return TRUE;
+}
+
+
+/********************
+ * limit_undo
+ ********************/
+static int
+limit_undo(cgrp_context_t *ctx, void *data, undo_t *undo)
+{
+    (void)ctx;
+    (void)data;
+
+    return partition_restore_mem(undo->partition, undo->mem);
+}
+
+
+/********************
+ * setting_same
+ ********************/
+static int
+setting_same(void *a1, void *a2)
+{
+    setting_t *s1 = (setting_t *)a1;
+    setting_t *s2 = (setting_t *)a2;
+
+    return same_partition(a1, a2) &&
+        s1->name != NULL && s2->name != NULL && !strcmp(s1->name, s2->name);
+}
+
+
 static int get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
 {
     argdsc_t *ad;
@@ -201,6 +201,8 @@ partition_add(cgrp_context_t *ctx, cgrp_partition_t *p)
 
     partition->settings = p->settings;
     partition_apply_settings(ctx, partition);
+
+    partition->mem_notify = p->mem_notify;
     
     if (!part_hash_insert(ctx, partition)) {
         OHM_ERROR("cgrp: failed to add partition '%s'", partition->name);
@@ -296,6 +298,9 @@ partition_print(cgrp_partition_t *partition, FILE *fp)
     }
     fprintf(fp, "realtime-limit period %d runtime %d\n",
             partition->limit.rt_period, partition->limit.rt_runtime);
+    if (partition->mem_notify != 0)
+        fprintf(fp, "memory-threshold %lluK\n",
+                (unsigned long long)(partition->mem_notify / K));
 
     for (cs = partition->settings; cs != NULL; cs = cs->next)
         fprintf(fp, "%s %s\n", cs->name, cs->value);
@@ -400,6 +405,9 @@ partition_freeze(cgrp_context_t *ctx, cgrp_partition_t *partition, int freeze)
 
         success = (write(partition->control.freeze, cmd, len) == len);
 
+        if (success)
+            partition->frozen = freeze;
+
         if (!freeze && success)
             unfreeze_fixup(ctx, partition);
 
@@ -435,7 +443,7 @@ partition_limit_cpu(cgrp_partition_t *partition, unsigned int share)
  * partition_limit_mem
  ********************/
 int
-partition_limit_mem(cgrp_partition_t *partition, unsigned int limit)
+partition_limit_mem(cgrp_partition_t *partition, u64_t limit)
 {
     char val[128];
     int  len, chk;
@@ -443,7 +451,7 @@ partition_limit_mem(cgrp_partition_t *partition, unsigned int limit)
     partition->limit.mem = limit;
 
     if (partition->control.mem >= 0 && limit > 0) {
-        len = snprintf(val, sizeof(val), "%u", limit);
+        len = snprintf(val, sizeof(val), "%llu", (unsigned long long)limit);
         chk = write(partition->control.mem, val, len);
         return chk == len;
     }
@@ -452,6 +460,36 @@ partition_limit_mem(cgrp_partition_t *partition, unsigned int limit)
 }
 
 
+/********************
+ * partition_restore_mem
+ ********************/
+int
+partition_restore_mem(cgrp_partition_t *partition, u64_t limit)
+{
+    char val[128];
+    int  len, chk;
+
+    /*
+     * Unlike partition_limit_mem, always write the limit, since 0 (no
+     * limit) has to be restored as well. The kernel takes -1 for that.
+     */
+
+    partition->limit.mem = limit;
+
+    if (partition->control.mem < 0)
+        return TRUE;
+
+    if (limit > 0)
+        len = snprintf(val, sizeof(val), "%llu", (unsigned long long)limit);
+    else
+        len = snprintf(val, sizeof(val), "-1");
+
+    chk = write(partition->control.mem, val, len);
+
+    return chk == len;
+}
+
+
 /********************
  * partition_limit_rt
  ********************/
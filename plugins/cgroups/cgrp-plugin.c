@@ -41,7 +41,9 @@ OHM_DEBUG_PLUGIN(cgroups,
 );
 
 
-OHM_IMPORTABLE(GObject *, signaling_register  , (gchar *uri, gchar **interested));
+OHM_IMPORTABLE(GObject *, signaling_register  , (gchar *uri, gchar **interested,
+                                                 const internal_ep_ops_t *ops,
+                                                 gpointer data));
 OHM_IMPORTABLE(gboolean , signaling_unregister, (GObject *ep));
 OHM_IMPORTABLE(int      , resolve             , (char *goal, char **locals));
 OHM_IMPORTABLE(int      , register_method     , (char *name,
@@ -365,7 +367,7 @@ OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
 
 
 OHM_PLUGIN_REQUIRES_METHODS(PLUGIN_PREFIX, 5, 
-   OHM_IMPORT("signaling.register_enforcement_point"  , signaling_register),
+   OHM_IMPORT("signaling.register_internal_ep"        , signaling_register),
    OHM_IMPORT("signaling.unregister_enforcement_point", signaling_unregister),
    OHM_IMPORT("dres.resolve"          , resolve),
    OHM_IMPORT("dres.register_method"  , register_method),
@@ -32,6 +32,8 @@ USA.
 
 #include <glib.h>
 
+#include "internal-ep-ops.h"                  /* from signaling */
+
 #include "cgrp-basic-types.h"
 #include "mm.h"
 #include "list.h"
@@ -125,10 +127,13 @@ typedef enum {
 #define CGRP_NO_CONTROL (-1)
 #define CGRP_NO_LIMIT     0
 
+typedef struct cgrp_mempres_s cgrp_mempres_t;
+
 typedef struct {
     char             *name;                 /* name of this partition */
     char             *path;                 /* path to this partition */
     int               flags;                  /* partition flags */
+    int               frozen;                 /* last set freezer state */
     struct {                                /* control file descriptors */
         int           tasks;                  /* partition tasks */
         int           freeze;                 /* partition freezer */
@@ -148,6 +153,9 @@ typedef struct {
 #endif
 
     cgrp_ctrl_setting_t *settings;          /* extra cgroup controls */
+
+    u64_t             mem_notify;           /* memory usage threshold */
+    cgrp_mempres_t   *mempres;              /* memory pressure monitoring */
 } cgrp_partition_t;
 
 
@@ -637,6 +645,11 @@ typedef struct {
 } cgrp_swap_t;
 
 
+typedef struct {
+    char            *hook;                  /* notification hook */
+} cgrp_memnotify_t;
+
+
 typedef struct {
     int  min;                               /* input range lower */
     int  max;                               /* and upper limits */
@@ -678,8 +691,6 @@ typedef struct {
 
     OhmFactStore     *store;                /* ohm factstore */
     GObject          *sigconn;              /* policy signaling interface */
-    gulong            sigdcn;               /* policy decision id */
-    gulong            sigkey;               /* policy keychange id */
     
     int               apptrack_sock;        /* notification fd */
     GIOChannel       *apptrack_chnl;        /* associated I/O channel */
@@ -697,6 +708,7 @@ typedef struct {
     cgrp_iowait_t     iow;                  /* I/O-wait state monitoring */
     cgrp_ioqlen_t     ioq;                  /* I/O queue length monitoring */
     cgrp_swap_t       swp;                  /* swap pressure monitoring */
+    cgrp_memnotify_t  mem;                  /* partition memory pressure */
 
     cgrp_curve_t     *oom_curve;            /* OOM adjustment mapping */
     int               oom_default;          /* default/starting value */
@@ -775,7 +787,8 @@ int partition_add_process(cgrp_partition_t *, cgrp_process_t *);
 int partition_add_group(cgrp_partition_t *, cgrp_group_t *, pid_t);
 int partition_freeze(cgrp_context_t *, cgrp_partition_t *, int);
 int partition_limit_cpu(cgrp_partition_t *, unsigned int);
-int partition_limit_mem(cgrp_partition_t *, unsigned int);
+int partition_limit_mem(cgrp_partition_t *, u64_t);
+int partition_restore_mem(cgrp_partition_t *, u64_t);
 int partition_limit_rt(cgrp_partition_t *, int, int);
 int partition_apply_settings(cgrp_context_t *, cgrp_partition_t *);
 int partition_apply_setting(cgrp_context_t *, cgrp_partition_t *,
@@ -863,7 +876,10 @@ cgrp_action_t *action_noop_new    (void);
 
 
 /* cgrp-ep.c */
-int  ep_init(cgrp_context_t *, GObject *(*)(gchar *, gchar **));
+typedef GObject *(*cgrp_ep_register_t)(gchar *, gchar **,
+                                       const internal_ep_ops_t *, gpointer);
+
+int  ep_init(cgrp_context_t *, cgrp_ep_register_t);
 void ep_exit(cgrp_context_t *, gboolean (*)(GObject *));
 
 
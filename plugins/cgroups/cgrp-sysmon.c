@@ -23,8 +23,10 @@ USA.
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
 
 #include "config.h"
 #include "cgrp-plugin.h"
@@ -46,6 +48,8 @@ static int  ioq_init(cgrp_context_t *ctx);
 static void ioq_exit(cgrp_context_t *ctx);
 static int  swp_init(cgrp_context_t *ctx);
 static void swp_exit(cgrp_context_t *ctx);
+static int  mem_init(cgrp_context_t *ctx);
+static void mem_exit(cgrp_context_t *ctx);
 
 static void          estim_free(estim_t *);
 static unsigned long estim_update(estim_t *, unsigned long);
@@ -55,6 +59,7 @@ static sysmon_t monitors[] = {
     { iow_init, iow_exit },
     { ioq_init, ioq_exit },
     { swp_init, swp_exit },
+    { mem_init, mem_exit },
     { NULL    , NULL     }
 };
 
@@ -612,6 +617,497 @@ swp_exit(cgrp_context_t *ctx)
 
 
 
+/*****************************************************************************
+ *                *** per-partition memory pressure monitoring ***           *
+ *****************************************************************************/
+
+/*
+ * With the legacy (v1) memory controller we register an eventfd for the
+ * memory usage threshold and another one for OOM notifications using
+ * cgroup.event_control. With the unified (v2) hierarchy there are no
+ * arbitrary usage thresholds, so we program the threshold as memory.high
+ * and watch memory.events for high, max and oom events instead. Since v2
+ * has no notification for usage dropping back below the threshold, we
+ * poll memory.current while the partition is under pressure.
+ */
+
+#define MEM_USAGE_V1   "memory.usage_in_bytes"
+#define MEM_OOMCTL_V1  "memory.oom_control"
+#define MEM_EVCTL_V1   "cgroup.event_control"
+#define MEM_USAGE_V2   "memory.current"
+#define MEM_EVENTS_V2  "memory.events"
+#define MEM_HIGH_V2    "memory.high"
+#define MEM_RELIEF_POLL 5                   /* v2 pressure relief poll (s) */
+
+enum {
+    MEM_STATE_LOW = 0,                      /* below threshold */
+    MEM_STATE_HIGH,                         /* above threshold */
+    MEM_STATE_OOM,                          /* hit the limit, OOM */
+};
+
+static const char *mem_state_names[] = {
+    [MEM_STATE_LOW]  = "low",
+    [MEM_STATE_HIGH] = "high",
+    [MEM_STATE_OOM]  = "oom",
+};
+
+struct cgrp_mempres_s {
+    cgrp_context_t   *ctx;                  /* plugin context */
+    cgrp_partition_t *partition;            /* monitored partition */
+    int               v2;                   /* unified hierarchy ? */
+    int               usage;                /* memory usage fd */
+    int               thrfd;                /* threshold eventfd (v1) */
+    int               oomfd;                /* OOM eventfd or memory.events */
+    GIOChannel       *thrchnl;              /* threshold I/O channel */
+    guint             thrsrc;               /*   and event source */
+    GIOChannel       *oomchnl;              /* OOM I/O channel */
+    guint             oomsrc;               /*   and event source */
+    guint             timer;                /* v2 pressure relief timer */
+    int               state;                /* MEM_STATE_* */
+    unsigned long     noom;                 /* number of OOM events */
+    unsigned long     nmax;                 /* v2 max/oom counters seen */
+    unsigned long     nhigh;                /* v2 high counter seen */
+    OhmFact          *fact;                 /* partition memory fact */
+};
+
+static gboolean mem_relief_cb(gpointer data);
+static void     mem_unwatch_partition(gpointer key, gpointer value,
+                                      gpointer data);
+
+
+/********************
+ * mem_read_u64
+ ********************/
+static int
+mem_read_u64(int fd, u64_t *value)
+{
+    char buf[64], *end;
+    int  len;
+
+    if (lseek(fd, 0, SEEK_SET) < 0 || (len = read(fd, buf, sizeof(buf)-1)) <= 0)
+        return FALSE;
+
+    buf[len] = '\0';
+    *value   = strtoull(buf, &end, 10);
+    
+    return (end != buf);
+}
+
+
+/********************
+ * mem_control
+ ********************/
+static int
+mem_control(cgrp_partition_t *partition, const char *entry, int flags)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", partition->path, entry);
+    
+    return open(path, flags);
+}
+
+
+/********************
+ * mem_update
+ ********************/
+static void
+mem_update(cgrp_mempres_t *mp, int state)
+{
+    cgrp_context_t *ctx = mp->ctx;
+    u64_t           usage;
+    char           *vars[4 + 1];
+
+    if (!mem_read_u64(mp->usage, &usage))
+        usage = 0;
+    
+    OHM_DEBUG(DBG_SYSMON, "partition '%s' memory %s, usage %llu, %lu OOMs",
+              mp->partition->name, mem_state_names[state],
+              (unsigned long long)usage, mp->noom);
+    
+    if (mp->fact != NULL) {
+        ohm_fact_set(mp->fact, "memory_state",
+                     ohm_value_from_string(mem_state_names[state]));
+        ohm_fact_set(mp->fact, "memory_usage",
+                     ohm_value_from_int((int)(usage / 1024)));
+        ohm_fact_set(mp->fact, "oom_count",
+                     ohm_value_from_int((int)mp->noom));
+    }
+
+    if (state == mp->state && state != MEM_STATE_OOM)
+        return;
+
+    mp->state = state;
+
+    if (ctx->mem.hook != NULL) {
+        vars[0] = "partition";
+        vars[1] = mp->partition->name;
+        vars[2] = "state";
+        vars[3] = (char *)mem_state_names[state];
+        vars[4] = NULL;
+
+        ctx->resolve(ctx->mem.hook, vars);
+    }
+}
+
+
+/********************
+ * mem_threshold_cb
+ ********************/
+static gboolean
+mem_threshold_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
+{
+    cgrp_mempres_t *mp = (cgrp_mempres_t *)data;
+    uint64_t        cnt;
+    u64_t           usage;
+
+    (void)chnl;
+
+    if (mask & (G_IO_HUP | G_IO_ERR)) {
+        OHM_ERROR("cgrp: memory threshold notification for '%s' failed",
+                  mp->partition->name);
+        mp->thrsrc = 0;
+        return FALSE;
+    }
+
+    if (read(mp->thrfd, &cnt, sizeof(cnt)) != sizeof(cnt))
+        return TRUE;
+
+    /* the threshold event fires when crossed in either direction */
+    if (mem_read_u64(mp->usage, &usage) && usage >= mp->partition->mem_notify)
+        mem_update(mp, MEM_STATE_HIGH);
+    else
+        mem_update(mp, MEM_STATE_LOW);
+    
+    return TRUE;
+}
+
+
+/********************
+ * mem_parse_events
+ ********************/
+static int
+mem_parse_events(int fd, unsigned long *high, unsigned long *max)
+{
+    char          buf[512], *p, *e;
+    int           len;
+    unsigned long n;
+
+    if (lseek(fd, 0, SEEK_SET) < 0 || (len = read(fd, buf, sizeof(buf)-1)) <= 0)
+        return FALSE;
+
+    buf[len] = '\0';
+    *high = *max = 0;
+    
+    for (p = buf; p != NULL && *p; p = e ? e + 1 : NULL) {
+        e = strchr(p, '\n');
+
+        if (!strncmp(p, "high ", 5))
+            *high = strtoul(p + 5, NULL, 10);
+        else if (!strncmp(p, "max ", 4) || !strncmp(p, "oom ", 4)) {
+            n     = strtoul(strchr(p, ' ') + 1, NULL, 10);
+            *max += n;
+        }
+    }
+    
+    return TRUE;
+}
+
+
+/********************
+ * mem_events_cb
+ ********************/
+static gboolean
+mem_events_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
+{
+    cgrp_mempres_t *mp = (cgrp_mempres_t *)data;
+    uint64_t        cnt;
+    unsigned long   high, max;
+
+    (void)chnl;
+    (void)mask;
+
+    if (!mp->v2) {
+        if (read(mp->oomfd, &cnt, sizeof(cnt)) != sizeof(cnt))
+            return TRUE;
+        
+        mp->noom += cnt;
+        mem_update(mp, MEM_STATE_OOM);
+        
+        return TRUE;
+    }
+    
+    if (!mem_parse_events(mp->oomfd, &high, &max))
+        return TRUE;
+
+    if (max > mp->nmax) {
+        mp->noom += max - mp->nmax;
+        mp->nmax  = max;
+        mp->nhigh = high;
+        mem_update(mp, MEM_STATE_OOM);
+    }
+    else if (high > mp->nhigh) {
+        mp->nhigh = high;
+        mem_update(mp, MEM_STATE_HIGH);
+    }
+    else
+        return TRUE;
+
+    if (mp->timer == 0)
+        mp->timer = g_timeout_add(1000 * MEM_RELIEF_POLL, mem_relief_cb, mp);
+    
+    return TRUE;
+}
+
+
+/********************
+ * mem_relief_cb
+ ********************/
+static gboolean
+mem_relief_cb(gpointer data)
+{
+    cgrp_mempres_t *mp = (cgrp_mempres_t *)data;
+    u64_t           usage;
+
+    if (!mem_read_u64(mp->usage, &usage) || usage >= mp->partition->mem_notify)
+        return TRUE;
+
+    mp->timer = 0;
+    mem_update(mp, MEM_STATE_LOW);
+
+    return FALSE;
+}
+
+
+/********************
+ * mem_watch
+ ********************/
+static guint
+mem_watch(int fd, GIOCondition mask, GIOFunc cb, cgrp_mempres_t *mp,
+          GIOChannel **chnl)
+{
+    if ((*chnl = g_io_channel_unix_new(fd)) == NULL)
+        return 0;
+
+    return g_io_add_watch(*chnl, mask, cb, mp);
+}
+
+
+/********************
+ * mem_setup_v1
+ ********************/
+static int
+mem_setup_v1(cgrp_mempres_t *mp)
+{
+    cgrp_partition_t *partition = mp->partition;
+    int               ctl, oomctl, len, chk;
+    char              cmd[128];
+    
+    if ((ctl = mem_control(partition, MEM_EVCTL_V1, O_WRONLY)) < 0)
+        return FALSE;
+
+    mp->thrfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    mp->oomfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    oomctl    = mem_control(partition, MEM_OOMCTL_V1, O_RDONLY);
+    
+    if (mp->thrfd < 0 || mp->oomfd < 0) {
+        close(ctl);
+        if (oomctl >= 0)
+            close(oomctl);
+        return FALSE;
+    }
+
+    len = snprintf(cmd, sizeof(cmd), "%d %d %llu", mp->thrfd, mp->usage,
+                   (unsigned long long)partition->mem_notify);
+    chk = write(ctl, cmd, len);
+
+    if (chk != len) {
+        OHM_ERROR("cgrp: failed to set memory threshold for '%s' (%s)",
+                  partition->name, strerror(errno));
+        close(ctl);
+        if (oomctl >= 0)
+            close(oomctl);
+        return FALSE;
+    }
+
+    if (oomctl >= 0) {
+        len = snprintf(cmd, sizeof(cmd), "%d %d", mp->oomfd, oomctl);
+        chk = write(ctl, cmd, len);
+
+        if (chk != len)
+            OHM_WARNING("cgrp: no OOM notifications for '%s' (%s)",
+                        partition->name, strerror(errno));
+        
+        /* the kernel keeps its own reference, we can close it */
+        close(oomctl);
+    }
+
+    close(ctl);
+
+    mp->thrsrc = mem_watch(mp->thrfd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                           mem_threshold_cb, mp, &mp->thrchnl);
+    mp->oomsrc = mem_watch(mp->oomfd, G_IO_IN,
+                           mem_events_cb, mp, &mp->oomchnl);
+    
+    return (mp->thrsrc != 0 && mp->oomsrc != 0);
+}
+
+
+/********************
+ * mem_setup_v2
+ ********************/
+static int
+mem_setup_v2(cgrp_mempres_t *mp)
+{
+    cgrp_partition_t *partition = mp->partition;
+    int               high, len, chk;
+    char              val[64];
+
+    if ((high = mem_control(partition, MEM_HIGH_V2, O_WRONLY)) >= 0) {
+        len = snprintf(val, sizeof(val), "%llu",
+                       (unsigned long long)partition->mem_notify);
+        chk = write(high, val, len);
+        close(high);
+
+        if (chk != len)
+            OHM_WARNING("cgrp: failed to set memory.high for '%s'",
+                        partition->name);
+    }
+    
+    if ((mp->oomfd = mem_control(partition, MEM_EVENTS_V2, O_RDONLY)) < 0)
+        return FALSE;
+
+    mem_parse_events(mp->oomfd, &mp->nhigh, &mp->nmax);
+    
+    mp->oomsrc = mem_watch(mp->oomfd, G_IO_PRI | G_IO_ERR,
+                           mem_events_cb, mp, &mp->oomchnl);
+
+    return (mp->oomsrc != 0);
+}
+
+
+/********************
+ * mem_watch_partition
+ ********************/
+static void
+mem_watch_partition(gpointer key, gpointer value, gpointer data)
+{
+    cgrp_partition_t *partition = (cgrp_partition_t *)value;
+    cgrp_context_t   *ctx       = (cgrp_context_t *)data;
+    cgrp_mempres_t   *mp;
+    int               success;
+    
+    (void)key;
+
+    if (partition->mem_notify == 0 || partition->mempres != NULL)
+        return;
+
+    if (ALLOC_OBJ(mp) == NULL) {
+        OHM_ERROR("cgrp: failed to allocate memory monitor for '%s'",
+                  partition->name);
+        return;
+    }
+
+    mp->ctx       = ctx;
+    mp->partition = partition;
+    mp->thrfd     = -1;
+    mp->oomfd     = -1;
+    
+    if ((mp->usage = mem_control(partition, MEM_USAGE_V1, O_RDONLY)) >= 0)
+        success = mem_setup_v1(mp);
+    else if ((mp->usage = mem_control(partition, MEM_USAGE_V2, O_RDONLY)) >= 0) {
+        mp->v2  = TRUE;
+        success = mem_setup_v2(mp);
+    }
+    else
+        success = FALSE;
+
+    partition->mempres = mp;
+    
+    if (!success) {
+        OHM_WARNING("cgrp: cannot monitor memory pressure of '%s'",
+                    partition->name);
+        mem_unwatch_partition(NULL, partition, NULL);
+        return;
+    }
+
+    if ((mp->fact = fact_create(ctx, CGRP_FACT_PART, partition->name)) != NULL)
+        ohm_fact_set(mp->fact, "memory_threshold",
+                     ohm_value_from_int((int)(partition->mem_notify / 1024)));
+    
+    mem_update(mp, MEM_STATE_LOW);
+
+    OHM_INFO("cgrp: memory pressure notification (%s) for '%s' enabled",
+             mp->v2 ? "v2" : "v1", partition->name);
+}
+
+
+/********************
+ * mem_unwatch_partition
+ ********************/
+static void
+mem_unwatch_partition(gpointer key, gpointer value, gpointer data)
+{
+    cgrp_partition_t *partition = (cgrp_partition_t *)value;
+    cgrp_mempres_t   *mp        = partition->mempres;
+    
+    (void)key;
+
+    if (mp == NULL)
+        return;
+
+    if (mp->timer != 0)
+        g_source_remove(mp->timer);
+    if (mp->thrsrc != 0)
+        g_source_remove(mp->thrsrc);
+    if (mp->oomsrc != 0)
+        g_source_remove(mp->oomsrc);
+    if (mp->thrchnl != NULL)
+        g_io_channel_unref(mp->thrchnl);
+    if (mp->oomchnl != NULL)
+        g_io_channel_unref(mp->oomchnl);
+    
+    if (mp->thrfd >= 0)
+        close(mp->thrfd);
+    if (mp->oomfd >= 0)
+        close(mp->oomfd);
+    if (mp->usage >= 0)
+        close(mp->usage);
+    
+    if (mp->fact != NULL && data != NULL)
+        fact_delete((cgrp_context_t *)data, mp->fact);
+
+    FREE(mp);
+    partition->mempres = NULL;
+}
+
+
+/********************
+ * mem_init
+ ********************/
+static int
+mem_init(cgrp_context_t *ctx)
+{
+    part_hash_foreach(ctx, mem_watch_partition, ctx);
+    
+    return TRUE;
+}
+
+
+/********************
+ * mem_exit
+ ********************/
+static void
+mem_exit(cgrp_context_t *ctx)
+{
+    part_hash_foreach(ctx, mem_unwatch_partition, ctx);
+
+    FREE(ctx->mem.hook);
+    ctx->mem.hook = NULL;
+}
+
+
+
 /*****************************************************************************
  *                          *** estimator routines ***                       *
  *****************************************************************************/
@@ -80,6 +80,7 @@ int __trace_printf(int id, const char *file, int line, const char *func,
  *****************************************************************************/
 
 #include <getopt.h>
+#include <sys/time.h>
 
 #define fatal(fmt, args...) do {                                \
         fprintf(stderr, "fatal error: "fmt"\n" , ## args);      \
@@ -196,6 +197,104 @@ int curve_to_svg(cgrp_curve_t *crv, const char *path, int imin, int imax)
 }
 
 
+/*****************************************************************************
+ *         *** interpreted vs. compiled evaluation benchmark ***             *
+ *****************************************************************************/
+
+static double timestamp(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+int benchmark(const char *func, double cmin, double cmax, int size, int rounds)
+{
+    cgrp_curve_t *crv1, *crv2;
+    token_t      *rpn;
+    void         *prog;
+    double       *xs, *interp, *compiled, step, start, t_interp, t_compiled;
+    double        t_table;
+    int           i, r, mismatch;
+    
+    if ((rpn = rpn_parse(func)) == NULL)
+        fatal("failed to parse function definition '%s'", func);
+    
+    if ((prog = rpn_compile(func, rpn)) == NULL)
+        fatal("failed to compile function definition '%s'", func);
+    
+    xs       = ALLOC_ARR(double, size);
+    interp   = ALLOC_ARR(double, size);
+    compiled = ALLOC_ARR(double, size);
+    
+    if (xs == NULL || interp == NULL || compiled == NULL)
+        fatal("failed to allocate benchmark tables of size %d", size);
+    
+    step = size > 1 ? (cmax - cmin) / (size - 1) : 0.0;
+    for (i = 0; i < size; i++)
+        xs[i] = cmin + i * step;
+    
+    start = timestamp();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < size; i++)
+            interp[i] = rpn_calc(xs[i], rpn);
+    t_interp = timestamp() - start;
+
+    start = timestamp();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < size; i++)
+            compiled[i] = rpn_eval(xs[i], prog);
+    t_compiled = timestamp() - start;
+
+    mismatch = 0;
+    for (i = 0; i < size; i++) {
+        if (interp[i] != compiled[i] &&
+            !(isnan(interp[i]) && isnan(compiled[i]))) {
+            if (mismatch < 10)
+                printf("mismatch: f(%f) = %f (interpreted), %f (compiled)\n",
+                       xs[i], interp[i], compiled[i]);
+            mismatch++;
+        }
+    }
+
+    printf("function '%s', %d points, %d rounds\n", func, size, rounds);
+    printf("  interpreted: %.3f ms (%.1f ns/eval)\n", t_interp,
+           1000000.0 * t_interp / (1.0 * size * rounds));
+    printf("  compiled:    %.3f ms (%.1f ns/eval)\n", t_compiled,
+           1000000.0 * t_compiled / (1.0 * size * rounds));
+    printf("  speedup:     %.2fx\n", t_compiled > 0 ? t_interp / t_compiled : 0);
+    printf("  mismatches:  %d\n", mismatch);
+
+    start = timestamp();
+    crv1  = curve_create(func, cmin, cmax, 0, size - 1, -size, size);
+    t_table = timestamp() - start;
+    crv2  = curve_create(func, cmin, cmax, 0, size - 1, -size, size);
+
+    if (crv1 == NULL || crv2 == NULL)
+        fatal("failed to create curve '%s'", func);
+
+    printf("  table:       %.3f ms, %s\n", t_table,
+           crv1 == crv2 ? "shared" : "NOT shared");
+    
+    if (crv1 != crv2)
+        mismatch++;
+
+    curve_destroy(crv2);
+    curve_destroy(crv1);
+    
+    rpn_release(prog);
+    rpn_free(rpn);
+    FREE(xs);
+    FREE(interp);
+    FREE(compiled);
+    
+    return mismatch == 0;
+}
+
+
 int main(int argc, char *argv[])
 {
     cgrp_curve_t *crv;
@@ -204,11 +303,11 @@ int main(int argc, char *argv[])
     token_t      *rpn;
     double        cmin, cmax, x, step;
     int           imin, imax, omin, omax, i, mapped, clamped; 
-    int           opt;
+    int           opt, bench, rounds;
 
 
 
-#define OPTIONS "c:C:i:I:o:O:s:f:g:h"
+#define OPTIONS "c:C:i:I:o:O:s:f:g:b:r:h"
     struct option options[] = {
         { "cmin", required_argument, NULL, 'c' },
         { "cmax", required_argument, NULL, 'C' },
@@ -219,6 +318,8 @@ int main(int argc, char *argv[])
         { "step", required_argument, NULL, 's' },
         { "func", required_argument, NULL, 'f' },
         { "svg" , required_argument, NULL, 'g' },
+        { "bench", required_argument, NULL, 'b' },
+        { "rounds", required_argument, NULL, 'r' },
         { "help", no_argument      , NULL, 'h' },
         { NULL  , 0                , NULL,  0  }
     };
@@ -235,13 +336,16 @@ int main(int argc, char *argv[])
     omin = -17;
     omax =  15;
     svg  =  NULL;
+    bench  = 0;
+    rounds = 10;
     
     while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
         switch (opt) {
         case 'h':
             printf("%s [--cmin cmin] [--cmax cmax] [--step step] --func func\n"
                    "   [--imin imin] [--imax imax] "
-                   "[--omin omin] [--omax omax] [--svg out]\n",
+                   "[--omin omin] [--omax omax] [--svg out]\n"
+                   "   [--bench size [--rounds rounds]]\n",
                    argv[0]);
             exit(0);
             break;
@@ -302,12 +406,29 @@ int main(int argc, char *argv[])
         case 'g':
             svg = optarg;
             break;
+
+        case 'b':
+            errno = 0;
+            bench = strtoul(optarg, &end, 10);
+            if (errno != 0 || *end || bench <= 0)
+                fatal("invalid bench argument '%s'", optarg);
+            break;
+
+        case 'r':
+            errno = 0;
+            rounds = strtoul(optarg, &end, 10);
+            if (errno != 0 || *end || rounds <= 0)
+                fatal("invalid rounds argument '%s'", optarg);
+            break;
             
         default:
             fatal("unknown command line option '%c'", opt);
         }
     }
 
+    if (bench > 0)
+        exit(benchmark(func, cmin, cmax, bench, rounds) ? 0 : 1);
+
     rpn = rpn_parse(func);
     
     if (rpn == NULL)
@@ -103,6 +103,49 @@ hash_table_foreach(hash_table_t *ht, GHFunc callback, void *data)
     g_hash_table_foreach(ht, callback, data);
 }
 
+
+/********************
+ * quark_table_create
+ ********************/
+hash_table_t *
+quark_table_create(void (*value_free)(void *))
+{
+    return g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                 NULL, value_free);
+}
+
+
+/********************
+ * quark_table_insert
+ ********************/
+int
+quark_table_insert(hash_table_t *ht, GQuark key, void *value)
+{
+    g_hash_table_insert(ht, GUINT_TO_POINTER(key), value);
+    return TRUE;
+}
+
+
+/********************
+ * quark_table_lookup
+ ********************/
+void *
+quark_table_lookup(hash_table_t *ht, GQuark key)
+{
+    return g_hash_table_lookup(ht, GUINT_TO_POINTER(key));
+}
+
+
+/********************
+ * quark_table_remove
+ ********************/
+int
+quark_table_remove(hash_table_t *ht, GQuark key)
+{
+    return g_hash_table_remove(ht, GUINT_TO_POINTER(key));
+}
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
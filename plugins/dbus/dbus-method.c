@@ -24,6 +24,12 @@ USA.
 
 extern int DBG_METHOD;                         /* debug flag for methods */
 
+/*
+ * The method table of an object is keyed first by the interned interface
+ * then by the interned member. Each entry holds the handlers registered
+ * for that interface and member, at most one per signature.
+ */
+
 typedef struct {
     char         *path;                        /* object path */
     bus_t        *bus;                         /* bus this object is on */
@@ -31,11 +37,14 @@ typedef struct {
 } object_t;
 
 typedef struct {
-    char                          *interface;
-    char                          *member;
+    list_hook_t   methods;                     /* handlers by signature */
+} methlist_t;
+
+typedef struct {
     char                          *signature;
     DBusObjectPathMessageFunction  handler;
     void                          *data;
+    list_hook_t                    hook;
 } method_t;
 
 
@@ -46,6 +55,9 @@ static int       object_register(object_t *object);
 static void      object_unregister(object_t *object);
 static void      object_purge(void *);
 
+static void methlist_purge(void *);
+static void methtable_purge(void *);
+
 static void session_bus_event(bus_t *, int, void *);
 
 
@@ -117,17 +129,30 @@ method_exit(void)
 
 
 /********************
- * method_key
+ * method_quark
  ********************/
-static inline char *
-method_key(char *buf, size_t size,
-           const char *interface, const char *member, const char *signature)
+static inline int
+method_quark(const char *str, GQuark *quark)
 {
-    snprintf(buf, size, "%s.%s/%s",
-             interface ? interface : "",
-             member    ? member    : "",
-             signature ? signature : "");
-    return buf;
+    if (str == NULL) {
+        *quark = 0;
+        return TRUE;
+    }
+    else
+        return (*quark = g_quark_try_string(str)) != 0;
+}
+
+
+/********************
+ * method_same
+ ********************/
+static inline int
+method_same(method_t *method, const char *signature)
+{
+    if (method->signature == NULL || signature == NULL)
+        return method->signature == signature;
+    else
+        return !strcmp(method->signature, signature);
 }
 
 
@@ -137,15 +162,113 @@ method_key(char *buf, size_t size,
 static void
 method_purge(method_t *method)
 {
-#define MEMBER_FREE(member) if ((method)->member) FREE((method)->member)
+    if (method) {
+        FREE(method->signature);
+        FREE(method);
+    }
+}
+
+
+/********************
+ * methlist_lookup
+ ********************/
+static methlist_t *
+methlist_lookup(object_t *object, GQuark interface, GQuark member)
+{
+    hash_table_t *members;
+
+    if ((members = quark_table_lookup(object->methods, interface)) == NULL)
+        return NULL;
+    else
+        return quark_table_lookup(members, member);
+}
+
+
+/********************
+ * methlist_add
+ ********************/
+static methlist_t *
+methlist_add(object_t *object, GQuark interface, GQuark member)
+{
+    hash_table_t *members;
+    methlist_t   *methlist;
+
+    if ((members = quark_table_lookup(object->methods, interface)) == NULL) {
+        if ((members = quark_table_create(methlist_purge)) == NULL)
+            return NULL;
+        
+        if (!quark_table_insert(object->methods, interface, members)) {
+            hash_table_destroy(members);
+            return NULL;
+        }
+    }
+
+    if (ALLOC_OBJ(methlist) != NULL) {
+        list_init(&methlist->methods);
+        
+        if (quark_table_insert(members, member, methlist))
+            return methlist;
 
-    MEMBER_FREE(interface);
-    MEMBER_FREE(member);
-    MEMBER_FREE(signature);
+        FREE(methlist);
+    }
+
+    if (hash_table_empty(members))
+        quark_table_remove(object->methods, interface);
     
-    FREE(method);
+    return NULL;
+}
+
+
+/********************
+ * methlist_del
+ ********************/
+static void
+methlist_del(object_t *object, GQuark interface, GQuark member)
+{
+    hash_table_t *members;
+
+    if ((members = quark_table_lookup(object->methods, interface)) == NULL)
+        return;
+    
+    quark_table_remove(members, member);
+
+    if (hash_table_empty(members))
+        quark_table_remove(object->methods, interface);
+}
 
-#undef METHOD_FREE
+
+/********************
+ * methlist_purge
+ ********************/
+static void
+methlist_purge(void *ptr)
+{
+    methlist_t  *methlist = (methlist_t *)ptr;
+    method_t    *method;
+    list_hook_t *p, *n;
+
+    if (methlist) {
+        list_foreach(&methlist->methods, p, n) {
+            list_delete(p);
+            method = list_entry(p, method_t, hook);
+            method_purge(method);
+        }
+
+        FREE(methlist);
+    }
+}
+
+
+/********************
+ * methtable_purge
+ ********************/
+static void
+methtable_purge(void *ptr)
+{
+    hash_table_t *members = (hash_table_t *)ptr;
+
+    if (members)
+        hash_table_destroy(members);
 }
 
 
@@ -157,43 +280,48 @@ method_add(DBusBusType type, const char *path, const char *interface,
            const char *member, const char *signature,
            DBusObjectPathMessageFunction handler, void *data)
 {
-    bus_t    *bus;
-    object_t *object;
-    method_t *method;
-    char      key_buf[1024];
-    char     *key = NULL;
+    bus_t       *bus;
+    object_t    *object;
+    methlist_t  *methlist;
+    method_t    *method;
+    list_hook_t *p, *n;
+    GQuark       iq, mq;
 
     if ((bus = bus_by_type(type)) == NULL)
         return FALSE;
     
     if (ALLOC_OBJ(method) == NULL)
-        goto failed;
+        return FALSE;
 
-    method->interface = interface ? STRDUP(interface) : NULL;
-    method->member    = STRDUP(member);
+    list_init(&method->hook);
     method->signature = signature ? STRDUP(signature) : NULL;
     method->handler   = handler;
     method->data      = data;
     
-    method_key(key_buf, sizeof(key_buf), interface, member, signature);
-    key = key_buf;
+    iq = interface ? g_quark_from_string(interface) : 0;
+    mq = g_quark_from_string(member);
 
     if ((object = object_lookup(bus, path)) == NULL) {
         if ((object = object_add(bus, path)) == NULL)
             goto failed;
     }
-    else
-        if (hash_table_lookup(object->methods, key) != NULL)
+
+    if ((methlist = methlist_lookup(object, iq, mq)) == NULL) {
+        if ((methlist = methlist_add(object, iq, mq)) == NULL)
             goto failed;
-            
-    if ((key = STRDUP(key)) == NULL)
-        goto failed;
+    }
+    else {
+        list_foreach(&methlist->methods, p, n) {
+            if (method_same(list_entry(p, method_t, hook), signature))
+                goto failed;
+        }
+    }
 
-    if (!hash_table_insert(object->methods, key, method))
-        goto failed;
+    list_append(&methlist->methods, &method->hook);
     
-    OHM_DEBUG(DBG_METHOD,
-              "registered handler %p for %s:%s", handler, path, key);
+    OHM_DEBUG(DBG_METHOD, "registered handler %p for %s:%s.%s/%s", handler,
+              path, interface ? interface : "", member,
+              signature ? signature : "");
 
     return TRUE;
     
@@ -212,38 +340,57 @@ method_del(DBusBusType type, const char *path, const char *interface,
            const char *member, const char *signature,
            DBusObjectPathMessageFunction handler, void *data)
 {
-    bus_t    *bus;
-    object_t *object;
-    method_t *method;
-    char      key[1024];
+    bus_t       *bus;
+    object_t    *object;
+    methlist_t  *methlist;
+    method_t    *method;
+    list_hook_t *p, *n;
+    GQuark       iq, mq;
 
     if ((bus = bus_by_type(type)) == NULL)
         return FALSE;
 
-    method_key(key, sizeof(key), interface, member, signature);
-    
-    if ((object = object_lookup(bus, path))                == NULL ||
-        (method = hash_table_lookup(object->methods, key)) == NULL)
+    if (!method_quark(interface, &iq) || !method_quark(member, &mq))
         return FALSE;
     
-    if (method->handler != handler || method->data != data) {
-        OHM_WARNING("dbus: %s:%s has handler %p instead of %p",
-                    path, key, method->handler, handler);
+    if ((object   = object_lookup(bus, path))          == NULL ||
+        (methlist = methlist_lookup(object, iq, mq)) == NULL)
         return FALSE;
-    }
-
-    hash_table_remove(object->methods, key);
     
-    OHM_DEBUG(DBG_METHOD,
-              "unregistered handler %p for %s:%s", method->handler, path, key);
+    list_foreach(&methlist->methods, p, n) {
+        method = list_entry(p, method_t, hook);
+
+        if (!method_same(method, signature))
+            continue;
+
+        if (method->handler != handler || method->data != data) {
+            OHM_WARNING("dbus: %s:%s.%s/%s has handler %p instead of %p",
+                        path, interface ? interface : "", member,
+                        signature ? signature : "", method->handler, handler);
+            return FALSE;
+        }
 
-    if (hash_table_empty(object->methods)) {
-        OHM_DEBUG(DBG_METHOD, "object %s became empty, destroying it", path);
-        object_unregister(object);
-        object_del(object);
+        list_delete(&method->hook);
+        method_purge(method);
+
+        OHM_DEBUG(DBG_METHOD, "unregistered handler %p for %s:%s.%s/%s",
+                  handler, path, interface ? interface : "", member,
+                  signature ? signature : "");
+
+        if (list_empty(&methlist->methods))
+            methlist_del(object, iq, mq);
+        
+        if (hash_table_empty(object->methods)) {
+            OHM_DEBUG(DBG_METHOD, "object %s became empty, destroying it",
+                      path);
+            object_unregister(object);
+            object_del(object);
+        }
+
+        return TRUE;
     }
 
-    return TRUE;
+    return FALSE;
 }
 
 
@@ -253,39 +400,47 @@ method_del(DBusBusType type, const char *path, const char *interface,
 DBusHandlerResult
 method_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
 {
-    const char *path      = dbus_message_get_path(msg);
-    const char *interface = dbus_message_get_interface(msg);
-    const char *member    = dbus_message_get_member(msg);
-    const char *signature = dbus_message_get_signature(msg);
-    const char *sender    = dbus_message_get_sender(msg);
-    bus_t      *bus       = bus_by_connection(c);
-    object_t   *object    = (object_t *)data;
-    method_t   *method;
-    char        key[1024];
-
-    if (bus == NULL)
+    object_t    *object = (object_t *)data;
+    const char  *interface, *member, *signature;
+    methlist_t  *methlist;
+    method_t    *method, *match;
+    list_hook_t *p, *n;
+    GQuark       iq, mq;
+
+    interface = dbus_message_get_interface(msg);
+    member    = dbus_message_get_member(msg);
+
+    /* nothing can be registered for a name that was never interned */
+    if (!method_quark(member, &mq) || !method_quark(interface, &iq))
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     
+    if ((methlist = methlist_lookup(object, iq, mq)) == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    signature = dbus_message_get_signature(msg);
+
     OHM_DEBUG(DBG_METHOD, "got method call %s.%s(%s) for %s from %s",
-              interface, member, signature, path ? path : NULL, sender);
+              interface, member, signature, object->path,
+              dbus_message_get_sender(msg));
 
-    method_key(key, sizeof(key), interface, member, signature);
-    if ((method = hash_table_lookup(object->methods, key)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, key);
-        return method->handler(c, msg, method->data);
-    }
+    /* prefer an exact signature match over a signature-less handler */
+    match = NULL;
 
-    method_key(key, sizeof(key), interface, member, NULL);
-    if ((method = hash_table_lookup(object->methods, key)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, key);
-        return method->handler(c, msg, method->data);
+    list_foreach(&methlist->methods, p, n) {
+        method = list_entry(p, method_t, hook);
+
+        if (method->signature == NULL)
+            match = method;
+        else if (signature != NULL && !strcmp(method->signature, signature)) {
+            match = method;
+            break;
+        }
     }
 
-    if ((method = hash_table_lookup(object->methods, member)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, member);
+    if ((method = match) != NULL) {
+        OHM_DEBUG(DBG_METHOD, "routing to handler %p (%s.%s/%s)",
+                  method->handler, interface ? interface : "", member,
+                  method->signature ? method->signature : "");
         return method->handler(c, msg, method->data);
     }
 
@@ -309,7 +464,7 @@ object_add(bus_t *bus, const char *path)
     if ((object->path = STRDUP(path)) == NULL)
         goto failed;
     
-    if ((object->methods = hash_table_create(NULL, object_purge)) == NULL)
+    if ((object->methods = quark_table_create(methtable_purge)) == NULL)
         goto failed;
     
     if (!hash_table_insert(bus->objects, object->path, object))
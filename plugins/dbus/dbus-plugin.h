@@ -37,12 +37,21 @@ USA.
 
 typedef GHashTable hash_table_t;
 
+#define SIGNAL_MISS_SLOTS 16               /* must be a power of two */
+
+typedef struct {
+    GQuark          interface;             /* interface of an unmatched */
+    GQuark          member;                /*   signal, and its member */
+    int             valid;                 /* whether this slot is in use */
+} signal_miss_t;
+
 typedef struct {
     DBusBusType     type;                  /* DBUS_BUS_{SYSTEM, SESSION} */
     DBusConnection *conn;                  /* connection if it is up */
     hash_table_t   *watches;               /* watched names */
     hash_table_t   *objects;               /* exported objects */
     hash_table_t   *signals;               /* signals we listen for */
+    signal_miss_t   misses[SIGNAL_MISS_SLOTS]; /* recently unmatched signals */
     list_hook_t     notify;                /* bus event watchers */
 } bus_t;
 
@@ -121,6 +130,15 @@ int hash_table_unhash(hash_table_t *ht, const char *key);
 int hash_table_empty(hash_table_t *ht);
 void hash_table_foreach(hash_table_t *ht, GHFunc callback, void *data);
 
+/*
+ * hash tables keyed by interned strings (GQuarks)
+ */
+
+hash_table_t *quark_table_create(void (*value_free)(void *));
+int quark_table_insert(hash_table_t *ht, GQuark key, void *value);
+void *quark_table_lookup(hash_table_t *ht, GQuark key);
+int quark_table_remove(hash_table_t *ht, GQuark key);
+
 
 
 
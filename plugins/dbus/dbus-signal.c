@@ -27,11 +27,17 @@ extern int DBG_SIGNAL;                         /* debug flag for signals */
 
 
 /*
- * a list of signal handlers (with the same hash key)
+ * a list of signal handlers (for the same interface and member)
+ *
+ * Signal lists are kept in a two-level table, first by the interned
+ * interface then by the interned member, so dispatching never needs
+ * to format or hash a composite key. Handlers registered without an
+ * interface live under the 0 quark and match any interface.
  */
 
 typedef struct {
-    char        *key;                          /* signal lookup key */
+    GQuark       interface;                    /* interned interface, or 0 */
+    GQuark       member;                       /* interned member, or 0 */
     char        *rule;                         /* signal D-BUS match rule */
     list_hook_t  signals;                      /* signal handlers */
 } siglist_t;
@@ -56,10 +62,12 @@ static void signal_del_filter(bus_t *bus);
 static DBusHandlerResult signal_dispatch(DBusConnection *c, DBusMessage *msg,
                                          void *data);
 
-static siglist_t *siglist_add(bus_t *bus, const char *key, const char *rule);
+static siglist_t *siglist_add(bus_t *bus, GQuark interface, GQuark member,
+                              const char *rule);
 static int        siglist_del(bus_t *bus, siglist_t *siglist);
-static siglist_t *siglist_lookup(bus_t *bus, const char *key);
+static siglist_t *siglist_lookup(bus_t *bus, GQuark interface, GQuark member);
 static void siglist_purge(void *ptr);
+static void sigtable_purge(void *ptr);
 
 static void siglist_add_match(bus_t *bus, siglist_t *siglist);
 static void siglist_del_match(bus_t *bus, siglist_t *siglist);
@@ -78,7 +86,7 @@ signal_init(void)
     system  = bus_by_type(DBUS_BUS_SYSTEM);
 
     if (system != NULL) {
-        system->signals  = hash_table_create(NULL, siglist_purge);
+        system->signals  = quark_table_create(sigtable_purge);
         
         if (system->signals == NULL) {
             OHM_ERROR("dbus: failed to create signal tables");
@@ -97,7 +105,7 @@ signal_init(void)
     session = bus_by_type(DBUS_BUS_SESSION);
 
     if (session != NULL) {
-        session->signals = hash_table_create(NULL, siglist_purge);
+        session->signals = quark_table_create(sigtable_purge);
 
         if (session->signals == NULL) {
             OHM_ERROR("dbus: failed to create signal tables");
@@ -159,7 +167,7 @@ signal_add_filter(bus_t *bus)
     if (bus->conn == NULL)
         return FALSE;
     
-    return dbus_connection_add_filter(bus->conn, signal_dispatch, NULL, NULL);
+    return dbus_connection_add_filter(bus->conn, signal_dispatch, bus, NULL);
 }
 
 
@@ -172,21 +180,74 @@ signal_del_filter(bus_t *bus)
     if (bus == NULL || bus->conn == NULL)
         return;
     
-    dbus_connection_remove_filter(bus->conn, signal_dispatch, NULL);
+    dbus_connection_remove_filter(bus->conn, signal_dispatch, bus);
 }
 
 
 /********************
- * signal_key
+ * signal_quark
  ********************/
-static inline char *
-signal_key(char *buf, size_t size, const char *interface, const char *member)
+static inline int
+signal_quark(const char *str, GQuark *quark)
 {
-    snprintf(buf, size, "%s.%s",
-             interface ? interface : "",
-             member    ? member    : "");
+    /*
+     * Look up the interned form of str without interning it. A string
+     * we have never seen cannot have any handlers registered for it.
+     */
+
+    if (str == NULL) {
+        *quark = 0;
+        return TRUE;
+    }
+    else
+        return (*quark = g_quark_try_string(str)) != 0;
+}
+
+
+/********************
+ * signal_miss
+ ********************/
+static inline signal_miss_t *
+signal_miss(bus_t *bus, GQuark interface, GQuark member)
+{
+    return bus->misses + ((interface * 31 + member) & (SIGNAL_MISS_SLOTS - 1));
+}
+
+
+/********************
+ * signal_missed
+ ********************/
+static inline int
+signal_missed(bus_t *bus, GQuark interface, GQuark member)
+{
+    signal_miss_t *miss = signal_miss(bus, interface, member);
     
-    return buf;
+    return miss->valid &&
+        miss->interface == interface && miss->member == member;
+}
+
+
+/********************
+ * signal_miss_add
+ ********************/
+static inline void
+signal_miss_add(bus_t *bus, GQuark interface, GQuark member)
+{
+    signal_miss_t *miss = signal_miss(bus, interface, member);
+
+    miss->interface = interface;
+    miss->member    = member;
+    miss->valid     = TRUE;
+}
+
+
+/********************
+ * signal_miss_flush
+ ********************/
+static inline void
+signal_miss_flush(bus_t *bus)
+{
+    memset(bus->misses, 0, sizeof(bus->misses));
 }
 
 
@@ -268,7 +329,8 @@ signal_add(DBusBusType type, const char *path, const char *interface,
     bus_t      *bus;
     signal_t   *sig;
     siglist_t  *siglist;
-    char        key[1024], rule[1024];
+    GQuark      iq, mq;
+    char        rule[1024];
 
     if ((bus = bus_by_type(type)) == NULL)
         return FALSE;
@@ -283,11 +345,12 @@ signal_add(DBusBusType type, const char *path, const char *interface,
     sig->handler   = handler;
     sig->data      = data;
 
-    signal_key(key, sizeof(key), interface, member);
+    iq = interface ? g_quark_from_string(interface) : 0;
+    mq = member    ? g_quark_from_string(member)    : 0;
     signal_rule(rule, sizeof(rule), interface, member, path);
 
-    if ((siglist = siglist_lookup(bus, key))    == NULL &&
-        (siglist = siglist_add(bus, key, rule)) == NULL) {
+    if ((siglist = siglist_lookup(bus, iq, mq))    == NULL &&
+        (siglist = siglist_add(bus, iq, mq, rule)) == NULL) {
         signal_purge(sig);
         OHM_WARNING("dbus: error setting the signal match");
         return FALSE;
@@ -310,16 +373,17 @@ signal_del(DBusBusType type, const char *path, const char *interface,
     siglist_t   *siglist;
     signal_t    *sig;
     list_hook_t *p, *n;
-    char         key[1024];
+    GQuark       iq, mq;
 
     (void)sender;
 
     if ((bus = bus_by_type(type)) == NULL)
         return FALSE;
 
-    signal_key(key, sizeof(key), interface, member);
+    if (!signal_quark(interface, &iq) || !signal_quark(member, &mq))
+        return FALSE;
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
+    if ((siglist = siglist_lookup(bus, iq, mq)) != NULL) {
         list_foreach(&siglist->signals, p, n) {
             sig = list_entry(p, signal_t, hook);
 
@@ -340,72 +404,97 @@ signal_del(DBusBusType type, const char *path, const char *interface,
 }
 
 
+/********************
+ * siglist_dispatch
+ ********************/
+static int
+siglist_dispatch(siglist_t *siglist, DBusConnection *c, DBusMessage *msg,
+                 const char *signature, const char *path, const char *sender)
+{
+    signal_t    *sig;
+    list_hook_t *p, *n;
+    int          handled;
+
+    handled = FALSE;
+
+    list_foreach(&siglist->signals, p, n) {
+        sig = list_entry(p, signal_t, hook);
+            
+        if (signal_matches(sig, signature, path, sender)) {
+            OHM_DEBUG(DBG_SIGNAL, "routing to handler %s.%s %p",
+                      siglist->interface ?
+                      g_quark_to_string(siglist->interface) : "",
+                      g_quark_to_string(siglist->member), sig->handler);
+            
+            handled |= sig->handler(c, msg, sig->data);
+        }
+    }
+
+    return handled;
+}
+
+
 /********************
  * signal_dispatch
  ********************/
 static DBusHandlerResult
 signal_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
 {
-    const char   *path      = dbus_message_get_path(msg);
-    const char   *interface = dbus_message_get_interface(msg);
-    const char   *member    = dbus_message_get_member(msg);
-    const char   *signature = dbus_message_get_signature(msg);
-    const char   *sender    = dbus_message_get_sender(msg);
-    bus_t        *bus       = bus_by_connection(c);
-    siglist_t    *siglist;
-    signal_t     *sig;
-    
-    char          key[1024];
-    list_hook_t  *p, *n;
+    bus_t        *bus = (bus_t *)data;
+    const char   *path, *interface, *member, *signature, *sender;
+    siglist_t    *exact, *any;
+    GQuark        iq, mq;
     int           handled;
     
-    (void)data;
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    interface = dbus_message_get_interface(msg);
+    member    = dbus_message_get_member(msg);
 
-    if (bus == NULL)
+    /*
+     * Reject uninteresting signals as early and as cheaply as possible:
+     * members nobody has ever registered for are not interned at all,
+     * and recently seen unmatched interface/member pairs are cached.
+     * An unknown interface can still match handlers registered without
+     * one, so it is looked up (and cached) as the 0 quark.
+     */
+
+    if (!signal_quark(member, &mq))
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    OHM_DEBUG(DBG_SIGNAL, "got signal %s.%s(%s) from %s/%s",
-              interface, member, signature, sender, path ? path : "-");
+    if (!signal_quark(interface, &iq))
+        iq = 0;
 
-    handled = FALSE;
+    if (signal_missed(bus, iq, mq))
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     
-    signal_key(key, sizeof(key), interface, member);
+    exact = iq ? siglist_lookup(bus, iq, mq) : NULL;
+    any   = siglist_lookup(bus, 0, mq);
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
-        list_foreach(&siglist->signals, p, n) {
-            sig = list_entry(p, signal_t, hook);
-            
-            if (signal_matches(sig, signature, path, sender)) {
-                OHM_DEBUG(DBG_SIGNAL, "routing to handler %s %p",
-                          key, sig->handler);
-                
-                handled |= sig->handler(c, msg, sig->data);
-            }
-        }
+    if (exact == NULL && any == NULL) {
+        signal_miss_add(bus, iq, mq);
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
-    
-    signal_key(key, sizeof(key), NULL, member);
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
-        list_foreach(&siglist->signals, p, n) {
-            sig = list_entry(p, signal_t, hook);
-            
-            if (signal_matches(sig, signature, path, sender)) {
-                OHM_DEBUG(DBG_SIGNAL, "routing to handler %s %p",
-                          key, sig->handler);
-                
-                handled |= sig->handler(c, msg, sig->data);
-            }
-        }
-    }
+    path      = dbus_message_get_path(msg);
+    signature = dbus_message_get_signature(msg);
+    sender    = dbus_message_get_sender(msg);
+
+    OHM_DEBUG(DBG_SIGNAL, "got signal %s.%s(%s) from %s/%s",
+              interface, member, signature, sender, path ? path : "-");
+
+    handled = FALSE;
+    
+    if (exact != NULL)
+        handled |= siglist_dispatch(exact, c, msg, signature, path, sender);
+    if (any != NULL)
+        handled |= siglist_dispatch(any, c, msg, signature, path, sender);
     
     if (handled)
         OHM_DEBUG(DBG_SIGNAL, "signal was handled by some handlers");
     
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;     /* let through to others */
-    
-#undef INVOKE_HANDLER
-#undef INVOKE_MATCHING
 }
 
 
@@ -413,25 +502,43 @@ signal_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
  * siglist_add
  ********************/
 static siglist_t *
-siglist_add(bus_t *bus, const char *key, const char *rule)
+siglist_add(bus_t *bus, GQuark interface, GQuark member, const char *rule)
 {
-    siglist_t *siglist;
+    hash_table_t *members;
+    siglist_t    *siglist;
+
+    if ((members = quark_table_lookup(bus->signals, interface)) == NULL) {
+        if ((members = quark_table_create(siglist_purge)) == NULL)
+            return NULL;
+        
+        if (!quark_table_insert(bus->signals, interface, members)) {
+            hash_table_destroy(members);
+            return NULL;
+        }
+    }
 
     if (ALLOC_OBJ(siglist) == NULL)
-        return NULL;
+        goto failed;
 
     list_init(&siglist->signals);
+    siglist->interface = interface;
+    siglist->member    = member;
 
-    if ((siglist->key  = STRDUP(key))  == NULL ||
-        (siglist->rule = STRDUP(rule)) == NULL ||
-        !hash_table_insert(bus->signals, siglist->key, siglist)) {
+    if ((siglist->rule = STRDUP(rule)) == NULL ||
+        !quark_table_insert(members, member, siglist)) {
         siglist_purge(siglist);
-        return NULL;
+        goto failed;
     }
 
     siglist_add_match(bus, siglist);
+    signal_miss_flush(bus);
 
     return siglist;
+
+ failed:
+    if (hash_table_empty(members))
+        quark_table_remove(bus->signals, interface);
+    return NULL;
 }
 
 
@@ -441,8 +548,23 @@ siglist_add(bus_t *bus, const char *key, const char *rule)
 static int
 siglist_del(bus_t *bus, siglist_t *siglist)
 {
+    hash_table_t *members;
+    GQuark        interface;
+    int           removed;
+
     siglist_del_match(bus, siglist);
-    return hash_table_remove(bus->signals, siglist->key);
+
+    interface = siglist->interface;
+
+    if ((members = quark_table_lookup(bus->signals, interface)) == NULL)
+        return FALSE;
+
+    removed = quark_table_remove(members, siglist->member);
+
+    if (hash_table_empty(members))
+        quark_table_remove(bus->signals, interface);
+
+    return removed;
 }
 
 
@@ -450,9 +572,14 @@ siglist_del(bus_t *bus, siglist_t *siglist)
  * siglist_lookup
  ********************/
 static siglist_t *
-siglist_lookup(bus_t *bus, const char *key)
+siglist_lookup(bus_t *bus, GQuark interface, GQuark member)
 {
-    return hash_table_lookup(bus->signals, key);
+    hash_table_t *members;
+
+    if ((members = quark_table_lookup(bus->signals, interface)) == NULL)
+        return NULL;
+    else
+        return quark_table_lookup(members, member);
 }
 
 
@@ -473,13 +600,25 @@ siglist_purge(void *ptr)
             signal_purge(sig);
         }
 
-        FREE(siglist->key);
         FREE(siglist->rule);
         FREE(siglist);
     }
 }
 
 
+/********************
+ * sigtable_purge
+ ********************/
+static void
+sigtable_purge(void *ptr)
+{
+    hash_table_t *members = (hash_table_t *)ptr;
+
+    if (members)
+        hash_table_destroy(members);
+}
+
+
 /********************
  * siglist_add_match
  ********************/
@@ -517,6 +656,20 @@ add_match(gpointer key, gpointer value, gpointer data)
 }
 
 
+/********************
+ * add_matches
+ ********************/
+static void
+add_matches(gpointer key, gpointer value, gpointer data)
+{
+    hash_table_t *members = (hash_table_t *)value;
+
+    (void)key;
+
+    hash_table_foreach(members, add_match, data);
+}
+
+
 /********************
  * session_bus_event
  ********************/
@@ -527,7 +680,7 @@ session_bus_event(bus_t *bus, int event, void *data)
     
     if (event == BUS_EVENT_CONNECTED) {
         signal_add_filter(bus);
-        hash_table_foreach(bus->signals, add_match, bus);
+        hash_table_foreach(bus->signals, add_matches, bus);
     }
 }
 
@@ -342,16 +342,15 @@ static DBusHandlerResult
 watch_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
 {
     DBusError    err;
-    bus_t       *bus;
+    bus_t       *bus = (bus_t *)data;
     const char  *name, *previous, *current;
     watchlist_t *watchlist;
     watch_t     *watch;
     list_hook_t *p, *n;
 
-    (void)data;
+    (void)c;
 
-    if ((bus = bus_by_connection(c)) == NULL ||
-        !dbus_message_is_signal(msg,
+    if (!dbus_message_is_signal(msg,
                                 "org.freedesktop.DBus", "NameOwnerChanged"))
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     
@@ -387,7 +386,7 @@ watchlist_add_filter(bus_t *bus)
     if (bus->conn == NULL)
         return FALSE;
 
-    return dbus_connection_add_filter(bus->conn, watch_dispatch, NULL, NULL);
+    return dbus_connection_add_filter(bus->conn, watch_dispatch, bus, NULL);
 }
 
 
@@ -398,7 +397,7 @@ static void
 watchlist_del_filter(bus_t *bus)
 {
     if (bus->conn != NULL)
-        dbus_connection_remove_filter(bus->conn, watch_dispatch, NULL);
+        dbus_connection_remove_filter(bus->conn, watch_dispatch, bus);
 }
 
 
@@ -0,0 +1,197 @@
+/*
+ *  gcc -Wall `pkg-config --cflags ohm glib-2.0` \
+ *      fsif-bench.c -o fsif-bench `pkg-config --libs ohm glib-2.0`
+ *
+ *  Benchmark for the selector lookups of the factstore interface. Fills
+ *  the factstore with 10 to 10000 facts and compares the time it takes to
+ *  find them by their id with a linear scan and with the selector index,
+ *  checking on the way that both come up with the same fact.
+ */
+
+#include <stdarg.h>
+
+#include "fsif.c"
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR || level == OHM_LOG_WARNING) {
+        va_start(ap, format);
+        vfprintf(stdout, format, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+int __trace_printf(int id, const char *file, int line, const char *func,
+                   const char *format, ...)
+{
+    va_list ap;
+
+    (void)file;
+    (void)line;
+    (void)func;
+
+    if (!id)
+        return FALSE;
+
+    va_start(ap, format);
+    vfprintf(stdout, format, ap);
+    va_end(ap);
+
+    return TRUE;
+}
+
+
+/*****************************************************************************
+ *                          *** lookup benchmark ***                         *
+ *****************************************************************************/
+
+#include <getopt.h>
+
+#define fatal(fmt, args...) do {                                \
+        fprintf(stderr, "fatal error: "fmt"\n" , ## args);      \
+        exit(1);                                                \
+    } while (0)
+
+#define BENCH_FACT  "com.nokia.policy.fsif_bench"
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static void populate(int nfact)
+{
+    fsif_field_t fldlist[] = {
+        { fldtype_integer, "id"   , { .integer = 0      } },
+        { fldtype_string , "class", { .string  = "bench"} },
+        { fldtype_invalid, NULL   , { .string  = NULL   } }
+    };
+    int i;
+
+    for (i = 0;  i < nfact;  i++) {
+        fldlist[0].value.integer = i;
+
+        if (!fsif_add_factstore_entry(BENCH_FACT, fldlist))
+            fatal("failed to add fact %d", i);
+    }
+}
+
+static void depopulate(int nfact)
+{
+    fsif_field_t selist[] = {
+        { fldtype_integer, "id", { .integer = 0    } },
+        { fldtype_invalid, NULL, { .string  = NULL } }
+    };
+    int i;
+
+    for (i = 0;  i < nfact;  i++) {
+        selist[0].value.integer = i;
+
+        if (!fsif_delete_factstore_entry(BENCH_FACT, selist))
+            fatal("failed to delete fact %d", i);
+    }
+}
+
+static double lookup(int nfact, int nlookup, int indexed)
+{
+    fsif_field_t selist[] = {
+        { fldtype_integer, "id"   , { .integer = 0      } },
+        { fldtype_string , "class", { .string  = "bench"} },
+        { fldtype_invalid, NULL   , { .string  = NULL   } }
+    };
+    OhmFact *fact;
+    double   start;
+    int      i;
+
+    srand(nfact);
+    start = now();
+
+    for (i = 0;  i < nlookup;  i++) {
+        selist[0].value.integer = rand() % nfact;
+
+        if (indexed)
+            fact = find_entry(BENCH_FACT, selist);
+        else
+            fact = scan_entry(BENCH_FACT, selist);
+
+        if (fact == NULL)
+            fatal("fact %ld not found", selist[0].value.integer);
+    }
+
+    return (now() - start) / nlookup;
+}
+
+static void check(int nfact)
+{
+    fsif_field_t selist[] = {
+        { fldtype_integer, "id", { .integer = 0    } },
+        { fldtype_invalid, NULL, { .string  = NULL } }
+    };
+    int i;
+
+    for (i = 0;  i <= nfact;  i++) {
+        selist[0].value.integer = i;
+
+        if (find_entry(BENCH_FACT, selist) != scan_entry(BENCH_FACT, selist))
+            fatal("lookups disagree on fact %d", i);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    int    sizes[] = { 10, 100, 1000, 10000 };
+    int    nlookup, opt, i;
+    double scan, indexed;
+
+    nlookup = 100000;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': nlookup = atoi(optarg); break;
+        default:
+            fatal("usage: %s [-n lookups]", argv[0]);
+        }
+    }
+
+    if (nlookup <= 0)
+        fatal("invalid number of lookups");
+
+    g_type_init();
+
+    fsif_init(NULL, 0);
+
+    for (i = 0;  i < (int)(sizeof(sizes) / sizeof(sizes[0]));  i++) {
+        populate(sizes[i]);
+
+        scan    = lookup(sizes[i], nlookup, FALSE);
+        indexed = lookup(sizes[i], nlookup, TRUE);
+
+        check(sizes[i]);
+
+        printf("%5d facts: scan %.3f usecs, indexed %.3f usecs, "
+               "speedup %.1fx\n", sizes[i], scan, indexed, scan / indexed);
+
+        depopulate(sizes[i]);
+    }
+
+    fsif_exit(NULL);
+
+    return 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,1761 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*! \defgroup pubif Public Interfaces */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include <ohm/ohm-plugin-log.h>
+#include <ohm/ohm-plugin-debug.h>
+#include <ohm/ohm-fact.h>
+
+#include "fsif.h"
+
+
+typedef enum {
+    watch_unknown = 0,
+    watch_insert,
+    watch_remove,
+    watch_update
+} watch_type_e;
+
+#if (watch_insert != fact_watch_insert) || (watch_remove != fact_watch_remove)
+#error "unmatching enumerations fact_watch_insert and watch_type_e"
+#endif
+
+/*
+ * The library is shared by all the plugins of the process. The factstore
+ * listeners are set up when the first plugin initializes it and torn down
+ * together with the watches when the last one goes away.
+ */
+typedef struct fsif_client_s {
+    struct fsif_client_s  *next;
+    OhmPlugin             *plugin;
+} fsif_client_t;
+
+typedef struct watch_fact_s {
+    struct watch_fact_s   *next;
+    char                  *factname;
+    struct watch_entry_s  *entries;
+    GQuark                 factquark;
+    GHashTable            *fields;      /* update watches by field quark */
+    struct watch_entry_s  *anyfld;      /* update watches for any field */
+    struct watch_entry_s  *multi;       /* multi-field update watches */
+} watch_fact_t;
+
+typedef struct watch_entry_s {
+    struct watch_entry_s  *next;
+    struct watch_entry_s  *fnext;
+    int                    id;
+    OhmPlugin             *plugin;      /* the one that added the watch */
+    fsif_field_t          *selist;
+    char                  *fldname;
+    GQuark                 fldquark;
+    GQuark                *fldquarks;
+    union {
+        fsif_field_watch_cb_t   field_watch;
+        fsif_fields_watch_cb_t  fields_watch;
+        fsif_fact_watch_cb_t    fact_watch;
+    }                      callback;
+    void                  *usrdata;
+} watch_entry_t;
+
+/*
+ * Selector lookups are served from an index keyed by the first selector
+ * field. An index is built for a (fact name, field) pair the first time it
+ * is looked up by, and kept up to date from the factstore signals. Facts
+ * with the same key value are kept in the same bucket.
+ */
+typedef struct {
+    union {
+        long           integer;
+        unsigned long  unsignd;
+        char          *string;
+    }                  key;
+    GSList            *facts;
+} index_bucket_t;
+
+typedef struct fact_index_s {
+    struct fact_index_s  *next;
+    char                 *factname;
+    char                 *fldname;
+    GQuark                fldquark;
+    fsif_fldtype_t        type;
+    GHashTable           *buckets;      /* index_bucket_t by key */
+    GHashTable           *facts;        /* index_bucket_t by fact */
+} fact_index_t;
+
+/*
+ * Field notifications held back while a multi-field update of a fact is
+ * in progress. They are delivered together once the last field is set.
+ */
+#define BATCH_MAX  32
+
+typedef struct update_batch_s {
+    struct update_batch_s *next;
+    OhmFact               *fact;
+    int                    nfield;
+    GQuark                 fields[BATCH_MAX];
+} update_batch_t;
+
+static OhmFactStore  *fs;
+static fsif_client_t *clients;
+static int            DBG_FS;
+static GQuark         data_quark;
+static int            watch_id = 1;
+static watch_fact_t  *wfact_inserts;
+static watch_fact_t  *wfact_removes;
+static watch_fact_t  *wfact_updates;
+static fact_index_t  *fact_indices;
+static GHashTable    *update_watches;
+static GQuark         batch_quark;
+static update_batch_t *batches;
+
+static OhmFact      *find_entry(char *, fsif_field_t *);
+static int           matching_entry(OhmFact *, fsif_field_t *);
+static OhmFact      *scan_entry(char *, fsif_field_t *);
+static fact_index_t *find_index(char *, fsif_field_t *);
+static fact_index_t *create_index(char *, fsif_field_t *);
+static void          destroy_indices(void);
+static void          index_insert(fact_index_t *, OhmFact *);
+static void          index_remove(fact_index_t *, OhmFact *);
+static void          index_fact_inserted(char *, OhmFact *);
+static void          index_fact_removed(char *, OhmFact *);
+static void          index_fact_updated(char *, OhmFact *, GQuark);
+static int           get_field(OhmFact *, fsif_fldtype_t, char *, void *);
+static void          set_field(OhmFact *, fsif_fldtype_t, char *, void *);
+static watch_fact_t *find_watch(char *, watch_type_e);
+static watch_fact_t *add_update_watch(char *);
+static watch_fact_t *find_update_watch(char *);
+static int           value_to_field(GValue *, fsif_field_t *);
+static void          notify_field(watch_fact_t *, OhmFact *, char *, GQuark,
+                                  GValue *);
+static void          notify_fields(watch_fact_t *, OhmFact *, char *,
+                                   GQuark *, int);
+static update_batch_t *find_batch(OhmFact *);
+static update_batch_t *stage_field(update_batch_t *, OhmFact *, char *,GQuark);
+static void          flush_batch(update_batch_t *, char *);
+static void          unlink_batch(update_batch_t *);
+static void          free_batches(void);
+static void          remove_watches(watch_fact_t *, OhmPlugin *);
+static void          unlink_field_watch(watch_fact_t *, watch_entry_t *);
+static void          free_watch_list(watch_fact_t **);
+static void          free_watches(void);
+static fsif_field_t *copy_selector(fsif_field_t *);
+static void          free_selector(fsif_field_t *);
+#if 0
+static char        **copy_string_list(char **);
+static void          free_string_list(char **);
+#endif
+static char         *print_selector(fsif_field_t *, char *, int);
+static char         *print_value(fsif_fldtype_t, void *, char *, int);
+static void          inserted_cb(void *, OhmFact *);
+static void          removed_cb(void *, OhmFact *);
+static void          updated_cb(void *, OhmFact *, GQuark, gpointer);
+static char         *time_str(unsigned long long, char *, int);
+
+static guint         updated_id;
+static guint         inserted_id;
+static guint         removed_id;
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+void fsif_init(OhmPlugin *plugin, int dbg_fs)
+{
+    fsif_client_t *client;
+
+    for (client = clients;  client != NULL;  client = client->next) {
+        if (client->plugin == plugin)
+            return;
+    }
+
+    if ((client = malloc(sizeof(*client))) == NULL) {
+        OHM_ERROR("fsif: [%s] failed to allocate memory", __FUNCTION__);
+        return;
+    }
+
+    memset(client, 0, sizeof(*client));
+    client->plugin = plugin;
+
+    /* debug messages go under the 'fact' flag of the first plugin having it */
+    if (!DBG_FS)
+        DBG_FS = dbg_fs;
+
+    if (clients == NULL) {
+        fs = ohm_fact_store_get_fact_store();
+        batch_quark = g_quark_from_static_string("fsif-update-batch");
+        data_quark  = g_quark_from_static_string("fsif-entry-data");
+
+        updated_id  = g_signal_connect(G_OBJECT(fs), "updated" ,
+                                       G_CALLBACK(updated_cb) , NULL);
+
+        inserted_id = g_signal_connect(G_OBJECT(fs), "inserted",
+                                       G_CALLBACK(inserted_cb), NULL);
+
+        removed_id  = g_signal_connect(G_OBJECT(fs), "removed" ,
+                                       G_CALLBACK(removed_cb) , NULL);
+    }
+
+    client->next = clients;
+    clients      = client;
+}
+
+void fsif_exit(OhmPlugin *plugin)
+{
+    fsif_client_t **prev, *client;
+
+    for (prev = &clients;  (client = *prev) != NULL;  prev = &client->next) {
+        if (client->plugin == plugin) {
+            *prev = client->next;
+            free(client);
+            break;
+        }
+    }
+
+    /* the callbacks of the plugin are about to go away */
+    remove_watches(wfact_inserts, plugin);
+    remove_watches(wfact_removes, plugin);
+    remove_watches(wfact_updates, plugin);
+
+    if (client == NULL || clients != NULL)
+        return;
+
+    fs = ohm_fact_store_get_fact_store();
+
+    if (g_signal_handler_is_connected(G_OBJECT(fs), updated_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), updated_id);
+        updated_id = 0;
+    }
+    if (g_signal_handler_is_connected(G_OBJECT(fs), inserted_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), inserted_id);
+        inserted_id = 0;
+    }
+    if (g_signal_handler_is_connected(G_OBJECT(fs), removed_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), removed_id);
+        removed_id = 0;
+    }
+
+    destroy_indices();
+    free_batches();
+    free_watches();
+
+    DBG_FS = 0;
+}
+
+int fsif_add_factstore_entry(char *name, fsif_field_t *fldlist)
+{
+    return fsif_add_factstore_entry_with_data(name, fldlist, NULL);
+}
+
+int fsif_add_factstore_entry_with_data(char         *name,
+                                       fsif_field_t *fldlist,
+                                       void         *data)
+{
+    OhmFact      *fact;
+    fsif_field_t *fld;
+
+    if (!name || !fldlist) {
+        OHM_ERROR("fsif: [%s] invalid arument", __FUNCTION__);
+        return FALSE;
+    }
+
+    if ((fact = ohm_fact_new(name)) == NULL) {
+        OHM_ERROR("fsif: [%s] Can't create new fact", __FUNCTION__);
+        return FALSE;
+    }
+
+    for (fld = fldlist;   fld->type != fldtype_invalid;   fld++) {
+        set_field(fact, fld->type, fld->name, (void *)&fld->value);
+    }
+
+    /*
+     * attach the data before inserting so that insert watches can already
+     * get to it with fsif_get_entry_data()
+     */
+    if (data != NULL)
+        g_object_set_qdata(G_OBJECT(fact), data_quark, data);
+
+    if (ohm_fact_store_insert(fs, fact))
+        OHM_DEBUG(DBG_FS, "factstore entry %s created", name);
+    else {
+        OHM_ERROR("fsif: [%s] Can't add %s to factsore",
+                  __FUNCTION__, name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int fsif_delete_factstore_entry(char *name, fsif_field_t *selist)
+{
+    OhmFact *fact;
+    char     selb[256];
+    char    *selstr;
+    int      success;
+
+    selstr = print_selector(selist, selb, sizeof(selb));
+
+    if ((fact = find_entry(name, selist)) == NULL) {
+        OHM_ERROR("fsif: [%s] Failed to delete '%s%s' entry: "
+                  "no entry found", __FUNCTION__, name, selstr);
+        success = FALSE;
+    }
+    else {
+        /* the fact may outlive the owner of its data */
+        g_object_set_qdata(G_OBJECT(fact), data_quark, NULL);
+
+        ohm_fact_store_remove(fs, fact);
+
+        g_object_unref(fact);
+
+        OHM_DEBUG(DBG_FS, "factstore entry %s%s deleted", name, selstr);
+
+        success = TRUE;
+    }
+
+    return success;
+}
+
+int fsif_destroy_factstore_entry(fsif_entry_t *fact)
+{
+    char *dump;
+
+    if (fact == NULL)
+        return FALSE;
+
+    dump = ohm_structure_to_string(OHM_STRUCTURE(fact));
+
+    g_object_set_qdata(G_OBJECT(fact), data_quark, NULL);
+    ohm_fact_store_remove(fs, fact);
+    g_object_unref(fact);
+
+    OHM_DEBUG(DBG_FS, "factstore entry deleted: %s", dump);
+
+    g_free(dump);
+
+    return TRUE;
+}
+
+int fsif_update_factstore_entry(char         *name,
+                                fsif_field_t *selist,
+                                fsif_field_t *fldlist)
+{
+    OhmFact        *fact;
+    fsif_field_t   *fld;
+    fsif_field_t   *last;
+    update_batch_t *batch;
+    char            selb[256];
+    char            valb[256];
+    char           *selstr;
+    char           *valstr;
+
+    selstr = print_selector(selist, selb, sizeof(selb));
+
+    if ((fact = find_entry(name, selist)) == NULL) {
+        OHM_ERROR("fsif: [%s] Failed to update '%s%s' entry: "
+                  "no entry found", __FUNCTION__, name, selstr);
+        return FALSE;
+    }
+
+    /*
+     * an update of several fields is marked on the fact with the last field
+     * to be set, so that watchers get the changes together once it is done
+     */
+    for (last = NULL, fld = fldlist;  fld->type != fldtype_invalid;  fld++) {
+        if (fld->name == NULL || fld->type > fldtype_time) {
+            OHM_ERROR("fsif: [%s] Failed to update '%s%s' entry: "
+                      "invalid field", __FUNCTION__, name, selstr);
+            return FALSE;
+        }
+        last = fld;
+    }
+
+    if (last != NULL && last != fldlist)
+        g_object_set_qdata(G_OBJECT(fact), batch_quark,
+                           GUINT_TO_POINTER(g_quark_from_string(last->name)));
+
+    for (fld = fldlist;   fld->type != fldtype_invalid;   fld++) {
+        set_field(fact, fld->type, fld->name, (void *)&fld->value);
+
+        if (DBG_FS) {
+            valstr = print_value(fld->type, (void *)&fld->value,
+                                 valb, sizeof(valb));
+            OHM_DEBUG(DBG_FS, "factstore entry update %s%s.%s = %s",
+                      name, selstr, fld->name, valstr);
+        }
+    }
+
+    if (last != NULL && last != fldlist) {
+        g_object_set_qdata(G_OBJECT(fact), batch_quark, NULL);
+
+        /* in case the notification of the last field did not come */
+        if ((batch = find_batch(fact)) != NULL)
+            flush_batch(batch, name);
+    }
+
+    return TRUE;
+}
+
+
+fsif_entry_t *fsif_get_entry(char *name, fsif_field_t *selist)
+{
+    OhmFact *fact;
+    char    *selstr;
+    char     selb[256];
+
+    fact = find_entry(name, selist);
+
+    if (DBG_FS) {
+        selstr = print_selector(selist, selb, sizeof(selb));
+        OHM_DEBUG(DBG_FS, "factstore lookup %s%s %ssucceeded",
+                  name, selstr, fact ? "" : "not ");
+    }
+
+    return fact;
+}
+
+void fsif_get_field_by_entry(fsif_entry_t   *entry,
+                             fsif_fldtype_t  type,
+                             char           *name,
+                             void           *vptr)
+{
+    if (entry != NULL && name != NULL && vptr != NULL) {
+        get_field(entry, type, name, vptr);
+    }
+}
+
+
+void fsif_set_field_by_entry(fsif_entry_t   *entry,
+                             fsif_fldtype_t  type,
+                             char           *name,
+                             void           *vptr)
+{
+    if (entry != NULL && name != NULL && vptr != NULL)
+        set_field(entry, type, name, vptr);
+}
+
+void *fsif_get_entry_data(fsif_entry_t *entry)
+{
+    if (entry == NULL)
+        return NULL;
+
+    return g_object_get_qdata(G_OBJECT(entry), data_quark);
+}
+
+int fsif_get_field_by_name(const char     *name,
+                           fsif_fldtype_t  type,
+                           char           *field,
+                           void           *vptr)
+{
+    OhmFact *fact;
+    GSList  *list;
+
+    if (name == NULL || field == NULL || vptr == NULL)
+        return FALSE;
+    
+    list = ohm_fact_store_get_facts_by_name(fs, name);
+
+    if (g_slist_length(list) != 1)
+        return FALSE;
+
+    fact = (OhmFact *)list->data;
+    
+    return get_field(fact, type, field, vptr);
+}
+    
+
+int fsif_add_fact_watch(OhmPlugin            *plugin,
+                        char                 *factname,
+                        fsif_fact_watch_e     type,
+                        fsif_fact_watch_cb_t  callback,
+                        void                 *usrdata)
+{
+    watch_fact_t   *wfact;
+    watch_fact_t  **wfact_head;
+    watch_entry_t  *wentry;
+
+    if (!factname || !callback)
+        return -1;
+    
+    switch(type) {
+    case fact_watch_insert:    wfact_head = &wfact_inserts;    break;
+    case fact_watch_remove:    wfact_head = &wfact_removes;    break;
+    default:                   return -1;
+    }
+
+
+    if ((wfact = find_watch(factname, type)) == NULL) {
+        if ((wfact = malloc(sizeof(*wfact))) == NULL)
+            return -1;
+        else {
+            memset(wfact, 0, sizeof(*wfact));
+            wfact->next     = *wfact_head;
+            wfact->factname = strdup(factname);
+
+            *wfact_head = wfact;
+        }
+    }
+
+    if ((wentry = malloc(sizeof(*wentry))) == NULL)
+        return -1;
+    else {
+        memset(wentry, 0, sizeof(*wentry));
+        wentry->next                = wfact->entries;
+        wentry->id                  = watch_id++;
+        wentry->plugin              = plugin;
+        wentry->callback.fact_watch = callback;
+        wentry->usrdata             = usrdata;
+        
+        wfact->entries = wentry;
+    }
+
+    OHM_DEBUG(DBG_FS, "fact watch point %d added for '%s'",
+              wentry->id, factname);
+
+    return wentry->id;
+}
+
+int fsif_add_field_watch(OhmPlugin             *plugin,
+                         char                  *factname,
+                         fsif_field_t          *selist,
+                         char                  *fldname,
+                         fsif_field_watch_cb_t  callback,
+                         void                  *usrdata)
+{
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+
+    if (!factname || !callback)
+        return -1;
+
+    if ((wfact = add_update_watch(factname)) == NULL)
+        return -1;
+
+    if ((wentry = malloc(sizeof(*wentry))) == NULL)
+        return -1;
+    else {
+        memset(wentry, 0, sizeof(*wentry));
+        wentry->next                 = wfact->entries;
+        wentry->id                   = watch_id++;
+        wentry->plugin               = plugin;
+        wentry->selist               = copy_selector(selist);
+        wentry->fldname              = fldname ? strdup(fldname) : NULL;
+        wentry->fldquark             = fldname?g_quark_from_string(fldname):0;
+        wentry->callback.field_watch = callback;
+        wentry->usrdata              = usrdata;
+        
+        wfact->entries = wentry;
+
+        if (wentry->fldquark) {
+            wentry->fnext = g_hash_table_lookup(wfact->fields,
+                                        GUINT_TO_POINTER(wentry->fldquark));
+            g_hash_table_insert(wfact->fields,
+                                GUINT_TO_POINTER(wentry->fldquark), wentry);
+        }
+        else {
+            wentry->fnext = wfact->anyfld;
+            wfact->anyfld = wentry;
+        }
+    }
+
+    OHM_DEBUG(DBG_FS, "field watch point %d added for '%s%s%s'", wentry->id,
+              factname, fldname?":":"", fldname?fldname:"");
+
+    return wentry->id;
+}
+
+int fsif_add_fields_watch(OhmPlugin              *plugin,
+                          char                   *factname,
+                          fsif_field_t           *selist,
+                          char                  **fldnames,
+                          fsif_fields_watch_cb_t  callback,
+                          void                   *usrdata)
+{
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    int            n;
+
+    if (!factname || !callback)
+        return -1;
+
+    if ((wfact = add_update_watch(factname)) == NULL)
+        return -1;
+
+    if ((wentry = malloc(sizeof(*wentry))) == NULL)
+        return -1;
+    else {
+        memset(wentry, 0, sizeof(*wentry));
+        wentry->id                    = watch_id++;
+        wentry->plugin                = plugin;
+        wentry->selist                = copy_selector(selist);
+        wentry->callback.fields_watch = callback;
+        wentry->usrdata               = usrdata;
+
+        if (fldnames != NULL) {
+            for (n = 0;  fldnames[n] != NULL;  n++)
+                ;
+
+            wentry->fldquarks = g_new0(GQuark, n + 1);
+
+            for (n = 0;  fldnames[n] != NULL;  n++)
+                wentry->fldquarks[n] = g_quark_from_string(fldnames[n]);
+        }
+
+        wentry->fnext = wfact->multi;
+        wfact->multi  = wentry;
+    }
+
+    OHM_DEBUG(DBG_FS, "multi-field watch point %d added for '%s'",
+              wentry->id, factname);
+
+    return wentry->id;
+}
+
+/*!
+ * @}
+ */
+
+
+static OhmFact *find_entry(char *name, fsif_field_t *selist)
+{
+    fact_index_t   *index;
+    index_bucket_t *bucket;
+    GSList         *list;
+    OhmFact        *fact;
+    gconstpointer   key;
+
+    if ((index = find_index(name, selist)) == NULL)
+        return scan_entry(name, selist);
+
+    switch (index->type) {
+    case fldtype_string:   key =  selist->value.string;  break;
+    case fldtype_integer:  key = &selist->value.integer; break;
+    case fldtype_unsignd:  key = &selist->value.unsignd; break;
+    default:               return scan_entry(name, selist);
+    }
+
+    if (key == NULL || (bucket = g_hash_table_lookup(index->buckets, key)) == NULL)
+        return NULL;
+
+    for (list = bucket->facts;  list != NULL;  list = g_slist_next(list)) {
+        fact = (OhmFact *)list->data;
+
+        if (matching_entry(fact, selist + 1))
+            return fact;
+    }
+
+    return NULL;
+}
+
+static OhmFact *scan_entry(char *name, fsif_field_t *selist)
+{
+    OhmFact            *fact;
+    GSList             *list;
+
+    for (list  = ohm_fact_store_get_facts_by_name(fs, name);
+         list != NULL;
+         list  = g_slist_next(list))
+    {
+        fact = (OhmFact *)list->data;
+
+        if (matching_entry(fact, selist))
+            return fact;
+    }
+
+
+    return NULL;
+}
+
+static int matching_entry(OhmFact *fact, fsif_field_t *selist)
+{
+    fsif_field_t       *se;
+    char               *strval;
+    long                intval;
+    unsigned long       unsval;
+    double              fltval;
+    unsigned long long  timeval;
+
+    if (selist == NULL)
+        return TRUE;
+
+    for (se = selist;   se->type != fldtype_invalid;   se++) {
+        switch (se->type) {
+                        
+        case fldtype_string:
+            get_field(fact, fldtype_string, se->name, &strval);
+            if (strval == NULL || strcmp(strval, se->value.string))
+                return FALSE;
+            break;
+                
+        case fldtype_integer:
+            get_field(fact, fldtype_integer, se->name, &intval);
+            if (intval != se->value.integer)
+                return FALSE;
+            break;
+            
+        case fldtype_unsignd:
+            get_field(fact, fldtype_unsignd, se->name, &unsval);
+            if (unsval != se->value.unsignd)
+                return FALSE;
+            break;
+            
+        case fldtype_floating:
+            get_field(fact, fldtype_floating, se->name, &fltval);
+            if (fltval != se->value.floating)
+                return FALSE;
+            break;
+            
+        case fldtype_time:
+            get_field(fact, fldtype_time, se->name, &timeval);
+            if (timeval != se->value.time)
+                return FALSE;
+            break;
+            
+        default:
+            return FALSE;
+        } /* switch type */
+    } /* for se */
+
+    return TRUE;
+}
+
+static guint index_hash_long(gconstpointer key)
+{
+    unsigned long value = *(const unsigned long *)key;
+
+    return (guint)(value ^ (value >> 31));
+}
+
+static gboolean index_equal_long(gconstpointer a, gconstpointer b)
+{
+    return *(const unsigned long *)a == *(const unsigned long *)b;
+}
+
+static void index_free_bucket(gpointer data)
+{
+    index_bucket_t *bucket = (index_bucket_t *)data;
+
+    g_slist_free(bucket->facts);
+    g_free(bucket);
+}
+
+static void index_free_string_bucket(gpointer data)
+{
+    index_bucket_t *bucket = (index_bucket_t *)data;
+
+    g_free(bucket->key.string);
+    index_free_bucket(data);
+}
+
+static fact_index_t *find_index(char *name, fsif_field_t *selist)
+{
+    fact_index_t *index;
+
+    if (selist == NULL || selist->name == NULL)
+        return NULL;
+
+    switch (selist->type) {
+    case fldtype_string:
+    case fldtype_integer:
+    case fldtype_unsignd:
+        break;
+    default:
+        return NULL;
+    }
+
+    for (index = fact_indices;  index != NULL;  index = index->next) {
+        if (index->type == selist->type             &&
+            !strcmp(index->fldname, selist->name)   &&
+            !strcmp(index->factname, name))
+            return index;
+    }
+
+    return create_index(name, selist);
+}
+
+static fact_index_t *create_index(char *name, fsif_field_t *selist)
+{
+    fact_index_t *index;
+    GSList       *list;
+
+    index = g_new0(fact_index_t, 1);
+
+    index->factname = g_strdup(name);
+    index->fldname  = g_strdup(selist->name);
+    index->fldquark = g_quark_from_string(selist->name);
+    index->type     = selist->type;
+    index->facts    = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (index->type == fldtype_string)
+        index->buckets = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               NULL, index_free_string_bucket);
+    else
+        index->buckets = g_hash_table_new_full(index_hash_long,
+                                               index_equal_long,
+                                               NULL, index_free_bucket);
+
+    for (list  = ohm_fact_store_get_facts_by_name(fs, name);
+         list != NULL;
+         list  = g_slist_next(list))
+    {
+        index_insert(index, (OhmFact *)list->data);
+    }
+
+    index->next  = fact_indices;
+    fact_indices = index;
+
+    OHM_DEBUG(DBG_FS, "created index for %s by %s", name, selist->name);
+
+    return index;
+}
+
+static void destroy_indices(void)
+{
+    fact_index_t *index;
+
+    while ((index = fact_indices) != NULL) {
+        fact_indices = index->next;
+
+        g_hash_table_destroy(index->facts);
+        g_hash_table_destroy(index->buckets);
+        g_free(index->factname);
+        g_free(index->fldname);
+        g_free(index);
+    }
+}
+
+static void index_insert(fact_index_t *index, OhmFact *fact)
+{
+    index_bucket_t *bucket;
+    GValue         *gv;
+    GType           type;
+    unsigned long   value;
+    gconstpointer   key;
+
+    if (g_hash_table_lookup(index->facts, fact) != NULL)
+        return;
+
+    /*
+     * facts without a usable key field are indexed the way matching_entry()
+     * would see them: never matching a string and matching 0 otherwise
+     */
+    gv    = ohm_fact_get(fact, index->fldname);
+    type  = gv ? G_VALUE_TYPE(gv) : G_TYPE_INVALID;
+    value = 0;
+
+    switch (index->type) {
+
+    case fldtype_string:
+        if (type != G_TYPE_STRING || (key = g_value_get_string(gv)) == NULL)
+            return;
+        break;
+
+    case fldtype_integer:
+        if (type == G_TYPE_LONG)
+            value = (unsigned long)g_value_get_long(gv);
+        else if (type == G_TYPE_INT)
+            value = (unsigned long)(long)g_value_get_int(gv);
+        key = &value;
+        break;
+
+    case fldtype_unsignd:
+        if (type == G_TYPE_ULONG)
+            value = g_value_get_ulong(gv);
+        key = &value;
+        break;
+
+    default:
+        return;
+    }
+
+    if ((bucket = g_hash_table_lookup(index->buckets, key)) == NULL) {
+        bucket = g_new0(index_bucket_t, 1);
+
+        if (index->type == fldtype_string) {
+            bucket->key.string = g_strdup((const char *)key);
+            g_hash_table_insert(index->buckets, bucket->key.string, bucket);
+        }
+        else {
+            bucket->key.unsignd = value;
+            g_hash_table_insert(index->buckets, &bucket->key.unsignd, bucket);
+        }
+    }
+
+    bucket->facts = g_slist_prepend(bucket->facts, fact);
+    g_hash_table_insert(index->facts, fact, bucket);
+}
+
+static void index_remove(fact_index_t *index, OhmFact *fact)
+{
+    index_bucket_t *bucket;
+
+    if ((bucket = g_hash_table_lookup(index->facts, fact)) == NULL)
+        return;
+
+    g_hash_table_remove(index->facts, fact);
+
+    if ((bucket->facts = g_slist_remove(bucket->facts, fact)) == NULL) {
+        if (index->type == fldtype_string)
+            g_hash_table_remove(index->buckets, bucket->key.string);
+        else
+            g_hash_table_remove(index->buckets, &bucket->key.unsignd);
+    }
+}
+
+static void index_fact_inserted(char *name, OhmFact *fact)
+{
+    fact_index_t *index;
+
+    for (index = fact_indices;  index != NULL;  index = index->next) {
+        if (!strcmp(index->factname, name))
+            index_insert(index, fact);
+    }
+}
+
+static void index_fact_removed(char *name, OhmFact *fact)
+{
+    fact_index_t *index;
+
+    for (index = fact_indices;  index != NULL;  index = index->next) {
+        if (!strcmp(index->factname, name))
+            index_remove(index, fact);
+    }
+}
+
+static void index_fact_updated(char *name, OhmFact *fact, GQuark fldquark)
+{
+    fact_index_t *index;
+
+    for (index = fact_indices;  index != NULL;  index = index->next) {
+        if (index->fldquark == fldquark && !strcmp(index->factname, name)) {
+            index_remove(index, fact);
+            index_insert(index, fact);
+        }
+    }
+}
+
+static int get_field(OhmFact *fact, fsif_fldtype_t type,char *name,void *vptr)
+{
+    GValue  *gv;
+
+    if (!fact || !name || !(gv = ohm_fact_get(fact, name))) {
+        OHM_ERROR("fsif: [%s] Cant find field %s",
+                  __FUNCTION__, name?name:"<null>");
+        goto return_empty_value;
+    }
+
+    switch (type) {
+
+    case fldtype_string:
+        if (G_VALUE_TYPE(gv) != G_TYPE_STRING)
+            goto type_mismatch;
+        else
+            *(const char **)vptr = g_value_get_string(gv);
+        break;
+
+    case fldtype_integer:
+        switch (G_VALUE_TYPE(gv)) {
+        case G_TYPE_LONG: *(long *)vptr = g_value_get_long(gv); break;
+        case G_TYPE_INT:  *(long *)vptr = g_value_get_int(gv);  break;
+        default:          goto type_mismatch;
+        }
+        break;
+
+    case fldtype_unsignd:
+        if (G_VALUE_TYPE(gv) != G_TYPE_ULONG)
+            goto type_mismatch;
+        else
+            *(unsigned long *)vptr = g_value_get_ulong(gv);
+        break;
+
+    case fldtype_floating:
+        if (G_VALUE_TYPE(gv) != G_TYPE_DOUBLE)
+            goto type_mismatch;
+        else
+            *(double *)vptr = g_value_get_double(gv);
+        break;
+
+    case fldtype_time:
+        if (G_VALUE_TYPE(gv) != G_TYPE_UINT64)
+            goto type_mismatch;
+        else
+            *(time_t *)vptr = g_value_get_uint64(gv);
+        break;
+
+    default:
+        break;
+    }
+
+    return TRUE;
+
+ type_mismatch:
+    OHM_ERROR("fsif: [%s] Type mismatch when fetching field '%s'",
+              __FUNCTION__,name);
+
+ return_empty_value:
+    switch (type) {
+    case fldtype_string:      *(char              **)vptr = NULL;       break;
+    case fldtype_integer:     *(long               *)vptr = 0;          break;
+    case fldtype_unsignd:     *(unsigned long      *)vptr = 0;          break;
+    case fldtype_floating:    *(double             *)vptr = 0.0;        break;
+    case fldtype_time:        *(unsigned long long *)vptr = 0ULL;       break;
+    default:                                                            break;
+    }
+
+    return FALSE;
+} 
+
+static void set_field(OhmFact *fact, fsif_fldtype_t type,char *name,void *vptr)
+{
+    fsif_value_t *v = (fsif_value_t *)vptr;
+    GValue       *gv;
+
+    switch (type) {
+    case fldtype_string:    gv = ohm_value_from_string(v->string);      break;
+    case fldtype_integer:   gv = ohm_value_from_int(v->integer);        break;
+    case fldtype_unsignd:   gv = ohm_value_from_unsigned(v->unsignd);   break;
+    case fldtype_floating:  gv = ohm_value_from_double(v->floating);    break;
+    case fldtype_time:      gv = ohm_value_from_time(v->time);          break;
+    default:          OHM_ERROR("fsif: invalid type for %s", name); return;
+    }
+
+    ohm_fact_set(fact, name, gv);
+}
+
+static watch_fact_t *add_update_watch(char *factname)
+{
+    watch_fact_t *wfact;
+
+    if ((wfact = find_watch(factname, watch_update)) == NULL) {
+        if ((wfact = malloc(sizeof(*wfact))) == NULL)
+            return NULL;
+        else {
+            memset(wfact, 0, sizeof(*wfact));
+            wfact->next      = wfact_updates;
+            wfact->factname  = strdup(factname);
+            wfact->factquark = g_quark_from_string(factname);
+            wfact->fields    = g_hash_table_new(g_direct_hash,g_direct_equal);
+
+            wfact_updates = wfact;
+
+            if (update_watches == NULL)
+                update_watches = g_hash_table_new(g_direct_hash,
+                                                  g_direct_equal);
+
+            g_hash_table_insert(update_watches,
+                                GUINT_TO_POINTER(wfact->factquark), wfact);
+        }
+    }
+
+    return wfact;
+}
+
+static watch_fact_t *find_watch(char *name, watch_type_e type)
+{
+    watch_fact_t *wfact;
+
+    if (name != NULL) {
+
+        switch (type) {
+        case watch_insert:   wfact = wfact_inserts;   break;
+        case watch_remove:   wfact = wfact_removes;   break;
+        case watch_update:   wfact = wfact_updates;   break;
+        default:             return NULL;
+        }
+
+        while (wfact != NULL) {
+
+            if (!strcmp(name, wfact->factname))
+                return wfact;
+
+            wfact = wfact->next;
+        }
+    }
+
+    return NULL;
+}
+
+
+static fsif_field_t *copy_selector(fsif_field_t *selist)
+{
+    fsif_field_t  *cplist;
+    fsif_field_t  *last;
+    fsif_field_t  *se;
+    fsif_field_t  *cp;
+    int            dim;
+    int            len;
+
+    if (selist == NULL)
+        cplist = NULL;
+    else {
+        for (last = selist;  last->type != fldtype_invalid;  last++)
+            ;
+        
+        dim = (last - selist) + 1;
+        len = dim * sizeof(fsif_field_t);
+        
+        if ((cplist = malloc(len)) != NULL) {
+            memset(cplist, 0, len);
+            
+            for (se = selist, cp = cplist;    se < last;    se++, cp++) {
+                cp->type = se->type;
+                cp->name = strdup(se->name);
+                
+                switch (se->type) {
+                    
+                case fldtype_string:
+                    cp->value.string = strdup(se->value.string);
+                    break;
+                    
+                case fldtype_integer:
+                    cp->value.integer = se->value.integer;
+                    break;
+                    
+                case fldtype_unsignd:
+                    cp->value.unsignd = se->value.unsignd;
+                    break;
+                    
+                case fldtype_floating:
+                    cp->value.floating = se->value.floating;
+                    break;
+                    
+                case fldtype_time:
+                    cp->value.time = se->value.time;
+                    break;
+                    
+                default:
+                    OHM_ERROR("fsif: [%s] unsupported type", __FUNCTION__);
+                    memset(&cp->value, 0, sizeof(cp->value));
+                    break;
+                } /* switch */
+            } /* for */
+        }
+    }
+
+    return cplist;
+}
+
+static void free_selector(fsif_field_t *selist)
+{
+    fsif_field_t  *se;
+
+    if (selist != NULL) {
+        for (se = selist;  se->type != fldtype_invalid;  se++) {
+            free(se->name);
+
+            switch(se->type) {
+
+            case fldtype_string:
+                free(se->value.string);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        free(selist);
+    }
+}
+
+#if 0
+static char **copy_string_list(char **inplist)
+{
+    char **outlist;
+    int    i;
+
+    for (i = 0;  inplist[i];  i++)
+        ;
+
+    if ((outlist = calloc(i + 1,  sizeof(char *))) != NULL) {
+        for (i = 0;  inplist[i];  i++) {
+            outlist[i] = strdup(inplist[i]);
+        }
+    }
+
+    return outlist;
+}
+
+
+static void  free_string_list(char **list)
+{
+    int i;
+
+    if (list != NULL) {
+        for (i = 0;  list[i];  i++)
+            free(list[i]);
+
+        free(list);
+    }
+}
+
+#endif
+
+static char *print_selector(fsif_field_t *selist, char *buf, int len)
+{
+    fsif_field_t *se;
+    fsif_value_t *v;
+    char         *p, *e, *c;
+    char         *val;
+    char          vb[64];
+
+    if (!selist || !buf || len < 3)
+        return "";
+
+    e = (p = buf) + len - 2;
+
+    p += snprintf(p, e-p, "[");
+
+    for (se = selist, c = "";
+         se->type != fldtype_invalid && p < e;
+         se++, c = ", ")
+    {
+        v = &se->value;
+
+        switch (se->type) {
+        case fldtype_string:   val = v->string;                         break;
+        case fldtype_integer:  val = vb; sprintf(vb,"%ld",v->integer);  break;
+        case fldtype_unsignd:  val = vb; sprintf(vb,"%lu",v->unsignd);  break;
+        case fldtype_floating: val = vb; sprintf(vb,"%lf",v->floating); break;
+        case fldtype_time:     val = time_str(v->time,vb,sizeof(vb));   break;
+        default:               val = "???";                             break;
+        }
+
+        p += snprintf(p, e-p, "%s%s:%s", c, se->name, val);
+    }
+
+    p += snprintf(p, (buf + len) - p, "]");
+
+    return buf;
+}
+
+static char *print_value(fsif_fldtype_t type, void *vptr, char *buf, int len)
+{
+    fsif_value_t *v = (fsif_value_t *)vptr;
+    char         *s;
+
+    if (!buf || !v || len <= 0)
+        return "";
+
+    switch (type) {
+    case fldtype_string:   s = v->string;                                break;
+    case fldtype_integer:  s = buf; snprintf(buf,len,"%ld",v->integer);  break;
+    case fldtype_unsignd:  s = buf; snprintf(buf,len,"%lu",v->unsignd);  break;
+    case fldtype_floating: s = buf; snprintf(buf,len,"%lf",v->floating); break;
+    case fldtype_time:     s = time_str(v->time,buf,len);                break;
+    default:               s = "???";                                    break;
+    }
+
+    return s;
+}
+
+static watch_fact_t *find_update_watch(char *name)
+{
+    GQuark factquark;
+
+    if (update_watches == NULL || (factquark = g_quark_try_string(name)) == 0)
+        return NULL;
+
+    return g_hash_table_lookup(update_watches, GUINT_TO_POINTER(factquark));
+}
+
+static int value_to_field(GValue *gval, fsif_field_t *fld)
+{
+    switch (G_VALUE_TYPE(gval)) {
+
+    case G_TYPE_STRING:
+        fld->type = fldtype_string;
+        fld->value.string = (char *)g_value_get_string(gval);
+        break;
+
+    case G_TYPE_LONG:
+        fld->type = fldtype_integer;
+        fld->value.integer = g_value_get_long(gval);
+        break;
+
+    case G_TYPE_INT:
+        fld->type = fldtype_integer;
+        fld->value.integer = g_value_get_int(gval);
+        break;
+
+    case G_TYPE_ULONG:
+        fld->type = fldtype_unsignd;
+        fld->value.unsignd = g_value_get_ulong(gval);
+        break;
+
+    case G_TYPE_DOUBLE:
+        fld->type = fldtype_floating;
+        fld->value.floating = g_value_get_double(gval);
+        break;
+
+    case G_TYPE_UINT64:
+        fld->type = fldtype_time;
+        fld->value.time = g_value_get_uint64(gval);
+        break;
+
+    default:
+        OHM_ERROR("fsif: [%s] Unsupported data type (%d) "
+                  "for field '%s'",
+                  __FUNCTION__, G_VALUE_TYPE(gval), fld->name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void notify_field(watch_fact_t *wfact,
+                         OhmFact      *fact,
+                         char         *name,
+                         GQuark        fldquark,
+                         GValue       *gval)
+{
+    watch_entry_t *fw, *aw, *wentry;
+    fsif_field_t   fld;
+    char           valb[256];
+    char          *valstr;
+
+    fw = g_hash_table_lookup(wfact->fields, GUINT_TO_POINTER(fldquark));
+    aw = wfact->anyfld;
+
+    if (fw == NULL && aw == NULL)
+        return;
+
+    fld.name = (char *)g_quark_to_string(fldquark);
+
+    if (!value_to_field(gval, &fld))
+        return;
+
+    if (DBG_FS) {
+        valstr = print_value(fld.type, (void *)&fld.value, valb, sizeof(valb));
+        OHM_DEBUG(DBG_FS, "field watch point: field '%s:%s' changed to '%s'",
+                  name, fld.name, valstr);
+    }
+
+    /*
+     * the watches of the field and the ones for any field are both kept
+     * latest first; merge them so that every matching one is notified
+     * in the same order as they would be from a single list
+     */
+    while (fw != NULL || aw != NULL) {
+        if (aw == NULL || (fw != NULL && fw->id > aw->id)) {
+            wentry = fw;
+            fw     = fw->fnext;
+        }
+        else {
+            wentry = aw;
+            aw     = aw->fnext;
+        }
+
+        if (matching_entry(fact, wentry->selist))
+            wentry->callback.field_watch(fact, name, &fld, wentry->usrdata);
+    }
+}
+
+static void notify_fields(watch_fact_t *wfact,
+                          OhmFact      *fact,
+                          char         *name,
+                          GQuark       *fields,
+                          int           nfield)
+{
+    watch_entry_t *wentry;
+    fsif_field_t   changed[BATCH_MAX + 1];
+    GValue        *gval;
+    GQuark        *q;
+    int            i, n;
+
+    for (wentry = wfact->multi;  wentry != NULL;  wentry = wentry->fnext) {
+        if (!matching_entry(fact, wentry->selist))
+            continue;
+
+        for (i = n = 0;  i < nfield;  i++) {
+            if (wentry->fldquarks != NULL) {
+                for (q = wentry->fldquarks;  *q && *q != fields[i];  q++)
+                    ;
+                if (!*q)
+                    continue;
+            }
+
+            changed[n].name = (char *)g_quark_to_string(fields[i]);
+
+            if ((gval = ohm_fact_get(fact, changed[n].name)) != NULL &&
+                value_to_field(gval, changed + n))
+                n++;
+        }
+
+        if (n > 0) {
+            OHM_DEBUG(DBG_FS, "field watch point: %d field%s of '%s' changed",
+                      n, n == 1 ? "" : "s", name);
+
+            changed[n].type = fldtype_invalid;
+            changed[n].name = NULL;
+
+            wentry->callback.fields_watch(fact, name, changed,wentry->usrdata);
+        }
+    }
+}
+
+static update_batch_t *find_batch(OhmFact *fact)
+{
+    update_batch_t *batch;
+
+    for (batch = batches;  batch != NULL;  batch = batch->next) {
+        if (batch->fact == fact)
+            return batch;
+    }
+
+    return NULL;
+}
+
+static update_batch_t *stage_field(update_batch_t *batch,
+                                   OhmFact        *fact,
+                                   char           *name,
+                                   GQuark          fldquark)
+{
+    int i;
+
+    if (batch == NULL) {
+        batch = g_new0(update_batch_t, 1);
+        batch->fact = fact;
+        batch->next = batches;
+        batches     = batch;
+    }
+
+    for (i = 0;  i < batch->nfield;  i++) {
+        if (batch->fields[i] == fldquark)
+            return batch;
+    }
+
+    if (batch->nfield >= BATCH_MAX) {
+        flush_batch(batch, name);
+        return stage_field(NULL, fact, name, fldquark);
+    }
+
+    batch->fields[batch->nfield++] = fldquark;
+
+    return batch;
+}
+
+static void flush_batch(update_batch_t *batch, char *name)
+{
+    watch_fact_t *wfact;
+    OhmFact      *fact = batch->fact;
+    GValue       *gval;
+    int           i;
+
+    unlink_batch(batch);
+
+    if ((wfact = find_update_watch(name)) != NULL) {
+        g_object_ref(fact);
+
+        for (i = 0;  i < batch->nfield;  i++) {
+            gval = ohm_fact_get(fact, g_quark_to_string(batch->fields[i]));
+
+            if (gval != NULL)
+                notify_field(wfact, fact, name, batch->fields[i], gval);
+        }
+
+        notify_fields(wfact, fact, name, batch->fields, batch->nfield);
+
+        g_object_unref(fact);
+    }
+
+    g_free(batch);
+}
+
+static void unlink_batch(update_batch_t *batch)
+{
+    update_batch_t **prev;
+
+    for (prev = &batches;  *prev != NULL;  prev = &(*prev)->next) {
+        if (*prev == batch) {
+            *prev = batch->next;
+            break;
+        }
+    }
+}
+
+static void remove_watches(watch_fact_t *wfact, OhmPlugin *plugin)
+{
+    watch_entry_t **prev, *wentry;
+
+    for ( ;  wfact != NULL;  wfact = wfact->next) {
+        prev = &wfact->entries;
+
+        while ((wentry = *prev) != NULL) {
+            if (wentry->plugin != plugin) {
+                prev = &wentry->next;
+                continue;
+            }
+
+            *prev = wentry->next;
+
+            if (wfact->fields != NULL)
+                unlink_field_watch(wfact, wentry);
+
+            OHM_DEBUG(DBG_FS, "watch point %d for '%s' removed",
+                      wentry->id, wfact->factname);
+
+            free_selector(wentry->selist);
+            free(wentry->fldname);
+            free(wentry);
+        }
+
+        prev = &wfact->multi;
+
+        while ((wentry = *prev) != NULL) {
+            if (wentry->plugin != plugin) {
+                prev = &wentry->fnext;
+                continue;
+            }
+
+            *prev = wentry->fnext;
+
+            OHM_DEBUG(DBG_FS, "watch point %d for '%s' removed",
+                      wentry->id, wfact->factname);
+
+            free_selector(wentry->selist);
+            g_free(wentry->fldquarks);
+            free(wentry);
+        }
+    }
+}
+
+static void unlink_field_watch(watch_fact_t *wfact, watch_entry_t *wentry)
+{
+    watch_entry_t **prev, *head;
+    gpointer        key;
+
+    if (!wentry->fldquark) {
+        for (prev = &wfact->anyfld;  *prev != NULL;  prev = &(*prev)->fnext) {
+            if (*prev == wentry) {
+                *prev = wentry->fnext;
+                break;
+            }
+        }
+        return;
+    }
+
+    key  = GUINT_TO_POINTER(wentry->fldquark);
+    head = g_hash_table_lookup(wfact->fields, key);
+
+    for (prev = &head;  *prev != NULL;  prev = &(*prev)->fnext) {
+        if (*prev == wentry) {
+            *prev = wentry->fnext;
+            break;
+        }
+    }
+
+    if (head != NULL)
+        g_hash_table_insert(wfact->fields, key, head);
+    else
+        g_hash_table_remove(wfact->fields, key);
+}
+
+static void free_watch_list(watch_fact_t **list)
+{
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+
+    while ((wfact = *list) != NULL) {
+        *list = wfact->next;
+
+        while ((wentry = wfact->entries) != NULL) {
+            wfact->entries = wentry->next;
+            free_selector(wentry->selist);
+            free(wentry->fldname);
+            free(wentry);
+        }
+
+        while ((wentry = wfact->multi) != NULL) {
+            wfact->multi = wentry->fnext;
+            free_selector(wentry->selist);
+            g_free(wentry->fldquarks);
+            free(wentry);
+        }
+
+        if (wfact->fields != NULL)
+            g_hash_table_destroy(wfact->fields);
+
+        free(wfact->factname);
+        free(wfact);
+    }
+}
+
+static void free_watches(void)
+{
+    free_watch_list(&wfact_inserts);
+    free_watch_list(&wfact_removes);
+    free_watch_list(&wfact_updates);
+
+    if (update_watches != NULL) {
+        g_hash_table_destroy(update_watches);
+        update_watches = NULL;
+    }
+}
+
+static void free_batches(void)
+{
+    update_batch_t *batch;
+
+    while ((batch = batches) != NULL) {
+        batches = batch->next;
+        g_free(batch);
+    }
+}
+
+static void inserted_cb(void *data, OhmFact *fact)
+{
+    (void)data;
+
+    char          *name;
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    
+    if (fact == NULL) {
+        OHM_ERROR("fsif: %s() called with null fact pointer",__FUNCTION__);
+        return;
+    }
+        
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    index_fact_inserted(name, fact);
+
+    if ((wfact = find_watch(name, watch_insert)) != NULL) {
+
+        OHM_DEBUG(DBG_FS, "fact watch point: fact '%s' inserted", name);
+
+        for (wentry = wfact->entries;  wentry != NULL;  wentry = wentry->next){
+
+            wentry->callback.fact_watch(fact, name, fact_watch_insert,
+                                        wentry->usrdata); 
+        } /* for */
+    } /* if find_watch */
+}
+
+static void removed_cb(void *data, OhmFact *fact)
+{
+    (void)data;
+
+    char           *name;
+    watch_fact_t   *wfact;
+    watch_entry_t  *wentry;
+    update_batch_t *batch;
+    
+    if (fact == NULL) {
+        OHM_ERROR("fsif: %s() called with null fact pointer",__FUNCTION__);
+        return;
+    }
+        
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    index_fact_removed(name, fact);
+
+    if ((batch = find_batch(fact)) != NULL) {
+        unlink_batch(batch);
+        g_free(batch);
+    }
+
+    if ((wfact = find_watch(name, watch_remove)) != NULL) {
+
+        OHM_DEBUG(DBG_FS, "fact watch point: fact '%s' removed", name);
+
+        for (wentry = wfact->entries;  wentry != NULL;  wentry = wentry->next){
+
+            wentry->callback.fact_watch(fact, name, fact_watch_remove,
+                                        wentry->usrdata); 
+        } /* for */
+    } /* if find_watch */
+}
+
+static void updated_cb(void *data,OhmFact *fact,GQuark fldquark,gpointer value)
+{
+    (void)data;
+
+    GValue         *gval = (GValue *)value;
+    char           *name;
+    watch_fact_t   *wfact;
+    update_batch_t *batch;
+    GQuark          last;
+    
+    if (fact == NULL) {
+        OHM_ERROR("fsif: %s() called with null fact pointer",__FUNCTION__);
+        return;
+    }
+        
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    index_fact_updated(name, fact, fldquark);
+
+    if (value == NULL || (wfact = find_update_watch(name)) == NULL)
+        return;
+
+    last  = GPOINTER_TO_UINT(g_object_get_qdata(G_OBJECT(fact), batch_quark));
+    batch = find_batch(fact);
+
+    if (last) {
+        batch = stage_field(batch, fact, name, fldquark);
+
+        if (fldquark == last)
+            flush_batch(batch, name);
+
+        return;
+    }
+
+    if (batch != NULL)
+        flush_batch(batch, name);
+
+    notify_field(wfact, fact, name, fldquark, gval);
+    notify_fields(wfact, fact, name, &fldquark, 1);
+}
+
+static char *time_str(unsigned long long t, char *buf , int len)
+{
+    time_t       sec;
+    unsigned int ms;
+    struct tm    tm;
+
+    sec = t / 1000ULL;
+    ms  = t % 1000ULL;
+
+    localtime_r(&sec, &tm);
+
+    snprintf(buf, len, "%02d/%02d %02d:%02d:%02d.%03d",
+             tm.tm_mday,tm.tm_mon+1,  tm.tm_hour,tm.tm_min,tm.tm_sec, ms);
+
+    return buf;
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
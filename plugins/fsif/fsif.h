@@ -18,17 +18,14 @@ USA.
 *************************************************************************/
 
 
-#ifndef __OHM_RESOURCE_FSIF_H__
-#define __OHM_RESOURCE_FSIF_H__
+#ifndef __OHM_FSIF_H__
+#define __OHM_FSIF_H__
 
 /*
- * FIXME:
- * The 'delay' and the 'timer' plugin share the similar fsif.[hc]
- * However, do to the rush, they are currently duplicated (ie. the same
- * code is duplicated in both directory.
- * Before we fix this pls. pay attention to kepp them identical (ie. make
- * identical changes to both copy)
- *
+ * Factstore interface shared by the resource, media, playback and delay
+ * plugins. There is a single instance of it per process; every plugin
+ * using it calls fsif_init() and fsif_exit() with its own handle. Watches
+ * are added on behalf of a plugin and are removed by its fsif_exit().
  */
 
 
@@ -75,20 +72,30 @@ typedef void (*fsif_field_watch_cb_t)(fsif_entry_t *, char *, fsif_field_t *,
                                       void *);
 typedef void (*fsif_fact_watch_cb_t)(fsif_entry_t *, char *, fsif_fact_watch_e,
                                      void *);
+typedef void (*fsif_fields_watch_cb_t)(fsif_entry_t *, char *, fsif_field_t *,
+                                       void *);
 
-void fsif_init(OhmPlugin *);
+void fsif_init(OhmPlugin *, int);
 void fsif_exit(OhmPlugin *);
 int  fsif_add_factstore_entry(char *, fsif_field_t *);
+int  fsif_add_factstore_entry_with_data(char *, fsif_field_t *, void *);
 int  fsif_delete_factstore_entry(char *, fsif_field_t *);
+int  fsif_destroy_factstore_entry(fsif_entry_t *);
 int  fsif_update_factstore_entry(char *, fsif_field_t *,fsif_field_t *);
+fsif_entry_t *fsif_get_entry(char *, fsif_field_t *);
 void fsif_get_field_by_entry(fsif_entry_t *, fsif_fldtype_t, char *, void *);
+void fsif_set_field_by_entry(fsif_entry_t *, fsif_fldtype_t, char *, void *);
+void *fsif_get_entry_data(fsif_entry_t *);
 int  fsif_get_field_by_name(const char *, fsif_fldtype_t, char *, void *);
-int  fsif_add_fact_watch(char *,fsif_fact_watch_e,fsif_fact_watch_cb_t,void *);
-int  fsif_add_field_watch(char *, fsif_field_t *, char *,
+int  fsif_add_fact_watch(OhmPlugin *, char *, fsif_fact_watch_e,
+                         fsif_fact_watch_cb_t, void *);
+int  fsif_add_field_watch(OhmPlugin *, char *, fsif_field_t *, char *,
                           fsif_field_watch_cb_t, void *);
+int  fsif_add_fields_watch(OhmPlugin *, char *, fsif_field_t *, char **,
+                           fsif_fields_watch_cb_t, void *);
 
 
-#endif /* __OHM_RESOURCE_FSIF_H__ */
+#endif /* __OHM_FSIF_H__ */
 
 /* 
  * Local Variables:
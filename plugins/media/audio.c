@@ -42,11 +42,9 @@ static void  audio_stream_changed_cb(fsif_entry_t *, char *,
 
 void audio_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-
-    fsif_add_fact_watch(FACTSTORE_AUDIO_STREAM, fact_watch_insert,
+    fsif_add_fact_watch(plugin, FACTSTORE_AUDIO_STREAM, fact_watch_insert,
 			audio_stream_changed_cb, NULL);
-    fsif_add_fact_watch(FACTSTORE_AUDIO_STREAM, fact_watch_remove,
+    fsif_add_fact_watch(plugin, FACTSTORE_AUDIO_STREAM, fact_watch_remove,
 			audio_stream_changed_cb, NULL);
 }
 
@@ -43,9 +43,7 @@ static int   override_value(const char *);
 
 void bluetooth_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-
-    fsif_add_field_watch(FACTSTORE_BLUETOOTH, NULL, "value",
+    fsif_add_field_watch(plugin, FACTSTORE_BLUETOOTH, NULL, "value",
                          bluetooth_changed_cb, NULL);
 }
 
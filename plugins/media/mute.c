@@ -43,10 +43,10 @@ static int   mute_value(const char *);
 
 void mute_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-
-    fsif_add_field_watch(FACTSTORE_MUTE, NULL, "value", mute_changed_cb, NULL);
-    fsif_add_field_watch(FACTSTORE_MUTE, NULL, "forced", mute_changed_cb, NULL);
+    fsif_add_field_watch(plugin, FACTSTORE_MUTE, NULL, "value",
+                         mute_changed_cb, NULL);
+    fsif_add_field_watch(plugin, FACTSTORE_MUTE, NULL, "forced",
+                         mute_changed_cb, NULL);
 }
 
 int mute_request(int value)
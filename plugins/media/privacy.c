@@ -43,9 +43,7 @@ static int   override_value(const char *);
 
 void privacy_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-
-    fsif_add_field_watch(FACTSTORE_PRIVACY, NULL, "value",
+    fsif_add_field_watch(plugin, FACTSTORE_PRIVACY, NULL, "value",
                          privacy_changed_cb, NULL);
 }
 
@@ -48,13 +48,11 @@ static void  destroy_media(media_t *);
 
 static void media_init(OhmPlugin *plugin)
 {
-    (void)plugin;
+    fsif_add_fact_watch(plugin, FACTSTORE_ENFORCEMENT_POINT,
+                        fact_watch_insert, enforcement_point_cb, NULL);
 
-    fsif_add_fact_watch(FACTSTORE_ENFORCEMENT_POINT, fact_watch_insert,
-                        enforcement_point_cb, NULL); 
-
-    fsif_add_fact_watch(FACTSTORE_ENFORCEMENT_POINT, fact_watch_remove,
-                        enforcement_point_cb, NULL); 
+    fsif_add_fact_watch(plugin, FACTSTORE_ENFORCEMENT_POINT,
+                        fact_watch_remove, enforcement_point_cb, NULL);
 }
 
 static void media_state_request(char *epid, char *media, char *group,
@@ -78,7 +78,7 @@ static void plugin_init(OhmPlugin *plugin)
     sm_init(plugin);
     dbusif_init(plugin);
     dresif_init(plugin);
-    fsif_init(plugin);
+    fsif_init(plugin, DBG_FS);
 
     timestamp_init();
 }
@@ -95,7 +95,6 @@ static void plugin_destroy(OhmPlugin *plugin)
 #include "sm.c"
 #include "dbusif.c"
 #include "dresif.c"
-#include "fsif.c"
 
 
 OHM_PLUGIN_REQUIRES_METHODS(playback, 1, 
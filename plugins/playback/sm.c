@@ -284,12 +284,11 @@ static void  schedule_fake_setprop_succeeded_event(client_t *, char *, char *);
 
 static void sm_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-
     static fsif_field_t selist[] = {
         { fldtype_string , "device", .value.string = "microphone" },
         { fldtype_invalid,   NULL  , .value.string = NULL         }
     };
+    static char *mutefld[] = { "mute", "forced", NULL };
 
     verify_state_machine();
 
@@ -297,17 +296,18 @@ static void sm_init(OhmPlugin *plugin)
     dbusif_add_goodbye_notification(fire_client_gone_event);
     dbusif_add_property_notification("State", fire_state_signal_event);
 
-#define ADD_FIELD_WATCH(f,s,n,cb) fsif_add_field_watch(f, s, n, cb,NULL)
+#define ADD_FIELD_WATCH(f,s,n,cb) fsif_add_field_watch(plugin,f,s,n,cb,NULL)
 
     ADD_FIELD_WATCH(FACTSTORE_PLAYBACK , NULL  , "setstate", setstate_cb );
     ADD_FIELD_WATCH(FACTSTORE_PLAYBACK , NULL  , "playhint", playhint_cb );
     ADD_FIELD_WATCH(FACTSTORE_PRIVACY  , NULL  , "value"   , privacy_cb  );
     ADD_FIELD_WATCH(FACTSTORE_BLUETOOTH, NULL  , "value"   , bluetooth_cb);
-    ADD_FIELD_WATCH(FACTSTORE_MUTE     , selist, "mute"    , mute_cb     );
-    ADD_FIELD_WATCH(FACTSTORE_MUTE     , selist, "forced"  , mute_cb     );
 
 #undef ADD_FIELD_WATCH
 
+    fsif_add_fields_watch(plugin, FACTSTORE_MUTE, selist, mutefld,
+                          mute_cb, NULL);
+
 }
 
 static sm_t *sm_create(char *name, void *user_data)
@@ -0,0 +1,375 @@
+/*
+ *  gcc -Wall `pkg-config --cflags ohm glib-2.0` \
+ *      arbiter-test.c -o arbiter-test `pkg-config --libs glib-2.0`
+ *
+ *  Test for the native arbiter. Without arguments it checks the basic
+ *  priority, sharing and recency rules. Given trace files recorded by the
+ *  resource plugin with 'arbiter-trace', it replays every decision the
+ *  rules made there and checks that the native arbiter comes to the same
+ *  grants and advices.
+ */
+
+#include <stdarg.h>
+
+#include "arbiter.c"
+
+int DBG_ARBITER;
+
+void plugin_print_timestamp(const char *function, const char *event)
+{
+    (void)function;
+    (void)event;
+}
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR || level == OHM_LOG_WARNING) {
+        va_start(ap, format);
+        vfprintf(stdout, format, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+int __trace_printf(int id, const char *file, int line, const char *func,
+                   const char *format, ...)
+{
+    va_list ap;
+
+    (void)file;
+    (void)line;
+    (void)func;
+
+    if (!id)
+        return FALSE;
+
+    va_start(ap, format);
+    vfprintf(stdout, format, ap);
+    va_end(ap);
+
+    return TRUE;
+}
+
+const char *ohm_plugin_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+    (void)key;
+
+    return NULL;
+}
+
+resource_set_t *resource_set_find_by_id(uint32_t manager_id)
+{
+    (void)manager_id;
+
+    return NULL;
+}
+
+void resource_set_foreach(resource_set_iter_cb_t cb, void *data)
+{
+    (void)cb;
+    (void)data;
+}
+
+int fsif_update_factstore_entry(char         *name,
+                                fsif_field_t *selist,
+                                fsif_field_t *fldlist)
+{
+    (void)name;
+    (void)selist;
+    (void)fldlist;
+
+    return TRUE;
+}
+
+
+/*****************************************************************************
+ *                         *** arbitration tests ***                         *
+ *****************************************************************************/
+
+#define fatal(fmt, args...) do {                                \
+        fprintf(stderr, "fatal error: "fmt"\n" , ## args);      \
+        exit(1);                                                \
+    } while (0)
+
+#define AUDIO  0x01
+#define VIDEO  0x02
+#define VIBRA  0x04
+
+typedef struct {
+    uint32_t  manager_id;
+    uint32_t  granted;
+    uint32_t  advice;
+} expect_t;
+
+static int nerror;
+
+
+static arbiter_set_t *set_add(arbiter_set_t *list, int *n, uint32_t id,
+                              const char *klass, uint32_t mandatory,
+                              uint32_t optional, uint32_t share,
+                              int acquire, int block, uint32_t stamp)
+{
+    arbiter_set_t *s = list + (*n)++;
+
+    memset(s, 0, sizeof(*s));
+    s->manager_id = id;
+    s->mandatory  = mandatory;
+    s->optional   = optional;
+    s->share      = share;
+    s->acquire    = acquire;
+    s->block      = block;
+    s->stamp      = stamp;
+
+    if ((s->klass = g_hash_table_lookup(classes, klass)) == NULL)
+        fatal("unknown class '%s'", klass);
+
+    return s;
+}
+
+static int check(const char *what, arbiter_set_t *list, int n,
+                 expect_t *expect, int nexpect)
+{
+    arbiter_set_t *s;
+    int            i, j, failed;
+
+    for (i = failed = 0;  i < nexpect;  i++) {
+        for (j = 0, s = NULL;  j < n;  j++) {
+            if (list[j].manager_id == expect[i].manager_id) {
+                s = list + j;
+                break;
+            }
+        }
+
+        if (s == NULL) {
+            printf("%s: set %u is missing\n", what, expect[i].manager_id);
+            failed = TRUE;
+        }
+        else if (s->granted != expect[i].granted ||
+                 s->advice  != expect[i].advice)
+        {
+            printf("%s: set %u granted 0x%x advice 0x%x, "
+                   "expected 0x%x and 0x%x\n", what, s->manager_id,
+                   s->granted, s->advice, expect[i].granted, expect[i].advice);
+            failed = TRUE;
+        }
+    }
+
+    if (failed)
+        nerror++;
+
+    return !failed;
+}
+
+static void basic_tests(void)
+{
+    arbiter_set_t list[8];
+    int           n;
+
+    add_class("event"     , 40, TRUE );
+    add_class("player"    , 30, TRUE );
+    add_class("background", 10, FALSE);
+
+    /* higher priority takes the resource */
+    n = 0;
+    set_add(list, &n, 1, "player", AUDIO, 0, 0, TRUE, FALSE, 1);
+    set_add(list, &n, 2, "event" , AUDIO, 0, 0, TRUE, FALSE, 2);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, 0, 0}, {2, AUDIO, AUDIO} };
+        check("priority", list, n, e, 2);
+    }
+
+    /* sets of shared classes can share what they both share */
+    n = 0;
+    set_add(list, &n, 1, "player", AUDIO, 0, AUDIO, TRUE, FALSE, 1);
+    set_add(list, &n, 2, "event" , AUDIO, 0, AUDIO, TRUE, FALSE, 2);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, AUDIO, AUDIO}, {2, AUDIO, AUDIO} };
+        check("sharing", list, n, e, 2);
+    }
+
+    /* ... but not with exclusive classes */
+    n = 0;
+    set_add(list, &n, 1, "background", AUDIO, 0, AUDIO, TRUE, FALSE, 1);
+    set_add(list, &n, 2, "player"    , AUDIO, 0, AUDIO, TRUE, FALSE, 2);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, 0, 0}, {2, AUDIO, AUDIO} };
+        check("exclusive", list, n, e, 2);
+    }
+
+    /* the most recent acquisition wins within a priority */
+    n = 0;
+    set_add(list, &n, 1, "background", AUDIO, 0, 0, TRUE, FALSE, 5);
+    set_add(list, &n, 2, "background", AUDIO, 0, 0, TRUE, FALSE, 3);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, AUDIO, AUDIO}, {2, 0, 0} };
+        check("recency", list, n, e, 2);
+    }
+
+    /* optional resources are granted if available */
+    n = 0;
+    set_add(list, &n, 1, "event" , VIDEO, 0, 0, TRUE, FALSE, 1);
+    set_add(list, &n, 2, "player", AUDIO, VIDEO|VIBRA, 0, TRUE, FALSE, 2);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, VIDEO, VIDEO}, {2, AUDIO|VIBRA, AUDIO|VIBRA} };
+        check("optional", list, n, e, 2);
+    }
+
+    /* blocked sets get advice but no grant and take nothing */
+    n = 0;
+    set_add(list, &n, 1, "event"     , AUDIO, 0, 0, TRUE, TRUE , 2);
+    set_add(list, &n, 2, "background", AUDIO, 0, 0, TRUE, FALSE, 1);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, 0, AUDIO}, {2, AUDIO, AUDIO} };
+        check("block", list, n, e, 2);
+    }
+
+    /* released sets get advice as if they were acquiring now */
+    n = 0;
+    set_add(list, &n, 1, "player", AUDIO, 0, 0, TRUE , FALSE, 1);
+    set_add(list, &n, 2, "player", AUDIO, 0, 0, FALSE, FALSE, 0);
+    set_add(list, &n, 3, "background", AUDIO, 0, 0, FALSE, FALSE, 0);
+    arbitrate(list, n);
+    {
+        expect_t e[] = { {1, AUDIO, AUDIO}, {2, 0, AUDIO}, {3, 0, 0} };
+        check("advice", list, n, e, 3);
+    }
+
+    printf("basic tests %s\n", nerror ? "failed" : "passed");
+}
+
+
+/*****************************************************************************
+ *                            *** trace replay ***                           *
+ *****************************************************************************/
+
+static void replay(const char *path)
+{
+    FILE          *fp;
+    char           line[512], klass[128], status[32];
+    arbiter_set_t *list;
+    expect_t      *expect;
+    int            size, n, nexpect, nrecord, nskip, known, lineno;
+    int            prio, shrd, acquire, block;
+    uint32_t       id, mandatory, optional, share, stamp, granted, advice;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        fatal("can't open '%s': %s", path, strerror(errno));
+
+    size    = 256;
+    list    = calloc(size, sizeof(list[0]));
+    expect  = calloc(size, sizeof(expect[0]));
+
+    if (list == NULL || expect == NULL)
+        fatal("can't allocate memory");
+
+    n = nexpect = nrecord = nskip = 0;
+    known  = TRUE;
+    lineno = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+
+        if (!strncmp(line, "class ", 6)) {
+            if (sscanf(line, "class %127s %d %d", klass, &prio, &shrd) != 3)
+                fatal("%s:%d: invalid class", path, lineno);
+
+            if (g_hash_table_lookup(classes, klass) == NULL)
+                add_class(klass, prio, shrd);
+        }
+        else if (!strncmp(line, "request ", 8))
+            ;
+        else if (!strncmp(line, "set ", 4)) {
+            if (sscanf(line, "set %u %127s %u %u %u %d %d %u", &id, klass,
+                       &mandatory, &optional, &share, &acquire, &block,
+                       &stamp) != 8)
+                fatal("%s:%d: invalid set", path, lineno);
+
+            if (n >= size)
+                fatal("%s:%d: too many resource sets", path, lineno);
+
+            if (g_hash_table_lookup(classes, klass) == NULL)
+                known = FALSE;
+            else {
+                set_add(list, &n, id, klass, mandatory, optional, share,
+                        acquire, block, stamp);
+            }
+        }
+        else if (!strncmp(line, "grant ", 6)) {
+            if (sscanf(line, "grant %u %u %u", &id, &granted, &advice) != 3)
+                fatal("%s:%d: invalid grant", path, lineno);
+
+            if (nexpect >= size)
+                fatal("%s:%d: too many grants", path, lineno);
+
+            expect[nexpect].manager_id = id;
+            expect[nexpect].granted    = granted;
+            expect[nexpect].advice     = advice;
+            nexpect++;
+        }
+        else if (!strncmp(line, "end", 3)) {
+            if (sscanf(line, "end %31s", status) != 1)
+                strcpy(status, "ok");
+
+            /* only the decisions of the native classes can be compared */
+            if (!known || strcmp(status, "ok"))
+                nskip++;
+            else {
+                snprintf(line, sizeof(line), "%s:%d", path, lineno);
+                arbitrate(list, n);
+                check(line, list, n, expect, nexpect);
+                nrecord++;
+            }
+
+            n = nexpect = 0;
+            known = TRUE;
+        }
+        else
+            fatal("%s:%d: invalid trace entry", path, lineno);
+    }
+
+    printf("%s: %d decisions compared, %d skipped\n", path, nrecord, nskip);
+
+    fclose(fp);
+    free(list);
+    free(expect);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    classes = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_class);
+
+    if (argc < 2)
+        basic_tests();
+    else {
+        for (i = 1;  i < argc;  i++)
+            replay(argv[i]);
+    }
+
+    g_hash_table_destroy(classes);
+
+    if (nerror)
+        fatal("%d mismatching decision%s", nerror, nerror == 1 ? "" : "s");
+
+    return 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,530 @@
+/*************************************************************************
+Copyright (C) 2011 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*! \defgroup pubif Public Interfaces */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include "plugin.h"
+#include "arbiter.h"
+#include "resource-set.h"
+#include "fsif.h"
+
+#define INTEGER_FIELD(n,v) { fldtype_integer, n, .value.integer = v }
+#define INVALID_FIELD      { fldtype_invalid, NULL, .value.string = NULL }
+
+/*
+ * Native arbitration for resource classes with simple priority-and-sharing
+ * policies. The classes are listed in the plugin configuration with their
+ * priority, and whether their sets may share resources with each other:
+ *
+ *     arbiter-classes = event,player,background
+ *     arbiter-event   = 40:shared
+ *
+ * A batch of requests is arbitrated natively only if every resource set in
+ * the system belongs to one of the listed classes and every request is
+ * about acquiring or releasing resources. Everything else goes to the rule
+ * engine, as before.
+ *
+ * Resource sets are ordered by class priority and, within a priority, the
+ * most recent acquisition first. Each acquiring set in turn is granted its
+ * mandatory resources, if all of them are available, together with the
+ * available optional ones. A resource granted to a set that shares it with
+ * others stays available for the lower ranking sets that share it too.
+ * The advice of a set is what it would be granted if it were acquiring now.
+ */
+
+extern int DBG_ARBITER;
+
+typedef struct {
+    char     *name;
+    int       priority;
+    int       shared;                   /* sets share resources */
+} arbiter_class_t;
+
+typedef struct {
+    resource_set_t  *rs;
+    arbiter_class_t *klass;
+    uint32_t         manager_id;
+    uint32_t         mandatory;
+    uint32_t         optional;
+    uint32_t         share;
+    uint32_t         stamp;             /* acquisition order */
+    int              acquire;
+    int              block;
+    uint32_t         granted;
+    uint32_t         advice;
+} arbiter_set_t;
+
+typedef struct {
+    int              eligible;
+} collect_t;
+
+
+static GHashTable    *classes;          /* arbiter_class_t by name */
+static arbiter_set_t *sets;
+static int            nset;
+static int            set_size;
+static uint32_t       stamp_seq;
+static FILE          *trace;
+static int            tracing;          /* recording a rule engine decision */
+
+static struct {
+    uint32_t  native;                   /* batches arbitrated natively */
+    uint32_t  deferred;                 /* batches left to the rule engine */
+} stats;
+
+static arbiter_class_t *add_class(const char *, int, int);
+static void free_class(gpointer);
+static int  native_request(const char *);
+static void collect_set(resource_set_t *, void *);
+static void arbitrate(arbiter_set_t *, int);
+static uint32_t arbitrate_set(arbiter_set_t *, uint32_t, uint32_t);
+static int  compare_sets(const void *, const void *);
+static void apply_set(arbiter_set_t *);
+static void trace_sets(dresif_request_t *, int);
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+void arbiter_init(OhmPlugin *plugin)
+{
+    const char *klasses;
+    const char *klass_configuration;
+    const char *trace_path;
+    char       *klass;
+    char       *prio;
+    char       *saveptr1, *saveptr2;
+    char        class_buf[512];
+    char        conf_buf[128];
+    char        key[128];
+    char       *e;
+    int         priority;
+    int         shared;
+
+    ENTER;
+
+    if ((klasses = ohm_plugin_get_param(plugin, "arbiter-classes")) == NULL) {
+        OHM_INFO("resource: all resource requests are resolved by rules");
+        LEAVE;
+        return;
+    }
+
+    classes = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_class);
+
+    strncpy(class_buf, klasses, sizeof(class_buf));
+    class_buf[sizeof(class_buf)-1] = '\0';
+
+    for (klass = strtok_r(class_buf, ", ", &saveptr1);
+         klass != NULL;
+         klass = strtok_r(NULL, ", ", &saveptr1))
+    {
+        snprintf(key, sizeof(key), "arbiter-%s", klass);
+
+        if (!(klass_configuration = ohm_plugin_get_param(plugin, key))) {
+            OHM_ERROR("resource: no arbiter configuration for class '%s'",
+                      klass);
+            continue;
+        }
+
+        strncpy(conf_buf, klass_configuration, sizeof(conf_buf));
+        conf_buf[sizeof(conf_buf)-1] = '\0';
+
+        prio     = strtok_r(conf_buf, ":", &saveptr2);
+        priority = prio ? strtol(prio, &e, 10) : 0;
+
+        if (prio == NULL || *e != '\0') {
+            OHM_ERROR("resource: invalid arbiter configuration '%s' for "
+                      "class '%s'", klass_configuration, klass);
+            continue;
+        }
+
+        shared = FALSE;
+
+        while ((prio = strtok_r(NULL, ":", &saveptr2)) != NULL) {
+            if (!strcmp(prio, "shared"))
+                shared = TRUE;
+            else if (strcmp(prio, "exclusive")) {
+                OHM_ERROR("resource: invalid arbiter flag '%s' for "
+                          "class '%s'", prio, klass);
+            }
+        }
+
+        add_class(klass, priority, shared);
+
+        OHM_INFO("resource: class '%s' is arbitrated natively with "
+                 "priority %d%s", klass, priority, shared ? ", shared" : "");
+    }
+
+    if ((trace_path = ohm_plugin_get_param(plugin, "arbiter-trace")) != NULL) {
+        if ((trace = fopen(trace_path, "a")) == NULL) {
+            OHM_ERROR("resource: can't open arbiter trace '%s': %s",
+                      trace_path, strerror(errno));
+        }
+        else {
+            OHM_INFO("resource: recording rule engine decisions to '%s'",
+                     trace_path);
+        }
+    }
+
+    LEAVE;
+}
+
+void arbiter_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    if (classes == NULL)
+        return;
+
+    OHM_INFO("resource: %u request batches arbitrated natively, "
+             "%u by rules", stats.native, stats.deferred);
+
+    if (trace != NULL) {
+        fclose(trace);
+        trace = NULL;
+    }
+
+    g_hash_table_destroy(classes);
+    classes = NULL;
+
+    free(sets);
+    sets     = NULL;
+    nset     = 0;
+    set_size = 0;
+}
+
+/*
+ * Arbitrate a batch of requests natively, if possible. Returns TRUE if the
+ * grants were updated, FALSE if the batch is to be resolved by the rules.
+ */
+int arbiter_resolve(dresif_request_t *reqs, int nreq)
+{
+    resource_set_t *rs;
+    collect_t       c;
+    int             i;
+
+    if (classes == NULL)
+        return FALSE;
+
+    c.eligible = TRUE;
+
+    for (i = 0;  i < nreq;  i++) {
+        if (!native_request(reqs[i].request))
+            c.eligible = FALSE;
+
+        if (!strcmp(reqs[i].request, "acquire")    &&
+            (rs = resource_set_find_by_id(reqs[i].manager_id)) != NULL &&
+            rs->stamp == 0)
+            rs->stamp = ++stamp_seq;
+    }
+
+    nset = 0;
+    resource_set_foreach(collect_set, &c);
+
+    if (trace != NULL) {
+        trace_sets(reqs, nreq);
+        tracing = TRUE;
+        stats.deferred++;
+        return FALSE;
+    }
+
+    if (!c.eligible) {
+        stats.deferred++;
+        return FALSE;
+    }
+
+    arbitrate(sets, nset);
+
+    for (i = 0;  i < nset;  i++)
+        apply_set(sets + i);
+
+    OHM_DEBUG(DBG_ARBITER, "arbitrated %d request%s over %d resource sets",
+              nreq, nreq == 1 ? "" : "s", nset);
+
+    stats.native++;
+
+    return TRUE;
+}
+
+/*
+ * Called once the rules are done with a batch arbiter_resolve() passed on,
+ * to record the resulting grants next to the input of the decision.
+ */
+void arbiter_resolved(int success)
+{
+    arbiter_set_t *s;
+    int            i;
+
+    if (!tracing)
+        return;
+
+    tracing = FALSE;
+
+    for (i = 0;  i < nset;  i++) {
+        s = sets + i;
+
+        /* sets destroyed by the batch are not there any more */
+        if (resource_set_find_by_id(s->manager_id) != s->rs)
+            continue;
+
+        fprintf(trace, "grant %u %u %u\n", s->manager_id,
+                s->rs->granted.factstore, s->rs->advice.factstore);
+    }
+
+    fprintf(trace, "end %s\n", success ? "ok" : "failed");
+    fflush(trace);
+}
+
+/*!
+ * @}
+ */
+
+static arbiter_class_t *add_class(const char *name, int priority, int shared)
+{
+    arbiter_class_t *klass;
+
+    if ((klass = malloc(sizeof(arbiter_class_t))) == NULL)
+        return NULL;
+
+    klass->name     = strdup(name);
+    klass->priority = priority;
+    klass->shared   = shared;
+
+    g_hash_table_insert(classes, klass->name, klass);
+
+    return klass;
+}
+
+static void free_class(gpointer ptr)
+{
+    arbiter_class_t *klass = (arbiter_class_t *)ptr;
+
+    free(klass->name);
+    free(klass);
+}
+
+static int native_request(const char *request)
+{
+    static const char *native[] = {
+        "register", "unregister", "update", "acquire", "release", NULL
+    };
+
+    const char **r;
+
+    for (r = native;  *r != NULL;  r++) {
+        if (!strcmp(request, *r))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void collect_set(resource_set_t *rs, void *data)
+{
+    collect_t     *c      = (collect_t *)data;
+    resset_t      *resset = rs->resset;
+    arbiter_set_t *s, *mem;
+    int            size;
+
+    if (nset >= set_size) {
+        size = set_size ? set_size * 2 : 64;
+
+        if ((mem = realloc(sets, size * sizeof(sets[0]))) == NULL) {
+            OHM_ERROR("resource: [%s] memory allocation failure",
+                      __FUNCTION__);
+            c->eligible = FALSE;
+            return;
+        }
+
+        sets     = mem;
+        set_size = size;
+    }
+
+    s = sets + nset++;
+
+    memset(s, 0, sizeof(*s));
+    s->rs         = rs;
+    s->klass      = g_hash_table_lookup(classes, resset->klass);
+    s->manager_id = rs->manager_id;
+    s->mandatory  = resset->flags.all & ~resset->flags.opt;
+    s->optional   = resset->flags.opt;
+    s->share      = resset->flags.share;
+    s->acquire    = rs->request && !strcmp(rs->request, "acquire");
+    s->block      = rs->block;
+
+    if (!s->acquire)
+        rs->stamp = 0;
+    else if (rs->stamp == 0)
+        rs->stamp = ++stamp_seq;
+
+    s->stamp = rs->stamp;
+
+    if (s->klass == NULL)
+        c->eligible = FALSE;
+}
+
+static void arbitrate(arbiter_set_t *list, int n)
+{
+    arbiter_set_t *s;
+    uint32_t       excl, shrd;          /* resources taken so far */
+    uint32_t       grp_excl, grp_shrd;  /* ... before the current priority */
+    uint32_t       result, share;
+    int            priority;
+    int            i;
+
+    qsort(list, n, sizeof(list[0]), compare_sets);
+
+    excl = shrd = 0;
+    grp_excl = grp_shrd = 0;
+    priority = 0;
+
+    for (i = 0;  i < n;  i++) {
+        s = list + i;
+
+        if (i == 0 || s->klass->priority != priority) {
+            priority = s->klass->priority;
+            grp_excl = excl;
+            grp_shrd = shrd;
+        }
+
+        if (!s->acquire) {
+            /* acquiring now it would be the newest of its priority */
+            s->granted = 0;
+            s->advice  = arbitrate_set(s, grp_excl, grp_shrd);
+            continue;
+        }
+
+        result     = arbitrate_set(s, excl, shrd);
+        s->advice  = result;
+        s->granted = s->block ? 0 : result;
+
+        share = s->klass->shared ? s->share : 0;
+
+        excl |= s->granted & ~share;
+        shrd |= s->granted &  share;
+    }
+}
+
+static uint32_t arbitrate_set(arbiter_set_t *s, uint32_t excl, uint32_t shrd)
+{
+    uint32_t share   = s->klass->shared ? s->share : 0;
+    uint32_t blocked = excl | (shrd & ~share);
+
+    if (s->mandatory & blocked)
+        return 0;
+
+    return s->mandatory | (s->optional & ~blocked);
+}
+
+static int compare_sets(const void *a, const void *b)
+{
+    const arbiter_set_t *sa = (const arbiter_set_t *)a;
+    const arbiter_set_t *sb = (const arbiter_set_t *)b;
+
+    if (sa->klass->priority != sb->klass->priority)
+        return sb->klass->priority - sa->klass->priority;
+
+    if (sa->stamp != sb->stamp)
+        return sb->stamp > sa->stamp ? 1 : -1;
+
+    return sa->manager_id < sb->manager_id ? -1 : 1;
+}
+
+static void apply_set(arbiter_set_t *s)
+{
+    resource_set_t *rs = s->rs;
+    fsif_field_t    fldlist[3];
+    int             n = 0;
+
+    fsif_field_t selist[] = {
+        INTEGER_FIELD("manager_id", rs->manager_id),
+        INVALID_FIELD
+    };
+
+    if (s->granted != rs->granted.factstore) {
+        fldlist[n].type          = fldtype_integer;
+        fldlist[n].name          = "granted";
+        fldlist[n].value.integer = s->granted;
+        n++;
+    }
+
+    if (s->advice != rs->advice.factstore) {
+        fldlist[n].type          = fldtype_integer;
+        fldlist[n].name          = "advice";
+        fldlist[n].value.integer = s->advice;
+        n++;
+    }
+
+    if (n > 0) {
+        fldlist[n].type = fldtype_invalid;
+        fldlist[n].name = NULL;
+
+        fsif_update_factstore_entry(FACTSTORE_RESOURCE_SET, selist, fldlist);
+    }
+}
+
+static void trace_sets(dresif_request_t *reqs, int nreq)
+{
+    static int       classes_traced;
+    GHashTableIter   it;
+    gpointer         key, value;
+    arbiter_class_t *klass;
+    arbiter_set_t   *s;
+    int              i;
+
+    if (!classes_traced) {
+        g_hash_table_iter_init(&it, classes);
+
+        while (g_hash_table_iter_next(&it, &key, &value)) {
+            klass = (arbiter_class_t *)value;
+            fprintf(trace, "class %s %d %d\n", klass->name,
+                    klass->priority, klass->shared);
+        }
+
+        classes_traced = TRUE;
+    }
+
+    for (i = 0;  i < nreq;  i++)
+        fprintf(trace, "request %u %s\n", reqs[i].manager_id, reqs[i].request);
+
+    for (i = 0;  i < nset;  i++) {
+        s = sets + i;
+
+        fprintf(trace, "set %u %s %u %u %u %d %d %u\n", s->manager_id,
+                s->rs->resset->klass, s->mandatory, s->optional, s->share,
+                s->acquire, s->block, s->stamp);
+    }
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,42 @@
+/*************************************************************************
+Copyright (C) 2011 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_RESOURCE_ARBITER_H__
+#define __OHM_RESOURCE_ARBITER_H__
+
+#include "dresif.h"
+
+/* hack to avoid multiple includes */
+typedef struct _OhmPlugin OhmPlugin;
+
+void arbiter_init(OhmPlugin *);
+void arbiter_exit(OhmPlugin *);
+int  arbiter_resolve(dresif_request_t *, int);
+void arbiter_resolved(int);
+
+#endif	/* __OHM_RESOURCE_ARBITER_H__ */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -29,6 +29,8 @@ USA.
 #include "plugin.h"
 #include "auth.h"
 
+#define AUTH_CACHE_MAX  256
+
 
 static GHashTable    *security_configuration;
 static auth_policy_t  default_policy;
@@ -38,9 +40,30 @@ typedef struct {
   char *arg;
 } configuration_entry;
 
+/*
+ * Successful authorizations, keyed by the D-Bus address of the client and
+ * the resource class. The start time of the process tells apart a reused
+ * pid, or a process that has exited, from the one that was authorized.
+ */
+typedef struct {
+    pid_t               pid;
+    unsigned long long  start;
+} cache_entry;
+
+static GHashTable    *auth_cache;
+
+static struct {
+    unsigned int  hits;
+    unsigned int  misses;
+    unsigned int  stale;                /* process exited or pid reused */
+} cache_stats;
+
 
 static void free_key(gpointer ptr);
 static void free_entry(gpointer ptr);
+static char *cache_key(const char *, const char *, char *, int);
+static gboolean peer_key(gpointer, gpointer, gpointer);
+static int  process_start_time(pid_t, unsigned long long *);
 
 
 /*! \addtogroup pubif
@@ -64,6 +87,9 @@ void auth_init(OhmPlugin *plugin)
     security_configuration = g_hash_table_new_full(g_str_hash, g_str_equal,
                                                    free_key, free_entry);
 
+    auth_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       free_key, free_key);
+
     default_policy = auth_accept;
 
     if ((default_str = ohm_plugin_get_param(plugin, "default")) != NULL) {
@@ -127,6 +153,12 @@ void auth_exit(OhmPlugin *plugin) {
     OHM_INFO("resource: destroying security configuration table");
     
     g_hash_table_destroy(security_configuration);
+
+    OHM_INFO("resource: authorization cache: %u hits, %u misses, %u stale",
+             cache_stats.hits, cache_stats.misses, cache_stats.stale);
+
+    g_hash_table_destroy(auth_cache);
+    auth_cache = NULL;
 }
 
 void auth_query(const char* klass, char** method, char** arg) {
@@ -147,6 +179,132 @@ auth_policy_t auth_get_default_policy() {
   return default_policy;
 }
 
+int auth_cache_lookup(const char *peer, const char *klass, pid_t *pid)
+{
+    cache_entry        *entry;
+    unsigned long long  start;
+    char                key[256];
+
+    if (auth_cache == NULL || peer == NULL || klass == NULL)
+        return FALSE;
+
+    cache_key(peer, klass, key, sizeof(key));
+
+    if ((entry = g_hash_table_lookup(auth_cache, key)) == NULL) {
+        cache_stats.misses++;
+        return FALSE;
+    }
+
+    if (!process_start_time(entry->pid, &start) || start != entry->start) {
+        OHM_DEBUG(DBG_AUTH, "dropping stale authorization of %s (pid %u)",
+                  peer, entry->pid);
+        g_hash_table_remove(auth_cache, key);
+        cache_stats.stale++;
+        cache_stats.misses++;
+        return FALSE;
+    }
+
+    OHM_DEBUG(DBG_AUTH, "%s (pid %u) is already authorized for class '%s'",
+              peer, entry->pid, klass);
+
+    *pid = entry->pid;
+    cache_stats.hits++;
+
+    return TRUE;
+}
+
+void auth_cache_add(const char *peer, const char *klass, pid_t pid)
+{
+    cache_entry *entry;
+    char         key[256];
+
+    if (auth_cache == NULL || peer == NULL || klass == NULL || pid == 0)
+        return;
+
+    entry = g_new0(cache_entry, 1);
+    entry->pid = pid;
+
+    if (!process_start_time(pid, &entry->start)) {
+        g_free(entry);
+        return;
+    }
+
+    /* clients come and go, so rather start over than let it grow */
+    if (g_hash_table_size(auth_cache) >= AUTH_CACHE_MAX)
+        g_hash_table_remove_all(auth_cache);
+
+    cache_key(peer, klass, key, sizeof(key));
+    g_hash_table_replace(auth_cache, g_strdup(key), entry);
+}
+
+void auth_cache_drop_peer(const char *peer)
+{
+    unsigned int n;
+
+    if (auth_cache == NULL || peer == NULL)
+        return;
+
+    n = g_hash_table_foreach_remove(auth_cache, peer_key, (gpointer)peer);
+
+    if (n > 0)
+        OHM_DEBUG(DBG_AUTH, "dropped %u authorization(s) of %s", n, peer);
+}
+
+void auth_cache_flush(void)
+{
+    if (auth_cache != NULL)
+        g_hash_table_remove_all(auth_cache);
+}
+
+static char *cache_key(const char *peer, const char *klass, char *buf, int len)
+{
+    snprintf(buf, len, "%s/%s", peer, klass);
+
+    return buf;
+}
+
+static gboolean peer_key(gpointer key, gpointer value, gpointer data)
+{
+    const char *peer = (const char *)data;
+    size_t      len  = strlen(peer);
+
+    (void)value;
+
+    return !strncmp((const char *)key, peer, len) && ((char *)key)[len] == '/';
+}
+
+static int process_start_time(pid_t pid, unsigned long long *start)
+{
+    FILE *fp;
+    char  path[64];
+    char  buf[1024];
+    char *p;
+    int   i;
+
+    snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return FALSE;
+
+    p = fgets(buf, sizeof(buf), fp);
+    fclose(fp);
+
+    /* the command name may contain spaces, skip past it */
+    if (p == NULL || (p = strrchr(buf, ')')) == NULL)
+        return FALSE;
+
+    /* starttime is the 22nd field, the 20th after the command name */
+    for (i = 0;  i < 20 && p != NULL;  i++)
+        p = strchr(p + 1, ' ');
+
+    if (p == NULL)
+        return FALSE;
+
+    *start = strtoull(p + 1, NULL, 10);
+
+    return TRUE;
+}
+
 static void free_key(gpointer ptr)
 {
     g_free(ptr);
@@ -21,6 +21,8 @@ USA.
 #ifndef __OHM_RESOURCE_AUTH_H__
 #define __OHM_RESOURCE_AUTH_H__
 
+#include <sys/types.h>
+
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 
@@ -33,6 +35,10 @@ void auth_init(OhmPlugin *);
 void auth_query(const char* klass, char** method, char** arg);
 auth_policy_t auth_get_default_policy();
 void auth_exit(OhmPlugin *plugin);
+int  auth_cache_lookup(const char *peer, const char *klass, pid_t *pid);
+void auth_cache_add(const char *peer, const char *klass, pid_t pid);
+void auth_cache_drop_peer(const char *peer);
+void auth_cache_flush(void);
 
 #endif /* __OHM_RESOURCE_AUTH_H__ */
 
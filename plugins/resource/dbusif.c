@@ -30,6 +30,7 @@ USA.
 #include "plugin.h"
 #include "dbusif.h"
 #include "manager.h"
+#include "auth.h"
 
 typedef struct {
     char                  *addr;
@@ -48,6 +49,8 @@ static void system_bus_init(void);
 static void session_bus_init(const char *);
 static void res_conn_setup(DBusConnection *);
 static void pid_queried(DBusPendingCall *, void *);
+static DBusHandlerResult name_owner_changed(DBusConnection *, DBusMessage *,
+                                            void *);
 
 
 
@@ -306,6 +309,22 @@ static void session_bus_init(const char *addr)
 
 static void res_conn_setup(DBusConnection *conn)
 {
+    char rule[512];
+
+    /* peer names of the previous bus, if any, mean nothing on this one */
+    auth_cache_flush();
+
+    /* authorizations are dropped when the peer leaves the bus */
+    snprintf(rule, sizeof(rule), "type='signal',sender='%s',interface='%s',"
+             "member='%s',path='%s',arg2=''", DBUS_ADMIN_NAME,
+             DBUS_ADMIN_INTERFACE, DBUS_NAME_OWNER_CHANGED_SIGNAL,
+             DBUS_ADMIN_PATH);
+
+    if (!dbus_connection_add_filter(conn, name_owner_changed, NULL, NULL))
+        OHM_ERROR("resource: can't add D-Bus filter for peer tracking");
+    else
+        dbus_bus_add_match(conn, rule, NULL);
+
     res_conn = resproto_init(RESPROTO_ROLE_MANAGER,
                              RESPROTO_TRANSPORT_DBUS,
                              conn);
@@ -383,6 +402,33 @@ static void pid_queried(DBusPendingCall *pend, void *data)
     dbus_pending_call_unref(pend);
 }
 
+static DBusHandlerResult name_owner_changed(DBusConnection *conn,
+                                            DBusMessage    *msg,
+                                            void           *ud)
+{
+    const char *name;
+    const char *before;
+    const char *after;
+
+    (void)conn;
+    (void)ud;
+
+    if (dbus_message_is_signal(msg, DBUS_ADMIN_INTERFACE,
+                               DBUS_NAME_OWNER_CHANGED_SIGNAL) &&
+        dbus_message_get_args(msg, NULL,
+                              DBUS_TYPE_STRING, &name,
+                              DBUS_TYPE_STRING, &before,
+                              DBUS_TYPE_STRING, &after,
+                              DBUS_TYPE_INVALID)              &&
+        name[0] == ':' && !after[0])
+    {
+        OHM_DEBUG(DBG_DBUS, "peer %s left the bus", name);
+        auth_cache_drop_peer(name);
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
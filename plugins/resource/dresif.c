@@ -27,15 +27,39 @@ USA.
 
 #include "plugin.h"
 #include "dresif.h"
+#include "arbiter.h"
 #include "resource-set.h"
 #include "timestamp.h"
 
 #define DRESIF_VARTYPE(t)  (char *)(t)
 #define DRESIF_VARVALUE(v) (char *)(v)
 
+#define BATCH_WINDOW_DEFAULT -1 /* usecs, 0: until idle, -1: no batching */
+
 
 OHM_IMPORTABLE(int, resolve, (char *goal, char **locals));
 
+/*
+ * Queued resource requests. Requests that arrive within the batch window
+ * are resolved together, with one resource_request goal for each run of
+ * consecutive requests with the same manager_id and request type, since
+ * the rules see those as variables. Only a batch that the arbiter handles
+ * entirely gets a single resolution. The batch callbacks are called around
+ * the resolution, to let the manager route the resulting grant changes
+ * back to the clients of the batch.
+ */
+static dresif_request_t  *batch;
+static int                nbatch;
+static int                batch_size;
+static guint              batch_srcid;
+static int                batch_window = BATCH_WINDOW_DEFAULT;
+static dresif_batch_cb_t  batch_begin;
+static dresif_batch_cb_t  batch_end;
+
+static int resolve_batch(dresif_request_t *, int);
+static gboolean flush_batch(gpointer);
+static void free_batch(dresif_request_t *, int);
+
 
 /*! \addtogroup pubif
  *  Functions
@@ -44,10 +68,10 @@ OHM_IMPORTABLE(int, resolve, (char *goal, char **locals));
 
 void dresif_init(OhmPlugin *plugin)
 {
-    char *name      = "dres.resolve";
-    char *signature = (char *)resolve_SIGNATURE;
-
-    (void)plugin;
+    char       *name      = "dres.resolve";
+    char       *signature = (char *)resolve_SIGNATURE;
+    const char *window_str;
+    char       *e;
 
     ENTER;
 
@@ -58,6 +82,44 @@ void dresif_init(OhmPlugin *plugin)
         exit(1);
     }
 
+    if ((window_str = ohm_plugin_get_param(plugin, "request-batch")) != NULL) {
+        batch_window = strtol(window_str, &e, 10);
+
+        if (*e != '\0') {
+            OHM_ERROR("resource: Invalid value '%s' for 'request-batch'",
+                      window_str);
+            batch_window = BATCH_WINDOW_DEFAULT;
+        }
+    }
+
+    if (batch_window < 0)
+        OHM_INFO("resource: resource requests are resolved one by one");
+    else
+        OHM_INFO("resource: resource requests are batched for %dusec",
+                 batch_window);
+
+    LEAVE;
+}
+
+
+void dresif_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    ENTER;
+
+    /* the pending batch is dropped, nobody is left to get the grants */
+    if (batch_srcid) {
+        g_source_remove(batch_srcid);
+        batch_srcid = 0;
+    }
+
+    free_batch(batch, nbatch);
+
+    batch      = NULL;
+    nbatch     = 0;
+    batch_size = 0;
+
     LEAVE;
 }
 
@@ -120,10 +182,153 @@ int dresif_resource_request(uint32_t  manager_id,
     return success;
 }
 
+int dresif_queue_resource_request(uint32_t  manager_id,
+                                  char     *client_name,
+                                  uint32_t  client_id,
+                                  char     *request,
+                                  uint32_t  reqno)
+{
+    dresif_request_t  req;
+    dresif_request_t *mem;
+    int               size;
+    int               success;
+
+    req.manager_id  = manager_id;
+    req.reqno       = reqno;
+    req.client_name = client_name;
+    req.client_id   = client_id;
+    req.request     = request;
+
+    if (batch_window < 0) {
+        if (batch_begin != NULL)
+            batch_begin(&req, 1, TRUE);
+
+        success = resolve_batch(&req, 1);
+
+        if (batch_end != NULL)
+            batch_end(&req, 1, success);
+
+        return success;
+    }
+
+    if (nbatch >= batch_size) {
+        size = batch_size ? batch_size * 2 : 16;
+
+        if ((mem = realloc(batch, size * sizeof(batch[0]))) == NULL) {
+            OHM_ERROR("resource: [%s] memory allocation failure",
+                      __FUNCTION__);
+            return FALSE;
+        }
+
+        batch      = mem;
+        batch_size = size;
+    }
+
+    req.client_name = strdup(client_name ? client_name : "<unknown>");
+    req.request     = strdup(request);
+    batch[nbatch++] = req;
+
+    OHM_DEBUG(DBG_DRES, "queued resource_request '%s' for %s/%u "
+              "(manager id %u), %d in batch", request, req.client_name,
+              client_id, manager_id, nbatch);
+
+    if (!batch_srcid) {
+        if (batch_window > 0)
+            batch_srcid = g_timeout_add((batch_window + 999) / 1000,
+                                        flush_batch, NULL);
+        else
+            batch_srcid = g_idle_add(flush_batch, NULL);
+    }
+
+    return TRUE;
+}
+
+void dresif_set_batch_callbacks(dresif_batch_cb_t begin, dresif_batch_cb_t end)
+{
+    batch_begin = begin;
+    batch_end   = end;
+}
+
 /*!
  * @}
  */
 
+static gboolean flush_batch(gpointer data)
+{
+    dresif_request_t *reqs = batch;
+    int               nreq = nbatch;
+    int               success;
+
+    (void)data;
+
+    /* requests coming in while resolving go to the next batch */
+    batch       = NULL;
+    nbatch      = 0;
+    batch_size  = 0;
+    batch_srcid = 0;
+
+    if (nreq > 0) {
+        OHM_DEBUG(DBG_DRES, "resolving %d batched resource request%s", nreq,
+                  nreq == 1 ? "" : "s");
+
+        if (batch_begin != NULL)
+            batch_begin(reqs, nreq, TRUE);
+
+        success = resolve_batch(reqs, nreq);
+
+        if (batch_end != NULL)
+            batch_end(reqs, nreq, success);
+    }
+
+    free_batch(reqs, nreq);
+
+    return FALSE;
+}
+
+static int same_context(dresif_request_t *r1, dresif_request_t *r2)
+{
+    return r1->manager_id == r2->manager_id && !strcmp(r1->request, r2->request);
+}
+
+static int resolve_batch(dresif_request_t *reqs, int nreq)
+{
+    dresif_request_t *last;
+    int               i, success;
+
+    if (arbiter_resolve(reqs, nreq))
+        return TRUE;
+
+    success = TRUE;
+
+    for (i = 0;  i < nreq;  i++) {
+        /* only repeated requests of the same set share a resolution */
+        if (i + 1 < nreq && same_context(reqs + i, reqs + i + 1))
+            continue;
+
+        last = reqs + i;
+
+        if (!dresif_resource_request(last->manager_id, last->client_name,
+                                     last->client_id, last->request))
+            success = FALSE;
+    }
+
+    arbiter_resolved(success);
+
+    return success;
+}
+
+static void free_batch(dresif_request_t *reqs, int nreq)
+{
+    int i;
+
+    for (i = 0;  i < nreq;  i++) {
+        free(reqs[i].client_name);
+        free(reqs[i].request);
+    }
+
+    free(reqs);
+}
+
 
 /* 
  * Local Variables:
@@ -26,8 +26,22 @@ USA.
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 
+typedef struct {
+    uint32_t  manager_id;
+    uint32_t  reqno;
+    char     *client_name;
+    uint32_t  client_id;
+    char     *request;
+} dresif_request_t;
+
+typedef void (*dresif_batch_cb_t)(dresif_request_t *, int, int);
+
 void dresif_init(OhmPlugin *);
+void dresif_exit(OhmPlugin *);
 int  dresif_resource_request(uint32_t, char *, uint32_t, char *);
+int  dresif_queue_resource_request(uint32_t, char *, uint32_t, char *,
+                                   uint32_t);
+void dresif_set_batch_callbacks(dresif_batch_cb_t, dresif_batch_cb_t);
 
 
 #endif /* __OHM_RESOURCE_DRESIF_H__ */
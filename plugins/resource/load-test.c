@@ -0,0 +1,775 @@
+/*************************************************************************
+Copyright (C) 2011 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Load generator for the resource manager. It simulates a number of
+ * resource clients over the internal resource protocol, each running the
+ * same script of requests, and reports the request-to-grant latencies and
+ * the CPU time spent by the daemon meanwhile. Driven from the console:
+ *
+ *     load-test start clients=50 script=boot
+ *     load-test start clients=20 script=acquire,release cycles=100 think=5
+ *
+ * Every client registers its own resource set, runs the script 'cycles'
+ * times and unregisters. Steps are acquire, release, update (toggles the
+ * optional video playback), audio, video and disconnect. A disconnect
+ * drops the set with an unregister while it may still hold resources and
+ * ends the client. The summary is printed as a single line of key=value
+ * pairs so that the runs of different builds can be compared directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gmodule.h>
+#include <ohm/ohm-plugin.h>
+#include <ohm/ohm-plugin-log.h>
+#include <ohm/ohm-plugin-debug.h>
+
+#include <res-conn.h>
+
+#define CLIENT_MAX     1024
+#define SCRIPT_MAX     32
+#define LOAD_KLASS     "player"
+
+typedef enum {
+    step_unknown = 0,
+    step_register,
+    step_acquire,
+    step_release,
+    step_update,
+    step_audio,
+    step_video,
+    step_disconnect,
+    step_unregister,
+} step_t;
+
+typedef enum {
+    client_idle = 0,
+    client_waiting,                     /* for a reply */
+    client_thinking,                    /* between two steps */
+    client_done
+} client_state_t;
+
+typedef struct {
+    uint32_t        id;                 /* resource set ID */
+    resset_t       *rset;
+    client_state_t  state;
+    int             cycle;
+    int             step;
+    step_t          current;
+    uint32_t        reqno;              /* request waiting for a reply */
+    uint32_t        video;              /* optional video playback */
+    double          sent;               /* when the request was sent */
+    guint           timer;
+} client_t;
+
+typedef struct {
+    double   *usecs;
+    int       nsample;
+    int       size;
+} samples_t;
+
+static struct {
+    char     *name;
+    char     *steps;
+} scripts[] = {
+    { "boot"   , "acquire"                          },
+    { "cycle"  , "acquire,release"                  },
+    { "streams", "audio,video,acquire,update,release" },
+    { "churn"  , "acquire,disconnect"               },
+    { NULL     , NULL                               }
+};
+
+
+OHM_IMPORTABLE(int   , add_command, (char *name, void (*handler)(char *)));
+OHM_IMPORTABLE(void *, timer_add  , (uint32_t delay,
+                                     resconn_timercb_t callback,
+                                     void *data));
+OHM_IMPORTABLE(void  , timer_del  , (void *timer));
+
+static resconn_t   *conn;
+static uint32_t     reqno = 1;
+
+static client_t    *clients;
+static int          nclient;
+static int          nactive;
+static step_t       script[SCRIPT_MAX];
+static int          nstep;
+static char         script_name[128];
+static int          ncycle;
+static int          think;              /* msecs between steps */
+static int          interval;           /* msecs between client starts */
+static int          nstarted;
+static int          stopping;
+static guint        start_timer;
+
+static samples_t    latency;
+static uint32_t     nrequest;
+static uint32_t     nerror;
+static double       start_time;
+static struct rusage start_usage;
+
+static void console_init(void);
+static void console_command(char *);
+static void load_start(char *);
+static void load_stop(void);
+static void load_report(void);
+static int  parse_script(const char *);
+static gboolean start_next_client(gpointer);
+
+static void      client_init(void);
+static void      client_run(client_t *);
+static void      client_send(client_t *, step_t);
+static void      client_finish(client_t *);
+static void      client_think(client_t *);
+static gboolean  client_think_cb(gpointer);
+static client_t *client_find(resset_t *);
+static void      client_unregister(resmsg_t *, resset_t *, void *);
+static void      client_grant(resmsg_t *, resset_t *, void *);
+static void      client_advice(resmsg_t *, resset_t *, void *);
+static void      client_status(resset_t *, resmsg_t *);
+static void      client_manager_up(resconn_t *);
+
+static double    now_usecs(void);
+static void      add_sample(samples_t *, double);
+static int       compare_samples(const void *, const void *);
+
+
+static void plugin_init(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    console_init();
+    client_init();
+}
+
+static void plugin_destroy(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    load_stop();
+    free(latency.usecs);
+}
+
+static void console_init(void)
+{
+    add_command("load-test", console_command);
+    OHM_INFO("load-test: registered load test console command handler");
+}
+
+static void console_command(char *cmd)
+{
+    if (!strcmp(cmd, "help")) {
+        printf("load-test help            show this help\n");
+        printf("load-test start [opts]    start a load test, options:\n");
+        printf("    clients=N             number of clients (10)\n");
+        printf("    script=S              boot, cycle, streams, churn or\n"
+               "                          a comma separated list of steps\n");
+        printf("    cycles=N              script repetitions (1)\n");
+        printf("    think=MS              delay between steps (0)\n");
+        printf("    interval=MS           delay between client starts (0)\n");
+        printf("load-test stop            stop the running load test\n");
+        printf("load-test status          show the progress of the test\n");
+    }
+    else if (!strncmp(cmd, "start", 5) && (!cmd[5] || isspace(cmd[5]))) {
+        load_start(cmd + 5);
+    }
+    else if (!strcmp(cmd, "stop")) {
+        load_stop();
+    }
+    else if (!strcmp(cmd, "status")) {
+        printf("load-test: %d clients, %d started, %d active, %u requests, "
+               "%u errors\n", nclient, nstarted, nactive, nrequest, nerror);
+    }
+    else {
+        printf("load-test: unknown command\n");
+    }
+}
+
+static void load_start(char *args)
+{
+    char *arg, *val, *saveptr;
+    int   n;
+
+    if (clients != NULL) {
+        printf("load-test: a test is already running\n");
+        return;
+    }
+
+    if (conn == NULL) {
+        printf("load-test: not connected to manager\n");
+        return;
+    }
+
+    n        = 10;
+    ncycle   = 1;
+    think    = 0;
+    interval = 0;
+    parse_script("boot");
+
+    for (arg = strtok_r(args, " \t", &saveptr);
+         arg != NULL;
+         arg = strtok_r(NULL, " \t", &saveptr))
+    {
+        if ((val = strchr(arg, '=')) == NULL) {
+            printf("load-test: invalid option '%s'\n", arg);
+            return;
+        }
+
+        *val++ = '\0';
+
+        if      (!strcmp(arg, "clients"))  n        = atoi(val);
+        else if (!strcmp(arg, "cycles"))   ncycle   = atoi(val);
+        else if (!strcmp(arg, "think"))    think    = atoi(val);
+        else if (!strcmp(arg, "interval")) interval = atoi(val);
+        else if (!strcmp(arg, "script")) {
+            if (!parse_script(val)) {
+                printf("load-test: invalid script '%s'\n", val);
+                return;
+            }
+        }
+        else {
+            printf("load-test: unknown option '%s'\n", arg);
+            return;
+        }
+    }
+
+    if (n <= 0 || n > CLIENT_MAX || ncycle <= 0 || think < 0 || interval < 0) {
+        printf("load-test: invalid options\n");
+        return;
+    }
+
+    if ((clients = calloc(n, sizeof(client_t))) == NULL) {
+        printf("load-test: can't allocate memory\n");
+        return;
+    }
+
+    nclient  = n;
+    nactive  = 0;
+    nstarted = 0;
+    nrequest = 0;
+    nerror   = 0;
+    latency.nsample = 0;
+
+    OHM_INFO("load-test: starting %d clients with script '%s', %d cycles",
+             nclient, script_name, ncycle);
+
+    getrusage(RUSAGE_SELF, &start_usage);
+    start_time = now_usecs();
+
+    if (interval > 0)
+        start_timer = g_timeout_add(interval, start_next_client, NULL);
+    else {
+        while (start_next_client(NULL))
+            ;
+    }
+}
+
+static void load_stop(void)
+{
+    int i;
+
+    if (clients == NULL)
+        return;
+
+    if (start_timer) {
+        g_source_remove(start_timer);
+        start_timer = 0;
+    }
+
+    stopping = TRUE;
+
+    for (i = 0;  i < nstarted;  i++) {
+        if (clients[i].state != client_done)
+            client_finish(clients + i);
+    }
+
+    stopping = FALSE;
+
+    load_report();
+}
+
+static void load_report(void)
+{
+    struct rusage  usage;
+    double         elapsed, cpu;
+    double        *s;
+    int            n;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    elapsed = now_usecs() - start_time;
+    cpu     = (usage.ru_utime.tv_sec  - start_usage.ru_utime.tv_sec)  * 1e6 +
+              (usage.ru_utime.tv_usec - start_usage.ru_utime.tv_usec)       +
+              (usage.ru_stime.tv_sec  - start_usage.ru_stime.tv_sec)  * 1e6 +
+              (usage.ru_stime.tv_usec - start_usage.ru_stime.tv_usec);
+
+    s = latency.usecs;
+    n = latency.nsample;
+
+    if (n > 0)
+        qsort(s, n, sizeof(s[0]), compare_samples);
+
+#define PCT(p) (n > 0 ? s[(int)((double)(n - 1) * (p) / 100.0)] : 0.0)
+
+    printf("load-test: clients=%d script=%s cycles=%d think=%d interval=%d "
+           "requests=%u errors=%u grants=%d "
+           "latency_min=%.0f latency_p50=%.0f latency_p90=%.0f "
+           "latency_p99=%.0f latency_max=%.0f "
+           "elapsed_usec=%.0f cpu_usec=%.0f cpu_per_request=%.1f\n",
+           nclient, script_name, ncycle, think, interval,
+           nrequest, nerror, n,
+           PCT(0), PCT(50), PCT(90), PCT(99), PCT(100),
+           elapsed, cpu, nrequest ? cpu / nrequest : 0.0);
+
+#undef PCT
+
+    free(clients);
+    clients  = NULL;
+    nclient  = 0;
+    nstarted = 0;
+}
+
+static int parse_script(const char *spec)
+{
+    static struct {
+        const char *name;
+        step_t      step;
+    } steps[] = {
+        { "acquire"   , step_acquire    },
+        { "release"   , step_release    },
+        { "update"    , step_update     },
+        { "audio"     , step_audio      },
+        { "video"     , step_video      },
+        { "disconnect", step_disconnect },
+        { NULL        , step_unknown    }
+    };
+
+    const char *name = spec;
+    char        buf[512];
+    char       *tok, *saveptr;
+    int         i, n;
+
+    for (i = 0;  scripts[i].name != NULL;  i++) {
+        if (!strcmp(spec, scripts[i].name)) {
+            spec = scripts[i].steps;
+            break;
+        }
+    }
+
+    strncpy(buf, spec, sizeof(buf));
+    buf[sizeof(buf)-1] = '\0';
+
+    for (tok = strtok_r(buf, ",", &saveptr), n = 0;
+         tok != NULL;
+         tok = strtok_r(NULL, ",", &saveptr))
+    {
+        for (i = 0;  steps[i].name != NULL;  i++) {
+            if (!strcmp(tok, steps[i].name))
+                break;
+        }
+
+        if (steps[i].name == NULL || n >= SCRIPT_MAX)
+            return FALSE;
+
+        script[n++] = steps[i].step;
+    }
+
+    if (n == 0)
+        return FALSE;
+
+    nstep = n;
+    snprintf(script_name, sizeof(script_name), "%s", name);
+
+    return TRUE;
+}
+
+static gboolean start_next_client(gpointer data)
+{
+    client_t *client;
+
+    (void)data;
+
+    if (clients == NULL || nstarted >= nclient) {
+        start_timer = 0;
+        return FALSE;
+    }
+
+    client = clients + nstarted++;
+
+    memset(client, 0, sizeof(*client));
+    client->id = nstarted;
+
+    nactive++;
+    client_send(client, step_register);
+
+    return nstarted < nclient;
+}
+
+
+static void client_init(void)
+{
+    conn = resproto_init(RESPROTO_ROLE_CLIENT, RESPROTO_TRANSPORT_INTERNAL,
+                         client_manager_up, "LoadTest", timer_add, timer_del);
+
+    if (conn == NULL) {
+        OHM_ERROR("load-test: can't initialize resource loopback protocol");
+        return;
+    }
+
+    resproto_set_handler(conn, RESMSG_UNREGISTER, client_unregister);
+    resproto_set_handler(conn, RESMSG_GRANT     , client_grant     );
+    resproto_set_handler(conn, RESMSG_ADVICE    , client_advice    );
+
+    OHM_INFO("load-test: resource loopback protocol initialized");
+}
+
+static void client_run(client_t *client)
+{
+    step_t step;
+
+    if (client->step >= nstep) {
+        client->step = 0;
+
+        if (++client->cycle >= ncycle) {
+            client_send(client, step_unregister);
+            return;
+        }
+    }
+
+    step = script[client->step++];
+
+    client_send(client, step);
+}
+
+static void client_send(client_t *client, step_t step)
+{
+    resmsg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+
+    client->current = step;
+    client->reqno   = reqno++;
+    client->state   = client_waiting;
+    client->sent    = now_usecs();
+
+    nrequest++;
+
+    switch (step) {
+
+    case step_register:
+    case step_update:
+        if (step == step_update)
+            client->video ^= RESMSG_VIDEO_PLAYBACK;
+
+        msg.record.type       = step == step_register ?
+                                RESMSG_REGISTER : RESMSG_UPDATE;
+        msg.record.id         = client->id;
+        msg.record.reqno      = client->reqno;
+        msg.record.rset.all   = RESMSG_AUDIO_PLAYBACK | client->video;
+        msg.record.rset.opt   = client->video;
+        msg.record.rset.share = 0;
+        msg.record.rset.mask  = 0;
+        msg.record.klass      = LOAD_KLASS;
+        msg.record.mode       = RESMSG_MODE_ALWAYS_REPLY;
+
+        if (step == step_register) {
+            if ((client->rset = resconn_connect(conn, &msg,
+                                                client_status)) == NULL) {
+                nerror++;
+                client_finish(client);
+            }
+        }
+        else
+            resproto_send_message(client->rset, &msg, client_status);
+        break;
+
+    case step_acquire:
+    case step_release:
+        msg.possess.type  = step == step_acquire ?
+                            RESMSG_ACQUIRE : RESMSG_RELEASE;
+        msg.possess.id    = client->id;
+        msg.possess.reqno = client->reqno;
+
+        resproto_send_message(client->rset, &msg, client_status);
+        break;
+
+    case step_audio:
+        msg.audio.type                 = RESMSG_AUDIO;
+        msg.audio.id                   = client->id;
+        msg.audio.reqno                = client->reqno;
+        msg.audio.group                = LOAD_KLASS;
+        msg.audio.pid                  = getpid();
+        msg.audio.property.name        = "media.name";
+        msg.audio.property.match.method  = resmsg_method_equals;
+        msg.audio.property.match.pattern = "load-test";
+
+        resproto_send_message(client->rset, &msg, client_status);
+        break;
+
+    case step_video:
+        msg.video.type  = RESMSG_VIDEO;
+        msg.video.id    = client->id;
+        msg.video.reqno = client->reqno;
+        msg.video.pid   = getpid();
+
+        resproto_send_message(client->rset, &msg, client_status);
+        break;
+
+    case step_disconnect:
+    case step_unregister:
+        msg.possess.type  = RESMSG_UNREGISTER;
+        msg.possess.id    = client->id;
+        msg.possess.reqno = client->reqno;
+
+        resconn_disconnect(client->rset, &msg, NULL);
+        client->rset = NULL;
+        client_finish(client);
+        break;
+
+    default:
+        client_finish(client);
+        break;
+    }
+}
+
+static void client_finish(client_t *client)
+{
+    resmsg_t msg;
+
+    if (client->timer) {
+        g_source_remove(client->timer);
+        client->timer = 0;
+    }
+
+    if (client->rset != NULL) {
+        memset(&msg, 0, sizeof(msg));
+        msg.possess.type  = RESMSG_UNREGISTER;
+        msg.possess.id    = client->id;
+        msg.possess.reqno = reqno++;
+
+        resconn_disconnect(client->rset, &msg, NULL);
+        client->rset = NULL;
+    }
+
+    if (client->state != client_done) {
+        client->state = client_done;
+
+        if (--nactive == 0 && nstarted >= nclient && !stopping)
+            load_report();
+    }
+}
+
+static void client_think(client_t *client)
+{
+    client->reqno = 0;
+
+    if (think > 0) {
+        client->state = client_thinking;
+        client->timer = g_timeout_add(think, client_think_cb, client);
+    }
+    else {
+        client->state = client_idle;
+        client_run(client);
+    }
+}
+
+static gboolean client_think_cb(gpointer data)
+{
+    client_t *client = (client_t *)data;
+
+    client->timer = 0;
+    client->state = client_idle;
+
+    client_run(client);
+
+    return FALSE;
+}
+
+static client_t *client_find(resset_t *rset)
+{
+    client_t *client;
+
+    if (rset == NULL || clients == NULL ||
+        rset->id == 0 || rset->id > (uint32_t)nstarted)
+        return NULL;
+
+    client = clients + (rset->id - 1);
+
+    return client->state == client_done ? NULL : client;
+}
+
+static void client_unregister(resmsg_t *msg, resset_t *rset, void *data)
+{
+    client_t *client;
+
+    if ((client = client_find(rset)) != NULL) {
+        client->rset = NULL;
+        client_finish(client);
+    }
+
+    resproto_reply_message(rset, msg, data, 0, "OK");
+}
+
+static void client_grant(resmsg_t *msg, resset_t *rset, void *data)
+{
+    client_t *client;
+
+    (void)data;
+
+    if ((client = client_find(rset)) == NULL)
+        return;
+
+    /* the grant is the reply to acquire, release and update */
+    if (client->state == client_waiting && msg->notify.reqno == client->reqno) {
+        add_sample(&latency, now_usecs() - client->sent);
+        client_think(client);
+    }
+}
+
+static void client_advice(resmsg_t *msg, resset_t *rset, void *data)
+{
+    (void)msg;
+    (void)rset;
+    (void)data;
+}
+
+static void client_status(resset_t *rset, resmsg_t *msg)
+{
+    client_t *client;
+
+    if ((client = client_find(rset)) == NULL || msg->type != RESMSG_STATUS)
+        return;
+
+    if (client->state != client_waiting || msg->status.reqno != client->reqno)
+        return;
+
+    /* the reply to the registration may come before resconn_connect returns */
+    if (client->rset == NULL && client->current == step_register)
+        client->rset = rset;
+
+    if (msg->status.errcod != 0) {
+        OHM_INFO("load-test: client %u: request failed: %d (%s)",
+                 client->id, msg->status.errcod, msg->status.errmsg);
+        nerror++;
+        client_think(client);
+        return;
+    }
+
+    switch (client->current) {
+    case step_acquire:
+    case step_release:
+    case step_update:
+        break;                          /* wait for the grant */
+    default:
+        client_think(client);
+        break;
+    }
+}
+
+static void client_manager_up(resconn_t *rc)
+{
+    (void)rc;
+
+    OHM_INFO("load-test: resource manager is up");
+}
+
+
+static double now_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void add_sample(samples_t *samples, double usecs)
+{
+    double *mem;
+    int     size;
+
+    if (samples->nsample >= samples->size) {
+        size = samples->size ? samples->size * 2 : 1024;
+
+        if ((mem = realloc(samples->usecs, size * sizeof(double))) == NULL)
+            return;
+
+        samples->usecs = mem;
+        samples->size  = size;
+    }
+
+    samples->usecs[samples->nsample++] = usecs;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+
+
+OHM_PLUGIN_DESCRIPTION(
+    "OHM internal resource load generator", /* description */
+    "0.0.1",                                /* version */
+    "janos.f.kovacs@nokia.com",             /* author */
+    OHM_LICENSE_LGPL,                       /* license */
+    plugin_init,                            /* initalize */
+    plugin_destroy,                         /* destroy */
+    NULL                                    /* notify */
+);
+
+OHM_PLUGIN_PROVIDES(
+    "maemo.resource_load"
+);
+
+OHM_PLUGIN_REQUIRES(
+    "resource"
+);
+
+OHM_PLUGIN_REQUIRES_METHODS(resource_load, 3,
+    OHM_IMPORT("dres.add_command"     , add_command),
+    OHM_IMPORT("resource.restimer_add", timer_add  ),
+    OHM_IMPORT("resource.restimer_del", timer_del  )
+);
+
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
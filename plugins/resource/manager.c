@@ -44,6 +44,7 @@ typedef struct reg_data_s {
     struct reg_data_s *next;
     int                canceled;
     int                authorize;
+    int                cacheable;   /* remember a successful authorization */
     resmsg_t          *msg;
     resset_t          *resset;
     void              *proto_data;
@@ -59,6 +60,7 @@ OHM_IMPORTABLE(int, auth_request, (char *id_type,  void *id,
                                    auth_request_cb_t callback, void *data));
 
 static uint32_t     trans_id;
+static int          batch_trans;    /* trans_id was started for a batch */
 static reg_data_t  *reg_reqs;
 
 static void forced_auto_release(resource_set_t *);
@@ -81,6 +83,9 @@ static void transaction_start(resource_set_t *, resmsg_t *);
 static void transaction_end(resource_set_t *);
 static void transaction_complete(uint32_t *, int, uint32_t, void *);
 
+static void batch_begin(dresif_request_t *, int, int);
+static void batch_end(dresif_request_t *, int, int);
+
 
 
 /*! \addtogroup pubif
@@ -91,9 +96,7 @@ static void transaction_complete(uint32_t *, int, uint32_t, void *);
 void manager_init(OhmPlugin *plugin)
 {
 #define ADD_FIELD_WATCH(n,cb) \
-    fsif_add_field_watch(FACTSTORE_RESOURCE_SET,NULL, n, cb, NULL)
-
-    (void)plugin;
+    fsif_add_field_watch(plugin, FACTSTORE_RESOURCE_SET, NULL, n, cb, NULL)
 
     char *name      = "auth.request";
     char *signature = (char *)auth_request_SIGNATURE; 
@@ -112,6 +115,8 @@ void manager_init(OhmPlugin *plugin)
     ADD_FIELD_WATCH("request", request_cb);
     ADD_FIELD_WATCH("block"  , block_cb  );
 
+    dresif_set_batch_callbacks(batch_begin, batch_end);
+
     LEAVE;
 
 #undef ADD_FIELD_WATCH
@@ -164,8 +169,8 @@ void manager_unregister(resmsg_t *msg, resset_t *resset, void *proto_data)
         resource_set_destroy(resset);
 
     if (manager_id) {
-        dresif_resource_request(manager_id, client_name, client_id,
-                                "unregister");
+        dresif_queue_resource_request(manager_id, client_name, client_id,
+                                      "unregister", 0);
     }
 
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
@@ -244,15 +249,13 @@ void manager_update(resmsg_t *msg, resset_t *resset, void *proto_data)
         rs->granted.client != 0)
         resource_set_update_factstore(resset, update_request);
 
-    dresif_resource_request(rs->manager_id, resset->peer, resset->id, "update");
+    dresif_queue_resource_request(rs->manager_id, resset->peer, resset->id,
+                                  "update", rs->reqno);
 
  reply_message:
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (trans_id != NO_TRANSACTION && (resset->mode & RESMSG_MODE_ALWAYS_REPLY))
-        resource_set_queue_change(rs, trans_id, rs->reqno, resource_set_granted);
-
     transaction_end(rs);
 }
 
@@ -292,8 +295,8 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
 
         if (acquire) {
             resource_set_update_factstore(resset, update_request);
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "acquire");
+            dresif_queue_resource_request(rs->manager_id, resset->peer,
+                                          resset->id, "acquire", rs->reqno);
         }
     }
 
@@ -301,7 +304,8 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
 
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (rs && trans_id && (resset->mode & RESMSG_MODE_ALWAYS_REPLY)) {
+    /* if resolved, the reply is queued after the resolution in batch_end */
+    if (rs && trans_id && !acquire && (resset->mode&RESMSG_MODE_ALWAYS_REPLY)){
         resource_set_queue_change(rs,trans_id,rs->reqno,resource_set_granted);
     }
 
@@ -348,8 +352,8 @@ void manager_release(resmsg_t *msg, resset_t *resset, void *proto_data)
 
         if (release) {
             resource_set_update_factstore(resset, update_request);
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "release");
+            dresif_queue_resource_request(rs->manager_id, resset->peer,
+                                          resset->id, "release", rs->reqno);
         }
     }
 
@@ -357,7 +361,8 @@ void manager_release(resmsg_t *msg, resset_t *resset, void *proto_data)
 
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (rs && trans_id && (resset->mode & RESMSG_MODE_ALWAYS_REPLY)) {
+    /* if resolved, the reply is queued after the resolution in batch_end */
+    if (rs && trans_id && !release && (resset->mode&RESMSG_MODE_ALWAYS_REPLY)){
         resource_set_queue_change(rs,trans_id,rs->reqno,resource_set_granted);
     }
 
@@ -394,8 +399,8 @@ void manager_audio(resmsg_t *msg, resset_t *resset, void *proto_data)
                                         propnam, method,pattern);
 
         if (success) {
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "audio");
+            dresif_queue_resource_request(rs->manager_id, resset->peer,
+                                          resset->id, "audio", rs->reqno);
         }
     }
 
@@ -429,8 +434,8 @@ void manager_video(resmsg_t *msg, resset_t *resset, void *proto_data)
         success = resource_set_add_spec(resset, resource_video, pid);
 
         if (success) {
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "video");
+            dresif_queue_resource_request(rs->manager_id, resset->peer,
+                                          resset->id, "video", rs->reqno);
         }
     }
 
@@ -466,8 +471,8 @@ static void forced_auto_release(resource_set_t *rs)
             resource_set_update_factstore(resset, update_block);
             resource_set_update_factstore(resset, update_request);
 
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "release");
+            dresif_queue_resource_request(rs->manager_id, resset->peer,
+                                          resset->id, "release", rs->reqno);
 
             transaction_end(rs);
         }
@@ -559,6 +564,9 @@ static void register_cb(int32_t errcod, reg_data_t *regreq)
         goto reply_message;
     }
 
+    if (regreq->cacheable)
+        auth_cache_add(resset->peer, resset->klass, regreq->pid);
+
     rs = resource_set_create(regreq->pid, resset);
     if (!rs) {
         errcod = ENOMEM;
@@ -567,7 +575,8 @@ static void register_cb(int32_t errcod, reg_data_t *regreq)
     }
 
     transaction_start(rs, msg);
-    dresif_resource_request(rs->manager_id, resset->peer, resset->id, "register");
+    dresif_queue_resource_request(rs->manager_id, resset->peer, resset->id,
+                                  "register", rs->reqno);
 
  reply_message:
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
@@ -741,6 +750,7 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
     reg_data_t  *last;
     char        *method;
     char        *arg;
+    pid_t        pid;
     int          success = FALSE;
     
     for (last = (reg_data_t *)&reg_reqs;   last->next;   last = last->next)
@@ -772,7 +782,16 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
             case RESMSG_REGISTER:
                 auth_query(resset->klass, &method, &arg);
 
-                if (!resset->peer) {
+                regreq->cacheable = TRUE;
+
+                if (resset->peer &&
+                    auth_cache_lookup(resset->peer, resset->klass, &pid))
+                {
+                    /* authorized already, no need to ask the bus */
+                    regreq->cacheable = FALSE;
+                    pid_cb(pid, regreq);
+                }
+                else if (!resset->peer) {
                     /* we can't query the pid -- better not authorize */
                     authorize_cb(FALSE, "not authorized", regreq);
                 }
@@ -872,6 +891,62 @@ static void transaction_end(resource_set_t *rs)
     }
 }
 
+/*
+ * Called around the resolution of a batch of resource requests. The grant
+ * and advice changes of the resolution go to a single transaction: the
+ * current one if the request was resolved right away, otherwise a new one.
+ * The request numbers are restored so that every client gets its reply
+ * with the reqno of its own request.
+ */
+static void batch_begin(dresif_request_t *reqs, int nreq, int unused)
+{
+    resource_set_t *rs;
+    int             i;
+
+    (void)unused;
+
+    if (trans_id == NO_TRANSACTION) {
+        transaction_start(NULL, NULL);
+        batch_trans = TRUE;
+    }
+
+    for (i = 0;  i < nreq;  i++) {
+        if ((rs = resource_set_find_by_id(reqs[i].manager_id)) != NULL &&
+            reqs[i].reqno != 0)
+            rs->reqno = reqs[i].reqno;
+    }
+}
+
+static void batch_end(dresif_request_t *reqs, int nreq, int success)
+{
+    resource_set_t *rs;
+    resset_t       *resset;
+    int             i;
+
+    (void)success;
+
+    for (i = 0;  i < nreq;  i++) {
+        if ((rs = resource_set_find_by_id(reqs[i].manager_id)) == NULL ||
+            (resset = rs->resset) == NULL)
+            continue;
+
+        if (trans_id && reqs[i].reqno &&
+            (resset->mode & RESMSG_MODE_ALWAYS_REPLY))
+        {
+            resource_set_queue_change(rs, trans_id, reqs[i].reqno,
+                                      resource_set_granted);
+        }
+
+        if (batch_trans)
+            rs->reqno = 0;
+    }
+
+    if (batch_trans) {
+        batch_trans = FALSE;
+        transaction_end(NULL);
+    }
+}
+
 static void transaction_complete(uint32_t *ids,int nid,uint32_t txid,void *ud)
 {
     int i;
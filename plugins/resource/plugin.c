@@ -36,6 +36,7 @@ USA.
 #include "dresif.h"
 #include "ruleif.h"
 #include "auth.h"
+#include "arbiter.h"
 
 /* these are the manually set up equivalents of OHM_EXPORTABLE */
 static const char *OHM_VAR(internalif_timer_add,_SIGNATURE) =
@@ -47,7 +48,7 @@ static const char *OHM_VAR(internalif_timer_del,_SIGNATURE) =
 
 int DBG_INIT, DBG_MGR, DBG_SET, DBG_DBUS, DBG_INTERNAL;
 int DBG_DRES, DBG_FS, DBG_QUE, DBG_TRANSACT, DBG_MEDIA, DBG_AUTH;
-int DBG_RULE;
+int DBG_RULE, DBG_ARBITER;
 
 OHM_DEBUG_PLUGIN(resource,
     OHM_DEBUG_FLAG( "init"    , "init sequence"      , &DBG_INIT     ),
@@ -61,7 +62,8 @@ OHM_DEBUG_PLUGIN(resource,
     OHM_DEBUG_FLAG( "transact", "transactions"       , &DBG_TRANSACT ),
     OHM_DEBUG_FLAG( "media"   , "media"              , &DBG_MEDIA    ),
     OHM_DEBUG_FLAG( "auth"    , "security"           , &DBG_AUTH     ),
-    OHM_DEBUG_FLAG( "rule"    , "prolog interface"   , &DBG_RULE     )
+    OHM_DEBUG_FLAG( "rule"    , "prolog interface"   , &DBG_RULE     ),
+    OHM_DEBUG_FLAG( "arbiter" , "native arbiter"     , &DBG_ARBITER  )
 );
 
 
@@ -93,13 +95,14 @@ static void plugin_init(OhmPlugin *plugin)
     dbusif_init(plugin);
     ruleif_init(plugin);
     internalif_init(plugin);
-    fsif_init(plugin);
+    fsif_init(plugin, DBG_FS);
     dresif_init(plugin);
     manager_init(plugin);
     resource_set_init(plugin);
     resource_spec_init(plugin);
     transaction_init(plugin);
     auth_init(plugin);
+    arbiter_init(plugin);
 
 #if 0    
     DBG_MGR = DBG_SET = DBG_DBUS = DBG_INTERNAL = DBG_DRES =
@@ -111,7 +114,10 @@ static void plugin_init(OhmPlugin *plugin)
 
 static void plugin_destroy(OhmPlugin *plugin)
 {
+    dresif_exit(plugin);
+    arbiter_exit(plugin);
     auth_exit(plugin);
+    resource_set_exit(plugin);
     fsif_exit(plugin);
 }
 
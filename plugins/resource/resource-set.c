@@ -32,10 +32,8 @@ USA.
 #include "fsif.h"
 #include "transaction.h"
 
-#define HASH_BITS      8
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
+#define HASH_INITIAL   256         /* initial number of buckets */
+#define HASH_LOAD      2           /* grow above this many sets per bucket */
 
 #define INTEGER_FIELD(n,v) { fldtype_integer, n, .value.integer = v }
 #define STRING_FIELD(n,v)  { fldtype_string , n, .value.string  = v ? v : "" }
@@ -43,7 +41,20 @@ USA.
 
 #define SELIST_DIM  2
 
-static resource_set_t  *hash_table[HASH_DIM];
+#define QUEUE_POOL_MAX 256         /* max. number of cached queue entries */
+
+static resource_set_t **hash_table;       /* by manager id */
+static uint32_t         hash_dim;         /* number of buckets, power of 2 */
+static uint32_t         hash_count;       /* number of resource sets */
+
+static resource_set_queue_t *queue_pool;    /* free queue entries */
+static uint32_t              queue_npool;
+
+static struct {
+    uint32_t  queued;               /* notifications queued */
+    uint32_t  coalesced;            /* superseded before being sent */
+    uint32_t  allocated;            /* queue entries malloc'ed */
+} queue_stats;
 
 static gboolean idle_task(gpointer);
 
@@ -51,6 +62,8 @@ static void enqueue_send_request(resource_set_t *, resource_set_field_id_t,
                                  uint32_t, uint32_t);
 static void dequeue_and_send(resource_set_t*,resource_set_field_id_t,uint32_t);
 static void destroy_queue(resource_set_t *, resource_set_field_id_t);
+static resource_set_queue_t *alloc_queue_entry(void);
+static void free_queue_entry(resource_set_queue_t *);
 
 static int add_factstore_entry(resource_set_t *);
 static int delete_factstore_entry(resource_set_t *);
@@ -79,6 +92,24 @@ void resource_set_init(OhmPlugin *plugin)
     LEAVE;
 }
 
+void resource_set_exit(OhmPlugin *plugin)
+{
+    resource_set_queue_t *qentry;
+
+    (void)plugin;
+
+    OHM_INFO("resource: %u notifications queued, %u coalesced, "
+             "%u queue entries allocated", queue_stats.queued,
+             queue_stats.coalesced, queue_stats.allocated);
+
+    while ((qentry = queue_pool) != NULL) {
+        queue_pool = qentry->next;
+        free(qentry);
+    }
+
+    queue_npool = 0;
+}
+
 resource_set_t *resource_set_create(pid_t client_pid, resset_t *resset)
 {
     static uint32_t  manager_id;
@@ -315,8 +346,12 @@ int resource_set_add_idle_task(resource_set_t *rs, resource_set_task_t task)
 resource_set_t *resource_set_find(fsif_entry_t *entry)
 {
     uint32_t manager_id = INVALID_MANAGER_ID;
-    resource_set_t *rs = NULL;
-    
+    resource_set_t *rs;
+
+    /* resource set facts carry a pointer to their set */
+    if ((rs = fsif_get_entry_data(entry)) != NULL)
+        return rs;
+
     fsif_get_field_by_entry(entry, fldtype_integer, "manager_id", &manager_id);
 
     if (manager_id == INVALID_MANAGER_ID)
@@ -331,6 +366,24 @@ resource_set_t *resource_set_find(fsif_entry_t *entry)
     return rs;
 }
 
+resource_set_t *resource_set_find_by_id(uint32_t manager_id)
+{
+    return find_in_hash_table(manager_id);
+}
+
+void resource_set_foreach(resource_set_iter_cb_t cb, void *data)
+{
+    resource_set_t *rs, *next;
+    uint32_t        i;
+
+    for (i = 0;  i < hash_dim;  i++) {
+        for (rs = hash_table[i];  rs != NULL;  rs = next) {
+            next = rs->next;
+            cb(rs, data);
+        }
+    }
+}
+
 void resource_set_dump_message(resmsg_t *msg,resset_t *resset,const char *dir)
 {
     resconn_t *rconn = resset->resconn;
@@ -432,12 +485,32 @@ static void enqueue_send_request(resource_set_t          *rs,
     default:                                                           return;
     }
 
-    if ((qentry = malloc(sizeof(resource_set_queue_t))) == NULL)
+    qhead = &value->queue;
+    queue_stats.queued++;
+
+    /*
+     * A later change within the same transaction supersedes an unsolicited
+     * notification that is still waiting for the transaction to complete.
+     * Replies to requests are kept, and so is everything for clients that
+     * asked to get a reply to each of their requests.
+     */
+    if ((qentry = qhead->tail) != NULL && qentry->txid == txid &&
+        qentry->reqno == 0 && !(resset->mode & RESMSG_MODE_ALWAYS_REPLY))
+    {
+        queue_stats.coalesced++;
+
+        qentry->reqno = reqno;
+        qentry->value = value->factstore;
+
+        OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) replaced queued %s value "
+                  "with %s", resset->peer, resset->id, rs->manager_id, type,
+                  resmsg_res_str(qentry->value, buf, sizeof(buf)));
+        return;
+    }
+
+    if ((qentry = alloc_queue_entry()) == NULL)
         OHM_ERROR("resource: [%s] memory allocation failure", __FUNCTION__);
     else {
-        qhead = &value->queue;
-
-        memset(qentry, 0, sizeof(resource_set_queue_t));
         qentry->txid  = txid;
         qentry->reqno = reqno;
         qentry->value = value->factstore;
@@ -481,10 +554,12 @@ static void dequeue_and_send(resource_set_t          *rs,
      * we assume that the queue contains strictly monoton increasing txid's
      * and this function is called with strictly monoton txid's
      */
-    while ((qentry = queue_pop_head(qhead)) != NULL) {
-        if (qentry->txid > txid)
+    while (qhead->head != NULL) {
+        if (qhead->head->txid > txid)
             return;             /* nothing to send */
 
+        qentry = queue_pop_head(qhead);
+
         if (qentry->txid == txid) {
             if (qentry->reqno || value->client != qentry->value) {
                 if (block && type == RESMSG_GRANT) {
@@ -525,7 +600,7 @@ static void dequeue_and_send(resource_set_t          *rs,
                       resset->peer, resset->id, rs->manager_id, txid);
         }
 
-        free(qentry);
+        free_queue_entry(qentry);
     } /* while */
 }
 
@@ -541,7 +616,38 @@ static void destroy_queue(resource_set_t *rs, resource_set_field_id_t what)
     }
 
     while ((qentry = queue_pop_head(qhead)) != NULL)
+        free_queue_entry(qentry);
+}
+
+static resource_set_queue_t *alloc_queue_entry(void)
+{
+    resource_set_queue_t *qentry;
+
+    if ((qentry = queue_pool) != NULL) {
+        queue_pool = qentry->next;
+        queue_npool--;
+    }
+    else {
+        if ((qentry = malloc(sizeof(resource_set_queue_t))) == NULL)
+            return NULL;
+
+        queue_stats.allocated++;
+    }
+
+    memset(qentry, 0, sizeof(resource_set_queue_t));
+
+    return qentry;
+}
+
+static void free_queue_entry(resource_set_queue_t *qentry)
+{
+    if (queue_npool >= QUEUE_POOL_MAX)
         free(qentry);
+    else {
+        qentry->next = queue_pool;
+        queue_pool   = qentry;
+        queue_npool++;
+    }
 }
 
 
@@ -576,7 +682,8 @@ static int add_factstore_entry(resource_set_t *rs)
         INVALID_FIELD
     };
 
-    success = fsif_add_factstore_entry(FACTSTORE_RESOURCE_SET, fldlist);
+    success = fsif_add_factstore_entry_with_data(FACTSTORE_RESOURCE_SET,
+                                                 fldlist, rs);
 
     return success;
 }
@@ -705,24 +812,70 @@ static int update_factstore_video(resource_set_t          *rs,
 }
 
 
+static int resize_hash_table(uint32_t dim)
+{
+    resource_set_t **bucket;
+    resource_set_t  *rs, *next;
+    uint32_t         i, index;
+
+    if ((bucket = calloc(dim, sizeof(bucket[0]))) == NULL)
+        return FALSE;
+
+    /* manager IDs are handed out sequentially so they spread evenly */
+    for (i = 0;  i < hash_dim;  i++) {
+        for (rs = hash_table[i];  rs != NULL;  rs = next) {
+            next  = rs->next;
+            index = rs->manager_id & (dim - 1);
+
+            rs->next = bucket[index];
+            bucket[index] = rs;
+        }
+    }
+
+    free(hash_table);
+
+    hash_table = bucket;
+    hash_dim   = dim;
+
+    return TRUE;
+}
+
 static void add_to_hash_table(resource_set_t *rs)
 {
-    int index = HASH_INDEX(rs->manager_id);
+    uint32_t index;
+
+    if (hash_table == NULL || hash_count >= hash_dim * HASH_LOAD) {
+        if (!resize_hash_table(hash_dim ? hash_dim * 2 : HASH_INITIAL)) {
+            /* a longer chain is still better than losing the set */
+            if (hash_table == NULL) {
+                OHM_ERROR("resource: can't allocate resource set hash table");
+                return;
+            }
+        }
+    }
+
+    index = rs->manager_id & (hash_dim - 1);
 
     rs->next = hash_table[index];
     hash_table[index] = rs;
+    hash_count++;
 }
 
 static void delete_from_hash_table(resource_set_t *rs)
 {
-    int              index  = HASH_INDEX(rs->manager_id);
     resset_t        *resset = rs->resset;
-    resource_set_t  *prev;
+    resource_set_t **prev;
 
-    for (prev = (void *)&hash_table[index];   prev->next;  prev = prev->next) {
-        if (prev->next == rs) {
-            prev->next = rs->next;
-            return;
+    if (hash_table != NULL) {
+        prev = &hash_table[rs->manager_id & (hash_dim - 1)];
+
+        for (;  *prev != NULL;  prev = &(*prev)->next) {
+            if (*prev == rs) {
+                *prev = rs->next;
+                rs->next = NULL;
+                hash_count--;
+                return;
+            }
         }
     }
 
@@ -733,10 +886,15 @@ static void delete_from_hash_table(resource_set_t *rs)
 
 static resource_set_t *find_in_hash_table(uint32_t manager_id)
 {
-    int index = HASH_INDEX(manager_id);
     resource_set_t *rs;
 
-    for (rs = hash_table[index];   rs != NULL;   rs = rs->next) {
+    if (hash_table == NULL)
+        return NULL;
+
+    for (rs = hash_table[manager_id & (hash_dim - 1)];
+         rs != NULL;
+         rs = rs->next)
+    {
         if (manager_id == rs->manager_id)
             break;
     }
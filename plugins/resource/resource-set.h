@@ -35,6 +35,7 @@ struct resource_set_s;
 union resource_spec_u;
 
 typedef void (*resource_set_task_t)(struct resource_set_s *);
+typedef void (*resource_set_iter_cb_t)(struct resource_set_s *, void *);
 
 typedef enum {
     resource_set_unknown_field = 0,
@@ -69,7 +70,7 @@ typedef struct {
 
 
 typedef struct resource_set_s {
-    struct resource_set_s   *next;
+    struct resource_set_s   *next;       /* manager ID hash chain */
     pid_t                    client_pid; /* pid of the resource client */
     uint32_t                 manager_id; /* resource-set generated unique ID */
     resset_t                *resset;     /* link to libresource */
@@ -80,6 +81,7 @@ typedef struct resource_set_s {
     resource_set_output_t    advice;     /* advice on this resource set */
     resource_set_qhead_t     qhead;      /* queue for delayed responses */
     uint32_t                 reqno;
+    uint32_t                 stamp;      /* acquisition order (arbiter) */
     struct {
         uint32_t            srcid;
         resource_set_task_t task;
@@ -96,6 +98,7 @@ typedef enum {
 
 
 void resource_set_init(OhmPlugin *);
+void resource_set_exit(OhmPlugin *);
 
 resource_set_t *resource_set_create(pid_t, resset_t *);
 void resource_set_destroy(resset_t *);
@@ -107,6 +110,8 @@ void resource_set_send_queued_changes(uint32_t, uint32_t);
 void resource_set_send_release_request(resource_set_t *);
 int  resource_set_add_idle_task(resource_set_t *, resource_set_task_t);
 resource_set_t *resource_set_find(struct _OhmFact *);
+resource_set_t *resource_set_find_by_id(uint32_t);
+void resource_set_foreach(resource_set_iter_cb_t, void *);
 
 void resource_set_dump_message(resmsg_t *, resset_t *, const char *);
 
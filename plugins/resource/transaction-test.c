@@ -0,0 +1,254 @@
+/*
+ *  gcc -Wall `pkg-config --cflags ohm glib-2.0` \
+ *      transaction-test.c -o transaction-test
+ *
+ *  Stress test for the transaction registry: creates and completes a large
+ *  number of overlapping transactions, unreferencing them in random order,
+ *  and checks that they complete in txid order with the right resource sets
+ *  and that stale txids are rejected.
+ */
+
+#include <stdarg.h>
+
+#include "transaction.c"
+
+int DBG_TRANSACT;
+
+void plugin_print_timestamp(const char *function, const char *event)
+{
+    (void)function;
+    (void)event;
+}
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR || level == OHM_LOG_WARNING) {
+        va_start(ap, format);
+        vfprintf(stdout, format, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+
+int __trace_printf(int id, const char *file, int line, const char *func,
+                   const char *format, ...)
+{
+    va_list ap;
+
+    (void)file;
+    (void)line;
+    (void)func;
+
+    if (!id)
+        return FALSE;
+
+    va_start(ap, format);
+    vfprintf(stdout, format, ap);
+    va_end(ap);
+
+    return TRUE;
+}
+
+
+/*****************************************************************************
+ *                    *** overlapping transaction test ***                   *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <sys/time.h>
+
+#define fatal(fmt, args...) do {                                \
+        fprintf(stderr, "fatal error: "fmt"\n" , ## args);      \
+        exit(1);                                                \
+    } while (0)
+
+#define RSID_POOL  64                   /* resource set ids to pick from */
+#define RSID_MAX   24                   /* max. additions per transaction */
+
+typedef struct {
+    int      nrsid;                     /* distinct resource sets added */
+    uint32_t rsidsum;                   /* sum of their ids */
+    int      completed;
+} expect_t;
+
+static expect_t *expected;
+static uint32_t  ntx;
+static uint32_t  last_completed;
+static uint32_t  ncompleted;
+
+
+static void completion(uint32_t *ids, int nid, uint32_t txid, void *data)
+{
+    expect_t *e;
+    char      seen[RSID_POOL];
+    uint32_t  sum;
+    int       i;
+
+    if (txid != last_completed + 1)
+        fatal("transaction %u completed after %u", txid, last_completed);
+
+    if (data != (void *)(unsigned long)txid)
+        fatal("transaction %u: wrong user data", txid);
+
+    e = expected + txid;
+
+    if (e->completed)
+        fatal("transaction %u completed twice", txid);
+
+    if (nid != e->nrsid)
+        fatal("transaction %u: %d resource sets instead of %d", txid,
+              nid, e->nrsid);
+
+    memset(seen, 0, sizeof(seen));
+    for (i = 0, sum = 0;  i < nid;  i++) {
+        if (ids[i] >= RSID_POOL || seen[ids[i]])
+            fatal("transaction %u: bogus or duplicate resource set %u",
+                  txid, ids[i]);
+        seen[ids[i]] = 1;
+        sum += ids[i];
+    }
+
+    if (sum != e->rsidsum)
+        fatal("transaction %u: wrong resource sets", txid);
+
+    e->completed   = TRUE;
+    last_completed = txid;
+    ncompleted++;
+}
+
+static void populate(uint32_t txid)
+{
+    expect_t *e = expected + txid;
+    char      seen[RSID_POOL];
+    uint32_t  rsid;
+    int       n, i;
+
+    memset(seen, 0, sizeof(seen));
+    n = rand() % RSID_MAX;
+
+    for (i = 0;  i < n;  i++) {
+        rsid = rand() % RSID_POOL;
+
+        if (!transaction_add_resource_set(txid, rsid))
+            fatal("failed to add resource set %u to transaction %u",
+                  rsid, txid);
+
+        if (!seen[rsid]) {
+            seen[rsid] = 1;
+            e->nrsid++;
+            e->rsidsum += rsid;
+        }
+    }
+}
+
+static void release(uint32_t *live, int *nlive, int idx)
+{
+    uint32_t txid = live[idx];
+
+    if (!transaction_unref(txid))
+        fatal("failed to unreference transaction %u", txid);
+
+    live[idx] = live[--*nlive];
+}
+
+static void check_stale(uint32_t txid)
+{
+    if (transaction_ref(txid) || transaction_unref(txid) ||
+        transaction_add_resource_set(txid, 0))
+        fatal("stale transaction %u was accepted", txid);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct timeval  start, end;
+    uint32_t       *live;
+    int             nlive, window, seed, opt;
+    uint32_t        txid, i;
+    double          usecs;
+
+    ntx    = 100000;
+    window = 512;
+    seed   = 1;
+
+    while ((opt = getopt(argc, argv, "n:w:s:h")) != -1) {
+        switch (opt) {
+        case 'n': ntx    = strtoul(optarg, NULL, 10); break;
+        case 'w': window = atoi(optarg);              break;
+        case 's': seed   = atoi(optarg);              break;
+        default:
+            fatal("usage: %s [-n transactions] [-w window] [-s seed]",
+                  argv[0]);
+        }
+    }
+
+    if (ntx == 0 || window <= 0)
+        fatal("invalid number of transactions or window size");
+
+    srand(seed);
+
+    expected = calloc(ntx + 1, sizeof(expected[0]));
+    live     = calloc(window + 1, sizeof(live[0]));
+
+    if (expected == NULL || live == NULL)
+        fatal("can't allocate memory");
+
+    gettimeofday(&start, NULL);
+
+    for (i = 0, nlive = 0;  i < ntx;  i++) {
+        txid = transaction_create(completion, (void *)(unsigned long)(i + 1));
+
+        if (txid != i + 1)
+            fatal("got transaction %u instead of %u", txid, i + 1);
+
+        populate(txid);
+
+        /* an extra reference, as a pending request would hold */
+        if (rand() % 4 == 0) {
+            transaction_ref(txid);
+            transaction_unref(txid);
+        }
+
+        live[nlive++] = txid;
+
+        if (nlive > window)
+            release(live, &nlive, rand() % nlive);
+
+        if (last_completed > 0 && rand() % 16 == 0)
+            check_stale(1 + rand() % last_completed);
+    }
+
+    while (nlive > 0)
+        release(live, &nlive, rand() % nlive);
+
+    gettimeofday(&end, NULL);
+
+    if (ncompleted != ntx)
+        fatal("%u of %u transactions completed", ncompleted, ntx);
+
+    for (i = 1;  i <= ntx;  i += 1 + ntx / 1000)
+        check_stale(i);
+
+    usecs = (end.tv_sec - start.tv_sec) * 1000000.0 +
+        (end.tv_usec - start.tv_usec);
+
+    printf("%u transactions, window %d, table size %u: %.3f usecs/tx\n",
+           ntx, window, txmap_size, usecs / ntx);
+
+    free(expected);
+    free(live);
+
+    return 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
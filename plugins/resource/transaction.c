@@ -28,19 +28,34 @@ USA.
 #include "plugin.h"
 #include "transaction.h"
 
-#define HASH_BITS      10
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
-
-#define ALLOC_DIM      1024
-#define ALLOC_JUNK     (ALLOC_DIM * sizeof(uint32_t))
+/*
+ * Transactions are numbered sequentially and completed in that order, so
+ * the live ones always fall in the window [txread, txwrite]. They are kept
+ * in a ring indexed by the low bits of the txid that doubles whenever the
+ * window would not fit. Each slot stores the full txid, and a lookup only
+ * succeeds if it matches: the bits above the ring mask work as a generation
+ * count, so a stale txid never finds a reused slot.
+ */
+#define TXMAP_INITIAL   64
+#define TXMAP_INDEX(id) ((id) & (txmap_size - 1))
+
+/*
+ * The resource sets of a transaction are kept in insertion order, as the
+ * completion callback wants them. Up to RESSET_SMALL of them live in the
+ * transaction itself and membership is checked by scanning them. Beyond
+ * that the ids move to the heap and get an open addressing index.
+ */
+#define RESSET_SMALL    8
+#define RESSET_HASH(id) ((id) * 2654435761U)
 
 
 typedef struct {
-    int       junks;
     int       length;
-    uint32_t *table;    
+    int       size;                     /* allocated length of table */
+    uint32_t *table;                    /* ids in insertion order */
+    uint32_t  small[RESSET_SMALL];      /* table, if length <= RESSET_SMALL */
+    uint32_t  hmask;
+    uint32_t *hash;                     /* table index + 1, 0 is empty */
 } resset_table_t;
 
 typedef struct {
@@ -56,12 +71,15 @@ typedef struct {
 } transaction_t;
 
 
-static transaction_t   transactions[HASH_DIM];
+static transaction_t  *transactions;
+static uint32_t        txmap_size;
 static uint32_t        txwrite;
 static uint32_t        txread = 1;
 
 static transaction_t *find_transaction(uint32_t);
+static int grow_transactions(void);
 static int add_resource_set(transaction_t *, uint32_t);
+static void free_resource_sets(transaction_t *);
 static void complete_transaction(uint32_t);
 
 
@@ -83,26 +101,29 @@ uint32_t transaction_create(transaction_callback_t callback, void *user_data)
 {
     static uint32_t  count = NO_TRANSACTION;
 
-    uint32_t       txid = ++count;
-    int            idx  = HASH_INDEX(txid);
-    transaction_t *tx   = transactions + idx;
+    uint32_t       txid;
+    transaction_t *tx;
 
-    if (tx->id != NO_TRANSACTION) {
-        OHM_ERROR("resource: transaction table overflow: transaction %u",txid);
-        txid = NO_TRANSACTION;
+    if (txwrite - txread + 2 > txmap_size && !grow_transactions()) {
+        OHM_ERROR("resource: can't allocate transaction %u", count + 1);
+        return NO_TRANSACTION;
     }
-    else {
-        memset(tx, 0, sizeof(transaction_t));
-        tx->id     = txid;
-        tx->refcnt = 1;
 
-        tx->completion.function  = callback;
-        tx->completion.user_data = user_data;
+    if ((txid = ++count) == NO_TRANSACTION)
+        txid = ++count;
 
-        txwrite = txid;
+    tx = transactions + TXMAP_INDEX(txid);
 
-        OHM_DEBUG(DBG_TRANSACT, "transaction %u created", txid);
-    }
+    memset(tx, 0, sizeof(transaction_t));
+    tx->id     = txid;
+    tx->refcnt = 1;
+
+    tx->completion.function  = callback;
+    tx->completion.user_data = user_data;
+
+    txwrite = txid;
+
+    OHM_DEBUG(DBG_TRANSACT, "transaction %u created", txid);
 
     return txid;
 }
@@ -171,46 +192,144 @@ int transaction_unref(uint32_t txid)
 
 static transaction_t *find_transaction(uint32_t txid)
 {
-    int            idx = HASH_INDEX(txid);
-    transaction_t *tx  = transactions + idx;
+    transaction_t *tx;
+
+    if (txid == NO_TRANSACTION || transactions == NULL)
+        return NULL;
+
+    tx = transactions + TXMAP_INDEX(txid);
+
+    return (txid == tx->id) ? tx : NULL;
+}
+
+static int grow_transactions(void)
+{
+    transaction_t *old  = transactions;
+    uint32_t       size = txmap_size ? txmap_size * 2 : TXMAP_INITIAL;
+    transaction_t *tx;
+    uint32_t       i;
+
+    if (size < txmap_size || (transactions = calloc(size, sizeof(*tx))) == NULL) {
+        transactions = old;
+        return FALSE;
+    }
+
+    for (i = 0;  i < txmap_size;  i++) {
+        if (old[i].id != NO_TRANSACTION) {
+            tx = transactions + (old[i].id & (size - 1));
+            *tx = old[i];
+
+            /* the small table moved along with the transaction */
+            if (old[i].resset.table == old[i].resset.small)
+                tx->resset.table = tx->resset.small;
+        }
+    }
+
+    OHM_DEBUG(DBG_TRANSACT, "transaction table grown to %u entries", size);
+
+    free(old);
+    txmap_size = size;
+
+    return TRUE;
+}
+
+
+static uint32_t *lookup_resource_set(resset_table_t *rt, uint32_t rsid)
+{
+    uint32_t i, idx;
 
-    return (txid != NO_TRANSACTION && txid == tx->id) ? tx : NULL;
+    for (i = RESSET_HASH(rsid) & rt->hmask; (idx = rt->hash[i]); ) {
+        if (rt->table[idx - 1] == rsid)
+            break;
+        i = (i + 1) & rt->hmask;
+    }
+
+    return rt->hash + i;
 }
 
+static int rehash_resource_sets(resset_table_t *rt, uint32_t size)
+{
+    uint32_t *hash;
+    int       i;
+
+    if ((hash = calloc(size, sizeof(*hash))) == NULL)
+        return FALSE;
+
+    free(rt->hash);
+    rt->hash  = hash;
+    rt->hmask = size - 1;
+
+    for (i = 0;  i < rt->length;  i++)
+        *lookup_resource_set(rt, rt->table[i]) = i + 1;
+
+    return TRUE;
+}
 
 static int add_resource_set(transaction_t *tx, uint32_t rsid)
 {
-    int   idx   = tx->resset.length;
-    int   junks;
-    int   size;
-    void *mem;
-    int   i;
-
-    for (i = 0;    i < tx->resset.length;   i++) {
-        if (tx->resset.table[i] == rsid)
-            return TRUE;        /* it is already there */
+    resset_table_t *rt  = &tx->resset;
+    uint32_t       *slot = NULL;
+    uint32_t       *mem;
+    int             size;
+    int             i;
+
+    if (rt->table == NULL) {
+        rt->table = rt->small;
+        rt->size  = RESSET_SMALL;
     }
-    
-    if ((junks = (idx + ALLOC_JUNK) / ALLOC_JUNK) > tx->resset.junks) {
-        size = junks * ALLOC_JUNK * sizeof(uint32_t *);
-        mem  = realloc(tx->resset.table, size);
-        
+
+    if (rt->hash == NULL) {
+        for (i = 0;    i < rt->length;   i++) {
+            if (rt->table[i] == rsid)
+                return TRUE;        /* it is already there */
+        }
+    }
+    else if (*(slot = lookup_resource_set(rt, rsid)))
+        return TRUE;                /* it is already there */
+
+    if (rt->length >= rt->size) {
+        size = rt->size * 2;
+
+        if (rt->table == rt->small) {
+            if ((mem = malloc(size * sizeof(uint32_t))) != NULL)
+                memcpy(mem, rt->small, rt->length * sizeof(uint32_t));
+        }
+        else
+            mem = realloc(rt->table, size * sizeof(uint32_t));
+
         if (mem == NULL)
             return FALSE;
 
-        tx->resset.junks = junks;
-        tx->resset.table = mem;
+        rt->table = mem;
+        rt->size  = size;
+
+        /* keep the index at most half full */
+        if (!rehash_resource_sets(rt, size * 2))
+            return FALSE;
+
+        slot = lookup_resource_set(rt, rsid);
     }
 
-    tx->resset.length = idx + 1;
-    tx->resset.table[idx] = rsid;
+    rt->table[rt->length++] = rsid;
+
+    if (slot != NULL)
+        *slot = rt->length;
 
     return TRUE;
 }
 
+static void free_resource_sets(transaction_t *tx)
+{
+    if (tx->resset.table != tx->resset.small)
+        free(tx->resset.table);
+
+    free(tx->resset.hash);
+}
+
 static void complete_transaction(uint32_t txid)
 {
     transaction_t *tx;
+    transaction_t  done;
     uint32_t       id;
 
     if (txid == txread) {
@@ -218,6 +337,7 @@ static void complete_transaction(uint32_t txid)
             if ((tx = find_transaction(id)) == NULL) {
                 OHM_ERROR("resource: wants to complete transaction %u "
                           "but can't find it", id);
+                txread = id + 1;
                 continue;
             }
 
@@ -226,15 +346,24 @@ static void complete_transaction(uint32_t txid)
 
             OHM_DEBUG(DBG_TRANSACT, "completing transaction %u", tx->id);
 
-            if (tx->completion.function != NULL) {
-                tx->completion.function(tx->resset.table, tx->resset.length,
-                                        tx->id, tx->completion.user_data);
-            }
-        
-            free(tx->resset.table);
+            /*
+             * Take the transaction out of the table before calling back,
+             * the callback might create new transactions and grow it.
+             */
+            done = *tx;
+            if (done.resset.table == tx->resset.small)
+                done.resset.table = done.resset.small;
+
             memset(tx, 0, sizeof(*tx));
-            
             txread = id + 1;
+
+            if (done.completion.function != NULL) {
+                done.completion.function(done.resset.table,
+                                         done.resset.length, done.id,
+                                         done.completion.user_data);
+            }
+        
+            free_resource_sets(&done);
         }
     }
 }
@@ -0,0 +1,55 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Direct callback interface for internal EPs, bypassing the GObject
+ * signals and properties. The signal name and the fact list are borrowed
+ * from the transaction and only valid during the call. decision returns
+ * TRUE (ACK), FALSE (NACK) or INTERNAL_EP_DEFERRED, in which case the EP
+ * answers later with internal_ep_ack().
+ *
+ * This header is shared with the plugins registering internal EPs
+ * through signaling.register_internal_ep, keep it free of anything else.
+ */
+
+#ifndef __OHM_SIGNALING_INTERNAL_EP_OPS_H__
+#define __OHM_SIGNALING_INTERNAL_EP_OPS_H__
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define INTERNAL_EP_DEFERRED (-1)
+
+typedef struct {
+    int  (*decision)   (GObject *ep, guint txid, const gchar *signal,
+                        GSList *facts, gpointer data);
+    void (*key_change) (GObject *ep, const gchar *signal, GSList *facts,
+                        gpointer data);
+} internal_ep_ops_t;
+
+#endif
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,236 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Shared memory transport between the signaling plugin and local
+ * enforcement points. The segment holds two single-producer,
+ * single-consumer byte rings: decisions from the policy engine to the
+ * EP and acknowledgements back. Each ring has an eventfd for wakeups.
+ *
+ * Records are a 32-bit length followed by the payload. A decision is a
+ * marshalled D-Bus signal, exactly what would have been broadcast, and an
+ * acknowledgement is an ep_ring_ack_t. The head and tail are free-running
+ * and only ever written by the producer and the consumer respectively.
+ *
+ * Nothing in the segment is trusted after it has been mapped, since the
+ * other side can write all of it. Each side accesses a ring through an
+ * ep_ring_view_t, a private copy of the ring geometry and of its own
+ * position. The peer's position is snapshotted and checked on every
+ * operation, so a corrupted ring can only lose records, never make us
+ * touch memory outside the ring.
+ */
+
+#ifndef LIBEP_RING_H
+#define LIBEP_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define EP_RING_MAGIC        0x45505247     /* "EPRG" */
+#define EP_RING_VERSION      1
+#define EP_RING_DECISIONS    (64 * 1024)    /* must be a power of two */
+#define EP_RING_ACKS         (4 * 1024)     /* must be a power of two */
+
+#define EP_RING_EMPTY        (-1)           /* no records in the ring */
+#define EP_RING_CORRUPT      (-2)           /* ring positions are bogus */
+
+typedef struct {
+    uint32_t           size;        /* size of the data, power of two */
+    volatile uint32_t  head;        /* producer position */
+    volatile uint32_t  tail;        /* consumer position */
+    uint32_t           unused;
+} ep_ring_t;
+
+typedef struct {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  length;               /* length of the whole segment */
+    uint32_t  decisions;            /* offset of the decision ring */
+    uint32_t  acks;                 /* offset of the ack ring */
+    uint32_t  unused;
+} ep_shm_t;
+
+typedef struct {
+    uint32_t  txid;
+    uint32_t  status;
+} ep_ring_ack_t;
+
+typedef struct {                    /* private view of a shared ring */
+    ep_ring_t *ring;                /* shared ring header */
+    char      *data;                /* shared ring data */
+    uint32_t   size;                /* size of the data, power of two */
+    uint32_t   pos;                 /* our head or tail */
+    int        producer;            /* whether pos is the head */
+} ep_ring_view_t;
+
+#define EP_RING_BYTES(size) (sizeof(ep_ring_t) + (size))
+#define EP_SHM_BYTES                                                    \
+    (sizeof(ep_shm_t) +                                                 \
+     EP_RING_BYTES(EP_RING_DECISIONS) + EP_RING_BYTES(EP_RING_ACKS))
+
+#define EP_SHM_DECISIONS     (sizeof(ep_shm_t))
+#define EP_SHM_ACKS          (EP_SHM_DECISIONS + EP_RING_BYTES(EP_RING_DECISIONS))
+
+#define EP_SHM_RING(shm, offs) ((ep_ring_t *)((char *)(shm) + (offs)))
+
+
+static inline void ep_shm_init(ep_shm_t *shm, uint32_t length)
+{
+    ep_ring_t *r;
+
+    memset(shm, 0, EP_SHM_BYTES);
+
+    shm->magic     = EP_RING_MAGIC;
+    shm->version   = EP_RING_VERSION;
+    shm->length    = length;
+    shm->decisions = EP_SHM_DECISIONS;
+    shm->acks      = EP_SHM_ACKS;
+
+    r = EP_SHM_RING(shm, shm->decisions);
+    r->size = EP_RING_DECISIONS;
+    r = EP_SHM_RING(shm, shm->acks);
+    r->size = EP_RING_ACKS;
+}
+
+static inline int ep_ring_size_ok(uint32_t size)
+{
+    return size >= 2 * sizeof(uint32_t) && (size & (size - 1)) == 0;
+}
+
+/* check a segment mapped from the peer, before taking a view of it */
+static inline int ep_shm_check(ep_shm_t *shm, uint32_t length)
+{
+    uint64_t decisions, acks, dsize, asize;
+
+    if (length < sizeof(*shm) ||
+        shm->magic != EP_RING_MAGIC || shm->version != EP_RING_VERSION ||
+        shm->length > length)
+        return 0;
+
+    decisions = shm->decisions;
+    acks      = shm->acks;
+
+    if (decisions < sizeof(*shm) || decisions + sizeof(ep_ring_t) > acks ||
+        acks + sizeof(ep_ring_t) > length || (decisions | acks) & 3)
+        return 0;
+
+    dsize = EP_SHM_RING(shm, decisions)->size;
+    asize = EP_SHM_RING(shm, acks)->size;
+
+    return ep_ring_size_ok(dsize) && ep_ring_size_ok(asize) &&
+        decisions + EP_RING_BYTES(dsize) <= acks &&
+        acks + EP_RING_BYTES(asize) <= length;
+}
+
+/* take a view of a ring, size is the trusted or already checked size */
+static inline void ep_ring_view(ep_ring_view_t *v, void *shm, uint32_t offs,
+                                uint32_t size, int producer)
+{
+    v->ring     = EP_SHM_RING(shm, offs);
+    v->data     = (char *)(v->ring + 1);
+    v->size     = size;
+    v->producer = producer;
+    v->pos      = producer ? v->ring->head : v->ring->tail;
+}
+
+/* len must be at most v->size, so both chunks stay inside the data */
+static inline void ep_ring_copy(ep_ring_view_t *v, uint32_t pos, void *buf,
+                                uint32_t len, int in)
+{
+    uint32_t  offs = pos & (v->size - 1);
+    uint32_t  n    = v->size - offs < len ? v->size - offs : len;
+
+    if (in) {
+        memcpy(v->data + offs, buf, n);
+        memcpy(v->data, (char *)buf + n, len - n);
+    }
+    else {
+        memcpy(buf, v->data + offs, n);
+        memcpy((char *)buf + n, v->data, len - n);
+    }
+}
+
+/* 1 if the record was added, 0 if it did not fit or the ring is corrupt */
+static inline int ep_ring_put(ep_ring_view_t *v, const void *buf, uint32_t len)
+{
+    uint32_t head = v->pos;
+    uint32_t tail = v->ring->tail;
+    uint32_t used = head - tail;
+
+    if (used > v->size)
+        return 0;                               /* bogus tail */
+
+    if (len > v->size - sizeof(len) || v->size - used < len + sizeof(len))
+        return 0;                               /* full */
+
+    ep_ring_copy(v, head, &len, sizeof(len), 1);
+    ep_ring_copy(v, head + sizeof(len), (void *)buf, len, 1);
+
+    __sync_synchronize();                       /* data before head */
+    v->pos        = head + sizeof(len) + len;
+    v->ring->head = v->pos;
+
+    return 1;
+}
+
+/* length of the next record, EP_RING_EMPTY or EP_RING_CORRUPT */
+static inline int32_t ep_ring_next(ep_ring_view_t *v)
+{
+    uint32_t tail  = v->pos;
+    uint32_t head  = v->ring->head;
+    uint32_t avail = head - tail;
+    uint32_t len;
+
+    if (avail == 0)
+        return EP_RING_EMPTY;
+
+    if (avail > v->size || avail < sizeof(len))
+        return EP_RING_CORRUPT;
+
+    __sync_synchronize();                       /* head before data */
+    ep_ring_copy(v, tail, &len, sizeof(len), 0);
+
+    if (len > avail - sizeof(len))
+        return EP_RING_CORRUPT;
+
+    return (int32_t)len;
+}
+
+/* consume the next record, len must be what ep_ring_next returned */
+static inline void ep_ring_get(ep_ring_view_t *v, void *buf, uint32_t len)
+{
+    uint32_t tail = v->pos;
+
+    ep_ring_copy(v, tail + sizeof(len), buf, len, 0);
+
+    __sync_synchronize();                       /* data before tail */
+    v->pos        = tail + sizeof(len) + len;
+    v->ring->tail = v->pos;
+}
+
+/* drop everything the producer claims to have written */
+static inline void ep_ring_flush(ep_ring_view_t *v)
+{
+    v->pos        = v->ring->head;
+    v->ring->tail = v->pos;
+}
+
+#endif
+
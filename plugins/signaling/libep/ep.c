@@ -18,21 +18,30 @@ USA.
 *************************************************************************/
 
 
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "ep.h"
+#include "ep-ring.h"
 
 
 /* globals */
 
 static DBusConnection *connection = NULL;
 static struct ep_list_head_s cb_list;
-static struct ep_list_head_s transaction_list;
 
 struct transaction_data {
     int txid;
     unsigned int refcount;
     int ready;
+    struct transaction_data *next;  /* hash chain */
 };
 
+/* in-flight transactions, hashed by txid */
+#define TX_BUCKETS 64               /* must be a power of two */
+static struct transaction_data *tx_hash[TX_BUCKETS];
+
 struct cb_data {
     char            *signal;
     char           **decision_names;
@@ -165,31 +174,179 @@ static void ** ep_list_convert_to_array(struct ep_list_head_s *head) {
     return retval;
 }
 
+static struct transaction_data ** tx_bucket(int txid)
+{
+    return &tx_hash[(unsigned int)txid & (TX_BUCKETS - 1)];
+}
+
+static int tx_insert(struct transaction_data *data)
+{
+    struct transaction_data **p;
+
+    /* append, so that the oldest entry of a txid is found first */
+    for (p = tx_bucket(data->txid); *p != NULL; p = &(*p)->next)
+        ;
+
+    data->next = NULL;
+    *p = data;
+
+    return TRUE;
+}
+
+static int tx_remove(struct transaction_data *data)
+{
+    struct transaction_data **p;
+
+    for (p = tx_bucket(data->txid); *p != NULL; p = &(*p)->next) {
+        if (*p == data) {
+            *p = data->next;
+            data->next = NULL;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 static struct transaction_data * ep_get_transaction(int txid) {
     
-    /* check if it is still valid -- need to be in the list */
+    /* check if it is still valid -- need to be in the hash */
     
-    struct ep_list_head_s *head = &transaction_list;
-    struct ep_list_node_s *node = NULL;
+    struct transaction_data *data;
 
-    node = head->first;
-
-    while (node) {
-        struct transaction_data *data = node->data;
+    for (data = *tx_bucket(txid); data != NULL; data = data->next) {
         if (data->txid == txid) {
             return data;
         }
-        node = node->next;
     }
     return NULL;
 }
 
+/* shared memory transport */
+
+static ep_shm_t *shm        = NULL;
+static size_t    shm_length = 0;
+static int       shm_efd    = -1;     /* decisions available */
+static int       shm_ackfd  = -1;     /* acks available */
+static char     *shm_buf    = NULL;   /* room for one decision */
+
+static ep_ring_view_t shm_decisions;  /* checked views of the rings */
+static ep_ring_view_t shm_acks;
+
+static int decision_match = FALSE;    /* broadcast match rule added */
+
+/* batched acknowledgements, if the policy engine supports them */
+
+static int            batch_acks  = FALSE;
+static int            dispatching = 0;     /* inside the message filter */
+static ep_ring_ack_t *ack_queue   = NULL;
+static int            ack_count   = 0;
+static int            ack_size    = 0;
+
+static int shm_send_ack (int txid, int status)
+{
+    ep_ring_ack_t ack;
+    uint64_t      one = 1;
+
+    ack.txid   = txid;
+    ack.status = status;
+
+    if (!ep_ring_put(&shm_acks, &ack, sizeof(ack)))
+        return FALSE;   /* full, use D-Bus */
+
+    if (write(shm_ackfd, &one, sizeof(one)) < 0) {
+        /* not fatal, the ack is picked up with the next wakeup */
+    }
+
+    return TRUE;
+}
+
+static void flush_acks (void)
+{
+    DBusMessage     *msg = NULL;
+    DBusMessageIter  msgit, arrit, structit;
+    char             path[256];
+    int              i;
+
+    /* all the acks queued during the dispatch go out in one signal */
+
+    if (ack_count == 0)
+        return;
+
+    snprintf(path, sizeof(path), "%s/%s", POLICY_DBUS_PATH, POLICY_DECISION);
+
+    msg = dbus_message_new_signal(path, POLICY_DBUS_INTERFACE,
+            POLICY_STATUS_BATCH);
+
+    if (msg == NULL)
+        goto out;
+
+    dbus_message_iter_init_append(msg, &msgit);
+
+    if (!dbus_message_iter_open_container(&msgit, DBUS_TYPE_ARRAY, "(uu)",
+                &arrit))
+        goto out;
+
+    for (i = 0; i < ack_count; i++) {
+        if (!dbus_message_iter_open_container(&arrit, DBUS_TYPE_STRUCT, NULL,
+                    &structit) ||
+            !dbus_message_iter_append_basic(&structit, DBUS_TYPE_UINT32,
+                    &ack_queue[i].txid) ||
+            !dbus_message_iter_append_basic(&structit, DBUS_TYPE_UINT32,
+                    &ack_queue[i].status) ||
+            !dbus_message_iter_close_container(&arrit, &structit))
+            goto out;
+    }
+
+    if (!dbus_message_iter_close_container(&msgit, &arrit))
+        goto out;
+
+    dbus_connection_send(connection, msg, NULL);
+
+ out:
+    /* whatever did not make it will time out */
+    if (msg)
+        dbus_message_unref(msg);
+    ack_count = 0;
+}
+
+static int queue_ack (int txid, int status)
+{
+    ep_ring_ack_t *queue;
+
+    if (ack_count == ack_size) {
+        queue = realloc(ack_queue, (ack_size + 16) * sizeof(ack_queue[0]));
+
+        if (queue == NULL)
+            return FALSE;
+
+        ack_queue = queue;
+        ack_size += 16;
+    }
+
+    ack_queue[ack_count].txid   = txid;
+    ack_queue[ack_count].status = status;
+    ack_count++;
+
+    /* acks outside of the message dispatch are not held back */
+    if (!dispatching)
+        flush_acks();
+
+    return TRUE;
+}
+
 static void send_signal (int txid, int status)
 {
     DBusMessage *msg;
     char         path[256];
     int          ret;
 
+    if (shm && shm_send_ack(txid, status))
+        return;
+
+    if (batch_acks && queue_ack(txid, status))
+        return;
+
 #if 0
     printf("libep: sending %s signal with txid %i\n",
             status ? "ACK" : "NACK", txid);
@@ -239,7 +396,7 @@ static void send_if_done(struct transaction_data *data)
 
     /* all callbacks have returned true or one has failed */
     send_signal(data->txid, TRUE);
-    ep_list_remove(&transaction_list, data);
+    tx_remove(data);
     free(data);
     data = NULL;
 }
@@ -263,7 +420,7 @@ static void ep_ready(int txid, int status) {
         if ((data->refcount == 0 && data->ready) || !status) {
             /* all callbacks have returned true or one has failed */
             send_signal(txid, status);
-            ep_list_remove(&transaction_list, data);
+            tx_remove(data);
             free(data);
             data = NULL;
         }
@@ -297,10 +454,133 @@ static void free_decisions(struct ep_decision **decisions) {
     free(decisions);
 }
 
-static void handle_message (DBusMessage *msg, struct cb_data *data)
+static void decode_value (DBusMessageIter *variantit,
+        struct ep_key_value_pair *pair)
+{
+    void *tmp = NULL;
+
+    dbus_message_iter_get_basic(variantit, (void *)&tmp);
+
+    switch (dbus_message_iter_get_arg_type(variantit)) {
+        case DBUS_TYPE_INT32:
+            pair->value = malloc(sizeof(int));
+            memcpy(pair->value, &tmp, sizeof(int));
+            pair->type = EP_VALUE_INT;
+            /* printf("libep:   value (int)    '%i'\n",
+                    *(int *) pair->value); */
+            break;
+        case DBUS_TYPE_DOUBLE:
+            pair->value = malloc(sizeof(double));
+            memcpy(pair->value, &tmp, sizeof(double));
+            pair->type = EP_VALUE_FLOAT;
+            /* printf("libep:   value (float)  '%f'\n",
+                    *(float *) pair->value); */
+            break;
+        case DBUS_TYPE_STRING:
+            pair->value = strdup(tmp);
+            pair->type = EP_VALUE_STRING;
+            /* printf("libep:   value (string) '%s'\n",
+                    (char *) pair->value); */
+            break;
+        default:
+            /* printf("libep:   value is unknown D-Bus type '%i'\n", 
+                    dbus_message_iter_get_arg_type(variantit)); */
+            break;
+    }
+}
+
+static int dispatch_decision (struct cb_data *data,
+        struct transaction_data *trans_data, char *actname,
+        struct ep_decision **decisions, dbus_uint32_t txid)
 {
     char *cb_decision_name;
-    int found = 0, i = 0;
+    int found = FALSE, i = 0;
+
+    /* count the callbacks if a transaction is needed */
+    if (trans_data) {
+        if (data->decision_names[0]) {
+            i = 0;
+            cb_decision_name = data->decision_names[i];
+            while (cb_decision_name) {
+                if (strcmp(cb_decision_name, actname) == 0) {
+                    trans_data->refcount++;
+#if 0
+                    printf("libep: increased transaction data '%p' refcount to %u for name '%s'\n",
+                            trans_data, trans_data->refcount, cb_decision_name);
+#endif
+                }
+                cb_decision_name = data->decision_names[++i];
+            }
+        }
+        else {
+            /* subscribe to all decisions */
+            trans_data->refcount++;
+        }
+    }
+
+    if (data->decision_names[0]) {
+        i = 0;
+        cb_decision_name = data->decision_names[i];
+
+        /* send the decisions */
+        while (cb_decision_name) {
+            if (strcmp(cb_decision_name, actname) == 0) {
+                data->cb(actname, decisions, ep_ready, txid, data->user_data);
+                found = TRUE;
+            }
+            cb_decision_name = data->decision_names[++i];
+        }
+    }
+    else {
+        /* call the callback for all decisions */
+        data->cb(actname, decisions, ep_ready, txid, data->user_data);
+        found = TRUE;
+    }
+
+    return found;
+}
+
+static void finish_transaction (struct transaction_data *trans_data,
+        dbus_uint32_t txid, int found, int success)
+{
+    if (txid != 0 && found) {
+
+        /* It's possible that the callbacks have had errors, and the
+         * NACK is already sent. In this case the transaction is already
+         * removed from the list and freed. See if this is the case. */
+        trans_data = ep_get_transaction(txid);
+        if (!trans_data) {
+            return;
+        }
+
+        /* the ACK signal is now ready to be sent */
+        trans_data->ready = TRUE;
+        send_if_done(trans_data);
+
+#if 0
+        printf("libep: signal handling success, waiting for callbacks\n");
+#endif
+        return; /* success */
+    }
+
+    /* no-one is interested or everything failed, just send the signal
+     * and be done with it */
+
+    if (trans_data) {
+        tx_remove(trans_data);
+        free(trans_data);
+        trans_data = NULL;
+    }
+
+    /* printf("libep: not waiting for handlers to return, parsing %s a success\n",
+            success ? "was" : "was not"); */
+
+    send_signal(txid, success);
+}
+
+static void handle_message (DBusMessage *msg, struct cb_data *data)
+{
+    int found = 0;
 
     struct transaction_data *trans_data = NULL;
 
@@ -368,7 +648,7 @@ static void handle_message (DBusMessage *msg, struct cb_data *data)
         if (!trans_data)
             goto send_signal;
         trans_data->txid = txid;
-        if (!ep_list_append(&transaction_list, trans_data)) {
+        if (!tx_insert(trans_data)) {
             success = FALSE;
             goto send_signal;
         }
@@ -433,7 +713,6 @@ static void handle_message (DBusMessage *msg, struct cb_data *data)
                 do {
                     struct ep_key_value_pair *pair =
                         calloc(1, sizeof(struct ep_key_value_pair));
-                    void *tmp = NULL;
                     char *key = NULL;
 
                     if (dbus_message_iter_get_arg_type(&structit) != DBUS_TYPE_STRUCT) {
@@ -468,34 +747,7 @@ static void handle_message (DBusMessage *msg, struct cb_data *data)
                         continue;
                     }
                     dbus_message_iter_recurse(&structfieldit, &variantit);
-                    dbus_message_iter_get_basic(&variantit, (void *)&tmp);
-                    
-                    switch (dbus_message_iter_get_arg_type(&variantit)) {
-                        case DBUS_TYPE_INT32:
-                            pair->value = malloc(sizeof(int));
-                            memcpy(pair->value, &tmp, sizeof(int));
-                            pair->type = EP_VALUE_INT;
-                            /* printf("libep:   value (int)    '%i'\n",
-                                    *(int *) pair->value); */
-                            break;
-                        case DBUS_TYPE_DOUBLE:
-                            pair->value = malloc(sizeof(double));
-                            memcpy(pair->value, &tmp, sizeof(double));
-                            pair->type = EP_VALUE_FLOAT;
-                            /* printf("libep:   value (float)  '%f'\n",
-                                    *(float *) pair->value); */
-                            break;
-                        case DBUS_TYPE_STRING:
-                            pair->value = strdup(tmp);
-                            pair->type = EP_VALUE_STRING;
-                            /* printf("libep:   value (string) '%s'\n",
-                                    (char *) pair->value); */
-                            break;
-                        default:
-                            /* printf("libep:   value is unknown D-Bus type '%i'\n", 
-                                    dbus_message_iter_get_arg_type(&variantit)); */
-                            break;
-                    }
+                    decode_value(&variantit, pair);
                     
                     ep_list_append(&pair_list, pair);
 
@@ -512,46 +764,8 @@ static void handle_message (DBusMessage *msg, struct cb_data *data)
             decisions = (struct ep_decision **) ep_list_convert_to_array(&decision_list);
             ep_list_free_all(&decision_list);
 
-            /* count the callbacks if a transaction is needed */
-            if (trans_data) {
-                if (data->decision_names[0]) {
-                    i = 0;
-                    cb_decision_name = data->decision_names[i];
-                    while (cb_decision_name) {
-                        if (strcmp(cb_decision_name, actname) == 0) {
-                            trans_data->refcount++;
-#if 0
-                            printf("libep: increased transaction data '%p' refcount to %u for name '%s'\n",
-                                    trans_data, trans_data->refcount, cb_decision_name);
-#endif
-                        }
-                        cb_decision_name = data->decision_names[++i];
-                    }
-                }
-                else {
-                    /* subscribe to all decisions */
-                    trans_data->refcount++;
-                }
-            }
-
-            if (data->decision_names[0]) {
-                i = 0;
-                cb_decision_name = data->decision_names[i];
-
-                /* send the decisions */
-                while (cb_decision_name) {
-                    if (strcmp(cb_decision_name, actname) == 0) {
-                        data->cb(actname, decisions, ep_ready, txid, data->user_data);
-                        found = TRUE;
-                    }
-                    cb_decision_name = data->decision_names[++i];
-                }
-            }
-            else {
-                /* call the callback for all decisions */
-                data->cb(actname, decisions, ep_ready, txid, data->user_data);
+            if (dispatch_decision(data, trans_data, actname, decisions, txid))
                 found = TRUE;
-            }
             
             free_decisions(decisions);
 
@@ -559,48 +773,464 @@ static void handle_message (DBusMessage *msg, struct cb_data *data)
 
     } while (dbus_message_iter_next(&arrit));
     
-    if (txid == 0) {
-        /* no ack is needed, go to send_signal for cleanup */
-        goto send_signal;
+send_signal:
+
+    /* TODO: free all memory */
+
+    finish_transaction(trans_data, txid, found, success);
+}
+
+/* delta-encoded decisions */
+
+/*
+ * An enforcement point registered with EP_REGISTER_DELTA gets its
+ * decisions as unicast signals on POLICY_DBUS_PATH/POLICY_DELTA carrying
+ * only the facts and fields that changed since the previous decision of
+ * the same signal. The full view is reconstructed here, so the decision
+ * callbacks see exactly what they would get from a broadcast decision.
+ *
+ * uint32 txid
+ * uint32 flags (EP_DELTA_FULL if the cache has to be rebuilt)
+ * array [
+ *    struct {
+ *       string "com.nokia.policy.audio_route"
+ *       uint32 2                                  (number of instances)
+ *       array [
+ *          struct {
+ *             uint32 1                            (instance index)
+ *             array [ struct { string, variant } ] (added/changed fields)
+ *             array [ string ]                    (removed fields)
+ *          }
+ *       ]
+ *    }
+ * ]
+ */
+
+struct delta_fact {
+    char                 *name;
+    unsigned int          count;
+    struct ep_decision  **instances;    /* NULL-terminated */
+    int                   seen;         /* present in the current message */
+};
+
+struct delta_signal {
+    char                  *signal;
+    struct ep_list_head_s  facts;
+};
+
+static int delta_mode = FALSE;
+static struct ep_list_head_s delta_cache;
+
+static void free_decision (struct ep_decision *decision)
+{
+    struct ep_key_value_pair **pairs = decision->pairs;
+
+    while (pairs && *pairs) {
+        free((*pairs)->key);
+        free((*pairs)->value);
+        free(*pairs);
+        pairs++;
     }
+    free(decision->pairs);
+    free(decision);
+}
 
-    if (found) {
+static void delta_fact_free (struct delta_fact *f)
+{
+    unsigned int i;
 
-        /* It's possible that the callbacks have had errors, and the
-         * NACK is already sent. In this case the transaction is already
-         * removed from the list and freed. See if this is the case. */
-        trans_data = ep_get_transaction(txid);
-        if (!trans_data) {
-            return;
+    for (i = 0; i < f->count; i++)
+        free_decision(f->instances[i]);
+
+    free(f->instances);
+    free(f->name);
+    free(f);
+}
+
+static void delta_signal_clear (struct delta_signal *ds)
+{
+    struct ep_list_node_s *node;
+
+    for (node = ds->facts.first; node != NULL; node = node->next)
+        delta_fact_free(node->data);
+
+    ep_list_free_all(&ds->facts);
+}
+
+static void delta_signal_drop (struct delta_signal *ds)
+{
+    delta_signal_clear(ds);
+    ep_list_remove(&delta_cache, ds);
+    free(ds->signal);
+    free(ds);
+}
+
+static void delta_cache_free (void)
+{
+    while (!ep_list_empty(&delta_cache))
+        delta_signal_drop(delta_cache.first->data);
+}
+
+static struct delta_signal * delta_signal_get (const char *signal, int create)
+{
+    struct ep_list_node_s *node;
+    struct delta_signal   *ds;
+
+    for (node = delta_cache.first; node != NULL; node = node->next) {
+        ds = node->data;
+        if (strcmp(ds->signal, signal) == 0)
+            return ds;
+    }
+
+    if (!create)
+        return NULL;
+
+    ds = calloc(1, sizeof(struct delta_signal));
+
+    if (ds == NULL || (ds->signal = strdup(signal)) == NULL ||
+        !ep_list_append(&delta_cache, ds)) {
+        if (ds)
+            free(ds->signal);
+        free(ds);
+        return NULL;
+    }
+
+    return ds;
+}
+
+static struct delta_fact * delta_fact_get (struct delta_signal *ds,
+        const char *name)
+{
+    struct ep_list_node_s *node;
+    struct delta_fact     *f;
+
+    for (node = ds->facts.first; node != NULL; node = node->next) {
+        f = node->data;
+        if (strcmp(f->name, name) == 0)
+            return f;
+    }
+
+    f = calloc(1, sizeof(struct delta_fact));
+
+    if (f == NULL)
+        return NULL;
+
+    f->name      = strdup(name);
+    f->instances = calloc(1, sizeof(struct ep_decision *));
+
+    if (f->name == NULL || f->instances == NULL ||
+        !ep_list_append(&ds->facts, f)) {
+        delta_fact_free(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+static int delta_fact_resize (struct delta_fact *f, unsigned int count)
+{
+    struct ep_decision **instances;
+    unsigned int         i;
+
+    if (count == f->count)
+        return TRUE;
+
+    for (i = count; i < f->count; i++)
+        free_decision(f->instances[i]);
+
+    if (count < f->count)
+        f->count = count;
+
+    instances = realloc(f->instances, (count + 1) * sizeof(instances[0]));
+
+    if (instances == NULL)
+        return FALSE;
+
+    f->instances = instances;
+
+    for (; f->count < count; f->count++) {
+        struct ep_decision *decision = calloc(1, sizeof(struct ep_decision));
+
+        if (decision == NULL ||
+            (decision->pairs = calloc(1, sizeof(decision->pairs[0]))) == NULL) {
+            free(decision);
+            f->instances[f->count] = NULL;
+            return FALSE;
         }
 
-        /* the ACK signal is now ready to be sent */
-        trans_data->ready = TRUE;
-        send_if_done(trans_data);
+        f->instances[f->count] = decision;
+    }
 
-#if 0
-        printf("libep: signal handling success, waiting for callbacks\n");
-#endif
-        return; /* success */
+    f->instances[count] = NULL;
+
+    return TRUE;
+}
+
+static int delta_set_pair (struct ep_decision *decision, const char *key,
+        DBusMessageIter *variantit)
+{
+    struct ep_key_value_pair  *pair, **pairs;
+    int                        n;
+
+    for (n = 0; decision->pairs[n] != NULL; n++) {
+        if (strcmp(decision->pairs[n]->key, key) == 0)
+            break;
     }
 
-send_signal:
+    if ((pair = decision->pairs[n]) != NULL) {
+        free(pair->value);
+        pair->value = NULL;
+        pair->type  = EP_VALUE_INVALID;
+    }
+    else {
+        pairs = realloc(decision->pairs, (n + 2) * sizeof(pairs[0]));
 
-    /* no-one is interested or everything failed, just send the signal
-     * and be done with it */
+        if (pairs == NULL)
+            return FALSE;
 
-    /* TODO: free all memory */
+        decision->pairs = pairs;
 
-    if (trans_data) {
-        ep_list_remove(&transaction_list, trans_data);
-        free(trans_data);
-        trans_data = NULL;
+        if ((pair = calloc(1, sizeof(struct ep_key_value_pair))) == NULL)
+            return FALSE;
+
+        if ((pair->key = strdup(key)) == NULL) {
+            free(pair);
+            return FALSE;
+        }
+
+        pairs[n]     = pair;
+        pairs[n + 1] = NULL;
     }
 
-    /* printf("libep: not waiting for handlers to return, parsing %s a success\n",
-            success ? "was" : "was not"); */
+    decode_value(variantit, pair);
 
-    send_signal(txid, success);
+    return TRUE;
+}
+
+static void delta_remove_pair (struct ep_decision *decision, const char *key)
+{
+    struct ep_key_value_pair **pairs = decision->pairs;
+
+    while (*pairs && strcmp((*pairs)->key, key) != 0)
+        pairs++;
+
+    if (*pairs == NULL)
+        return;
+
+    free((*pairs)->key);
+    free((*pairs)->value);
+    free(*pairs);
+
+    /* keep the array NULL-terminated */
+    do {
+        pairs[0] = pairs[1];
+        pairs++;
+    } while (*pairs);
+}
+
+static int next_arg (DBusMessageIter *it, int type)
+{
+    return dbus_message_iter_next(it) &&
+        dbus_message_iter_get_arg_type(it) == type;
+}
+
+static int apply_delta_instance (DBusMessageIter *changeit,
+        struct delta_fact *f)
+{
+    DBusMessageIter      setit, fieldit, variantit, delit;
+    struct ep_decision  *decision;
+    dbus_uint32_t        idx;
+    char                *key;
+
+    if (dbus_message_iter_get_arg_type(changeit) != DBUS_TYPE_UINT32)
+        return FALSE;
+
+    dbus_message_iter_get_basic(changeit, (void *)&idx);
+
+    if (idx >= f->count || !next_arg(changeit, DBUS_TYPE_ARRAY))
+        return FALSE;
+
+    decision = f->instances[idx];
+
+    /* added and changed fields */
+    dbus_message_iter_recurse(changeit, &setit);
+
+    while (dbus_message_iter_get_arg_type(&setit) == DBUS_TYPE_STRUCT) {
+        dbus_message_iter_recurse(&setit, &fieldit);
+
+        if (dbus_message_iter_get_arg_type(&fieldit) != DBUS_TYPE_STRING)
+            return FALSE;
+
+        dbus_message_iter_get_basic(&fieldit, (void *)&key);
+
+        if (!next_arg(&fieldit, DBUS_TYPE_VARIANT))
+            return FALSE;
+
+        dbus_message_iter_recurse(&fieldit, &variantit);
+
+        if (!delta_set_pair(decision, key, &variantit))
+            return FALSE;
+
+        dbus_message_iter_next(&setit);
+    }
+
+    /* removed fields */
+    if (!next_arg(changeit, DBUS_TYPE_ARRAY))
+        return FALSE;
+
+    dbus_message_iter_recurse(changeit, &delit);
+
+    while (dbus_message_iter_get_arg_type(&delit) == DBUS_TYPE_STRING) {
+        dbus_message_iter_get_basic(&delit, (void *)&key);
+        delta_remove_pair(decision, key);
+        dbus_message_iter_next(&delit);
+    }
+
+    return TRUE;
+}
+
+static struct delta_signal * apply_delta (DBusMessage *msg,
+        const char *signal, dbus_uint32_t *txid)
+{
+    DBusMessageIter        msgit, arrit, factit, instit, changeit;
+    struct delta_signal   *ds;
+    struct delta_fact     *f;
+    struct ep_list_node_s *node;
+    dbus_uint32_t          flags, count;
+    char                  *name;
+
+    if (!dbus_message_iter_init(msg, &msgit) ||
+        dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32)
+        return NULL;
+
+    dbus_message_iter_get_basic(&msgit, (void *)txid);
+
+    if (!next_arg(&msgit, DBUS_TYPE_UINT32))
+        return NULL;
+
+    dbus_message_iter_get_basic(&msgit, (void *)&flags);
+
+    if (!next_arg(&msgit, DBUS_TYPE_ARRAY))
+        return NULL;
+
+    /* a delta without a base to apply it on needs a resync */
+    if ((ds = delta_signal_get(signal, flags & EP_DELTA_FULL)) == NULL)
+        return NULL;
+
+    if (flags & EP_DELTA_FULL)
+        delta_signal_clear(ds);
+
+    for (node = ds->facts.first; node != NULL; node = node->next)
+        ((struct delta_fact *) node->data)->seen = FALSE;
+
+    dbus_message_iter_recurse(&msgit, &arrit);
+
+    while (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_STRUCT) {
+        dbus_message_iter_recurse(&arrit, &factit);
+
+        if (dbus_message_iter_get_arg_type(&factit) != DBUS_TYPE_STRING)
+            goto fail;
+
+        dbus_message_iter_get_basic(&factit, (void *)&name);
+
+        if (!next_arg(&factit, DBUS_TYPE_UINT32))
+            goto fail;
+
+        dbus_message_iter_get_basic(&factit, (void *)&count);
+
+        if (!next_arg(&factit, DBUS_TYPE_ARRAY) ||
+            (f = delta_fact_get(ds, name)) == NULL ||
+            !delta_fact_resize(f, count))
+            goto fail;
+
+        f->seen = TRUE;
+
+        dbus_message_iter_recurse(&factit, &instit);
+
+        while (dbus_message_iter_get_arg_type(&instit) == DBUS_TYPE_STRUCT) {
+            dbus_message_iter_recurse(&instit, &changeit);
+
+            if (!apply_delta_instance(&changeit, f))
+                goto fail;
+
+            dbus_message_iter_next(&instit);
+        }
+
+        dbus_message_iter_next(&arrit);
+    }
+
+    return ds;
+
+ fail:
+    /* the cache cannot be trusted any more, wait for a full snapshot */
+    delta_signal_drop(ds);
+    return NULL;
+}
+
+static void handle_delta (DBusMessage *msg)
+{
+    struct transaction_data *trans_data = NULL;
+    struct delta_signal     *ds;
+    struct delta_fact       *f;
+    struct ep_list_node_s   *node, *fnode;
+    struct cb_data          *data;
+    const char              *signal = dbus_message_get_member(msg);
+    dbus_uint32_t            txid = 0;
+    int                      found = FALSE, success = TRUE;
+
+    /* apply the delta once, then hand the full view to every callback */
+
+    if (signal == NULL)
+        return;
+
+    if ((ds = apply_delta(msg, signal, &txid)) == NULL) {
+        /* NACK makes the policy engine send a full snapshot next time */
+        finish_transaction(NULL, txid, FALSE, FALSE);
+        return;
+    }
+
+    if (txid != 0) {
+        trans_data = calloc(1, sizeof(struct transaction_data));
+        if (!trans_data)
+            goto send_signal;
+        trans_data->txid = txid;
+        if (!tx_insert(trans_data)) {
+            success = FALSE;
+            goto send_signal;
+        }
+    }
+
+    for (node = cb_list.first; node != NULL; node = node->next) {
+        data = node->data;
+
+        if (strcmp(data->signal, signal) != 0)
+            continue;
+
+        for (fnode = ds->facts.first; fnode != NULL; fnode = fnode->next) {
+            f = fnode->data;
+
+            if (f->seen && f->count > 0)
+                found |= dispatch_decision(data, trans_data, f->name,
+                        f->instances, txid);
+        }
+    }
+
+ send_signal:
+    finish_transaction(trans_data, txid, found, success);
+}
+
+static void dispatch_message (DBusMessage *msg)
+{
+    struct ep_list_node_s *node = cb_list.first;
+    struct cb_data *data = NULL;
+
+    while (node) {
+        data = node->data;
+        if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE, data->signal)) {
+            handle_message(msg, data);
+        }
+        node = node->next;
+    }
 }
 
 static DBusHandlerResult filter (DBusConnection *conn, DBusMessage *msg,
@@ -610,34 +1240,223 @@ static DBusHandlerResult filter (DBusConnection *conn, DBusMessage *msg,
     (void) arg;
 
     struct ep_list_head_s *head = &cb_list;
-    struct ep_list_node_s *node = NULL;
-    struct cb_data *data = NULL;
 
     /* printf("libep: policy event received\n"); */
 
     if (ep_list_empty(head))
         goto end;
 
-    node = head->first;
-    
-    while (node) {
-        data = node->data;
-        if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE, data->signal)) {
-            handle_message(msg, data);
-        }
-        node = node->next;
+    dispatching++;
+
+    if (dbus_message_has_path(msg, POLICY_DBUS_PATH "/" POLICY_DELTA)) {
+        if (delta_mode &&
+            dbus_message_has_interface(msg, POLICY_DBUS_INTERFACE) &&
+            dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_SIGNAL)
+            handle_delta(msg);
     }
+    else
+        dispatch_message(msg);
+
+    dispatching--;
 
 end:
+    /*
+     * Send the acks of this message before returning. Holding them for
+     * the next message is not safe, since nothing guarantees it reaches
+     * this filter (pending call replies, other filters, no callbacks).
+     */
+    if (!dispatching)
+        flush_acks();
+
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+static void shm_close (void)
+{
+    if (shm)
+        munmap(shm, shm_length);
+    if (shm_efd >= 0)
+        close(shm_efd);
+    if (shm_ackfd >= 0)
+        close(shm_ackfd);
+    free(shm_buf);
+
+    shm        = NULL;
+    shm_length = 0;
+    shm_efd    = -1;
+    shm_ackfd  = -1;
+    shm_buf    = NULL;
+}
+
+static int shm_map (int fd, int efd, int ackfd)
+{
+    struct stat  st;
+    void        *map;
+
+    /* the policy engine passes the segment and the two eventfds */
+
+    shm_efd   = efd;
+    shm_ackfd = ackfd;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)EP_SHM_BYTES)
+        goto failed;
+
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED)
+        goto failed;
+
+    close(fd);
+    fd = -1;
+
+    shm        = map;
+    shm_length = st.st_size;
+
+    if ((size_t)(uint32_t)shm_length != shm_length ||
+        !ep_shm_check(shm, shm_length))
+        goto failed;
+
+    /* take the geometry once, the segment is not trusted afterwards */
+    ep_ring_view(&shm_decisions, shm, shm->decisions,
+                 EP_SHM_RING(shm, shm->decisions)->size, FALSE);
+    ep_ring_view(&shm_acks, shm, shm->acks,
+                 EP_SHM_RING(shm, shm->acks)->size, TRUE);
+
+    shm_buf = malloc(shm_decisions.size);
+
+    if (shm_buf == NULL)
+        goto failed;
+
+    return TRUE;
+
+ failed:
+    if (fd >= 0)
+        close(fd);
+    shm_close();
+    return FALSE;
+}
+
+static void parse_register_reply (DBusMessage *reply, int flags)
+{
+    DBusMessageIter  it;
+    const char      *capability;
+    int              fds[3], nfd = 0, fd, i;
+
+    /*
+     * The reply carries the shared memory descriptors, if we asked for
+     * them and they could be passed, followed by the capabilities the
+     * policy engine accepted. An old policy engine sends an empty reply.
+     */
+
+    batch_acks = FALSE;
+
+    if (dbus_message_iter_init(reply, &it)) {
+        do {
+            switch (dbus_message_iter_get_arg_type(&it)) {
+#ifdef DBUS_TYPE_UNIX_FD
+                case DBUS_TYPE_UNIX_FD:
+                    dbus_message_iter_get_basic(&it, &fd);
+                    if (nfd < 3)
+                        fds[nfd++] = fd;
+                    else
+                        close(fd);
+                    break;
+#endif
+                case DBUS_TYPE_STRING:
+                    dbus_message_iter_get_basic(&it, &capability);
+                    if (strcmp(capability, EP_CAPABILITY_BATCH) == 0)
+                        batch_acks = TRUE;
+                    break;
+                default:
+                    break;
+            }
+        } while (dbus_message_iter_next(&it));
+    }
+
+    if ((flags & EP_REGISTER_SHM) && nfd == 3)
+        shm_map(fds[0], fds[1], fds[2]);
+    else {
+        for (i = 0; i < nfd; i++)
+            close(fds[i]);
+    }
+
+    (void) fd;
+}
+
+int ep_shm_fd (void)
+{
+    return shm ? shm_efd : -1;
+}
+
+int ep_shm_dispatch (void)
+{
+    DBusMessage *msg;
+    DBusError    err;
+    uint64_t     count;
+    int32_t      len;
+    int          n = 0;
+
+    if (!shm)
+        return -1;
+
+    if (read(shm_efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        return -1;
+
+    while ((len = ep_ring_next(&shm_decisions)) != EP_RING_EMPTY) {
+        if (len == EP_RING_CORRUPT) {
+            /* the transactions will time out */
+            ep_ring_flush(&shm_decisions);
+            break;
+        }
+
+        ep_ring_get(&shm_decisions, shm_buf, len);
+
+        dbus_error_init(&err);
+        msg = dbus_message_demarshal(shm_buf, len, &err);
+
+        if (msg == NULL) {
+            dbus_error_free(&err);
+            continue;
+        }
+
+        dispatch_message(msg);
+        dbus_message_unref(msg);
+        n++;
+    }
+
+    return n;
+}
+
+static int add_decision_match (void)
+{
+    char      polrule[512];
+    DBusError err;
+
+    snprintf(polrule, sizeof(polrule), "type='signal',interface='%s',"
+             "path='%s/%s'", POLICY_DBUS_INTERFACE, POLICY_DBUS_PATH, POLICY_DECISION);
+
+    dbus_error_init(&err);
+    dbus_bus_add_match(connection, polrule, &err);
+
+    if (dbus_error_is_set(&err)) {
+        dbus_error_free(&err);
+        return FALSE;
+    }
+
+    decision_match = TRUE;
+    return TRUE;
+}
+
 int ep_register (DBusConnection *c, const char *name, const char **capabilities)
+{
+    return ep_register_flags(c, name, capabilities, 0);
+}
+
+int ep_register_flags (DBusConnection *c, const char *name,
+        const char **capabilities, int flags)
 {
     DBusMessage     *msg = NULL, *reply;
     int              success = 0;
-    char             polrule[512];
-    DBusError        err;
     DBusMessageIter message_iter,
                     array_iter;
 
@@ -645,20 +1464,19 @@ int ep_register (DBusConnection *c, const char *name, const char **capabilities)
 
     /* first, let's do a filter */
 
-    snprintf(polrule, sizeof(polrule), "type='signal',interface='%s',"
-             "path='%s/%s'", POLICY_DBUS_INTERFACE, POLICY_DBUS_PATH, POLICY_DECISION);
-
-    dbus_error_init(&err);
-
     if (!dbus_connection_add_filter(connection, filter, NULL, NULL)) {
         goto failed;
     }
 
-    dbus_bus_add_match(connection, polrule, &err);
+    /* delta decisions are sent to us directly, no match rule is needed
+     * and the broadcast decisions are of no interest */
+    delta_mode = (flags & EP_REGISTER_DELTA) ? TRUE : FALSE;
 
-    if (dbus_error_is_set(&err)) {
-        dbus_error_free(&err);
-        goto failed;
+    /* with shared memory we only need the match rule if we do not get
+     * the segment, so wait for the reply */
+    if (!delta_mode && !(flags & EP_REGISTER_SHM)) {
+        if (!add_decision_match())
+            goto failed;
     }
 
     /* then register to the policy engine */
@@ -688,6 +1506,29 @@ int ep_register (DBusConnection *c, const char *name, const char **capabilities)
         capabilities++;
     }
 
+    if (delta_mode) {
+        const char *delta = EP_CAPABILITY_DELTA;
+
+        if (!dbus_message_iter_append_basic(&array_iter, DBUS_TYPE_STRING, &delta))
+            goto failed;
+    }
+
+    if (flags & EP_REGISTER_SHM) {
+        const char *shared = EP_CAPABILITY_SHM;
+
+        if (!dbus_message_iter_append_basic(&array_iter, DBUS_TYPE_STRING, &shared))
+            goto failed;
+    }
+
+    /* always offer batched acks, they are used if the policy engine
+     * says it understands them */
+    {
+        const char *batch = EP_CAPABILITY_BATCH;
+
+        if (!dbus_message_iter_append_basic(&array_iter, DBUS_TYPE_STRING, &batch))
+            goto failed;
+    }
+
     dbus_message_iter_close_container(&message_iter, &array_iter);
 
     reply = dbus_connection_send_with_reply_and_block(connection, msg, -1, NULL);
@@ -696,6 +1537,18 @@ int ep_register (DBusConnection *c, const char *name, const char **capabilities)
         goto failed;
     }
 
+    parse_register_reply(reply, flags);
+
+    if ((flags & EP_REGISTER_SHM) && !shm && !delta_mode) {
+        /* no shared memory, fall back to the broadcast decisions */
+        if (!add_decision_match()) {
+            dbus_message_unref(reply);
+            goto failed;
+        }
+    }
+
+    dbus_message_unref(reply);
+
     success = 1;
 
     /* intentional fallthrough */
@@ -721,7 +1574,18 @@ int ep_unregister (DBusConnection *c)
              "path='%s/%s'", POLICY_DBUS_INTERFACE, POLICY_DBUS_PATH, POLICY_DECISION);
         
     dbus_connection_remove_filter(connection, filter, NULL);
-    dbus_bus_remove_match(connection, polrule, NULL);
+
+    if (decision_match)
+        dbus_bus_remove_match(connection, polrule, NULL);
+
+    flush_acks();
+    batch_acks = FALSE;
+
+    delta_cache_free();
+    shm_close();
+
+    decision_match = FALSE;
+    delta_mode = FALSE;
 
     /* then unregister */
 
@@ -36,6 +36,22 @@ USA.
 #define POLICY_DBUS_NAME        "org.freedesktop.ohm"
 #define POLICY_DECISION         "decision"
 #define POLICY_STATUS           "status"
+#define POLICY_DELTA            "delta"
+#define POLICY_STATUS_BATCH     "status_batch"
+
+/* capability telling the policy engine we want delta-encoded decisions */
+#define EP_CAPABILITY_DELTA     "@delta"
+#define EP_DELTA_FULL           0x1
+
+/* capability asking for the shared memory transport */
+#define EP_CAPABILITY_SHM       "@shm"
+
+/* capability negotiating batched acknowledgements */
+#define EP_CAPABILITY_BATCH     "@batch"
+
+/* registration flags */
+#define EP_REGISTER_DELTA       0x1     /* receive decisions as deltas */
+#define EP_REGISTER_SHM         0x2     /* use shared memory if possible */
 
 /* As simple API as possible: those wanting to do more difficult things
  * can use the D-Bus API directly. */
@@ -71,9 +87,20 @@ typedef void    (*ep_decision_cb) (const char *decision_name,
 /* functions for registering and unregistering to the policy engine */
 
 int ep_register     (DBusConnection *connection, const char *name, const char **capabilities);
+int ep_register_flags (DBusConnection *connection, const char *name,
+        const char **capabilities, int flags);
 int ep_unregister   (DBusConnection *connection);
 
 
+/* shared memory transport: if registered with EP_REGISTER_SHM, poll the
+ * descriptor returned by ep_shm_fd() in the main loop and call
+ * ep_shm_dispatch() when it is readable. ep_shm_fd() returns -1 if the
+ * decisions keep coming over D-Bus. */
+
+int ep_shm_fd       (void);
+int ep_shm_dispatch (void);
+
+
 /* function for setting up the policy decision filter */
 
 int ep_filter   (const char **decision_names, const char *signal, 
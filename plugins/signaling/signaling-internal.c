@@ -26,43 +26,211 @@ USA.
  * Copyright (C) 2008, Nokia. All rights reserved.
  */
 
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
 #include "signaling.h"
+#include "libep/ep-ring.h"
 
-#define ONLY_ONE_TRANSACTION 1
+#define DEFAULT_PIPELINE_DEPTH 1   /* max. transactions in flight/signal */
 
 static int DBG_SIGNALING, DBG_FACTS;
 
 GSList         *enforcement_points = NULL;
 DBusConnection *connection;
 GHashTable     *transactions;
-#ifdef ONLY_ONE_TRANSACTION
-GHashTable     *signal_queues;
-#endif
+GHashTable     *signal_queues;  /* signal name -> signal_pipeline */
+GHashTable     *subscriptions;  /* interned signal name -> list of EPs */
+GHashTable     *watched_addrs;  /* addresses of watched external EPs */
+
+static GPtrArray *ep_slots;         /* EPs indexed by their slot number */
+static GHashTable *ep_ids;          /* EP id -> EnforcementPoint */
+static GPtrArray *deadlines;        /* issued transactions, min-heap */
+static guint      deadline_timer;   /* g_source for the earliest deadline */
+static guint64    deadline_armed;   /* expiry deadline_timer is set for */
 
 static OhmFactStore *store;
 static gboolean ecosystem_ready;
 
+static guint    default_depth    = DEFAULT_PIPELINE_DEPTH;
+static gboolean default_collapse = FALSE;
+
+/*
+ * Transactions of a signal go through a pipeline. At most depth of them
+ * are in flight at any time, the rest wait in the pending queue. The
+ * completion of transactions is reported in the order they were issued,
+ * even if a later one finishes first.
+ */
+
+typedef struct _signal_pipeline {
+    gchar    *signal;           /* signal name */
+    GQueue   *pending;          /* transactions waiting to be issued */
+    GQueue   *issued;           /* issued, not yet reported transactions */
+    guint     active;           /* number of unfinished issued ones */
+    guint     depth;            /* max. number of active transactions */
+    gboolean  collapse;         /* collapse superseded pending decisions */
+    gboolean  scheduled;        /* processing scheduled in the idle loop */
+    gboolean  running;          /* pipeline_run in progress */
+    gboolean  reporting;        /* pipeline_report in progress */
+} signal_pipeline;
+
     
 typedef void (*internal_ep_cb_t) (GObject *ep, GObject *transaction, gboolean success);
 
 static gboolean process_inq(gpointer data);
+static void     pipeline_run(signal_pipeline *pipeline);
+static void     pipeline_report(signal_pipeline *pipeline);
+static void     deadline_remove(Transaction *t);
 
-static int watch_dbus_addr(const char *addr, gboolean watchit,
-                           DBusHandlerResult (*filter)(DBusConnection *,
-                                                       DBusMessage *, void *),
-                           void *user_data);
+static int watch_dbus_addr(const char *addr, gboolean watchit);
 
 static Transaction * transaction_lookup(guint txid)
 {
     return (Transaction *)g_hash_table_lookup(transactions, &txid);
 }
 
-#ifdef ONLY_ONE_TRANSACTION
-static GQueue * signal_queue_lookup(gchar *signal)
+static signal_pipeline * signal_queue_lookup(const gchar *signal)
 {
-    return (GQueue *)g_hash_table_lookup(signal_queues, signal);
+    if (signal_queues == NULL || signal == NULL)
+        return NULL;
+
+    return (signal_pipeline *)g_hash_table_lookup(signal_queues, signal);
+}
+
+static void signal_pipeline_free(signal_pipeline *pipeline)
+{
+    Transaction *t;
+
+    /* issued transactions are owned by their timeouts and EPs */
+    while ((t = g_queue_pop_head(pipeline->pending)) != NULL)
+        g_object_unref(t);
+
+    g_queue_free(pipeline->pending);
+    g_queue_free(pipeline->issued);
+    g_free(pipeline->signal);
+    g_free(pipeline);
+}
+
+static signal_pipeline * signal_pipeline_get(const gchar *signal)
+{
+    signal_pipeline *pipeline;
+
+    if (signal_queues == NULL)
+        return NULL;
+
+    if ((pipeline = signal_queue_lookup(signal)) != NULL)
+        return pipeline;
+
+    pipeline = g_new0(signal_pipeline, 1);
+    pipeline->signal   = g_strdup(signal);
+    pipeline->pending  = g_queue_new();
+    pipeline->issued   = g_queue_new();
+    pipeline->depth    = default_depth;
+    pipeline->collapse = default_collapse;
+
+    g_hash_table_insert(signal_queues, pipeline->signal, pipeline);
+
+    return pipeline;
+}
+
+gboolean configure_pipeline(const gchar *signal, guint depth,
+        gboolean collapse)
+{
+    signal_pipeline *pipeline;
+
+    /* a depth of 0 means the built-in default (keep the current one) */
+
+    if (signal == NULL) {
+        default_depth    = depth ? depth : DEFAULT_PIPELINE_DEPTH;
+        default_collapse = collapse;
+        OHM_DEBUG(DBG_SIGNALING, "default pipeline depth %u%s", default_depth,
+                collapse ? ", collapsing superseded decisions" : "");
+        return TRUE;
+    }
+
+    if ((pipeline = signal_pipeline_get(signal)) == NULL)
+        return FALSE;
+
+    if (depth)
+        pipeline->depth = depth;
+    pipeline->collapse  = collapse;
+
+    OHM_DEBUG(DBG_SIGNALING, "pipeline depth for '%s' %u%s", signal,
+            pipeline->depth, collapse ? ", collapsing superseded decisions" : "");
+
+    /* a deeper pipeline might let pending transactions through */
+    pipeline_run(pipeline);
+
+    return TRUE;
+}
+
+/*
+ * subscription index
+ *
+ * Maps (interned) signal names to the list of registered enforcement
+ * points interested in them, so routing a transaction does not need to
+ * ask every enforcement point whether it wants the signal or not.
+ */
+
+static gboolean subscription_registered(gpointer ep)
+{
+    return g_slist_find(enforcement_points, ep) != NULL;
+}
+
+static void subscription_add(gpointer ep, GSList *signals)
+{
+    GSList      *i, *eps;
+    const gchar *signal;
+
+    if (subscriptions == NULL)
+        return;
+
+    for (i = signals; i != NULL; i = g_slist_next(i)) {
+        signal = g_intern_string(i->data);
+        eps    = g_hash_table_lookup(subscriptions, signal);
+
+        if (g_slist_find(eps, ep) != NULL)
+            continue;
+
+        g_hash_table_steal(subscriptions, signal);
+        g_hash_table_insert(subscriptions, (gpointer)signal,
+                            g_slist_prepend(eps, ep));
+    }
+}
+
+static void subscription_remove(gpointer ep, GSList *signals)
+{
+    GSList      *i, *eps;
+    const gchar *signal;
+
+    if (subscriptions == NULL)
+        return;
+
+    for (i = signals; i != NULL; i = g_slist_next(i)) {
+        signal = g_intern_string(i->data);
+
+        if ((eps = g_hash_table_lookup(subscriptions, signal)) == NULL)
+            continue;
+
+        g_hash_table_steal(subscriptions, signal);
+
+        if ((eps = g_slist_remove(eps, ep)) != NULL)
+            g_hash_table_insert(subscriptions, (gpointer)signal, eps);
+    }
+}
+
+GSList *subscribed_enforcement_points(const gchar *signal)
+{
+    if (subscriptions == NULL || signal == NULL)
+        return NULL;
+
+    return (GSList *)g_hash_table_lookup(subscriptions, signal);
 }
-#endif
 
 gboolean init_signaling(DBusConnection *c, int flag_signaling, int flag_facts)
 {
@@ -80,16 +248,27 @@ gboolean init_signaling(DBusConnection *c, int flag_signaling, int flag_facts)
         return FALSE;
     }
     
-#ifdef ONLY_ONE_TRANSACTION
     signal_queues = g_hash_table_new_full(g_str_hash,
             g_str_equal,
             NULL,
-            (GDestroyNotify) g_queue_free);
+            (GDestroyNotify) signal_pipeline_free);
     if (signal_queues == NULL) {
         g_error("Failed to create signal queue hash table.");
         return FALSE;
     }
-#endif
+
+    subscriptions = g_hash_table_new_full(g_str_hash,
+            g_str_equal,
+            NULL,
+            (GDestroyNotify) g_slist_free);
+    if (subscriptions == NULL) {
+        g_error("Failed to create subscription hash table.");
+        return FALSE;
+    }
+
+    ep_slots  = g_ptr_array_new();
+    deadlines = g_ptr_array_new();
+    ep_ids    = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     connection = c;
 
@@ -107,16 +286,49 @@ gboolean deinit_signaling()
     }
 
     g_slist_free(enforcement_points);
+    enforcement_points = NULL;
+
+    if (subscriptions) {
+        g_hash_table_destroy(subscriptions);
+        subscriptions = NULL;
+    }
 
     /* TODO: stop all possibly ongoing transactions (or verify that they
      * are actually stopped when all enforcement points are gone) */
     if (transactions)
         g_hash_table_destroy(transactions);
 
-#ifdef ONLY_ONE_TRANSACTION
-    if (signal_queues)
+    if (deadline_timer) {
+        g_source_remove(deadline_timer);
+        deadline_timer = 0;
+    }
+
+    if (deadlines) {
+        g_ptr_array_free(deadlines, TRUE);
+        deadlines = NULL;
+    }
+
+    if (ep_slots) {
+        g_ptr_array_free(ep_slots, TRUE);
+        ep_slots = NULL;
+    }
+
+    if (ep_ids) {
+        g_hash_table_destroy(ep_ids);
+        ep_ids = NULL;
+    }
+
+    if (signal_queues) {
         g_hash_table_destroy(signal_queues);
-#endif
+        signal_queues = NULL;
+    }
+
+    if (watched_addrs) {
+        dbus_connection_remove_filter(connection,
+                update_external_enforcement_points, NULL);
+        g_hash_table_destroy(watched_addrs);
+        watched_addrs = NULL;
+    }
 
     store = NULL;
 
@@ -191,15 +403,108 @@ enum {
     PROP_FACTS
 };
 
-static GSList * result_list(GSList *ep_list)
+/*
+ * Every registered enforcement point has a small, stable slot number.
+ * Transactions keep their members in an array indexed by the slot and
+ * track the answers in bitmaps, so acking, the completion check and the
+ * timeout sweep do not need to walk or allocate lists.
+ */
+
+#define BIT_WORD(n) ((n) / 32)
+#define BIT_MASK(n) (1U << ((n) % 32))
+#define BIT_WORDS(n) (((n) + 31) / 32)
+
+#define BIT_TEST(map, n) ((map)[BIT_WORD(n)] & BIT_MASK(n))
+#define BIT_SET(map, n)  ((map)[BIT_WORD(n)] |= BIT_MASK(n))
+#define BIT_CLR(map, n)  ((map)[BIT_WORD(n)] &= ~BIT_MASK(n))
+
+enum {
+    MEMBERS_ACKED,
+    MEMBERS_NACKED,
+    MEMBERS_NOT_ANSWERED
+};
+
+static guint *ep_slot(EnforcementPoint *ep)
 {
-    GSList *retval = NULL, *i = NULL;
-    gchar *id;
+    if (G_TYPE_CHECK_INSTANCE_TYPE(ep, EXTERNAL_EP_STRATEGY_TYPE))
+        return &((ExternalEPStrategy *)ep)->slot;
+    else
+        return &((InternalEPStrategy *)ep)->slot;
+}
 
-    for (i = ep_list; i != NULL; i = g_slist_next(i)) {
-        g_object_get(i->data, "id", &id, NULL);
-        
-        retval = g_slist_prepend(retval, id);
+static const gchar *ep_id(EnforcementPoint *ep)
+{
+    if (G_TYPE_CHECK_INSTANCE_TYPE(ep, EXTERNAL_EP_STRATEGY_TYPE))
+        return ((ExternalEPStrategy *)ep)->id;
+    else
+        return ((InternalEPStrategy *)ep)->id;
+}
+
+static void ep_slot_alloc(EnforcementPoint *ep)
+{
+    guint slot;
+
+    /* reuse the lowest free slot to keep the bitmaps short */
+    for (slot = 0; slot < ep_slots->len; slot++) {
+        if (g_ptr_array_index(ep_slots, slot) == NULL)
+            break;
+    }
+
+    if (slot == ep_slots->len)
+        g_ptr_array_add(ep_slots, ep);
+    else
+        g_ptr_array_index(ep_slots, slot) = ep;
+
+    *ep_slot(ep) = slot;
+}
+
+static void ep_slot_free(EnforcementPoint *ep)
+{
+    guint slot = *ep_slot(ep);
+
+    if (ep_slots != NULL && slot < ep_slots->len &&
+        g_ptr_array_index(ep_slots, slot) == ep)
+        g_ptr_array_index(ep_slots, slot) = NULL;
+}
+
+static EnforcementPoint *transaction_member(Transaction *t, guint slot)
+{
+    if (t->members == NULL || slot >= t->members->len)
+        return NULL;
+
+    return g_ptr_array_index(t->members, slot);
+}
+
+static gboolean member_in(Transaction *t, guint slot, int which)
+{
+    if (transaction_member(t, slot) == NULL)
+        return FALSE;
+
+    switch (which) {
+        case MEMBERS_NOT_ANSWERED:
+            return BIT_TEST(t->unanswered_map, slot) ? TRUE : FALSE;
+        case MEMBERS_NACKED:
+            return BIT_TEST(t->nacked_map, slot) ? TRUE : FALSE;
+        case MEMBERS_ACKED:
+            return !BIT_TEST(t->unanswered_map, slot) &&
+                !BIT_TEST(t->nacked_map, slot);
+        default:
+            return FALSE;
+    }
+}
+
+static GSList * result_list(Transaction *t, int which)
+{
+    GSList *retval = NULL;
+    guint   slot;
+
+    if (t->members == NULL)
+        return NULL;
+
+    for (slot = 0; slot < t->members->len; slot++) {
+        if (member_in(t, slot, which))
+            retval = g_slist_prepend(retval,
+                    g_strdup(ep_id(transaction_member(t, slot))));
     }
 
     return retval;
@@ -223,17 +528,17 @@ static void transaction_get_property(GObject *object,
             g_value_set_string(value, t->signal);
             break;
         case PROP_RESPONSE_COUNT:
-            g_value_set_uint(value, g_slist_length(t->acked)+g_slist_length(t->nacked));
+            g_value_set_uint(value, t->nmember - t->unanswered);
             break;
         case PROP_ACKED:
             /* TODO: cache these? */
-            g_value_set_pointer(value, result_list(t->acked));
+            g_value_set_pointer(value, result_list(t, MEMBERS_ACKED));
             break;
         case PROP_NACKED:
-            g_value_set_pointer(value, result_list(t->nacked));
+            g_value_set_pointer(value, result_list(t, MEMBERS_NACKED));
             break;
         case PROP_NOT_ANSWERED:
-            g_value_set_pointer(value, result_list(t->not_answered));
+            g_value_set_pointer(value, result_list(t, MEMBERS_NOT_ANSWERED));
             break;
         case PROP_FACTS:
             /* FIXME: pass a copy? To be refactored with OhmFacts */
@@ -323,14 +628,20 @@ static void external_ep_strategy_set_property(GObject *object,
         GParamSpec *pspec)
 {
     ExternalEPStrategy *ep = EXTERNAL_EP_STRATEGY(object);
+    gboolean registered;
     switch (property_id) {
         case PROP_ID:
             g_free(ep->id);
             ep->id = g_value_dup_string(value);
             break;
         case PROP_INTERESTED:
+            registered = subscription_registered(ep);
+            if (registered)
+                subscription_remove(ep, ep->interested);
             free_string_list(ep->interested);
             ep->interested = g_value_get_pointer(value);
+            if (registered)
+                subscription_add(ep, ep->interested);
             break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -344,14 +655,20 @@ static void internal_ep_strategy_set_property(GObject *object,
         GParamSpec *pspec)
 {
     InternalEPStrategy *ep = INTERNAL_EP_STRATEGY(object);
+    gboolean registered;
     switch (property_id) {
         case PROP_ID:
             g_free(ep->id);
             ep->id = g_value_dup_string(value);
             break;
         case PROP_INTERESTED:
+            registered = subscription_registered(ep);
+            if (registered)
+                subscription_remove(ep, ep->interested);
             free_string_list(ep->interested);
             ep->interested = g_value_get_pointer(value);
+            if (registered)
+                subscription_add(ep, ep->interested);
             break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -424,19 +741,14 @@ gboolean internal_ep_is_interested(EnforcementPoint *self,
         Transaction *t)
 {
     InternalEPStrategy *s = INTERNAL_EP_STRATEGY(self);
-    gchar *signal;
     gboolean retval = FALSE;
 
-    g_object_get(t, "signal", &signal, NULL);
-
-    if (g_slist_find_custom(s->interested, signal, strcmp)) {
+    if (g_slist_find_custom(s->interested, t->signal, strcmp)) {
         retval = TRUE;
     }
 
     OHM_DEBUG(DBG_SIGNALING, "Internal EP %p %s interested in signal '%s'",
-            self, retval ? "is" : "is not", signal);
-
-    g_free(signal);
+            self, retval ? "is" : "is not", t->signal);
 
     return retval;
 }
@@ -445,19 +757,14 @@ gboolean external_ep_is_interested(EnforcementPoint *self,
         Transaction *t)
 {
     ExternalEPStrategy *s = EXTERNAL_EP_STRATEGY(self);
-    gchar *signal;
     gboolean retval = FALSE;
 
-    g_object_get(t, "signal", &signal, NULL);
-
-    if (g_slist_find_custom(s->interested, signal, strcmp)) {
+    if (g_slist_find_custom(s->interested, t->signal, strcmp)) {
         retval = TRUE;
     }
 
     OHM_DEBUG(DBG_SIGNALING, "External EP %p %s interested in signal '%s'",
-            self, retval ? "is" : "is not", signal);
-
-    g_free(signal);
+            self, retval ? "is" : "is not", t->signal);
 
     return retval;
 }
@@ -480,17 +787,27 @@ static void internal_ep_cb(EnforcementPoint *self, Transaction *t,
 gboolean internal_ep_send_decision(EnforcementPoint *self,
         Transaction *transaction)
 {
-    guint txid;
+    guint txid = transaction->txid;
     InternalEPStrategy *s = INTERNAL_EP_STRATEGY(self);
-
-    g_object_get(transaction,
-            "txid", &txid,
-            NULL);
+    const internal_ep_ops_t *ops = s->ops;
+    int status;
 
     OHM_DEBUG(DBG_SIGNALING, "Internal EP send decision, txid '%u'", txid);
     
     if (txid == 0) {
-        g_signal_emit (INTERNAL_EP_STRATEGY(self), signals [ON_KEY_CHANGE], 0, transaction);
+        if (ops != NULL && ops->key_change != NULL)
+            ops->key_change(G_OBJECT(self), transaction->signal,
+                    transaction->facts, s->ops_data);
+        else
+            g_signal_emit (INTERNAL_EP_STRATEGY(self), signals [ON_KEY_CHANGE], 0, transaction);
+    }
+    else if (ops != NULL && ops->decision != NULL) {
+        s->ongoing_transactions = g_slist_prepend(s->ongoing_transactions, transaction);
+        status = ops->decision(G_OBJECT(self), txid, transaction->signal,
+                transaction->facts, s->ops_data);
+
+        if (status != INTERNAL_EP_DEFERRED)
+            enforcement_point_receive_ack(self, transaction, status ? 1 : 0);
     }
     else {
         s->ongoing_transactions = g_slist_prepend(s->ongoing_transactions, transaction);
@@ -511,115 +828,174 @@ gboolean internal_ep_send_decision(EnforcementPoint *self,
     return TRUE;
 }
 
-static int map_to_dbus_type(GValue *gval, gchar *sig, void **value)
+void internal_ep_set_ops(EnforcementPoint *self, const internal_ep_ops_t *ops,
+        gpointer data)
+{
+    InternalEPStrategy *s = INTERNAL_EP_STRATEGY(self);
+
+    s->ops      = ops;
+    s->ops_data = data;
+}
+
+gboolean internal_ep_ack(EnforcementPoint *self, guint txid, gboolean success)
 {
+    InternalEPStrategy *s = INTERNAL_EP_STRATEGY(self);
+    GSList *i;
+
+    for (i = s->ongoing_transactions; i != NULL; i = g_slist_next(i)) {
+        Transaction *t = i->data;
+
+        if (t->txid == txid)
+            return enforcement_point_receive_ack(self, t, success ? 1 : 0);
+    }
+
+    OHM_DEBUG(DBG_SIGNALING, "Internal EP '%s': no ongoing transaction %u",
+            s->id, txid);
 
-    int retval;
-    gulong ul, *pul;
-    glong l, *pl;
-    gdouble d, *pd;
+    return FALSE;
+}
+
+static gboolean supported_value(GValue *gval)
+{
+    if (gval == NULL || !G_IS_VALUE(gval))
+        return FALSE;
 
-    if (!G_IS_VALUE(gval)) {
-        return DBUS_TYPE_INVALID;
+    switch (G_VALUE_TYPE(gval)) {
+        case G_TYPE_STRING: case G_TYPE_INT:   case G_TYPE_UINT:
+        case G_TYPE_LONG:   case G_TYPE_ULONG: case G_TYPE_FLOAT:
+        case G_TYPE_DOUBLE:
+            return TRUE;
+        default:
+            return FALSE;
     }
+}
+
+static gboolean append_fact_value(DBusMessageIter *iter, GValue *gval)
+{
+    /*
+     * Appends a fact field value as a variant. The basic value is
+     * converted on the stack, no heap allocations are needed.
+     */
+
+    union {
+        dbus_int32_t  i;
+        dbus_uint32_t u;
+        double        d;
+        const char   *s;
+    } v;
+    const char      *sig;
+    int              type;
+    DBusMessageIter  variant_iter;
+
+    if (gval == NULL || !G_IS_VALUE(gval))
+        return FALSE;
 
     switch(G_VALUE_TYPE(gval)) {
         case G_TYPE_STRING:
-            *sig = 's';
-            *value = (void *) g_strdup(g_value_get_string(gval));
-            retval = DBUS_TYPE_STRING;
+            v.s  = g_value_get_string(gval);
+            sig  = DBUS_TYPE_STRING_AS_STRING;
+            type = DBUS_TYPE_STRING;
+            if (v.s == NULL)
+                v.s = "";
             break;
         case G_TYPE_INT:
-            *sig = 'i';
-            l = g_value_get_int(gval);
-            pl = g_malloc(sizeof(glong));
-            *pl = l;
-            *value = pl;
-            retval = DBUS_TYPE_INT32;
+            v.i  = g_value_get_int(gval);
+            sig  = DBUS_TYPE_INT32_AS_STRING;
+            type = DBUS_TYPE_INT32;
             break;
         case G_TYPE_UINT:
-            *sig = 'u';
-            ul = g_value_get_uint(gval);
-            pul = g_malloc(sizeof(gulong));
-            *pul = ul;
-            *value = pul;
-            retval = DBUS_TYPE_UINT32;
+            v.u  = g_value_get_uint(gval);
+            sig  = DBUS_TYPE_UINT32_AS_STRING;
+            type = DBUS_TYPE_UINT32;
             break;
         case G_TYPE_LONG:
-            *sig = 'i';
-            l = g_value_get_long(gval);
-            pl = g_malloc(sizeof(glong));
-            *pl = l;
-            *value = pl;
-            retval = DBUS_TYPE_INT32;
+            v.i  = g_value_get_long(gval);
+            sig  = DBUS_TYPE_INT32_AS_STRING;
+            type = DBUS_TYPE_INT32;
             break;
         case G_TYPE_ULONG:
-            *sig = 'u';
-            ul = g_value_get_ulong(gval);
-            pul = g_malloc(sizeof(gulong));
-            *pul = ul;
-            *value = pul;
-            retval = DBUS_TYPE_UINT32;
+            v.u  = g_value_get_ulong(gval);
+            sig  = DBUS_TYPE_UINT32_AS_STRING;
+            type = DBUS_TYPE_UINT32;
             break;
         case G_TYPE_FLOAT:
-            *sig = 'd';
-            d = g_value_get_float(gval);
-            pd = g_malloc(sizeof(gdouble));
-            *pd = d;
-            *value = pd;
-            retval = DBUS_TYPE_DOUBLE;
+            v.d  = g_value_get_float(gval);
+            sig  = DBUS_TYPE_DOUBLE_AS_STRING;
+            type = DBUS_TYPE_DOUBLE;
             break;
         case G_TYPE_DOUBLE:
-            *sig = 'd';
-            d = g_value_get_double(gval);
-            pd = g_malloc(sizeof(gdouble));
-            *pd = d;
-            *value = pd;
-            retval = DBUS_TYPE_DOUBLE;
+            v.d  = g_value_get_double(gval);
+            sig  = DBUS_TYPE_DOUBLE_AS_STRING;
+            type = DBUS_TYPE_DOUBLE;
             break;
         default:
-            /* printf("ERROR ALARM ERROR: G_VALUE_TYPE: '%i'\n", G_VALUE_TYPE(gval)); */
-            *sig = '?';
-            retval = DBUS_TYPE_INVALID;
-            break;
+            /* unsupported data type */
+            return FALSE;
     }
 
-    return retval;
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, sig,
+                &variant_iter) ||
+        !dbus_message_iter_append_basic(&variant_iter, type, &v) ||
+        !dbus_message_iter_close_container(iter, &variant_iter)) {
+        OHM_ERROR("signaling: error appending OhmFact value");
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
-static gboolean send_ipc_signal(gpointer data)
+static gboolean append_fact(DBusMessageIter *fact_iter, OhmFact *of)
 {
-    pending_signal *signal = data;
-    Transaction    *transaction = signal->transaction;
-    dbus_uint32_t   txid;
-
-    GSList         *facts = signal->facts, *i, *j;
-    GSList         *k = NULL;
-    char           *path = DBUS_PATH_POLICY "/decision";
-    char           *interface = DBUS_INTERFACE_POLICY;
-    gchar          *signal_name;
-
-    DBusMessage    *dbus_signal = NULL;
-
-    /* this is ridiculous */
-    DBusMessageIter message_iter,
-                    command_array_iter,
-                    command_array_entry_iter,
-                    fact_iter,
-                    fact_struct_iter,
-                    fact_struct_field_iter,
-                    variant_iter;
-
-    g_object_get(transaction,
-            "txid",
-            &txid,
-            "signal",
-            &signal_name,
-            NULL);
+    DBusMessageIter  fact_struct_iter, fact_struct_field_iter;
+    GSList          *k;
+    GValue          *gval;
+    const gchar     *field_name;
+
+    if (!dbus_message_iter_open_container(fact_iter, DBUS_TYPE_ARRAY,
+                "(sv)", &fact_struct_iter)) {
+        OHM_ERROR("signaling: error opening container");
+        return FALSE;
+    }
 
-    /**
-     * This is really complicated and nasty. Idea is that the message is
-     * supposed to look something like this:
+    for (k = ohm_fact_get_fields(of); k != NULL; k = g_slist_next(k)) {
+        field_name = g_quark_to_string((GQuark)GPOINTER_TO_INT(k->data));
+        gval       = ohm_fact_get(of, field_name);
+
+        if (!supported_value(gval))
+            continue;
+
+        if (!dbus_message_iter_open_container(&fact_struct_iter,
+                    DBUS_TYPE_STRUCT, NULL, &fact_struct_field_iter)) {
+            OHM_ERROR("signaling: error opening container");
+            return FALSE;
+        }
+
+        if (!dbus_message_iter_append_basic(&fact_struct_field_iter,
+                    DBUS_TYPE_STRING, &field_name)) {
+            OHM_ERROR("signaling: error appending OhmFact field");
+            return FALSE;
+        }
+
+        if (!append_fact_value(&fact_struct_field_iter, gval))
+            return FALSE;
+
+        dbus_message_iter_close_container(&fact_struct_iter,
+                &fact_struct_field_iter);
+    }
+
+    dbus_message_iter_close_container(fact_iter, &fact_struct_iter);
+
+    return TRUE;
+}
+
+DBusMessage *encode_decision(Transaction *transaction)
+{
+    /*
+     * Serializes the decision of a transaction into a D-Bus signal. The
+     * decision is encoded only once, the resulting message is cached in
+     * the transaction and shared by all external enforcement points.
+     *
+     * The message looks like this:
      *
      * uint32 0
      * array [
@@ -649,160 +1025,699 @@ static gboolean send_ipc_signal(gpointer data)
      *       ]
      *    )
      * ]
-     *
      */
 
-    OHM_DEBUG(DBG_SIGNALING, "sending signal with txid '%u'", txid);
+    char            *path = DBUS_PATH_POLICY "/decision";
+    char            *interface = DBUS_INTERFACE_POLICY;
+    DBusMessage     *msg;
+    DBusMessageIter  message_iter, command_array_iter,
+                     command_array_entry_iter, fact_iter;
+    dbus_uint32_t    txid;
+    GSList          *i, *j, *ohm_facts;
+    gchar           *f;
+
+    if (transaction->decision != NULL)
+        return transaction->decision;
+
+    if ((msg = dbus_message_new_signal(path, interface,
+                    transaction->signal)) == NULL)
+        return NULL;
 
-    if ((dbus_signal =
-                dbus_message_new_signal(path, interface, signal_name)) == NULL)
-        goto end;
+    txid = transaction->txid;
 
-    /* open message_iter */
-    dbus_message_iter_init_append(dbus_signal, &message_iter);
+    dbus_message_iter_init_append(msg, &message_iter);
 
     if (!dbus_message_iter_append_basic(&message_iter, DBUS_TYPE_UINT32, &txid))
-        goto end;
+        goto fail;
 
-    /* open command_array_iter */
     if (!dbus_message_iter_open_container(&message_iter, DBUS_TYPE_ARRAY,
                 "{saa(sv)}", &command_array_iter))
-        goto end;
-
-    for (i = facts; i != NULL; i = g_slist_next(i)) {
-        gchar *f = i->data;
-        GSList *ohm_facts = ohm_fact_store_get_facts_by_name(store, f);
+        goto fail;
 
-        /* printf("key: %s, facts: %s\n", f, ohm_facts ? "yes" : "ERROR: NO FACTS!"); */
+    for (i = transaction->facts; i != NULL; i = g_slist_next(i)) {
+        f = i->data;
 
-        if (!ohm_facts)
+        if ((ohm_facts = ohm_fact_store_get_facts_by_name(store, f)) == NULL)
             continue;
 
-        /* open command_array_entry_iter */
-        if (!dbus_message_iter_open_container(&command_array_iter, DBUS_TYPE_DICT_ENTRY,
-                    NULL, &command_array_entry_iter)) {
+        if (!dbus_message_iter_open_container(&command_array_iter,
+                    DBUS_TYPE_DICT_ENTRY, NULL, &command_array_entry_iter)) {
             OHM_ERROR("signaling: error opening container");
-            goto end;
+            goto fail;
         }
 
-        if (!dbus_message_iter_append_basic
-                (&command_array_entry_iter, DBUS_TYPE_STRING, &f)) {
+        if (!dbus_message_iter_append_basic(&command_array_entry_iter,
+                    DBUS_TYPE_STRING, &f)) {
             OHM_ERROR("signaling: error appending OhmFact key");
-            goto end;
+            goto fail;
         }
 
-        /* open fact_iter */
-        if (!dbus_message_iter_open_container(&command_array_entry_iter, DBUS_TYPE_ARRAY,
-                    "a(sv)", &fact_iter)) {
+        if (!dbus_message_iter_open_container(&command_array_entry_iter,
+                    DBUS_TYPE_ARRAY, "a(sv)", &fact_iter)) {
             OHM_ERROR("signaling: error opening container");
-            goto end;
+            goto fail;
         }
 
         for (j = ohm_facts; j != NULL; j = g_slist_next(j)) {
+            if (!append_fact(&fact_iter, j->data))
+                goto fail;
+        }
 
-            OhmFact *of = j->data;
-            GSList *fields = NULL;
+        dbus_message_iter_close_container(&command_array_entry_iter, &fact_iter);
+        dbus_message_iter_close_container(&command_array_iter,
+                &command_array_entry_iter);
+    }
 
-            /* printf("starting to process OhmFact '%p'\n", of); */
+    dbus_message_iter_close_container(&message_iter, &command_array_iter);
 
-            /* open fact_struct_iter */
-            if (!dbus_message_iter_open_container(&fact_iter, DBUS_TYPE_ARRAY,
-                        "(sv)", &fact_struct_iter)) {
-                OHM_ERROR("signaling: error opening container");
-                goto end;
-            }
+    transaction->decision = msg;
+    return msg;
 
-#if 0
-            printf("%s: about to emit fact %s\n", __FUNCTION__,
-                    ohm_structure_to_string(OHM_STRUCTURE(of)));
-#endif
-            fields = ohm_fact_get_fields(of);
+ fail:
+    dbus_message_unref(msg);
+    return NULL;
+}
 
-            for (k = fields; k != NULL; k = g_slist_next(k)) {
+/*
+ * delta-encoded decisions
+ *
+ * Enforcement points registering with the CAPABILITY_DELTA capability get
+ * their decisions as unicast signals carrying only the fact instances and
+ * fields that changed since the previous decision of the same signal sent
+ * to them. The first decision, every DELTA_RESYNC_PERIOD'th one and the
+ * first one after a NACK carry a full snapshot instead. The message looks
+ * like this:
+ *
+ * uint32 txid
+ * uint32 flags                            (DELTA_FULL for full snapshots)
+ * array [
+ *    struct {
+ *       string "com.nokia.policy.audio_route"
+ *       uint32 2                          (number of instances)
+ *       array [
+ *          struct {
+ *             uint32 1                    (index of the changed instance)
+ *             array [                     (added or changed fields)
+ *                struct {
+ *                   string "device"
+ *                   variant                   string "ihf"
+ *                }
+ *             ]
+ *             array [                     (removed fields)
+ *                string "mode"
+ *             ]
+ *          }
+ *       ]
+ *    }
+ * ]
+ */
 
-                GQuark qk = (GQuark)GPOINTER_TO_INT(k->data);
-                const gchar *field_name = g_quark_to_string(qk);
-                /* printf("%s: field name: %s\n", __FUNCTION__, field_name ?: "<NULL>"); */
-                gchar sig_c = '?';
-                gchar sig[2] = "?"; 
-                void *value;
-                GValue *gval = ohm_fact_get(of, field_name);
-                int dbus_type = map_to_dbus_type(gval, &sig_c, &value);
+typedef struct _delta_snapshot {
+    GHashTable *facts;          /* fact name -> GPtrArray of instances */
+    guint       count;          /* deltas since the last full snapshot */
+} delta_snapshot;
 
-                sig[0] = sig_c;
+static void free_value(gpointer data)
+{
+    GValue *value = data;
 
-                /* printf("Field name: %s\n", field_name); */
+    g_value_unset(value);
+    g_free(value);
+}
 
-                if (dbus_type == DBUS_TYPE_INVALID) {
-                    /* unsupported data type */
-                    continue;
-                }
+static GValue *copy_value(const GValue *src)
+{
+    GValue *value = g_new0(GValue, 1);
 
-                /* open fact_struct_field_iter */
-                if (!dbus_message_iter_open_container(&fact_struct_iter, DBUS_TYPE_STRUCT,
-                            NULL, &fact_struct_field_iter)) {
-                    OHM_ERROR("signaling: error opening container");
-                    goto end;
-                }
+    g_value_init(value, G_VALUE_TYPE(src));
+    g_value_copy(src, value);
 
-                if (!dbus_message_iter_append_basic
-                        (&fact_struct_field_iter, DBUS_TYPE_STRING, &field_name)) {
-                    OHM_ERROR("signaling: error appending OhmFact field");
-                    goto end;
-                }
+    return value;
+}
 
-                /* open variant_iter */
-                if (!dbus_message_iter_open_container(&fact_struct_field_iter, DBUS_TYPE_VARIANT, sig, &variant_iter)) {
-                    OHM_ERROR("signaling: error opening container");
-                    goto end;
-                }
+static gboolean same_value(const GValue *v1, const GValue *v2)
+{
+    const gchar *s1, *s2;
 
-                if (dbus_type == DBUS_TYPE_STRING) {
-                    if (!dbus_message_iter_append_basic(&variant_iter, dbus_type, &value)) {
-                        OHM_ERROR("signaling: error appending OhmFact value");
-                        goto end;
-                    }
-                }
-                else {
-                    if (!dbus_message_iter_append_basic(&variant_iter, dbus_type, value)) {
-                        OHM_ERROR("signaling: error appending OhmFact value");
-                        goto end;
-                    }
-                }
+    if (v1 == NULL || v2 == NULL || G_VALUE_TYPE(v1) != G_VALUE_TYPE(v2))
+        return FALSE;
 
-                g_free(value);
+    switch (G_VALUE_TYPE(v1)) {
+        case G_TYPE_STRING:
+            s1 = g_value_get_string(v1);
+            s2 = g_value_get_string(v2);
+            return !strcmp(s1 ? s1 : "", s2 ? s2 : "");
+        case G_TYPE_INT:    return g_value_get_int(v1) == g_value_get_int(v2);
+        case G_TYPE_UINT:   return g_value_get_uint(v1) == g_value_get_uint(v2);
+        case G_TYPE_LONG:   return g_value_get_long(v1) == g_value_get_long(v2);
+        case G_TYPE_ULONG:  return g_value_get_ulong(v1) == g_value_get_ulong(v2);
+        case G_TYPE_FLOAT:  return g_value_get_float(v1) == g_value_get_float(v2);
+        case G_TYPE_DOUBLE: return g_value_get_double(v1) == g_value_get_double(v2);
+        default:            return FALSE;
+    }
+}
 
-                /* close variant_iter */
-                dbus_message_iter_close_container(&fact_struct_field_iter, &variant_iter);
-                /* close fact_struct_field_iter */
-                dbus_message_iter_close_container(&fact_struct_iter, &fact_struct_field_iter);
-            }
-            /* close fact_struct_iter */
-            dbus_message_iter_close_container(&fact_iter, &fact_struct_iter);
-        }
-        /* close fact_iter */
-        dbus_message_iter_close_container(&command_array_entry_iter, &fact_iter);
+static void free_instances(gpointer data)
+{
+    GPtrArray *instances = data;
+    guint      i;
 
-        /* close command_array_entry_iter */
-        dbus_message_iter_close_container(&command_array_iter, &command_array_entry_iter);
-    }
+    for (i = 0; i < instances->len; i++)
+        g_hash_table_destroy(g_ptr_array_index(instances, i));
 
-    /* close command_array_iter */
-    dbus_message_iter_close_container(&message_iter, &command_array_iter);
+    g_ptr_array_free(instances, TRUE);
+}
+
+static void delta_snapshot_free(gpointer data)
+{
+    delta_snapshot *snapshot = data;
+
+    g_hash_table_destroy(snapshot->facts);
+    g_free(snapshot);
+}
+
+void delta_reset(ExternalEPStrategy *ep)
+{
+    /* forget everything sent so far, the next decisions will be full */
+
+    if (ep->snapshots != NULL) {
+        g_hash_table_destroy(ep->snapshots);
+        ep->snapshots = NULL;
+    }
+}
+
+static delta_snapshot *delta_snapshot_get(ExternalEPStrategy *ep,
+        const gchar *signal, gboolean *full)
+{
+    delta_snapshot *snapshot = NULL;
+
+    if (ep->snapshots == NULL)
+        ep->snapshots = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, delta_snapshot_free);
+    else
+        snapshot = g_hash_table_lookup(ep->snapshots, signal);
+
+    if (snapshot != NULL && snapshot->count < DELTA_RESYNC_PERIOD) {
+        snapshot->count++;
+        *full = FALSE;
+        return snapshot;
+    }
+
+    snapshot = g_new0(delta_snapshot, 1);
+    snapshot->facts = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, free_instances);
+    g_hash_table_replace(ep->snapshots, g_strdup(signal), snapshot);
+
+    *full = TRUE;
+    return snapshot;
+}
+
+static gboolean instance_changed(GHashTable *old, OhmFact *of, GSList *fields)
+{
+    GHashTableIter  it;
+    gpointer        key, value;
+    GSList         *k;
+    GValue         *gval;
+    guint           n = 0;
+
+    if (old == NULL)
+        return TRUE;
+
+    for (k = fields; k != NULL; k = g_slist_next(k)) {
+        gval = ohm_fact_get(of, g_quark_to_string(GPOINTER_TO_INT(k->data)));
+
+        if (!supported_value(gval))
+            continue;
+
+        if (!same_value(g_hash_table_lookup(old, k->data), gval))
+            return TRUE;
+
+        n++;
+    }
+
+    /* any removed fields ? */
+    if (n != g_hash_table_size(old))
+        return TRUE;
+
+    g_hash_table_iter_init(&it, old);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        if (!supported_value(ohm_fact_get(of,
+                            g_quark_to_string(GPOINTER_TO_INT(key)))))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gboolean append_instance(DBusMessageIter *iter, guint idx,
+        GHashTable *old, OhmFact *of, GSList *fields)
+{
+    DBusMessageIter  inst_iter, set_iter, field_iter, del_iter;
+    GHashTableIter   it;
+    gpointer         key, value;
+    GSList          *k;
+    GValue          *gval;
+    const gchar     *name;
+    dbus_uint32_t    index = idx;
+
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+                &inst_iter) ||
+        !dbus_message_iter_append_basic(&inst_iter, DBUS_TYPE_UINT32, &index) ||
+        !dbus_message_iter_open_container(&inst_iter, DBUS_TYPE_ARRAY, "(sv)",
+                &set_iter))
+        goto fail;
+
+    for (k = fields; k != NULL; k = g_slist_next(k)) {
+        name = g_quark_to_string(GPOINTER_TO_INT(k->data));
+        gval = ohm_fact_get(of, name);
+
+        if (!supported_value(gval))
+            continue;
+
+        if (old != NULL && same_value(g_hash_table_lookup(old, k->data), gval))
+            continue;
+
+        if (!dbus_message_iter_open_container(&set_iter, DBUS_TYPE_STRUCT,
+                    NULL, &field_iter) ||
+            !dbus_message_iter_append_basic(&field_iter, DBUS_TYPE_STRING,
+                    &name) ||
+            !append_fact_value(&field_iter, gval))
+            goto fail;
+
+        dbus_message_iter_close_container(&set_iter, &field_iter);
+    }
+
+    dbus_message_iter_close_container(&inst_iter, &set_iter);
+
+    if (!dbus_message_iter_open_container(&inst_iter, DBUS_TYPE_ARRAY, "s",
+                &del_iter))
+        goto fail;
+
+    if (old != NULL) {
+        g_hash_table_iter_init(&it, old);
+        while (g_hash_table_iter_next(&it, &key, &value)) {
+            name = g_quark_to_string(GPOINTER_TO_INT(key));
+
+            if (supported_value(ohm_fact_get(of, name)))
+                continue;
+
+            if (!dbus_message_iter_append_basic(&del_iter, DBUS_TYPE_STRING,
+                        &name))
+                goto fail;
+        }
+    }
+
+    dbus_message_iter_close_container(&inst_iter, &del_iter);
+    dbus_message_iter_close_container(iter, &inst_iter);
+
+    return TRUE;
+
+ fail:
+    OHM_ERROR("signaling: failed to encode delta of fact instance %u", idx);
+    return FALSE;
+}
+
+static GHashTable *snapshot_instance(OhmFact *of, GSList *fields)
+{
+    GHashTable *instance;
+    GSList     *k;
+    GValue     *gval;
+
+    instance = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+            NULL, free_value);
+
+    for (k = fields; k != NULL; k = g_slist_next(k)) {
+        gval = ohm_fact_get(of, g_quark_to_string(GPOINTER_TO_INT(k->data)));
+
+        if (supported_value(gval))
+            g_hash_table_insert(instance, k->data, copy_value(gval));
+    }
+
+    return instance;
+}
+
+static gboolean append_delta_fact(DBusMessageIter *iter, gchar *name,
+        delta_snapshot *snapshot)
+{
+    DBusMessageIter  fact_iter, inst_iter;
+    GPtrArray       *instances;
+    GHashTable      *old;
+    GSList          *ohm_facts, *j, *fields;
+    OhmFact         *of;
+    dbus_uint32_t    n;
+    guint            idx;
+
+    ohm_facts = ohm_fact_store_get_facts_by_name(store, name);
+    n         = g_slist_length(ohm_facts);
+    instances = g_hash_table_lookup(snapshot->facts, name);
+
+    if (instances == NULL) {
+        instances = g_ptr_array_new();
+        g_hash_table_insert(snapshot->facts, g_strdup(name), instances);
+    }
+
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+                &fact_iter) ||
+        !dbus_message_iter_append_basic(&fact_iter, DBUS_TYPE_STRING, &name) ||
+        !dbus_message_iter_append_basic(&fact_iter, DBUS_TYPE_UINT32, &n) ||
+        !dbus_message_iter_open_container(&fact_iter, DBUS_TYPE_ARRAY,
+                "(ua(sv)as)", &inst_iter)) {
+        OHM_ERROR("signaling: failed to encode delta of fact %s", name);
+        return FALSE;
+    }
+
+    for (j = ohm_facts, idx = 0; j != NULL; j = g_slist_next(j), idx++) {
+        of     = j->data;
+        fields = ohm_fact_get_fields(of);
+        old    = idx < instances->len ? g_ptr_array_index(instances, idx) : NULL;
+
+        if (!instance_changed(old, of, fields))
+            continue;
+
+        if (!append_instance(&inst_iter, idx, old, of, fields))
+            return FALSE;
+
+        if (old != NULL) {
+            g_hash_table_destroy(old);
+            g_ptr_array_index(instances, idx) = snapshot_instance(of, fields);
+        }
+        else
+            g_ptr_array_add(instances, snapshot_instance(of, fields));
+    }
+
+    /* drop the instances that are gone */
+    while (instances->len > n)
+        g_hash_table_destroy(g_ptr_array_remove_index(instances,
+                        instances->len - 1));
+
+    dbus_message_iter_close_container(&fact_iter, &inst_iter);
+    dbus_message_iter_close_container(iter, &fact_iter);
+
+    return TRUE;
+}
+
+DBusMessage *encode_delta(ExternalEPStrategy *ep, Transaction *transaction)
+{
+    DBusMessage     *msg;
+    DBusMessageIter  message_iter, array_iter;
+    delta_snapshot  *snapshot;
+    dbus_uint32_t    txid, flags;
+    gboolean         full;
+    GSList          *i;
+
+    if ((msg = dbus_message_new_signal(DBUS_PATH_POLICY_DELTA,
+                    DBUS_INTERFACE_POLICY, transaction->signal)) == NULL)
+        return NULL;
+
+    if (!dbus_message_set_destination(msg, ep->id))
+        goto fail;
+
+    snapshot = delta_snapshot_get(ep, transaction->signal, &full);
+    txid     = transaction->txid;
+    flags    = full ? DELTA_FULL : 0;
+
+    dbus_message_iter_init_append(msg, &message_iter);
+
+    if (!dbus_message_iter_append_basic(&message_iter, DBUS_TYPE_UINT32, &txid) ||
+        !dbus_message_iter_append_basic(&message_iter, DBUS_TYPE_UINT32, &flags) ||
+        !dbus_message_iter_open_container(&message_iter, DBUS_TYPE_ARRAY,
+                "(sua(ua(sv)as))", &array_iter))
+        goto fail;
+
+    for (i = transaction->facts; i != NULL; i = g_slist_next(i)) {
+        if (!append_delta_fact(&array_iter, i->data, snapshot))
+            goto fail;
+    }
+
+    dbus_message_iter_close_container(&message_iter, &array_iter);
+
+    OHM_DEBUG(DBG_SIGNALING, "encoded %s decision %u for EP %s",
+            full ? "full" : "delta", txid, ep->id);
+
+    return msg;
+
+ fail:
+    /* we do not know what the EP has got, resync with a full snapshot */
+    delta_reset(ep);
+    dbus_message_unref(msg);
+    return NULL;
+}
+
+static gboolean send_delta_signal(gpointer data)
+{
+    pending_signal *signal = data;
+    Transaction    *transaction = signal->transaction;
+    ExternalEPStrategy *ep = signal->ep;
+    DBusMessage    *dbus_signal;
+
+    OHM_DEBUG(DBG_SIGNALING, "sending delta signal with txid '%u' to '%s'",
+            transaction->txid, ep->id);
+
+    if ((dbus_signal = encode_delta(ep, transaction)) != NULL) {
+        dbus_connection_send(connection, dbus_signal, NULL);
+        dbus_message_unref(dbus_signal);
+    }
+
+    g_object_unref(ep);
+    g_object_unref(transaction);
+    g_free(signal);
+
+    return FALSE;
+}
 
-    if (!dbus_connection_send(connection, dbus_signal, NULL))
-        goto end;
+/* shared memory transport */
 
-end:
+struct _ep_shm {
+    ep_shm_t   *map;
+    size_t      length;
+    ep_ring_view_t decisions;   /* our view of the decision ring */
+    ep_ring_view_t acks;        /* our view of the ack ring */
+    int         fd;             /* shared memory object, handed to the EP */
+    int         efd;            /* eventfd, decisions available */
+    int         ackfd;          /* eventfd, acks available */
+    GIOChannel *chnl;
+    guint       watch;
+};
+
+void shm_free(ExternalEPStrategy *ep)
+{
+    ep_shm *shm = ep->shm;
+
+    if (shm == NULL)
+        return;
+
+    if (shm->watch)
+        g_source_remove(shm->watch);
+    if (shm->chnl != NULL)
+        g_io_channel_unref(shm->chnl);
+    if (shm->map != NULL)
+        munmap(shm->map, shm->length);
+    if (shm->fd >= 0)
+        close(shm->fd);
+    if (shm->efd >= 0)
+        close(shm->efd);
+    if (shm->ackfd >= 0)
+        close(shm->ackfd);
+
+    g_free(shm);
+    ep->shm = NULL;
+}
+
+static gboolean shm_ack_cb(GIOChannel *chnl, GIOCondition cond, gpointer data)
+{
+    ExternalEPStrategy *s = data;
+    EnforcementPoint   *ep = (EnforcementPoint *)s;
+    ep_ring_ack_t       ack;
+    Transaction        *transaction;
+    uint64_t            count;
+    int32_t             len;
+
+    (void) chnl;
+
+    if (cond & (G_IO_ERR | G_IO_HUP)) {
+        OHM_ERROR("signaling: ack channel of EP %s closed", s->id);
+        s->shm->watch = 0;
+        return FALSE;
+    }
+
+    if (read(s->shm->ackfd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        OHM_ERROR("signaling: failed to read ack eventfd of EP %s (%s)",
+                s->id, strerror(errno));
+
+    /* keep the EP around in case an ack makes it go away */
+    g_object_ref(ep);
+
+    while (s->shm != NULL &&
+           (len = ep_ring_next(&s->shm->acks)) != EP_RING_EMPTY) {
+        if (len != sizeof(ack)) {
+            OHM_ERROR("signaling: corrupted ack ring of EP %s", s->id);
+            ep_ring_flush(&s->shm->acks);
+            break;
+        }
+
+        ep_ring_get(&s->shm->acks, &ack, sizeof(ack));
+
+        transaction = transaction_lookup(ack.txid);
+
+        if (transaction == NULL ||
+            transaction_unanswered_ep(transaction, s->id) != ep) {
+            OHM_DEBUG(DBG_SIGNALING, "stray shm ack %u from %s", ack.txid,
+                    s->id);
+            continue;
+        }
+
+        enforcement_point_receive_ack(ep, transaction, ack.status);
+    }
+
+    g_object_unref(ep);
+
+    return TRUE;
+}
+
+gboolean shm_create(ExternalEPStrategy *ep)
+{
+    ep_shm *shm;
+    char    name[64];
+    size_t  page;
+
+    shm = g_new0(ep_shm, 1);
+    shm->fd = shm->efd = shm->ackfd = -1;
+    ep->shm = shm;
+
+    page        = sysconf(_SC_PAGESIZE);
+    shm->length = ((EP_SHM_BYTES + page - 1) / page) * page;
+
+    /* an unlinked object, only reachable through the passed descriptor */
+    snprintf(name, sizeof(name), "/ohm-ep-%u-%p", (unsigned)getpid(), ep);
+
+    if ((shm->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+        OHM_ERROR("signaling: can't create shared memory for %s (%s)",
+                ep->id, strerror(errno));
+        goto fail;
+    }
+    shm_unlink(name);
+
+    if (ftruncate(shm->fd, shm->length) < 0 ||
+        (shm->map = mmap(NULL, shm->length, PROT_READ | PROT_WRITE,
+                MAP_SHARED, shm->fd, 0)) == MAP_FAILED) {
+        OHM_ERROR("signaling: can't map shared memory for %s (%s)",
+                ep->id, strerror(errno));
+        shm->map = NULL;
+        goto fail;
+    }
+
+    /* the geometry is ours, never read it back from the segment */
+    ep_shm_init(shm->map, shm->length);
+    ep_ring_view(&shm->decisions, shm->map, EP_SHM_DECISIONS,
+            EP_RING_DECISIONS, TRUE);
+    ep_ring_view(&shm->acks, shm->map, EP_SHM_ACKS, EP_RING_ACKS, FALSE);
+
+    if ((shm->efd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+        (shm->ackfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        OHM_ERROR("signaling: can't create eventfd for %s (%s)",
+                ep->id, strerror(errno));
+        goto fail;
+    }
+
+    if ((shm->chnl = g_io_channel_unix_new(shm->ackfd)) == NULL ||
+        !(shm->watch = g_io_add_watch(shm->chnl, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                        shm_ack_cb, ep)))
+        goto fail;
+
+    OHM_DEBUG(DBG_SIGNALING, "shared memory transport set up for %s", ep->id);
+
+    return TRUE;
+
+ fail:
+    shm_free(ep);
+    return FALSE;
+}
+
+static gboolean shm_send(ExternalEPStrategy *ep, Transaction *transaction)
+{
+    DBusMessage *msg, *copy;
+    uint64_t     one = 1;
+    dbus_bool_t  success;
+
+    /*
+     * Marshal the shared decision once, for all shm EPs. Marshalling
+     * locks the message, so do it on a copy: the original may still
+     * have to go out as the broadcast, which needs to set its serial.
+     */
+    if (transaction->marshalled == NULL) {
+        if ((msg = encode_decision(transaction)) == NULL ||
+            (copy = dbus_message_copy(msg)) == NULL)
+            return FALSE;
+
+        dbus_message_set_serial(copy, transaction->txid ? transaction->txid : 1);
+        success = dbus_message_marshal(copy, &transaction->marshalled,
+                &transaction->marshalled_len);
+        dbus_message_unref(copy);
+
+        if (!success)
+            return FALSE;
+    }
+
+    if (!ep_ring_put(&ep->shm->decisions, transaction->marshalled,
+                    transaction->marshalled_len))
+        return FALSE;
+
+    if (write(ep->shm->efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        OHM_ERROR("signaling: failed to wake up EP %s (%s)", ep->id,
+                strerror(errno));
+
+    return TRUE;
+}
+
+static gboolean send_shm_signal(gpointer data)
+{
+    pending_signal *signal = data;
+    Transaction    *transaction = signal->transaction;
+    ExternalEPStrategy *ep = signal->ep;
+    DBusMessage    *msg;
+
+    OHM_DEBUG(DBG_SIGNALING, "publishing txid '%u' to '%s'",
+            transaction->txid, ep->id);
+
+    if (ep->shm == NULL || !shm_send(ep, transaction)) {
+        /* ring full or gone, fall back to D-Bus */
+        OHM_DEBUG(DBG_SIGNALING, "shm ring of %s unusable, using D-Bus",
+                ep->id);
+
+        if ((msg = encode_decision(transaction)) != NULL &&
+            (msg = dbus_message_copy(msg)) != NULL) {
+            dbus_message_set_destination(msg, ep->id);
+            dbus_connection_send(connection, msg, NULL);
+            dbus_message_unref(msg);
+        }
+    }
+
+    g_object_unref(ep);
+    g_object_unref(transaction);
+    g_free(signal);
+
+    return FALSE;
+}
+
+static gboolean send_ipc_signal(gpointer data)
+{
+    pending_signal *signal = data;
+    Transaction    *transaction = signal->transaction;
+    DBusMessage    *dbus_signal;
+
+    OHM_DEBUG(DBG_SIGNALING, "sending signal with txid '%u'",
+            transaction->txid);
+
+    if ((dbus_signal = encode_decision(transaction)) != NULL)
+        dbus_connection_send(connection, dbus_signal, NULL);
 
     /* this function is meant to be called from an idle loop, so we
      * don't handle sending errors -- they will just timeout */
 
-    g_object_unref(transaction);
+    transaction->ipc_pending = FALSE;
     signal->klass->pending_signals = g_slist_remove(signal->klass->pending_signals, signal);
     g_free(signal);
-    dbus_message_unref(dbus_signal);
-    g_free(signal_name);
+    g_object_unref(transaction);
 
     return FALSE;
 }
@@ -817,41 +1732,40 @@ gboolean external_ep_send_decision(EnforcementPoint * self,
 
     ExternalEPStrategyClass *k = EXTERNAL_EP_STRATEGY_GET_CLASS(self);
     ExternalEPStrategy *s = EXTERNAL_EP_STRATEGY(self);
-    GSList         *i = NULL;
     pending_signal *signal = NULL;
-    gboolean        found = FALSE;
-    guint           txid;
-    GSList         *facts;
-
-    g_object_get(transaction,
-            "txid",
-            &txid,
-            "facts",
-            &facts,
-            NULL);
 
-    OHM_DEBUG(DBG_SIGNALING, "External EP send decision, txid '%u'", txid);
+    OHM_DEBUG(DBG_SIGNALING, "External EP send decision, txid '%u'",
+            transaction->txid);
 
-    for (i = k->pending_signals; i != NULL; i = g_slist_next(i)) {
-        signal = i->data;
-        if (signal->transaction == transaction) {
-            /*
-             * there already is a signal pending submit 
-             */
-            found = TRUE;
-            break;
-        }
+    if (s->shm != NULL) {
+        /* local EPs get the decision through shared memory */
+        signal = g_new0(pending_signal, 1);
+        signal->facts = transaction->facts;
+        signal->transaction = g_object_ref(transaction);
+        signal->klass = k;
+        signal->ep = g_object_ref(s);
+        g_idle_add(send_shm_signal, signal);
+    }
+    else if (s->delta) {
+        /* delta EPs get their own unicast signal */
+        signal = g_new0(pending_signal, 1);
+        signal->facts = transaction->facts;
+        signal->transaction = g_object_ref(transaction);
+        signal->klass = k;
+        signal->ep = g_object_ref(s);
+        g_idle_add(send_delta_signal, signal);
     }
-
-    if (!found) {
+    else if (!transaction->ipc_pending) {
         /*
-         * an IPC signal needs to be sent 
+         * The decision is broadcast, so one IPC signal per transaction is
+         * enough for all the other external enforcement points.
          */
-        pending_signal *signal = g_new0(pending_signal, 1);
-        signal->facts = facts;
+        signal = g_new0(pending_signal, 1);
+        signal->facts = transaction->facts;
         signal->transaction = transaction;
         signal->klass = k;
-        k->pending_signals = g_slist_append(k->pending_signals, signal);
+        k->pending_signals = g_slist_prepend(k->pending_signals, signal);
+        transaction->ipc_pending = TRUE;
         /* we need the transaction to live until the signal sending*/
         g_object_ref(transaction);
         g_idle_add(send_ipc_signal, signal);
@@ -898,6 +1812,8 @@ gboolean external_ep_unregister(EnforcementPoint * self)
         transaction_remove_ep(i->data, self);
     }
 
+    shm_free(s);
+
     return TRUE;
 }
 
@@ -973,6 +1889,10 @@ gboolean external_ep_receive_ack(EnforcementPoint * self,
     /* internal reference count */
     s->ongoing_transactions = g_slist_remove(s->ongoing_transactions, transaction);
 
+    /* the EP might have lost track of the deltas, resync it */
+    if (s->delta && !status)
+        delta_reset(s);
+
     /* tell the transaction that we are ready */
     transaction_ack_ep(transaction, self, status);
     if (transaction_done(transaction)) {
@@ -994,11 +1914,19 @@ static void transaction_instance_init(GTypeInstance * instance,
 
     Transaction *self = (Transaction *) instance;
     self->txid = 0;
-    self->acked = NULL;
-    self->nacked = NULL;
-    self->not_answered = NULL;
-    self->timeout_id = 0;
+    self->members = NULL;
+    self->unanswered_map = NULL;
+    self->nacked_map = NULL;
+    self->nmember = 0;
+    self->unanswered = 0;
+    self->deadline = 0;
+    self->heap_index = -1;
     self->built_ready = FALSE;
+    self->finished = FALSE;
+    self->ipc_pending = FALSE;
+    self->decision = NULL;
+    self->marshalled = NULL;
+    self->marshalled_len = 0;
 }
 
 static void external_ep_dispose(GObject *object)
@@ -1016,6 +1944,9 @@ static void external_ep_dispose(GObject *object)
     }
     g_slist_free(self->interested);
     self->interested = NULL;
+
+    delta_reset(self);
+    shm_free(self);
 }
 
 static void internal_ep_dispose(GObject *object)
@@ -1038,35 +1969,41 @@ static void internal_ep_dispose(GObject *object)
 static void transaction_dispose(GObject *object)
 {
 
-    GSList *i = NULL;
     Transaction *self = TRANSACTION(object);
+    EnforcementPoint *ep;
+    guint slot;
     OHM_DEBUG(DBG_SIGNALING, "transaction_dispose");
 
     /* Note that the EPs might have been unregistered during the transaction,
      * therefore these may be the last references to them */
 
-    for (i = self->acked; i != 0; i = g_slist_next(i)) {
-        EnforcementPoint *ep = i->data;
-        g_object_unref(ep);
+    if (self->members != NULL) {
+        for (slot = 0; slot < self->members->len; slot++) {
+            if ((ep = g_ptr_array_index(self->members, slot)) != NULL)
+                g_object_unref(ep);
+        }
+        g_ptr_array_free(self->members, TRUE);
+        self->members = NULL;
     }
-    g_slist_free(self->acked);
 
-    for (i = self->nacked; i != 0; i = g_slist_next(i)) {
-        EnforcementPoint *ep = i->data;
-        g_object_unref(ep);
-    }
-    g_slist_free(self->nacked);
-    
-    /* in case of timeout, these are still referenced */
-    for (i = self->not_answered; i != 0; i = g_slist_next(i)) {
-        EnforcementPoint *ep = i->data;
-        g_object_unref(ep);
-    }
-    g_slist_free(self->not_answered);
+    g_free(self->unanswered_map);
+    g_free(self->nacked_map);
+    self->unanswered_map = NULL;
+    self->nacked_map = NULL;
 
     free_facts(self->facts);
     self->facts = NULL;
 
+    if (self->decision != NULL) {
+        dbus_message_unref(self->decision);
+        self->decision = NULL;
+    }
+
+    if (self->marshalled != NULL) {
+        dbus_free(self->marshalled);
+        self->marshalled = NULL;
+    }
+
     g_free(self->signal);
     self->signal = NULL;
 }
@@ -1226,6 +2163,8 @@ static void internal_ep_strategy_instance_init(GTypeInstance * instance,
 
     OHM_DEBUG(DBG_SIGNALING, "initing internal strategy");
     self->id = NULL;
+    self->ops = NULL;
+    self->ops_data = NULL;
 }
 
 
@@ -1265,6 +2204,9 @@ static void external_ep_strategy_instance_init(GTypeInstance * instance,
 
     OHM_DEBUG(DBG_SIGNALING, "initing external strategy");
     self->id = NULL;
+    self->delta = FALSE;
+    self->snapshots = NULL;
+    self->shm = NULL;
 }
 
 static void external_ep_strategy_class_init(gpointer g_class,
@@ -1411,76 +2353,156 @@ gboolean transaction_done(Transaction *self)
     if (!self->built_ready)
         return FALSE;
         
-    OHM_DEBUG(DBG_SIGNALING, "transaction_done unanswered ep count '%i'", g_slist_length(self->not_answered));
+    OHM_DEBUG(DBG_SIGNALING, "transaction_done unanswered ep count '%u'", self->unanswered);
 
-    return g_slist_length(self->not_answered) ? FALSE : TRUE;
+    return self->unanswered ? FALSE : TRUE;
 
 }
 
 void transaction_add_ep(Transaction *self, EnforcementPoint *ep)
 {
+    guint slot = *ep_slot(ep), words;
+
+    if (transaction_member(self, slot) != NULL)
+        return;
+
+    if (self->members == NULL)
+        self->members = g_ptr_array_new();
+
+    if (slot >= self->members->len) {
+        words = BIT_WORDS(self->members->len);
+        g_ptr_array_set_size(self->members, slot + 1);
+
+        if (BIT_WORDS(slot + 1) > words) {
+            self->unanswered_map = g_renew(guint32, self->unanswered_map,
+                    BIT_WORDS(slot + 1));
+            self->nacked_map = g_renew(guint32, self->nacked_map,
+                    BIT_WORDS(slot + 1));
+            memset(self->unanswered_map + words, 0,
+                    (BIT_WORDS(slot + 1) - words) * sizeof(guint32));
+            memset(self->nacked_map + words, 0,
+                    (BIT_WORDS(slot + 1) - words) * sizeof(guint32));
+        }
+    }
 
     /* ref in case that the EP goes away and we still want to use the
      * results  */
 
-    g_object_ref(ep);
-
-    self->not_answered = g_slist_prepend(self->not_answered, ep);
+    g_ptr_array_index(self->members, slot) = g_object_ref(ep);
+    BIT_SET(self->unanswered_map, slot);
+    self->nmember++;
+    self->unanswered++;
 
-    OHM_DEBUG(DBG_SIGNALING, "Added ep %p to transaction %i, unanswered ep count now %i", ep, self->txid, g_slist_length(self->not_answered));
+    OHM_DEBUG(DBG_SIGNALING, "Added ep %p to transaction %i, unanswered ep count now %u", ep, self->txid, self->unanswered);
 }
 
 void transaction_remove_ep(Transaction *self, EnforcementPoint *ep)
 {
+    guint slot = *ep_slot(ep);
+
+    if (transaction_member(self, slot) != ep)
+        return;
 
-    self->not_answered = g_slist_remove(self->not_answered, ep);
+    if (BIT_TEST(self->unanswered_map, slot)) {
+        BIT_CLR(self->unanswered_map, slot);
+        self->unanswered--;
+    }
+    BIT_CLR(self->nacked_map, slot);
+
+    g_ptr_array_index(self->members, slot) = NULL;
+    self->nmember--;
     
-    OHM_DEBUG(DBG_SIGNALING, "Removed ep %p to transaction %i, unanswered ep count now %i", ep, self->txid, g_slist_length(self->not_answered));
+    OHM_DEBUG(DBG_SIGNALING, "Removed ep %p to transaction %i, unanswered ep count now %u", ep, self->txid, self->unanswered);
 
     g_object_unref(ep);
 }
 
+EnforcementPoint *transaction_unanswered_ep(Transaction *self, const gchar *id)
+{
+    EnforcementPoint *ep;
+    guint word, bit, slot;
 
-void transaction_ack_ep(Transaction *self, EnforcementPoint *ep, 
+    if (self->members == NULL || self->unanswered == 0)
+        return NULL;
+
+    if (id != NULL) {
+        /* map the id to its slot instead of scanning the members */
+        if (ep_ids == NULL || (ep = g_hash_table_lookup(ep_ids, id)) == NULL)
+            return NULL;
+
+        slot = *ep_slot(ep);
+
+        if (transaction_member(self, slot) != ep ||
+            !BIT_TEST(self->unanswered_map, slot))
+            return NULL;
+
+        return ep;
+    }
+
+    for (word = 0; word < BIT_WORDS(self->members->len); word++) {
+        if (!self->unanswered_map[word])
+            continue;
+
+        for (bit = 0; bit < 32; bit++) {
+            slot = word * 32 + bit;
+
+            if (!(self->unanswered_map[word] & BIT_MASK(bit)))
+                continue;
+
+            return g_ptr_array_index(self->members, slot);
+        }
+    }
+
+    return NULL;
+}
+
+void transaction_ack_ep(Transaction *self, EnforcementPoint *ep, 
         gboolean ack)
 {
-    gchar *id;
+    guint slot = *ep_slot(ep);
 
-    if (ack) {
-        /* OHM_DEBUG(DBG_SIGNALING, "ACK received from an enforcement point!"); */
-        self->acked = g_slist_prepend(self->acked, ep);
+    if (transaction_member(self, slot) != ep ||
+        !BIT_TEST(self->unanswered_map, slot)) {
+        OHM_DEBUG(DBG_SIGNALING, "duplicate or stray answer to transaction %u",
+                self->txid);
+        return;
     }
-    else {
+
+    BIT_CLR(self->unanswered_map, slot);
+    self->unanswered--;
+
+    if (!ack) {
         /* OHM_DEBUG(DBG_SIGNALING, "NACK received from an enforcement point!"); */
-        self->nacked = g_slist_prepend(self->nacked, ep);
+        BIT_SET(self->nacked_map, slot);
     }
 
-    self->not_answered = g_slist_remove(self->not_answered, ep);
-
-    g_object_get(ep, "id", &id, NULL);
-    g_signal_emit (self, signals [ON_ACK_RECEIVED], 0, id, ack);
-    g_free(id);
+    if (g_signal_has_handler_pending(self, signals [ON_ACK_RECEIVED], 0, FALSE))
+        g_signal_emit (self, signals [ON_ACK_RECEIVED], 0, ep_id(ep), ack);
 
     return;
 }
 
 void transaction_complete(Transaction *self)
 {
-    GSList *i;
-#ifdef ONLY_ONE_TRANSACTION
-    GQueue *queue;
-#endif
-    
+    signal_pipeline *pipeline;
+    guint slot;
+
+    if (self->finished)
+        return;
+
+    self->finished = TRUE;
+
     OHM_DEBUG(DBG_SIGNALING, "transaction complete!");
 
-    if (g_slist_length(self->not_answered) != 0) {
+    if (self->unanswered != 0) {
         /* we are here because of a timeout (TODO: or because of a
          * non-transaction decision, but refactor this away soon) */
         OHM_DEBUG(DBG_SIGNALING, "not all enforcement points answered");
 
-        for (i = self->not_answered; i != 0; i = g_slist_next(i)) {
-            EnforcementPoint *ep = i->data;
-            enforcement_point_stop_transaction(ep, self);
+        for (slot = 0; slot < self->members->len; slot++) {
+            if (member_in(self, slot, MEMBERS_NOT_ANSWERED))
+                enforcement_point_stop_transaction(
+                        transaction_member(self, slot), self);
         }
     }
 
@@ -1505,88 +2527,209 @@ void transaction_complete(Transaction *self)
         }
     }
 
-    g_signal_emit (self, signals [ON_TRANSACTION_COMPLETE], 0);
-
     /* remove transaction from the table */
-    g_hash_table_remove(transactions, &self->txid);
+    if (transaction_lookup(self->txid) == self)
+        g_hash_table_remove(transactions, &self->txid);
 
     /* remove the timeout */
-    if (self->timeout_id)
-        g_source_remove(self->timeout_id);
-
-#ifdef ONLY_ONE_TRANSACTION
-    queue = signal_queue_lookup(self->signal);
-
-    if (queue) {
-        OHM_DEBUG(DBG_SIGNALING, "found queue '%s' (%p)",
-                self->signal, queue);
-
-        /* go on and process the next transaction */
-        if (!g_queue_is_empty(queue)) {
-            OHM_DEBUG(DBG_SIGNALING,
-                    "transaction queue '%p' not empty (%i left), scheduling processing",
-                    queue, g_queue_get_length(queue));
-            /* Let's not delay the processing because of test issues :-) */
-            process_inq(g_strdup(self->signal));
-        }
-        else {
-            /* This was the last item in the queue, so remove it from
-             * the hash map. Note that the queue is also freed. */
-            OHM_DEBUG(DBG_SIGNALING, "queue is empty, removing it from the map");
-            g_hash_table_remove(signal_queues, self->signal);
+    deadline_remove(self);
+
+    pipeline = signal_queue_lookup(self->signal);
+
+    if (pipeline == NULL || !g_queue_find(pipeline->issued, self)) {
+        /* not issued through a pipeline, report right away */
+        g_signal_emit (self, signals [ON_TRANSACTION_COMPLETE], 0);
+        g_object_unref(self);
+        return;
+    }
+
+    pipeline->active--;
+
+    OHM_DEBUG(DBG_SIGNALING, "pipeline '%s': %u active, %u pending",
+            pipeline->signal, pipeline->active,
+            g_queue_get_length(pipeline->pending));
+
+    /* report everything finished in order, then go on with the next ones */
+    pipeline_report(pipeline);
+    pipeline_run(pipeline);
+}
+
+static void pipeline_report(signal_pipeline *pipeline)
+{
+    Transaction *t;
+
+    if (pipeline->reporting)
+        return;
+
+    pipeline->reporting = TRUE;
+
+    /* only report a transaction once all earlier ones have been reported */
+    while ((t = g_queue_peek_head(pipeline->issued)) != NULL && t->finished) {
+        g_queue_pop_head(pipeline->issued);
+
+        OHM_DEBUG(DBG_SIGNALING, "reporting transaction '%u' of '%s'",
+                t->txid, pipeline->signal);
+
+        g_signal_emit (t, signals [ON_TRANSACTION_COMPLETE], 0);
+        g_object_unref(t);
+    }
+
+    pipeline->reporting = FALSE;
+}
+
+/*
+ * Transaction timeouts are kept in a binary min-heap ordered by deadline,
+ * with a single timer armed for the earliest one.
+ */
+
+static guint64 now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (guint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#define HEAP_AT(i) ((Transaction *)g_ptr_array_index(deadlines, (i)))
+
+static void heap_set(guint i, Transaction *t)
+{
+    g_ptr_array_index(deadlines, i) = t;
+    t->heap_index = i;
+}
+
+static void heap_sift(guint i)
+{
+    Transaction *t = HEAP_AT(i);
+    guint        parent, child;
+
+    /* up */
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (HEAP_AT(parent)->deadline <= t->deadline)
+            break;
+        heap_set(i, HEAP_AT(parent));
+        i = parent;
+    }
+
+    /* down */
+    while ((child = 2 * i + 1) < deadlines->len) {
+        if (child + 1 < deadlines->len &&
+            HEAP_AT(child + 1)->deadline < HEAP_AT(child)->deadline)
+            child++;
+        if (t->deadline <= HEAP_AT(child)->deadline)
+            break;
+        heap_set(i, HEAP_AT(child));
+        i = child;
+    }
+
+    heap_set(i, t);
+}
+
+static gboolean deadline_expired(gpointer data);
+
+static void deadline_arm(void)
+{
+    Transaction *t;
+    guint64      now;
+
+    if (deadlines->len == 0) {
+        if (deadline_timer) {
+            g_source_remove(deadline_timer);
+            deadline_timer = 0;
         }
+        return;
     }
-#endif
-    g_object_unref(self);
+
+    t = HEAP_AT(0);
+
+    /* an earlier timer just re-arms itself when it goes off */
+    if (deadline_timer && deadline_armed <= t->deadline)
+        return;
+
+    if (deadline_timer)
+        g_source_remove(deadline_timer);
+
+    now = now_ms();
+    deadline_armed = t->deadline;
+    deadline_timer = g_timeout_add(t->deadline > now ? t->deadline - now : 0,
+            deadline_expired, NULL);
 }
 
-static gboolean timeout_transaction(gpointer data)
+static void deadline_add(Transaction *t, guint timeout)
 {
-    OHM_DEBUG(DBG_SIGNALING, "timer launched on transaction!");
-    transaction_complete(data);
-    return FALSE;
+    t->deadline = now_ms() + timeout;
+
+    g_ptr_array_add(deadlines, t);
+    t->heap_index = deadlines->len - 1;
+    heap_sift(t->heap_index);
+
+    deadline_arm();
 }
 
-static gboolean process_inq(gpointer data)
+static void deadline_remove(Transaction *t)
 {
-    /*
-     * Runs (mostly) in the idle loop, sends out the decisions, checks if the
-     * transactions have been completed 
-     */
+    Transaction *last;
+    guint        i;
 
-    GSList           *e = NULL;
-    gboolean        ret = TRUE;
-    Transaction      *t = NULL;
-    gchar       *signal = (gchar *) data;
-    GQueue       *queue = signal_queue_lookup(signal);
+    if (t->heap_index < 0 || deadlines == NULL)
+        return;
 
-    g_free(signal);
+    i    = t->heap_index;
+    last = g_ptr_array_remove_index(deadlines, deadlines->len - 1);
+    t->heap_index = -1;
 
-#ifndef ONLY_ONE_TRANSACTION
-    while (queue != NULL && !g_queue_is_empty(queue)) {
-#endif
+    if (last != t) {
+        heap_set(i, last);
+        heap_sift(i);
+    }
 
-    if (queue == NULL || g_queue_is_empty(queue)) {
-        OHM_DEBUG(DBG_SIGNALING,
-                "Error! Nothing to process, even though processing was scheduled.");
-        return FALSE;
+    if (deadlines->len == 0)
+        deadline_arm();
+}
+
+static gboolean deadline_expired(gpointer data)
+{
+    Transaction *t;
+    guint64      now = now_ms();
+
+    (void) data;
+
+    deadline_timer = 0;
+
+    while (deadlines->len > 0 && (t = HEAP_AT(0))->deadline <= now) {
+        OHM_DEBUG(DBG_SIGNALING, "transaction %u timed out", t->txid);
+        deadline_remove(t);
+        transaction_complete(t);
     }
 
-    t = g_queue_pop_head(queue);
+    deadline_arm();
+
+    return FALSE;
+}
+
+static void transaction_issue(Transaction *t)
+{
+    /*
+     * Sends out the decision of a transaction to the enforcement points
+     * subscribed to its signal and checks if it is already completed.
+     */
+
+    GSList           *e = NULL;
+    GSList        *next = NULL;
+    gboolean        ret = TRUE;
 
     OHM_DEBUG(DBG_SIGNALING, "Processing transaction %p", t);
 
     g_hash_table_insert(transactions, &t->txid, t);
 
-    for (e = enforcement_points; e != NULL; e = g_slist_next(e)) {
+    /* only the enforcement points subscribed to the signal are visited */
+    for (e = subscribed_enforcement_points(t->signal); e != NULL; e = next) {
         EnforcementPoint *ep = e->data;
+        next = g_slist_next(e);
         OHM_DEBUG(DBG_SIGNALING, "process: ep 0x%p", ep);
 
-        /* check whether or not anyone the enforcement point is
-         * interested in receiving the signal */
-        if (!enforcement_point_is_interested(ep, t))
-            continue;
-
         transaction_add_ep(t, ep);
         ret = enforcement_point_send_decision(ep, t);
         if (!ret) {
@@ -1612,26 +2755,110 @@ static gboolean process_inq(gpointer data)
     }
 
     else {
-        /* attach a timer to the transaction and make it call all the
-         * receive_ack functions on the enforcement_points in nacked queue with
-         * an error value when it triggers */
+        /* put the transaction in the deadline heap, when it expires the
+         * enforcement points that have not answered are stopped */
 
-        guint timeout = 0;
+        deadline_add(t, t->timeout);
+    }
+}
 
-        g_object_get(t, "timeout", &timeout, NULL);
+static void pipeline_run(signal_pipeline *pipeline)
+{
+    Transaction *t;
 
-        /* printf("setting timeout: %u", timeout); */
-        t->timeout_id = g_timeout_add(timeout, timeout_transaction, t);
+    if (pipeline->running)
+        return;
+
+    pipeline->running = TRUE;
+
+    while ((t = g_queue_peek_head(pipeline->pending)) != NULL) {
+        if (t->finished) {
+            /* superseded, just needs to be reported in its turn */
+            g_queue_pop_head(pipeline->pending);
+            g_queue_push_tail(pipeline->issued, t);
+            continue;
+        }
+
+        if (pipeline->active >= pipeline->depth)
+            break;
+
+        g_queue_pop_head(pipeline->pending);
+        pipeline->active++;
+        g_queue_push_tail(pipeline->issued, t);
+        transaction_issue(t);
     }
-#ifndef ONLY_ONE_TRANSACTION
+
+    pipeline->running = FALSE;
+
+    pipeline_report(pipeline);
+}
+
+static gboolean process_inq(gpointer data)
+{
+    /*
+     * Runs (mostly) in the idle loop, sends out the decisions, checks if the
+     * transactions have been completed 
+     */
+
+    gchar            *signal = (gchar *) data;
+    signal_pipeline  *pipeline = signal_queue_lookup(signal);
+
+    g_free(signal);
+
+    if (pipeline == NULL) {
+        OHM_DEBUG(DBG_SIGNALING,
+                "Error! Nothing to process, even though processing was scheduled.");
+        return FALSE;
     }
-    g_queue_free(queue);
-#endif
+
+    pipeline->scheduled = FALSE;
+    pipeline_run(pipeline);
 
     return FALSE;
 }
 
 
+static gboolean same_facts(GSList *facts1, GSList *facts2)
+{
+    GSList *i;
+
+    if (g_slist_length(facts1) != g_slist_length(facts2))
+        return FALSE;
+
+    for (i = facts1; i != NULL; i = g_slist_next(i)) {
+        if (g_slist_find_custom(facts2, i->data, (GCompareFunc)strcmp) == NULL)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void pipeline_collapse(signal_pipeline *pipeline, Transaction *t)
+{
+    /*
+     * Marks the pending (not yet issued) transactions that t supersedes,
+     * ie. the ones with the same set of fact keys, finished. These are
+     * never sent to anyone, but are reported as completed in their turn.
+     */
+
+    GList       *l;
+    Transaction *old;
+
+    for (l = pipeline->pending->head; l != NULL; l = l->next) {
+        old = l->data;
+
+        if (old->finished || !same_facts(old->facts, t->facts))
+            continue;
+
+        OHM_DEBUG(DBG_SIGNALING, "transaction '%u' of '%s' superseded by '%u'",
+                old->txid, pipeline->signal, t->txid);
+
+        old->built_ready = TRUE;
+        old->finished    = TRUE;
+    }
+}
+
+
 static gboolean register_fact(const gchar *uri, const gchar *name, gboolean internal, GSList *capabilities)
 {
     GSList  *i;
@@ -1735,23 +2962,9 @@ EnforcementPoint * register_enforcement_point(const gchar *uri,
      * Registers an internal or external enforcement point 
      */
 
-    GSList *i = NULL;
     EnforcementPoint *ep = NULL;
-    gchar *id;
-
-    for (i = enforcement_points; i != NULL; i = g_slist_next(i)) {
-
-        g_object_get(i->data, "id", &id, NULL);
-
-        if (!strcmp(id, uri)) {
-            ep = i->data;
-            g_free(id);
-            break;
-        }
-        g_free(id);
-    }
 
-    if (ep != NULL) {
+    if (g_hash_table_lookup(ep_ids, uri) != NULL) {
         OHM_DEBUG(DBG_SIGNALING, "Could not register: ep '%s' already registered", uri);
         return NULL;
     }
@@ -1769,9 +2982,14 @@ EnforcementPoint * register_enforcement_point(const gchar *uri,
     g_object_set(ep, "id", uri, NULL);
     g_object_set(ep, "interested", capabilities, NULL);
 
-    OHM_DEBUG(DBG_SIGNALING, "Created ep '%s' at 0x%p", uri, ep);
+    ep_slot_alloc(ep);
+    g_hash_table_insert(ep_ids, g_strdup(uri), ep);
+
+    OHM_DEBUG(DBG_SIGNALING, "Created ep '%s' at 0x%p, slot %u", uri, ep,
+            *ep_slot(ep));
 
     enforcement_points = g_slist_prepend(enforcement_points, ep);
+    subscription_add(ep, capabilities);
 
     register_fact(uri, name, internal, capabilities);
 
@@ -1784,29 +3002,20 @@ gboolean unregister_enforcement_point(const gchar *uri)
     /* free memory and remove from the ep list */
     /* also remember to remove the ep from ongoing transactions list */
 
-    GSList *i = NULL;
     EnforcementPoint *ep = NULL;
-    gchar *id;
-
-    for (i = enforcement_points; i != NULL; i = g_slist_next(i)) {
-
-        g_object_get(i->data, "id", &id, NULL);
+    GSList *interested = NULL;
 
-        if (!strcmp(id, uri)) {
-            ep = i->data;
-            g_free(id);
-            break;
-        }
-        g_free(id);
-    }
-
-    if (ep == NULL) {
+    if ((ep = g_hash_table_lookup(ep_ids, uri)) == NULL) {
         return FALSE;
     }
 
     OHM_DEBUG(DBG_SIGNALING, "Unregister: '%s' was found", uri);
 
     enforcement_point_unregister(ep);
+    g_object_get(ep, "interested", &interested, NULL);
+    subscription_remove(ep, interested);
+    ep_slot_free(ep);
+    g_hash_table_remove(ep_ids, uri);
     enforcement_points = g_slist_remove(enforcement_points, ep);
     g_object_unref(ep);
 
@@ -1815,13 +3024,137 @@ gboolean unregister_enforcement_point(const gchar *uri)
     return TRUE;
 }
 
-static int watch_dbus_addr(const char *addr, gboolean watchit,
-                           DBusHandlerResult (*filter)(DBusConnection *,
-                                                       DBusMessage *, void *),
-                           void *user_data)
+static void name_owner_lost(const char *addr)
 {
-    char      match[1024];
-    DBusError err;
+    /* a watched client went away, unregister if it was one of ours */
+
+    if (unregister_enforcement_point(addr))
+        OHM_DEBUG(DBG_SIGNALING, "Removed service '%s'", addr);
+    else
+        OHM_DEBUG(DBG_SIGNALING, "Terminated service '%s' wasn't registered",
+                addr);
+
+    watch_dbus_addr(addr, FALSE);
+}
+
+static void name_has_owner_reply(DBusPendingCall *pend, void *data)
+{
+    const char  *addr = data;
+    DBusMessage *reply;
+    dbus_bool_t  has_owner = TRUE;
+
+    if ((reply = dbus_pending_call_steal_reply(pend)) == NULL)
+        return;
+
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR ||
+        !dbus_message_get_args(reply, NULL,
+                DBUS_TYPE_BOOLEAN, &has_owner, DBUS_TYPE_INVALID))
+        OHM_ERROR("NameHasOwner failed for %s", addr);
+
+    dbus_message_unref(reply);
+
+    /* the client was gone before its match rule was in place */
+    if (!has_owner && g_hash_table_lookup(watched_addrs, addr) != NULL) {
+        OHM_DEBUG(DBG_SIGNALING, "service '%s' exited before being watched",
+                addr);
+        name_owner_lost(addr);
+    }
+}
+
+static gboolean call_bus(const char *method, const char *arg,
+                         DBusPendingCallNotifyFunction notify,
+                         const char *addr)
+{
+    DBusMessage     *msg;
+    DBusPendingCall *pend = NULL;
+    gboolean         success = FALSE;
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+            DBUS_INTERFACE_DBUS, method);
+
+    if (msg == NULL)
+        return FALSE;
+
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg,
+                DBUS_TYPE_INVALID))
+        goto out;
+
+    if (notify == NULL) {
+        dbus_message_set_no_reply(msg, TRUE);
+        success = dbus_connection_send(connection, msg, NULL);
+        goto out;
+    }
+
+    if (!dbus_connection_send_with_reply(connection, msg, &pend, -1) ||
+        pend == NULL)
+        goto out;
+
+    success = dbus_pending_call_set_notify(pend, notify, g_strdup(addr),
+            g_free);
+    dbus_pending_call_unref(pend);
+
+ out:
+    dbus_message_unref(msg);
+    return success;
+}
+
+static void add_match_reply(DBusPendingCall *pend, void *data)
+{
+    const char  *addr = data;
+    DBusMessage *reply;
+
+    if ((reply = dbus_pending_call_steal_reply(pend)) == NULL)
+        return;
+
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR)
+        OHM_ERROR("Can't add match for %s: %s", addr,
+                dbus_message_get_error_name(reply));
+
+    dbus_message_unref(reply);
+
+    /*
+     * Now that the match rule is in place we are bound to see the client
+     * go away. Check that it has not done so already in the meantime.
+     */
+
+    if (g_hash_table_lookup(watched_addrs, addr) != NULL)
+        call_bus("NameHasOwner", addr, name_has_owner_reply, addr);
+}
+
+static int watch_dbus_addr(const char *addr, gboolean watchit)
+{
+    char  match[1024];
+    char *key;
+
+    /*
+     * Notes:
+     *   There is a single filter for all watched clients, installed when
+     *   the first client is watched. It parses NameOwnerChanged once and
+     *   looks up the name in watched_addrs. The match rules are added
+     *   asynchronously, so registering an EP does not cost a round trip
+     *   to the bus. The window between the client registering and the
+     *   match rule taking effect is closed by a NameHasOwner check once
+     *   the bus has acknowledged AddMatch.
+     */
+
+    if (watched_addrs == NULL) {
+        if (!watchit)
+            return TRUE;
+
+        watched_addrs = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, NULL);
+
+        if (!dbus_connection_add_filter(connection,
+                        update_external_enforcement_points, NULL, NULL)) {
+            OHM_ERROR("Failed to install NameOwnerChanged filter.");
+            g_hash_table_destroy(watched_addrs);
+            watched_addrs = NULL;
+            return FALSE;
+        }
+    }
+
+    if (watchit == (g_hash_table_lookup(watched_addrs, addr) != NULL))
+        return TRUE;
 
     snprintf(match, sizeof(match),
              "type='signal',"
@@ -1831,40 +3164,21 @@ static int watch_dbus_addr(const char *addr, gboolean watchit,
              SIGNAL_NAME_OWNER_CHANGED, DBUS_PATH_FDO,
              addr);
 
-    if (filter) {
-        if (watchit) {
-            if (!dbus_connection_add_filter(connection, filter, user_data,NULL)) {
-                OHM_ERROR("Failed to install dbus filter %p.", filter);
-                return FALSE;
-            }
-        }
-        else
-            dbus_connection_remove_filter(connection, filter, user_data);
-    }
-
-    /*
-     * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
-     */
-
     if (watchit) {
-        dbus_error_init(&err);
-        dbus_bus_add_match(connection, match, &err);
+        key = g_strdup(addr);
+        g_hash_table_insert(watched_addrs, key, key);
 
-        if (dbus_error_is_set(&err)) {
-            OHM_ERROR("Can't add match \"%s\": %s", match, err.message);
-            dbus_error_free(&err);
+        if (!call_bus("AddMatch", match, add_match_reply, addr)) {
+            OHM_ERROR("Can't add match \"%s\"", match);
+            g_hash_table_remove(watched_addrs, addr);
             return FALSE;
         }
     }
-    else
-        dbus_bus_remove_match(connection, match, NULL);
+    else {
+        /* on the removal path we do not care about errors */
+        g_hash_table_remove(watched_addrs, addr);
+        call_bus("RemoveMatch", match, NULL, NULL);
+    }
 
     return TRUE;
 }
@@ -1878,6 +3192,10 @@ DBusHandlerResult update_external_enforcement_points(DBusConnection * c,
     (void) user_data;
     (void) c;
 
+    if (!dbus_message_is_signal(msg, DBUS_INTERFACE_FDO,
+                SIGNAL_NAME_OWNER_CHANGED))
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
     if (!dbus_message_get_args(msg,
             NULL,
             DBUS_TYPE_STRING,
@@ -1889,17 +3207,11 @@ DBusHandlerResult update_external_enforcement_points(DBusConnection * c,
             DBUS_TYPE_INVALID))
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    if (!strcmp(after, "")) {
-        /* a service went away, unregister if it was one of ours */
-        if (unregister_enforcement_point(sender)) {
-            OHM_DEBUG(DBG_SIGNALING, "Removed service '%s'", sender);
-            watch_dbus_addr(sender, FALSE, update_external_enforcement_points, NULL);
-        }
-        else {
-            OHM_DEBUG(DBG_SIGNALING, "Terminated service '%s' wasn't registered", sender);
-            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-        }
-    }
+    if (after[0] != '\0' || watched_addrs == NULL ||
+        g_hash_table_lookup(watched_addrs, sender) == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    name_owner_lost(sender);
 
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
@@ -1914,6 +3226,7 @@ DBusHandlerResult register_external_enforcement_point(DBusConnection * c,
     EnforcementPoint *ep = NULL;
     DBusMessageIter  msgit;
     GSList *capabilities = NULL;
+    gboolean delta = FALSE, shm = FALSE, batch = FALSE;
 
     (void) user_data;
 
@@ -1945,6 +3258,23 @@ DBusHandlerResult register_external_enforcement_point(DBusConnection * c,
 
                 dbus_message_iter_get_basic(&arrit, (void *)&capability);
 
+                if (!strcmp(capability, CAPABILITY_BATCH)) {
+                    batch = TRUE;
+                    continue;
+                }
+
+                if (!strcmp(capability, CAPABILITY_SHM)) {
+                    OHM_DEBUG(DBG_SIGNALING, "EP %s wants shared memory", name);
+                    shm = TRUE;
+                    continue;
+                }
+
+                if (!strcmp(capability, CAPABILITY_DELTA)) {
+                    OHM_DEBUG(DBG_SIGNALING, "EP %s wants delta decisions", name);
+                    delta = TRUE;
+                    continue;
+                }
+
                 OHM_DEBUG(DBG_SIGNALING, "EP %s is interested in capability %s",
                         name, capability);
 
@@ -1972,10 +3302,48 @@ DBusHandlerResult register_external_enforcement_point(DBusConnection * c,
                 "Enforcement point registration failed");
     }
     else {
+        EXTERNAL_EP_STRATEGY(ep)->delta = delta;
         reply = dbus_message_new_method_return(msg);
+
+#ifdef DBUS_TYPE_UNIX_FD
+        /*
+         * Local EPs asking for it get a shared memory ring for decisions
+         * and acks. If the descriptors cannot be passed the EP just keeps
+         * using D-Bus.
+         */
+        if (shm && reply != NULL &&
+            dbus_connection_can_send_type(c, DBUS_TYPE_UNIX_FD) &&
+            shm_create(EXTERNAL_EP_STRATEGY(ep))) {
+            ep_shm *x = EXTERNAL_EP_STRATEGY(ep)->shm;
+
+            if (dbus_message_append_args(reply,
+                            DBUS_TYPE_UNIX_FD, &x->fd,
+                            DBUS_TYPE_UNIX_FD, &x->efd,
+                            DBUS_TYPE_UNIX_FD, &x->ackfd,
+                            DBUS_TYPE_INVALID)) {
+                /* the message has its own copies of the descriptors */
+                close(x->fd);
+                x->fd = -1;
+                /* shared memory carries full decisions */
+                EXTERNAL_EP_STRATEGY(ep)->delta = FALSE;
+            }
+            else
+                shm_free(EXTERNAL_EP_STRATEGY(ep));
+        }
+#else
+        (void) shm;
+#endif
+
+        /* tell the EP we understand batched acks, after the descriptors */
+        if (batch && reply != NULL) {
+            const char *accepted = CAPABILITY_BATCH;
+
+            dbus_message_append_args(reply, DBUS_TYPE_STRING, &accepted,
+                    DBUS_TYPE_INVALID);
+        }
         /* start watching client so that we get notified when it disconnects
            even if it doesn't explicitly disconnect */
-        watch_dbus_addr(uri, TRUE, update_external_enforcement_points, NULL);
+        watch_dbus_addr(uri, TRUE);
     }
 
     if (reply == NULL) {
@@ -2023,6 +3391,7 @@ DBusHandlerResult unregister_external_enforcement_point(DBusConnection * c,
                 "Enforcement point unregistration failed"); 
     }
     else {
+        watch_dbus_addr(uri, FALSE);
         reply = dbus_message_new_method_return(msg);
     }
 
@@ -2080,9 +3449,7 @@ Transaction * queue_decision(gchar *signal, GSList *facts,
 
     Transaction        *transaction;
     guint               txid = 0;
-    gboolean            needs_processing = FALSE;
-    GQueue             *queue = NULL;
-    gpointer            data;
+    signal_pipeline    *pipeline = NULL;
 
     /* create a new empty transaction */
 
@@ -2116,44 +3483,26 @@ Transaction * queue_decision(gchar *signal, GSList *facts,
             timeout,
             NULL);
 
-#ifdef ONLY_ONE_TRANSACTION
-    /* fetch the correct queue from the queue map */
-    queue = signal_queue_lookup(signal);
-    if (!queue) {
-        /* no existing queue for signal, so create a new one and add it
-         * to the signal_queues map */
-
-        queue = g_queue_new();
-        if (!queue) {
-            g_object_unref(transaction);
-            return NULL;
-        }
-        g_hash_table_insert(signal_queues, signal, queue);
-    }
-#else
-    queue = g_queue_new();
-    if (!queue) {
+    /* fetch the correct pipeline from the pipeline map */
+    pipeline = signal_pipeline_get(signal);
+    if (!pipeline) {
         g_object_unref(transaction);
         return NULL;
     }
-#endif
 
-    /* if the list is empty, there is no processing already pending */
-    if (g_queue_is_empty(queue))
-        needs_processing = TRUE;
+    if (pipeline->collapse)
+        pipeline_collapse(pipeline, transaction);
 
-    g_queue_push_tail(queue, transaction);
+    g_queue_push_tail(pipeline->pending, transaction);
     OHM_DEBUG(DBG_SIGNALING, "added transaction %p to queue '%s' (%p)",
-            transaction, signal, queue);
+            transaction, signal, pipeline);
 
-    if (needs_processing) {
-        data = g_strdup(signal);
-
-        if (deferred_execution)
-            /* add the policy decision to the queue to be processed later */
-            g_idle_add(process_inq, data);
-        else
-            process_inq(data);
+    if (!deferred_execution)
+        pipeline_run(pipeline);
+    else if (!pipeline->scheduled) {
+        /* add the policy decision to the queue to be processed later */
+        pipeline->scheduled = TRUE;
+        g_idle_add(process_inq, g_strdup(signal));
     }
 
     if (!need_transaction || !deferred_execution) {
@@ -2166,6 +3515,31 @@ Transaction * queue_decision(gchar *signal, GSList *facts,
     return transaction;
 }
 
+static void receive_status(const char *sender, dbus_uint32_t txid,
+                           dbus_uint32_t status)
+{
+    EnforcementPoint *ep = NULL;
+    Transaction *transaction = NULL;
+
+    transaction = transaction_lookup(txid);
+
+    if (transaction == NULL) {
+        OHM_DEBUG(DBG_SIGNALING, "unknown transaction %u, ignored", txid);
+        return;
+    }
+
+    if ((ep = transaction_unanswered_ep(transaction, sender)) != NULL)
+        OHM_DEBUG(DBG_SIGNALING, "transaction 0x%x %sed by peer '%s'", txid,
+                status ? "ACK" : "NAK", sender);
+
+    if (ep == NULL) {
+        OHM_DEBUG(DBG_SIGNALING, "transaction ACK/NAK from unknown peer %s, ignored...", sender);
+        return;
+    }
+
+    enforcement_point_receive_ack(ep, transaction, status);
+}
+
 DBusHandlerResult dbus_ack(DBusConnection * c, DBusMessage * msg,
         void *data)
 {
@@ -2182,17 +3556,23 @@ DBusHandlerResult dbus_ack(DBusConnection * c, DBusMessage * msg,
     (void) c;
 
     DBusError      error;
+    DBusMessageIter msgit, arrit, structit;
     dbus_uint32_t  txid, status;
-    GSList *i = NULL;
-    EnforcementPoint *ep = NULL;
-    Transaction *transaction = NULL;
+    gboolean       batch;
 
 #if 1
     OHM_DEBUG(DBG_SIGNALING, "got signal %s.%s, sender %s", interface ?: "NULL", member,
             sender ?: "NULL");
 #endif
 
-    if (member == NULL || strcmp(member, "status"))
+    if (member == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    if (!strcmp(member, SIGNAL_POLICY_ACK))
+        batch = FALSE;
+    else if (!strcmp(member, SIGNAL_POLICY_ACK_BATCH))
+        batch = TRUE;
+    else
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
     if (interface == NULL || strcmp(interface, DBUS_INTERFACE_POLICY))
@@ -2201,50 +3581,48 @@ DBusHandlerResult dbus_ack(DBusConnection * c, DBusMessage * msg,
     if (sender == NULL)
         return DBUS_HANDLER_RESULT_HANDLED;
 
-    dbus_error_init(&error);
-    if (!dbus_message_get_args(msg, &error,
-                DBUS_TYPE_UINT32, &txid,
-                DBUS_TYPE_UINT32, &status,
-                DBUS_TYPE_INVALID)) {
-        g_warning("Failed to parse policy status signal (%s)", error.message);
-        dbus_error_free(&error);
-        return DBUS_HANDLER_RESULT_HANDLED;
-    }
-    dbus_error_free(&error);
-
-    transaction = transaction_lookup(txid);
+    if (batch) {
+        /* array of (txid, status) pairs from one EP */
+        if (!dbus_message_iter_init(msg, &msgit) ||
+            dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_ARRAY) {
+            g_warning("Failed to parse policy status batch from %s", sender);
+            return DBUS_HANDLER_RESULT_HANDLED;
+        }
 
-    if (transaction == NULL) {
-        OHM_DEBUG(DBG_SIGNALING, "unknown transaction %u, ignored", txid);
-        return DBUS_HANDLER_RESULT_HANDLED;
-    }
+        dbus_message_iter_recurse(&msgit, &arrit);
 
-    for (i = transaction->not_answered; i != NULL; i = g_slist_next(i)) {
-        EnforcementPoint *tmp = i->data;
-        gchar *id;
+        while (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_STRUCT) {
+            dbus_message_iter_recurse(&arrit, &structit);
 
-        g_object_get(tmp, "id", &id, NULL);
+            if (dbus_message_iter_get_arg_type(&structit) != DBUS_TYPE_UINT32)
+                break;
+            dbus_message_iter_get_basic(&structit, &txid);
 
-        OHM_DEBUG(DBG_SIGNALING, "comparing id '%s' and sender '%s'", id, sender);
+            if (!dbus_message_iter_next(&structit) ||
+                dbus_message_iter_get_arg_type(&structit) != DBUS_TYPE_UINT32)
+                break;
+            dbus_message_iter_get_basic(&structit, &status);
 
-        if (!strcmp(id, sender)) {
-            /* we found the sender */
-            ep = tmp;
-            OHM_DEBUG(DBG_SIGNALING, "transaction 0x%x %sed by peer '%s'", txid,
-                    status ? "ACK" : "NAK", id);
+            receive_status(sender, txid, status);
 
-            g_free(id);
-            break;
+            dbus_message_iter_next(&arrit);
         }
-        g_free(id);
+
+        return DBUS_HANDLER_RESULT_HANDLED;
     }
 
-    if (ep == NULL) {
-        OHM_DEBUG(DBG_SIGNALING, "transaction ACK/NAK from unknown peer %s, ignored...", sender);
+    dbus_error_init(&error);
+    if (!dbus_message_get_args(msg, &error,
+                DBUS_TYPE_UINT32, &txid,
+                DBUS_TYPE_UINT32, &status,
+                DBUS_TYPE_INVALID)) {
+        g_warning("Failed to parse policy status signal (%s)", error.message);
+        dbus_error_free(&error);
         return DBUS_HANDLER_RESULT_HANDLED;
     }
+    dbus_error_free(&error);
 
-    enforcement_point_receive_ack(ep, transaction, status);
+    receive_status(sender, txid, status);
 
     return DBUS_HANDLER_RESULT_HANDLED;
 }
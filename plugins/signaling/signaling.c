@@ -56,6 +56,34 @@ OHM_EXPORTABLE(GObject *, register_internal_enforcement_point, (gchar *uri, gcha
     return (GObject *) ep;
 }
 
+/* same as above, but decisions are delivered through the given callbacks */
+OHM_EXPORTABLE(GObject *, register_internal_ep, (gchar *uri, gchar **interested, const internal_ep_ops_t *ops, gpointer data))
+{
+    EnforcementPoint *ep = NULL;
+    GSList *capabilities = NULL;
+
+    while (*interested != NULL) {
+        capabilities = g_slist_prepend(capabilities, g_strdup(*interested));
+        interested++;
+    }
+
+    ep = register_enforcement_point(uri, NULL, TRUE, capabilities);
+
+    if (ep == NULL)
+        return NULL;
+
+    internal_ep_set_ops(ep, ops, data);
+
+    g_object_ref(ep);
+    return (GObject *) ep;
+}
+
+/* answer a decision that the callback interface deferred */
+OHM_EXPORTABLE(gboolean, ack_internal_decision, (GObject *ep, guint txid, gboolean success))
+{
+    return internal_ep_ack((EnforcementPoint *) ep, txid, success);
+}
+
 OHM_EXPORTABLE(gboolean, unregister_internal_enforcement_point, (GObject *ep))
 {
     EnforcementPoint *ep_in = (EnforcementPoint *) ep;
@@ -196,6 +224,55 @@ error:
     return 0;
 }
 
+/* pipeline configuration */
+
+static void configure_pipelines(OhmPlugin *plugin)
+{
+    /*
+     * pipeline-depth = <depth>
+     * pipelines      = <signal>:<depth>[,<signal>:<depth>...]
+     * collapse       = all | <signal>[,<signal>...]
+     */
+
+    const gchar *depth    = ohm_plugin_get_param(plugin, "pipeline-depth");
+    const gchar *signals  = ohm_plugin_get_param(plugin, "pipelines");
+    const gchar *collapse = ohm_plugin_get_param(plugin, "collapse");
+    gchar      **list, *sep;
+    gboolean     all;
+    int          i;
+
+    all = (collapse != NULL && !strcmp(collapse, "all"));
+
+    configure_pipeline(NULL, depth ? (guint)strtoul(depth, NULL, 10) : 0, all);
+
+    if (signals != NULL) {
+        list = g_strsplit(signals, ",", 0);
+
+        for (i = 0; list[i] != NULL; i++) {
+            g_strstrip(list[i]);
+
+            if ((sep = strchr(list[i], ':')) == NULL) {
+                OHM_WARNING("signaling: invalid pipeline '%s'", list[i]);
+                continue;
+            }
+
+            *sep++ = '\0';
+            configure_pipeline(list[i], (guint)strtoul(sep, NULL, 10), all);
+        }
+
+        g_strfreev(list);
+    }
+
+    if (collapse != NULL && !all) {
+        list = g_strsplit(collapse, ",", 0);
+
+        for (i = 0; list[i] != NULL; i++)
+            configure_pipeline(g_strstrip(list[i]), 0, TRUE);
+
+        g_strfreev(list);
+    }
+}
+
 /* init and exit */
 
     static void
@@ -211,6 +288,7 @@ plugin_init(OhmPlugin * plugin)
         g_warning("Failed to initialize signaling plugin debugging.");
 
     init_signaling(c, DBG_SIGNALING, DBG_FACTS);
+    configure_pipelines(plugin);
     return;
 }
 
@@ -229,8 +307,10 @@ OHM_PLUGIN_DESCRIPTION("signaling",
         OHM_LICENSE_LGPL, plugin_init, plugin_exit,
         NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(signaling, 5,
+OHM_PLUGIN_PROVIDES_METHODS(signaling, 7,
         OHM_EXPORT(register_internal_enforcement_point, "register_enforcement_point"),
+        OHM_EXPORT(register_internal_ep, "register_internal_ep"),
+        OHM_EXPORT(ack_internal_decision, "ack_internal_decision"),
         OHM_EXPORT(unregister_internal_enforcement_point, "unregister_enforcement_point"),
         OHM_EXPORT(signal_changed, "signal_changed"),
         OHM_EXPORT(queue_policy_decision, "queue_policy_decision"),
@@ -238,6 +318,8 @@ OHM_PLUGIN_PROVIDES_METHODS(signaling, 5,
 
 OHM_PLUGIN_DBUS_SIGNALS(
         {NULL, DBUS_INTERFACE_POLICY, SIGNAL_POLICY_ACK,
+            NULL, dbus_ack, NULL},
+        {NULL, DBUS_INTERFACE_POLICY, SIGNAL_POLICY_ACK_BATCH,
             NULL, dbus_ack, NULL}
         );
 
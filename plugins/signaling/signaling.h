@@ -43,6 +43,7 @@ USA.
 #include <dbus/dbus.h>
 
 #include "signaling_marshal.h"
+#include "internal-ep-ops.h"
 
 #include <ohm/ohm-plugin.h>
 #include <ohm/ohm-fact.h>
@@ -58,10 +59,19 @@ USA.
 #define METHOD_POLICY_REGISTER    "register"
 #define METHOD_POLICY_UNREGISTER  "unregister"
 #define SIGNAL_POLICY_ACK         "status"
+#define SIGNAL_POLICY_ACK_BATCH   "status_batch"
 #define SIGNAL_NAME_OWNER_CHANGED "NameOwnerChanged"
 
 #define ENFORCEMENT_FACT_NAME "com.nokia.policy.enforcement_point"
 
+#define DBUS_PATH_POLICY_DELTA   DBUS_PATH_POLICY "/delta"
+#define CAPABILITY_DELTA         "@delta"  /* EP wants delta decisions */
+#define DELTA_FULL               0x1       /* full snapshot, not a delta */
+#define DELTA_RESYNC_PERIOD      16        /* deltas between full snapshots */
+
+#define CAPABILITY_SHM           "@shm"    /* EP wants shared memory */
+#define CAPABILITY_BATCH         "@batch"  /* EP can send batched acks */
+
 #define TRANSACTION_TYPE (transaction_get_type())
 #define TRANSACTION(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), TRANSACTION_TYPE, Transaction))
 #define TRANSACTION_CLASS(vtable) (G_TYPE_CHECK_CLASS_CAST((vtable), TRANSACTION_TYPE, TransactionClass))
@@ -105,13 +115,21 @@ typedef struct _Transaction {
     GObject         parent;
     guint           txid;
     gchar          *signal;
-    GSList         *acked;
-    GSList         *nacked;
-    GSList         *not_answered;
+    GPtrArray      *members;        /* EPs indexed by slot number */
+    guint32        *unanswered_map; /* bitmap of EPs yet to answer */
+    guint32        *nacked_map;     /* bitmap of EPs that NACKed */
+    guint           nmember;
+    guint           unanswered;
     guint           timeout; /* in milliseconds */
-    guint           timeout_id; /* g_source */
+    guint64         deadline;   /* expiry time, monotonic milliseconds */
+    gint            heap_index; /* position in the deadline heap, or -1 */
     gboolean        built_ready;
+    gboolean        finished;  /* completed, maybe not yet reported */
     GSList         *facts;
+    gboolean        ipc_pending; /* IPC signal queued for sending */
+    DBusMessage    *decision;    /* encoded decision, shared by all EPs */
+    char           *marshalled;  /* the decision marshalled for shm EPs */
+    int             marshalled_len;
 
 } Transaction;
 
@@ -134,6 +152,7 @@ typedef struct _EnforcementPointInterface {
 } EnforcementPointInterface;
 
 GType           enforcement_point_get_type(void);
+gboolean        enforcement_point_is_interested(EnforcementPoint * self, Transaction *transaction);
 gboolean        enforcement_point_receive_ack (EnforcementPoint * self, Transaction *transaction, guint status);
 gboolean        enforcement_point_send_decision(EnforcementPoint * self, Transaction *transaction);
 gboolean        enforcement_point_stop_transaction(EnforcementPoint * self, Transaction *transaction);
@@ -145,6 +164,7 @@ void            transaction_complete(Transaction *t);
 void            transaction_add_ep(Transaction *t, EnforcementPoint *ep);
 void            transaction_remove_ep(Transaction *t, EnforcementPoint *ep);
 void            transaction_ack_ep(Transaction *t, EnforcementPoint *ep, gboolean ack);
+EnforcementPoint *transaction_unanswered_ep(Transaction *t, const gchar *id);
 
 typedef struct _fact {
     gchar *key;
@@ -164,6 +184,10 @@ typedef struct _ExternalEPStrategy {
     gchar          *id;
     GSList         *ongoing_transactions;
     GSList         *interested;
+    guint           slot;       /* small stable number for ack bitmaps */
+    gboolean        delta;      /* send delta-encoded decisions */
+    GHashTable     *snapshots;  /* last sent facts per signal */
+    struct _ep_shm *shm;        /* shared memory transport, if any */
 
 } ExternalEPStrategy;
 
@@ -176,6 +200,7 @@ typedef struct _pending_signal {
     GSList *facts;
     Transaction *transaction;
     ExternalEPStrategyClass *klass;
+    ExternalEPStrategy *ep;     /* recipient of a delta signal */
 } pending_signal;
 
 GType           external_ep_get_type(void);
@@ -189,6 +214,9 @@ typedef struct _InternalEPStrategy {
     gchar          *id;
     GSList         *ongoing_transactions;
     GSList         *interested;
+    guint           slot;       /* small stable number for ack bitmaps */
+    const internal_ep_ops_t *ops;  /* direct callbacks, if any */
+    gpointer        ops_data;
 
 } InternalEPStrategy;
 
@@ -197,6 +225,8 @@ typedef struct _InternalEPStrategyClass {
 } InternalEPStrategyClass;
 
 GType           internal_ep_get_type(void);
+void            internal_ep_set_ops(EnforcementPoint *self, const internal_ep_ops_t *ops, gpointer data);
+gboolean        internal_ep_ack(EnforcementPoint *self, guint txid, gboolean success);
 
 
 /* API functions */
@@ -205,6 +235,21 @@ EnforcementPoint * register_enforcement_point(const gchar * uri, const gchar *na
 
 gboolean unregister_enforcement_point(const gchar *uri);
 
+GSList * subscribed_enforcement_points(const gchar *signal);
+
+DBusMessage * encode_decision(Transaction *transaction);
+
+DBusMessage * encode_delta(ExternalEPStrategy *ep, Transaction *transaction);
+
+void delta_reset(ExternalEPStrategy *ep);
+
+typedef struct _ep_shm ep_shm;
+
+gboolean shm_create(ExternalEPStrategy *ep);
+void shm_free(ExternalEPStrategy *ep);
+
+gboolean configure_pipeline(const gchar *signal, guint depth, gboolean collapse);
+
 Transaction * queue_decision(gchar *signal, GSList *facts, int txid, gboolean need_transaction, guint timeout, gboolean deferred_execution);
 
 gboolean init_signaling();
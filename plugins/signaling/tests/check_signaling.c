@@ -28,6 +28,7 @@ USA.
 
 #include <check.h>
 #include "../signaling.h"
+#include "../libep/ep-ring.h"
 
 /**
  * ohm_log:
@@ -504,10 +505,10 @@ test_transaction(gpointer data) {
     }
     else {
         int i = 0;
+        EnforcementPoint *ep;
         /* Get acks for the EPs */
-        while (test_transaction_object->not_answered) {
+        while ((ep = transaction_unanswered_ep(test_transaction_object, NULL)) != NULL) {
             i++;
-            EnforcementPoint *ep = test_transaction_object->not_answered->data;
             printf(">>> receiving ack from ep %i\n", i);
             enforcement_point_receive_ack(ep, test_transaction_object, i % 3);
         }
@@ -686,6 +687,478 @@ START_TEST (test_signaling_timeout)
 END_TEST
 
 
+/*
+ * test_signaling_subscriptions
+ *
+ * Test that routing a signal through the subscription index yields the
+ * same enforcement points as asking every enforcement point in turn.
+ */
+
+extern GSList *enforcement_points;
+
+static GSList *test_capabilities(gchar **names) {
+    GSList *capabilities = NULL;
+
+    while (*names != NULL) {
+        capabilities = g_slist_prepend(capabilities, g_strdup(*names));
+        names++;
+    }
+
+    return capabilities;
+}
+
+static void test_compare_routing(const gchar *signal) {
+    Transaction *t;
+    GSList *i, *indexed;
+    guint linear = 0;
+
+    t = g_object_new(TRANSACTION_TYPE, "signal", signal, NULL);
+    indexed = subscribed_enforcement_points(signal);
+
+    for (i = enforcement_points; i != NULL; i = g_slist_next(i)) {
+        if (enforcement_point_is_interested(i->data, t)) {
+            linear++;
+            fail_unless(g_slist_find(indexed, i->data) != NULL,
+                    "EP %p missing from index for '%s'", i->data, signal);
+        }
+    }
+
+    fail_unless(linear == g_slist_length(indexed),
+            "Index has %i EPs for '%s', linear scan %i",
+            g_slist_length(indexed), signal, linear);
+
+    g_object_unref(t);
+}
+
+START_TEST (test_signaling_subscriptions)
+
+    DBusError error;
+    DBusConnection *c;
+    EnforcementPoint *ep;
+    gboolean ret;
+    guint i;
+
+    gchar *audio[]  = {"audio_actions", "actions", NULL};
+    gchar *video[]  = {"video_actions", "actions", NULL};
+    gchar *cgroup[] = {"cgroup_actions", NULL};
+    gchar *all[]    = {"audio_actions", "video_actions", "cgroup_actions",
+                       "actions", NULL};
+    gchar *none[]   = {NULL};
+    gchar *signals[] = {"actions", "audio_actions", "video_actions",
+                        "cgroup_actions", "interactions", NULL};
+
+    printf("> test_signaling_subscriptions\n");
+
+    dbus_error_init(&error);
+    c = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+    ret = init_signaling(c, 0, 0);
+    fail_unless(ret == TRUE, "Init failed");
+
+    register_enforcement_point("audio",   NULL, TRUE,  test_capabilities(audio));
+    register_enforcement_point("video",   NULL, FALSE, test_capabilities(video));
+    register_enforcement_point("cgroups", NULL, TRUE,  test_capabilities(cgroup));
+    register_enforcement_point("all",     NULL, FALSE, test_capabilities(all));
+    register_enforcement_point("none",    NULL, TRUE,  test_capabilities(none));
+    ep = register_enforcement_point("other", NULL, FALSE, test_capabilities(audio));
+
+    for (i = 0; signals[i] != NULL; i++)
+        test_compare_routing(signals[i]);
+
+    /* change the interests of a registered EP */
+    g_object_set(ep, "interested", test_capabilities(cgroup), NULL);
+
+    for (i = 0; signals[i] != NULL; i++)
+        test_compare_routing(signals[i]);
+
+    /* unregister a couple of EPs */
+    ret = unregister_enforcement_point("all");
+    fail_unless(ret, "Failed to unregister EP");
+    ret = unregister_enforcement_point("audio");
+    fail_unless(ret, "Failed to unregister EP");
+
+    for (i = 0; signals[i] != NULL; i++)
+        test_compare_routing(signals[i]);
+
+    fail_unless(subscribed_enforcement_points("interactions") == NULL,
+            "Unexpected subscribers for 'interactions'");
+
+    deinit_signaling();
+
+END_TEST
+
+
+/*
+ * test_signaling_pipeline
+ *
+ * Test that with a pipeline depth of 2 two decisions of the same signal
+ * are in flight at the same time, and that their completion is reported
+ * in txid order even if the enforcement point acks them in reverse order.
+ */
+
+static GSList *pipeline_pending = NULL;
+static internal_ep_cb_t pipeline_cb = NULL;
+static guint pipeline_completed[2];
+static int pipeline_ncompleted = 0;
+
+static void test_pipeline_complete(Transaction *t, gpointer data) {
+    guint txid;
+
+    g_object_get(t, "txid", &txid, NULL);
+    fail_unless(pipeline_ncompleted < 2, "Too many completions");
+    pipeline_completed[pipeline_ncompleted++] = txid;
+
+    if (pipeline_ncompleted == 2)
+        g_main_loop_quit(loop);
+}
+
+static gboolean test_pipeline_ack(gpointer data) {
+    GSList *i;
+    EnforcementPoint *ep = data;
+
+    /* pipeline_pending is in reverse order of arrival */
+    for (i = pipeline_pending; i != NULL; i = g_slist_next(i))
+        pipeline_cb(G_OBJECT(ep), G_OBJECT(i->data), TRUE);
+
+    g_slist_free(pipeline_pending);
+    pipeline_pending = NULL;
+
+    return FALSE;
+}
+
+static gboolean test_pipeline_decision(EnforcementPoint *e, Transaction *t, internal_ep_cb_t cb, gpointer data) {
+
+    decision_count++;
+    pipeline_cb = cb;
+    pipeline_pending = g_slist_prepend(pipeline_pending, t);
+
+    /* ack only once both decisions have been received */
+    if (decision_count == 2)
+        g_idle_add(test_pipeline_ack, e);
+
+    return TRUE;
+}
+
+START_TEST (test_signaling_pipeline)
+
+    DBusError error;
+    DBusConnection *c;
+    EnforcementPoint *ep;
+    Transaction *t1, *t2;
+    guint txid1, txid2;
+    gboolean ret;
+
+    gchar *arr[] = {"pipelined_actions", NULL};
+    GSList *capabilities = NULL;
+    gchar **interested = arr;
+
+    printf("> test_signaling_pipeline\n");
+
+    dbus_error_init(&error);
+    c = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+    ret = init_signaling(c, 0, 0);
+    fail_unless(ret == TRUE, "Init failed");
+
+    ret = configure_pipeline("pipelined_actions", 2, FALSE);
+    fail_unless(ret == TRUE, "Failed to configure pipeline");
+
+    while (*interested != NULL) {
+        capabilities = g_slist_prepend(capabilities, g_strdup(*interested));
+        interested++;
+    }
+
+    ep = register_enforcement_point("pipelined", NULL, TRUE, capabilities);
+    g_signal_connect(ep, "on-decision", G_CALLBACK(test_pipeline_decision), NULL);
+
+    decision_count = 0;
+    pipeline_ncompleted = 0;
+
+    t1 = queue_decision("pipelined_actions", NULL, 0, TRUE, 5000, TRUE);
+    t2 = queue_decision("pipelined_actions", NULL, 0, TRUE, 5000, TRUE);
+
+    g_signal_connect(t1, "on-transaction-complete", G_CALLBACK(test_pipeline_complete), NULL);
+    g_signal_connect(t2, "on-transaction-complete", G_CALLBACK(test_pipeline_complete), NULL);
+
+    g_object_get(t1, "txid", &txid1, NULL);
+    g_object_get(t2, "txid", &txid2, NULL);
+
+    g_main_loop_run(loop);
+
+    fail_unless(decision_count == 2, "Decision sent %i times", decision_count);
+    fail_unless(pipeline_completed[0] == txid1 && pipeline_completed[1] == txid2,
+            "Completions reported out of order: %u, %u",
+            pipeline_completed[0], pipeline_completed[1]);
+
+    g_object_unref(t1);
+    g_object_unref(t2);
+
+    deinit_signaling();
+
+END_TEST
+
+/*
+ * test_signaling_internal_ep_ops
+ *
+ * Test the direct callback interface for internal EPs: one EP answers
+ * from within the callback, the other defers and answers later.
+ */
+
+static guint ops_deferred_txid;
+static gboolean ops_complete_ok;
+
+static gboolean test_ops_deferred_ack(gpointer data) {
+    fail_unless(internal_ep_ack(data, ops_deferred_txid, TRUE),
+            "Deferred ack for %u not accepted", ops_deferred_txid);
+    return FALSE;
+}
+
+static int test_ops_decision(GObject *ep, guint txid, const gchar *signal,
+        GSList *facts, gpointer data) {
+
+    fail_unless(txid != 0, "Wrong txid");
+    fail_unless(!strcmp(signal, "actions"), "Wrong signal '%s'", signal);
+    fail_unless(g_slist_length(facts) == 1, "Wrong number of facts");
+    decision_count++;
+
+    if (data == NULL)
+        return TRUE;
+
+    ops_deferred_txid = txid;
+    g_idle_add(test_ops_deferred_ack, data);
+
+    return INTERNAL_EP_DEFERRED;
+}
+
+static void test_ops_key_change(GObject *ep, const gchar *signal,
+        GSList *facts, gpointer data) {
+    key_changed_count++;
+}
+
+static const internal_ep_ops_t test_ops = {
+    .decision   = test_ops_decision,
+    .key_change = test_ops_key_change,
+};
+
+static void test_ops_complete(Transaction *t, gpointer data) {
+    GSList *nacked = NULL, *not_answered = NULL;
+
+    g_object_get(t, "nacked", &nacked, "not_answered", &not_answered, NULL);
+    ops_complete_ok = (nacked == NULL && not_answered == NULL);
+
+    g_main_loop_quit(loop);
+}
+
+START_TEST (test_signaling_internal_ep_ops)
+
+    DBusError error;
+    DBusConnection *c;
+    EnforcementPoint *sync_ep, *deferred_ep;
+    gchar *arr[] = {"actions", NULL};
+    gboolean ret;
+
+    printf("> test_signaling_internal_ep_ops\n");
+
+    dbus_error_init(&error);
+    c = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+    ret = init_signaling(c, 0, 0);
+    fail_unless(ret == TRUE, "Init failed");
+
+    sync_ep = register_enforcement_point("ops-sync", NULL, TRUE,
+            test_capabilities(arr));
+    deferred_ep = register_enforcement_point("ops-deferred", NULL, TRUE,
+            test_capabilities(arr));
+
+    internal_ep_set_ops(sync_ep, &test_ops, NULL);
+    internal_ep_set_ops(deferred_ep, &test_ops, deferred_ep);
+
+    key_changed_count = 0;
+    decision_count = 0;
+    ops_deferred_txid = 0;
+    ops_complete_ok = FALSE;
+
+    queue_decision("actions", g_slist_prepend(NULL, g_strdup("fact")), 0,
+            FALSE, 0, FALSE);
+    fail_unless(key_changed_count == 2, "Key changed %i times", key_changed_count);
+
+    test_transaction_object = queue_decision("actions",
+            g_slist_prepend(NULL, g_strdup("fact")), 0, TRUE, 2000, TRUE);
+    g_signal_connect(test_transaction_object, "on-transaction-complete",
+            G_CALLBACK(test_ops_complete), NULL);
+
+    g_main_loop_run(loop);
+
+    fail_unless(decision_count == 2, "Decision sent %i times", decision_count);
+    fail_unless(ops_deferred_txid != 0, "Decision was not deferred");
+    fail_unless(ops_complete_ok, "Transaction did not complete with ACKs");
+
+    g_object_unref(test_transaction_object);
+
+    deinit_signaling();
+
+END_TEST
+
+
+/*
+ * test_signaling_shm_ring
+ *
+ * Pass records of varying sizes through the shared memory decision ring,
+ * wrapping around it several times, with separate producer and consumer
+ * views like the policy engine and an EP have.
+ * */
+
+#define SHM_GUARD 4096
+
+static char *shm_segment(void)
+{
+    char *seg;
+
+    /* the segment is followed by a guard area that must stay untouched */
+    seg = g_malloc(EP_SHM_BYTES + SHM_GUARD);
+    memset(seg + EP_SHM_BYTES, 0xa5, SHM_GUARD);
+    ep_shm_init((ep_shm_t *)seg, EP_SHM_BYTES);
+
+    return seg;
+}
+
+static gboolean shm_guard_intact(char *seg)
+{
+    int i;
+
+    for (i = 0; i < SHM_GUARD; i++)
+        if ((unsigned char)seg[EP_SHM_BYTES + i] != 0xa5)
+            return FALSE;
+
+    return TRUE;
+}
+
+START_TEST (test_signaling_shm_ring)
+
+    char           *seg, in[1024], out[1024];
+    ep_ring_view_t  prod, cons;
+    int32_t         len;
+    uint32_t        n, total;
+    int             i, j;
+
+    printf("> test_signaling_shm_ring\n");
+
+    seg = shm_segment();
+    fail_unless(ep_shm_check((ep_shm_t *)seg, EP_SHM_BYTES),
+            "Fresh segment rejected");
+
+    ep_ring_view(&prod, seg, EP_SHM_DECISIONS, EP_RING_DECISIONS, TRUE);
+    ep_ring_view(&cons, seg, EP_SHM_DECISIONS, EP_RING_DECISIONS, FALSE);
+
+    fail_unless(ep_ring_next(&cons) == EP_RING_EMPTY, "New ring not empty");
+
+    for (i = 0, total = 0; total < 4 * EP_RING_DECISIONS; i++) {
+        n = 1 + (i * 37) % sizeof(in);
+
+        for (j = 0; j < (int)n; j++)
+            in[j] = (char)(i + j);
+
+        fail_unless(ep_ring_put(&prod, in, n) == 1, "Put %d failed", i);
+
+        len = ep_ring_next(&cons);
+        fail_unless(len == (int32_t)n, "Record %d has length %d instead of %u",
+                i, len, n);
+
+        ep_ring_get(&cons, out, len);
+        fail_unless(!memcmp(in, out, n), "Record %d corrupted", i);
+
+        total += n + sizeof(uint32_t);
+    }
+
+    fail_unless(ep_ring_next(&cons) == EP_RING_EMPTY, "Drained ring not empty");
+
+    /* fill it up, the record that does not fit must be refused */
+    for (i = 0; ep_ring_put(&prod, in, sizeof(in)); i++)
+        ;
+    fail_unless(i == EP_RING_DECISIONS / (sizeof(in) + sizeof(uint32_t)),
+            "Ring took %d records", i);
+    fail_unless(ep_ring_put(&prod, in, EP_RING_DECISIONS) == 0,
+            "Oversized record accepted");
+
+    fail_unless(shm_guard_intact(seg), "Guard area overwritten");
+    g_free(seg);
+
+END_TEST
+
+/*
+ * test_signaling_shm_hostile
+ *
+ * The peer can write anything into the segment at any time. Check that
+ * bogus sizes, positions and record lengths are rejected and never make
+ * the rings touch memory outside of the segment.
+ * */
+
+START_TEST (test_signaling_shm_hostile)
+
+    char           *seg, buf[EP_RING_ACKS];
+    ep_shm_t       *shm;
+    ep_ring_t      *ring;
+    ep_ring_view_t  prod, cons;
+    ep_ring_ack_t   ack = { 1, 1 };
+    uint32_t        len;
+
+    printf("> test_signaling_shm_hostile\n");
+
+    seg = shm_segment();
+    shm = (ep_shm_t *)seg;
+
+    /* geometry checks at map time */
+    EP_SHM_RING(shm, shm->acks)->size = EP_RING_ACKS - 1;
+    fail_unless(!ep_shm_check(shm, EP_SHM_BYTES), "Bad ring size accepted");
+    EP_SHM_RING(shm, shm->acks)->size = 2 * EP_RING_ACKS;
+    fail_unless(!ep_shm_check(shm, EP_SHM_BYTES), "Oversized ring accepted");
+    EP_SHM_RING(shm, shm->acks)->size = EP_RING_ACKS;
+    shm->acks = EP_SHM_BYTES;
+    fail_unless(!ep_shm_check(shm, EP_SHM_BYTES), "Bad ring offset accepted");
+    shm->acks = 0xfffffff0;
+    fail_unless(!ep_shm_check(shm, EP_SHM_BYTES), "Wrapping offset accepted");
+    shm->acks = EP_SHM_ACKS;
+    fail_unless(ep_shm_check(shm, EP_SHM_BYTES), "Restored segment rejected");
+
+    ep_ring_view(&prod, seg, EP_SHM_ACKS, EP_RING_ACKS, TRUE);
+    ep_ring_view(&cons, seg, EP_SHM_ACKS, EP_RING_ACKS, FALSE);
+    ring = prod.ring;
+
+    /* a size changed after mapping is ignored */
+    ring->size = 0x80000000;
+    fail_unless(ep_ring_put(&prod, &ack, sizeof(ack)) == 1, "Put failed");
+    fail_unless(ep_ring_next(&cons) == sizeof(ack), "Bad record length");
+    ep_ring_get(&cons, &ack, sizeof(ack));
+
+    /* a tail beyond the head must not make the producer overwrite data */
+    ring->tail = prod.pos + 4 * EP_RING_ACKS;
+    fail_unless(ep_ring_put(&prod, &ack, sizeof(ack)) == 0,
+            "Put with bogus tail accepted");
+    ring->tail = cons.pos;
+
+    /* a head too far ahead of the tail */
+    ring->head = cons.pos + EP_RING_ACKS + 8;
+    fail_unless(ep_ring_next(&cons) == EP_RING_CORRUPT,
+            "Bogus head not detected");
+
+    /* a record claiming more than there is in the ring */
+    ring->head = prod.pos;
+    fail_unless(ep_ring_put(&prod, &ack, sizeof(ack)) == 1, "Put failed");
+    len = 0xffffff00;
+    memcpy(cons.data + (cons.pos & (cons.size - 1)), &len, sizeof(len));
+    fail_unless(ep_ring_next(&cons) == EP_RING_CORRUPT,
+            "Bogus record length not detected");
+
+    ep_ring_flush(&cons);
+    fail_unless(ep_ring_next(&cons) == EP_RING_EMPTY, "Flushed ring not empty");
+
+    /* records larger than the ring are refused up front */
+    fail_unless(ep_ring_put(&prod, buf, sizeof(buf)) == 0,
+            "Oversized record accepted");
+
+    fail_unless(shm_guard_intact(seg), "Guard area overwritten");
+    g_free(seg);
+
+END_TEST
+
+
 Suite *ohm_signaling_suite(void)
 {
     Suite *suite = suite_create("ohm_signaling");
@@ -699,6 +1172,11 @@ Suite *ohm_signaling_suite(void)
     tcase_add_test(tc_all, test_signaling_internal_ep_2);
     tcase_add_test(tc_all, test_signaling_internal_ep_gobject);
     tcase_add_test(tc_all, test_signaling_timeout);
+    tcase_add_test(tc_all, test_signaling_subscriptions);
+    tcase_add_test(tc_all, test_signaling_pipeline);
+    tcase_add_test(tc_all, test_signaling_internal_ep_ops);
+    tcase_add_test(tc_all, test_signaling_shm_ring);
+    tcase_add_test(tc_all, test_signaling_shm_hostile);
     
     tcase_set_timeout(tc_all, 120);
     suite_add_tcase(suite, tc_all);
@@ -0,0 +1,160 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file encode-bench.c
+ * @brief microbenchmark for encoding policy decisions
+ *
+ * Measures the cost of serializing a decision into a D-Bus signal as a
+ * function of the number of facts in the decision.
+ *
+ * usage: encode-bench [max-facts [rounds]]
+ */
+
+#include "../signaling.h"
+
+#define FACT_PREFIX "com.nokia.policy.bench_"
+#define NFIELD      4
+
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR && level != OHM_LOG_WARNING)
+        return;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+static double timestamp(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static GSList *create_facts(OhmFactStore *store, int n)
+{
+    OhmFact *fact;
+    GSList  *names = NULL;
+    char     name[64];
+    int      i;
+
+    for (i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), FACT_PREFIX"%d", i);
+
+        fact = ohm_fact_new(name);
+        ohm_fact_set(fact, "device", ohm_value_from_string("headset"));
+        ohm_fact_set(fact, "type"  , ohm_value_from_string("sink"));
+        ohm_fact_set(fact, "mode"  , ohm_value_from_int(i));
+        ohm_fact_set(fact, "volume", ohm_value_from_int(100 - i % 100));
+        ohm_fact_store_insert(store, fact);
+
+        names = g_slist_prepend(names, g_strdup(name));
+    }
+
+    return names;
+}
+
+static GSList *copy_names(GSList *names, int n)
+{
+    GSList *copy = NULL;
+
+    for ( ; names != NULL && n > 0; names = g_slist_next(names), n--)
+        copy = g_slist_prepend(copy, g_strdup(names->data));
+
+    return copy;
+}
+
+int main(int argc, char *argv[])
+{
+    OhmFactStore *store;
+    Transaction  *t;
+    GSList       *names;
+    DBusMessage  *msg;
+    double        start, total;
+    int           max, rounds, n, r;
+
+    max    = argc > 1 ? atoi(argv[1]) : 64;
+    rounds = argc > 2 ? atoi(argv[2]) : 1000;
+
+    g_type_init();
+
+    if (max <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [max-facts [rounds]]\n", argv[0]);
+        exit(1);
+    }
+
+    if (!init_signaling(NULL, 0, 0)) {
+        fprintf(stderr, "failed to initialize signaling\n");
+        exit(1);
+    }
+
+    store = ohm_get_fact_store();
+    names = create_facts(store, max);
+
+    printf("%8s %8s %12s %12s\n", "facts", "fields", "usecs/enc", "nsecs/field");
+
+    for (n = 1; n <= max; n *= 2) {
+        total = 0.0;
+
+        for (r = 0; r < rounds; r++) {
+            t = g_object_new(TRANSACTION_TYPE, NULL);
+            g_object_set(G_OBJECT(t),
+                    "txid", (guint)r + 1,
+                    "signal", "bench_actions",
+                    "facts", copy_names(names, n),
+                    NULL);
+
+            /* only the encoding itself is measured */
+            start = timestamp();
+            msg   = encode_decision(t);
+            total += timestamp() - start;
+
+            if (msg == NULL) {
+                fprintf(stderr, "failed to encode decision\n");
+                exit(1);
+            }
+
+            g_object_unref(t);
+        }
+
+        printf("%8d %8d %12.2f %12.2f\n", n, n * NFIELD, total / rounds,
+               1000.0 * total / rounds / (n * NFIELD));
+    }
+
+    deinit_signaling();
+
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,627 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file signaling-bench.c
+ * @brief end-to-end throughput and latency benchmark for signaling
+ *
+ * Starts a private dbus-daemon (unless one is given with -a), runs the
+ * signaling core on its own connection and registers a number of
+ * synthetic internal EPs in-process and libep-based external EPs in
+ * child processes. Decisions are then queued at a fixed rate, the same
+ * way queue_policy_decision() does it, and the time from queueing to
+ * transaction completion is measured.
+ *
+ * usage: signaling-bench [-i internal-eps] [-e external-eps] [-f facts]
+ *                        [-r decisions/s] [-n decisions] [-d ack-delay-ms]
+ *                        [-x nack-percent] [-t timeout-ms] [-s] [-D]
+ *                        [-a bus-address]
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "../signaling.h"
+#include "../libep/ep.h"
+
+#define SIGNAL_NAME  "bench_actions"
+#define FACT_PREFIX  "com.nokia.policy.bench_"
+#define POLICY_NAME  "org.freedesktop.ohm"
+
+typedef void (*internal_ep_cb_t) (GObject *ep, GObject *transaction, gboolean success);
+
+typedef struct {
+    int     internal;           /* number of internal EPs */
+    int     external;           /* number of external (libep) EPs */
+    int     facts;              /* facts per decision */
+    int     rate;               /* decisions per second */
+    int     count;              /* decisions to make */
+    int     delay;              /* ack delay in ms */
+    int     nack;               /* NACK rate in percent */
+    int     timeout;            /* transaction timeout in ms */
+    int     flags;              /* libep registration flags */
+    char   *address;            /* bus address */
+} options_t;
+
+typedef struct {
+    EnforcementPoint *ep;
+    Transaction      *t;
+    internal_ep_cb_t  cb;
+    gboolean          success;
+} internal_ack_t;
+
+typedef struct {
+    ep_answer_cb    cb;
+    ep_answer_token token;
+    int             success;
+} external_ack_t;
+
+static options_t   opt;
+static GMainLoop  *loop;
+static GSList     *fact_names;
+static double     *latency;
+static double     *started;
+static int         queued, completed, failed;
+
+extern GSList     *enforcement_points;
+
+
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR && level != OHM_LOG_WARNING)
+        return;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+static double timestamp(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static double cpu_usecs(int who)
+{
+    struct rusage ru;
+
+    getrusage(who, &ru);
+
+    return
+        ru.ru_utime.tv_sec * 1000000.0 + ru.ru_utime.tv_usec +
+        ru.ru_stime.tv_sec * 1000000.0 + ru.ru_stime.tv_usec;
+}
+
+static gboolean roll_success(void)
+{
+    return (rand() % 100) >= opt.nack;
+}
+
+
+/*
+ * synthetic external enforcement points, one process each
+ */
+
+static gboolean external_ack(gpointer data)
+{
+    external_ack_t *ack = data;
+
+    ack->cb(ack->token, ack->success);
+    g_free(ack);
+
+    return FALSE;
+}
+
+static void external_decision(const char *name, struct ep_decision **decisions,
+                              ep_answer_cb cb, ep_answer_token token,
+                              void *user_data)
+{
+    external_ack_t *ack;
+
+    (void) name;
+    (void) decisions;
+    (void) user_data;
+
+    if (opt.delay == 0) {
+        cb(token, roll_success());
+        return;
+    }
+
+    ack          = g_new0(external_ack_t, 1);
+    ack->cb      = cb;
+    ack->token   = token;
+    ack->success = roll_success();
+
+    g_timeout_add(opt.delay, external_ack, ack);
+}
+
+static gboolean external_shm(GIOChannel *chnl, GIOCondition cond,
+                             gpointer data)
+{
+    (void) chnl;
+    (void) cond;
+    (void) data;
+
+    ep_shm_dispatch();
+
+    return TRUE;
+}
+
+static void external_quit(int sig)
+{
+    (void) sig;
+
+    g_main_loop_quit(loop);
+}
+
+static void external_ep(int idx)
+{
+    const char     *capabilities[] = { SIGNAL_NAME, NULL };
+    DBusConnection *conn;
+    DBusError       err;
+    char            name[32];
+
+    dbus_error_init(&err);
+
+    if ((conn = dbus_connection_open_private(opt.address, &err)) == NULL ||
+        !dbus_bus_register(conn, &err)) {
+        fprintf(stderr, "EP %d: can't connect to %s (%s)\n", idx,
+                opt.address, err.message ? err.message : "unknown error");
+        exit(1);
+    }
+
+    srand(getpid());
+    snprintf(name, sizeof(name), "bench-ep-%d", idx);
+
+    loop = g_main_loop_new(NULL, FALSE);
+    dbus_connection_setup_with_g_main(conn, NULL);
+
+    if (!ep_filter(NULL, SIGNAL_NAME, external_decision, NULL) ||
+        !ep_register_flags(conn, name, capabilities, opt.flags)) {
+        fprintf(stderr, "EP %d: registration failed\n", idx);
+        exit(1);
+    }
+
+    if (ep_shm_fd() >= 0)
+        g_io_add_watch(g_io_channel_unix_new(ep_shm_fd()), G_IO_IN,
+                external_shm, NULL);
+
+    signal(SIGTERM, external_quit);
+    g_main_loop_run(loop);
+
+    exit(0);
+}
+
+
+/*
+ * synthetic internal enforcement points
+ */
+
+static gboolean internal_ack(gpointer data)
+{
+    internal_ack_t *ack = data;
+
+    ack->cb(G_OBJECT(ack->ep), G_OBJECT(ack->t), ack->success);
+    g_object_unref(ack->t);
+    g_free(ack);
+
+    return FALSE;
+}
+
+static void internal_decision(EnforcementPoint *ep, Transaction *t,
+                              internal_ep_cb_t cb, gpointer data)
+{
+    internal_ack_t *ack;
+
+    (void) data;
+
+    if (opt.delay == 0) {
+        cb(G_OBJECT(ep), G_OBJECT(t), roll_success());
+        return;
+    }
+
+    ack          = g_new0(internal_ack_t, 1);
+    ack->ep      = ep;
+    ack->t       = g_object_ref(t);
+    ack->cb      = cb;
+    ack->success = roll_success();
+
+    g_timeout_add(opt.delay, internal_ack, ack);
+}
+
+static void internal_eps(int n)
+{
+    GSList           *capabilities;
+    EnforcementPoint *ep;
+    char              name[32];
+    int               i;
+
+    for (i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "bench-internal-%d", i);
+
+        capabilities = g_slist_prepend(NULL, g_strdup(SIGNAL_NAME));
+        ep = register_enforcement_point(name, NULL, TRUE, capabilities);
+
+        if (ep == NULL) {
+            fprintf(stderr, "failed to register internal EP %d\n", i);
+            exit(1);
+        }
+
+        g_signal_connect(G_OBJECT(ep), "on-decision",
+                G_CALLBACK(internal_decision), NULL);
+    }
+}
+
+
+/*
+ * the policy engine side
+ */
+
+static DBusHandlerResult bench_filter(DBusConnection *c, DBusMessage *msg,
+                                      void *data)
+{
+    (void) data;
+
+    /* what the dbus plugin would route to the signaling plugin */
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_POLICY,
+                METHOD_POLICY_REGISTER))
+        return register_external_enforcement_point(c, msg, NULL);
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_POLICY,
+                METHOD_POLICY_UNREGISTER))
+        return unregister_external_enforcement_point(c, msg, NULL);
+
+    if (dbus_message_is_signal(msg, DBUS_INTERFACE_POLICY, SIGNAL_POLICY_ACK) ||
+        dbus_message_is_signal(msg, DBUS_INTERFACE_POLICY,
+                SIGNAL_POLICY_ACK_BATCH))
+        return dbus_ack(c, msg, NULL);
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static DBusConnection *policy_connection(void)
+{
+    DBusConnection *conn;
+    DBusError       err;
+    char            match[256];
+
+    dbus_error_init(&err);
+
+    if ((conn = dbus_connection_open_private(opt.address, &err)) == NULL ||
+        !dbus_bus_register(conn, &err)) {
+        fprintf(stderr, "can't connect to %s (%s)\n", opt.address,
+                err.message ? err.message : "unknown error");
+        exit(1);
+    }
+
+    if (dbus_bus_request_name(conn, POLICY_NAME, DBUS_NAME_FLAG_DO_NOT_QUEUE,
+                &err) != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        fprintf(stderr, "can't get name %s\n", POLICY_NAME);
+        exit(1);
+    }
+
+    snprintf(match, sizeof(match), "type='signal',interface='%s'",
+             DBUS_INTERFACE_POLICY);
+    dbus_bus_add_match(conn, match, NULL);
+
+    dbus_connection_add_filter(conn, bench_filter, NULL, NULL);
+    dbus_connection_setup_with_g_main(conn, NULL);
+
+    return conn;
+}
+
+static void create_facts(int n)
+{
+    OhmFactStore *store = ohm_get_fact_store();
+    OhmFact      *fact;
+    char          name[64];
+    int           i;
+
+    for (i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), FACT_PREFIX"%d", i);
+
+        fact = ohm_fact_new(name);
+        ohm_fact_set(fact, "device", ohm_value_from_string("headset"));
+        ohm_fact_set(fact, "type"  , ohm_value_from_string("sink"));
+        ohm_fact_set(fact, "mode"  , ohm_value_from_int(i));
+        ohm_fact_store_insert(store, fact);
+
+        fact_names = g_slist_prepend(fact_names, g_strdup(name));
+    }
+}
+
+static GSList *copy_names(void)
+{
+    GSList *copy = NULL, *i;
+
+    for (i = fact_names; i != NULL; i = g_slist_next(i))
+        copy = g_slist_prepend(copy, g_strdup(i->data));
+
+    return copy;
+}
+
+static void decision_complete(Transaction *t, gpointer data)
+{
+    int     idx = GPOINTER_TO_INT(data);
+    GSList *nacked = NULL, *not_answered = NULL;
+
+    latency[idx] = timestamp() - started[idx];
+
+    g_object_get(t, "nacked", &nacked, "not_answered", &not_answered, NULL);
+
+    if (nacked != NULL || not_answered != NULL)
+        failed++;
+
+    g_slist_foreach(nacked, (GFunc)g_free, NULL);
+    g_slist_foreach(not_answered, (GFunc)g_free, NULL);
+    g_slist_free(nacked);
+    g_slist_free(not_answered);
+
+    g_object_unref(t);
+
+    if (++completed == opt.count)
+        g_main_loop_quit(loop);
+}
+
+static gboolean make_decision(gpointer data)
+{
+    Transaction *t;
+
+    (void) data;
+
+    if (queued >= opt.count)
+        return FALSE;
+
+    started[queued] = timestamp();
+
+    /* this is what queue_policy_decision() does */
+    t = queue_decision(SIGNAL_NAME, copy_names(), 0, TRUE, opt.timeout, TRUE);
+
+    if (t == NULL) {
+        fprintf(stderr, "failed to queue decision %d\n", queued);
+        exit(1);
+    }
+
+    g_signal_connect(G_OBJECT(t), "on-transaction-complete",
+            G_CALLBACK(decision_complete), GINT_TO_POINTER(queued));
+
+    queued++;
+
+    return TRUE;
+}
+
+static gboolean wait_for_eps(gpointer data)
+{
+    static int waited = 0;
+    int        n      = opt.internal + opt.external;
+
+    (void) data;
+
+    if ((int)g_slist_length(enforcement_points) >= n) {
+        g_main_loop_quit(loop);
+        return FALSE;
+    }
+
+    if (++waited > 500) {
+        fprintf(stderr, "only %u of %d EPs registered\n",
+                g_slist_length(enforcement_points), n);
+        exit(1);
+    }
+
+    return TRUE;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static double percentile(double *sorted, int n, int p)
+{
+    int idx = (n * p + 99) / 100 - 1;
+
+    return sorted[idx < 0 ? 0 : idx];
+}
+
+static GPid start_bus(void)
+{
+    gchar   *argv[] = { "dbus-daemon", "--session", "--nofork",
+                        "--print-address", NULL };
+    GError  *error = NULL;
+    GPid     pid;
+    gint     out;
+    char     buf[512];
+    ssize_t  len;
+
+    if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                    NULL, NULL, &pid, NULL, &out, NULL, &error)) {
+        fprintf(stderr, "can't start dbus-daemon (%s)\n", error->message);
+        exit(1);
+    }
+
+    if ((len = read(out, buf, sizeof(buf) - 1)) <= 0) {
+        fprintf(stderr, "no address from dbus-daemon\n");
+        exit(1);
+    }
+
+    buf[len] = '\0';
+    opt.address = g_strstrip(g_strdup(buf));
+    close(out);
+
+    return pid;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-i internal-eps] [-e external-eps] [-f facts]\n"
+            "          [-r decisions/s] [-n decisions] [-d ack-delay-ms]\n"
+            "          [-x nack-percent] [-t timeout-ms] [-s] [-D]\n"
+            "          [-a bus-address]\n"
+            "  -s  use the shared memory transport for external EPs\n"
+            "  -D  use delta-encoded decisions for external EPs\n",
+            argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    DBusConnection *conn;
+    GPid            bus = 0;
+    pid_t          *children;
+    double          start, elapsed, cpu, child_cpu;
+    int             c, i;
+
+    opt.internal = 1;
+    opt.external = 4;
+    opt.facts    = 4;
+    opt.rate     = 100;
+    opt.count    = 1000;
+    opt.delay    = 0;
+    opt.nack     = 0;
+    opt.timeout  = 2000;
+
+    while ((c = getopt(argc, argv, "i:e:f:r:n:d:x:t:sDa:h")) != -1) {
+        switch (c) {
+        case 'i': opt.internal = atoi(optarg);            break;
+        case 'e': opt.external = atoi(optarg);            break;
+        case 'f': opt.facts    = atoi(optarg);            break;
+        case 'r': opt.rate     = atoi(optarg);            break;
+        case 'n': opt.count    = atoi(optarg);            break;
+        case 'd': opt.delay    = atoi(optarg);            break;
+        case 'x': opt.nack     = atoi(optarg);            break;
+        case 't': opt.timeout  = atoi(optarg);            break;
+        case 's': opt.flags   |= EP_REGISTER_SHM;         break;
+        case 'D': opt.flags   |= EP_REGISTER_DELTA;       break;
+        case 'a': opt.address  = optarg;                  break;
+        default:  usage(argv[0]);
+        }
+    }
+
+    if (opt.internal < 0 || opt.external < 0 || opt.facts <= 0 ||
+        opt.rate <= 0 || opt.count <= 0 || opt.delay < 0 ||
+        opt.nack < 0 || opt.nack > 100 || opt.timeout <= 0 ||
+        opt.internal + opt.external == 0)
+        usage(argv[0]);
+
+    if (opt.address == NULL)
+        bus = start_bus();
+
+    /* the external EPs are forked before anything else is set up */
+    children = g_new0(pid_t, opt.external + 1);
+
+    for (i = 0; i < opt.external; i++) {
+        if ((children[i] = fork()) == 0)
+            external_ep(i);
+        if (children[i] < 0) {
+            perror("fork");
+            exit(1);
+        }
+    }
+
+    g_type_init();
+    srand(getpid());
+
+    loop = g_main_loop_new(NULL, FALSE);
+    conn = policy_connection();
+
+    if (!init_signaling(conn, 0, 0)) {
+        fprintf(stderr, "failed to initialize signaling\n");
+        exit(1);
+    }
+
+    create_facts(opt.facts);
+    internal_eps(opt.internal);
+
+    g_timeout_add(10, wait_for_eps, NULL);
+    g_main_loop_run(loop);
+
+    latency = g_new0(double, opt.count);
+    started = g_new0(double, opt.count);
+
+    /* drive the decisions at a fixed rate */
+    start = timestamp();
+    cpu   = cpu_usecs(RUSAGE_SELF);
+
+    g_timeout_add(1000 / opt.rate > 0 ? 1000 / opt.rate : 1, make_decision,
+            NULL);
+    g_main_loop_run(loop);
+
+    elapsed = timestamp() - start;
+    cpu     = cpu_usecs(RUSAGE_SELF) - cpu;
+
+    for (i = 0; i < opt.external; i++)
+        kill(children[i], SIGTERM);
+    for (i = 0; i < opt.external; i++)
+        waitpid(children[i], NULL, 0);
+
+    child_cpu = cpu_usecs(RUSAGE_CHILDREN);
+
+    qsort(latency, opt.count, sizeof(latency[0]), compare_double);
+
+    printf("EPs: %d internal, %d external%s%s; %d facts/decision; "
+           "ack delay %d ms, %d%% NACKs\n",
+           opt.internal, opt.external,
+           opt.flags & EP_REGISTER_SHM   ? ", shm"   : "",
+           opt.flags & EP_REGISTER_DELTA ? ", delta" : "",
+           opt.facts, opt.delay, opt.nack);
+    printf("%d decisions in %.2f s (%.1f/s), %d failed or timed out\n",
+           completed, elapsed / 1000000.0,
+           completed / (elapsed / 1000000.0), failed);
+    printf("latency usecs: p50 %.1f, p99 %.1f, max %.1f\n",
+           percentile(latency, opt.count, 50),
+           percentile(latency, opt.count, 99),
+           latency[opt.count - 1]);
+    printf("CPU usecs/decision: policy %.1f, EPs %.1f (incl. setup)\n",
+           cpu / completed, child_cpu / completed);
+
+    deinit_signaling();
+    dbus_connection_close(conn);
+
+    if (bus) {
+        kill(bus, SIGTERM);
+        g_spawn_close_pid(bus);
+    }
+
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
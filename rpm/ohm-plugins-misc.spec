@@ -134,7 +134,9 @@ rm -rf %{buildroot}
 
 # FIXME: install maemo-specific files distro-conditionally
 rm -f -- $RPM_BUILD_ROOT%{_libdir}/ohm/*.la
+rm -f -- $RPM_BUILD_ROOT%{_libdir}/%{name}/libfsif.la
 rm -f -- $RPM_BUILD_ROOT%{_libdir}/ohm/libohm_call_test.so
+rm -f -- $RPM_BUILD_ROOT%{_libdir}/ohm/libohm_resource_load.so
 
 mkdir -p %{buildroot}%{_libdir}/systemd/user/pre-user-session.target.wants
 ln -s ../ohm-session-agent.service %{buildroot}%{_libdir}/systemd/user/pre-user-session.target.wants/
@@ -153,6 +155,8 @@ fi
 
 %files
 %defattr(-,root,root,-)
+%dir %{_libdir}/%{name}
+%{_libdir}/%{name}/libfsif.so
 %{_libdir}/ohm/libohm_auth.so
 %{_libdir}/ohm/libohm_auth_test.so
 %{_libdir}/ohm/libohm_delay.so